@@ -67,13 +67,9 @@ public:
 
   // Verifies the sum and creates another dataframe holding it.
   void counter() {
-    size_t SZ = 100*1000;
     DataFrame* v = getKVStore()->getAndWait(main);
 
-    double sum = 0;
-    for (size_t i = 0; i < SZ; ++i) {
-      sum += v->get_double(0,i);
-    }
+    double sum = v->sum(0);
     p("The sum is  ").pln(sum);
     delete v;
 
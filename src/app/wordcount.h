@@ -1,52 +1,71 @@
 #pragma once
 
-#include "map.h"
-#include "row.h"
+#include "dataframe.h"
+#include "application.h"
+#include "string.h"
+#include "array.h"
+#include "key.h"
+#include <string>
+
+/**
+ * Reads the words of a file, separated by whitespace, one at a time,
+ * through a buffer that is refilled as it runs out.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class FileReader : public Object {
+public:
+    static const size_t BUFSIZE = 1024;
 
-// Placeholder file until network is linked to the KVStore.
-// WordCount Application is not quite functioning.
+    char* buf_;
+    size_t end_;   // end of the data in buf_
+    size_t i_;     // next char of buf_ to read
+    FILE* file_;
 
-class FileReader : public Writer {
-public:
-  /** Reads next word and stores it in the row. Actually read the word.
-      While reading the word, we may have to re-fill the buffer  */
-    void visit(Row & r) override {
-       ssert(i_ < end_);
-        assert(! isspace(buf_[i_]));
-        size_t wStart = i_;
-        while (true) {
-            if (i_ == end_) {
-                if (feof(file_)) { ++i_;  break; }
-                i_ = wStart;
-                wStart = 0;
-                fillBuffer_();
-            }
-            if (isspace(buf_[i_]))  break;
-            ++i_;
-        }
-        buf_[i_] = 0;
-        String word(buf_ + wStart, i_ - wStart);
-        r.set(0, word);
-        ++i_;
+    /** Creates the reader and opens the file for reading. */
+    FileReader(const char* path) {
+        file_ = fopen(path, "r");
+        assert(file_ != nullptr);
+        buf_ = new char[BUFSIZE + 1]; //  null terminator
+        end_ = 0;
+        i_ = 0;
+        fillBuffer_();
         skipWhitespace_();
     }
 
-    /** Returns true when there are no more words to read.  There is nothing
+    ~FileReader() {
+        fclose(file_);
+        delete[] buf_;
+    }
+
+    /** Returns true when there are no more words to read. There is nothing
        more to read if we are at the end of the buffer and the file has
-       all been read.     */
-    bool done() override { return (i_ >= end_) && feof(file_);  }
+       all been read. */
+    bool done() { return (i_ >= end_) && feof(file_); }
 
-    /** Creates the reader and opens the file for reading.  */
-    FileReader() {
-        file_ = fopen(arg.file, "r");
-        if (file_ == nullptr) FATAL_ERROR("Cannot open file " << arg.file);
-        buf_ = new char[BUFSIZE + 1]; //  null terminator
-        fillBuffer_();
+    /** Reads the next word. While reading the word, we may have to re-fill
+       the buffer. */
+    String* next() {
+        assert(!done());
+        size_t wStart = i_;
+        while (i_ < end_ && !isspace(buf_[i_])) ++i_;
+        String* word;
+        if (i_ < end_ || feof(file_)) {
+            word = new String(buf_ + wStart, i_ - wStart);
+        } else {
+            // the word runs past the buffer; gather it a buffer at a time
+            ByteArray part;
+            part.append(buf_ + wStart, i_ - wStart);
+            do {
+                fillBuffer_();
+                while (i_ < end_ && !isspace(buf_[i_])) ++i_;
+                part.append(buf_, i_);
+            } while (i_ == end_ && end_ > 0);
+            word = new String(part.data(), part.size());
+        }
         skipWhitespace_();
+        return word;
     }
 
-    static const size_t BUFSIZE = 1024;
-
     /** Reads more data from the file. */
     void fillBuffer_() {
         size_t start = 0;
@@ -56,12 +75,12 @@ public:
             memcpy(buf_, buf_ + i_, start);
         }
         // read more contents
-        end_ = start + fread(buf_+start, sizeof(char), BUFSIZE - start, file_);
+        end_ = start + fread(buf_ + start, sizeof(char), BUFSIZE - start, file_);
         i_ = start;
     }
 
-    /** Skips spaces.  Note that this may need to fill the buffer if the
-        last character of the buffer is space itself.  */
+    /** Skips spaces. Note that this may need to fill the buffer if the
+        last character of the buffer is space itself. */
     void skipWhitespace_() {
         while (true) {
             if (i_ == end_) {
@@ -69,150 +88,107 @@ public:
                 fillBuffer_();
             }
             // if the current character is not whitespace, we are done
-            if (!isspace(buf_[i_]))
-                return;
+            if (!isspace(buf_[i_])) return;
             // otherwise skip it
             ++i_;
         }
     }
-
-    char * buf_;
-    size_t end_ = 0;
-    size_t i_ = 0;
-    FILE * file_;
-};
-
-
-/****************************************************************************/
-class Adder : public Reader {
-public:
-  SIMap& map_;  // String to Num map;  Num holds an int
-
-  Adder(SIMap& map) : map_(map)  {}
-
-  bool visit(Row& r) override {
-    String* word = r.get_string(0);
-    assert(word != nullptr);
-    Num* num = map_.contains(*word) ? map_.get(*word) : new Num();
-    assert(num != nullptr);
-    num->v++;
-    map_.set(*word, num);
-    return false;
-  }
-};
-
-/***************************************************************************/
-class Summer : public Writer {
-public:
-  SIMap& map_;
-  size_t i = 0;
-  size_t j = 0;
-  size_t seen = 0;
-
-  Summer(SIMap& map) : map_(map) {}
-
-  void next() {
-      if (i == map_.capacity_ ) return;
-      if ( j < map_.items_[i].keys_.size() ) {
-          j++;
-          ++seen;
-      } else {
-          ++i;
-          j = 0;
-          while( i < map_.capacity_ && map_.items_[i].keys_.size() == 0 )  i++;
-          if (k()) ++seen;
-      }
-  }
-
-  String* k() {
-      if (i==map_.capacity_ || j == map_.items_[i].keys_.size()) return nullptr;
-      return (String*) (map_.items_[i].keys_.get_(j));
-  }
-
-  size_t v() {
-      if (i == map_.capacity_ || j == map_.items_[i].keys_.size()) {
-          assert(false); return 0;
-      }
-      return ((Num*)(map_.items_[i].vals_.get_(j)))->v;
-  }
-
-  void visit(Row& r) {
-      if (!k()) next();
-      String & key = *k();
-      size_t value = v();
-      r.set(0, key);
-      r.set(1, (int) value);
-      next();
-  }
-
-  bool done() {return seen == map_.size(); }
 };
 
 /****************************************************************************
  * Calculate a word count for given file:
  *   1) read the data (single node)
- *   2) produce word counts per homed chunks, in parallel
- *   3) combine the results
+ *   2) count the words stored on each node, and send each word's count to
+ *      the node that owns the word, where the counts are added up
+ *   3) tell node 0 how many different words each node holds
  **********************************************************author: pmaj ****/
-class WordCount: public Application {
+class WordCount : public Application {
 public:
-  static const size_t BUFSIZE = 1024;
-  Key in;
-  KeyBuff kbuf;
-  SIMap all;
+  const char* file_;   // external; file node 0 reads
+  Key* in_;            // key of the words
+  DataFrame* words_;   // the words, one a row
+  DataFrame* counts_;  // the words this node owns, and their counts
+  size_t distinct_;    // different words in the file, known to node 0
+
+  WordCount(size_t idx, KVStore* kv, const char* file) : Application(idx, kv) {
+    file_ = file;
+    in_ = new Key(new String("wc-data"), 0);
+    words_ = nullptr;
+    counts_ = nullptr;
+    distinct_ = 0;
+    run_();
+  }
 
-  WordCount(size_t idx, NetworkIfc & net):
-    Application(idx, net), in("data"), kbuf(new Key("wc-map-",0)) { }
+  ~WordCount() {
+    delete in_;
+    delete words_;
+    delete counts_;
+  }
 
   /** The master nodes reads the input, then all of the nodes count. */
   void run_() override {
-    if (index == 0) {
-      FileReader fr;
-      delete DataFrame::fromVisitor(&in, &kv, "S", fr);
-    }
+    if (this_node() == 0) read_();
+    else words_ = kv_->getAndWait(in_);
     local_count();
     reduce();
   }
 
-  /** Returns a key for given node.  These keys are homed on master node
-   *  which then joins them one by one. */
-  Key* mk_key(size_t idx) {
-      Key * k = kbuf.c(idx).get();
-      LOG("Created key " << k->c_str());
-      return k;
+  /** Reads the file into a dataframe of one String column, and makes it
+   *  the value of in_. */
+  void read_() {
+    FileReader fr(file_);
+    StringColumn* sc = new StringColumn(kv_);
+    while (!fr.done()) sc->push_back(fr.next());
+    sc->finalize();
+    Schema scm;
+    words_ = new DataFrame(scm, kv_);
+    words_->add_column(sc);
+    const char* ser = words_->serialize(words_);
+    // the store keeps the key it is handed
+    kv_->put(new Key(in_->getName()->clone(), in_->getHomeNode()), ser);
+    delete[] ser;
   }
 
-  /** Compute word counts on the local node and build a data frame. */
+  /** Counts each word this node owns across the cluster. */
   void local_count() {
-    DataFrame* words = (kv.waitAndGet(in));
-    p("Node ").p(index).pln(": starting local count...");
-    SIMap map;
-    Adder add(map);
-    words->local_map(add);
-    delete words;
-    Summer cnt(map);
-    delete DataFrame::fromVisitor(mk_key(index), &kv, "SI", cnt);
+    p("Node ").p(this_node()).pln(": starting local count...");
+    IntArray keys;
+    keys.push_back(0);
+    Aggs aggs;
+    aggs.count();
+    counts_ = words_->group_by(keys, aggs, "wc-count");
   }
 
-  /** Merge the data frames of all nodes */
+  /** Adds up, on node 0, how many different words each node owns */
   void reduce() {
-    if (index != 0) return;
+    std::string k = "wc-distinct-" + std::to_string(this_node());
+    if (this_node() != 0) {
+      Key key(new String(k.c_str()), 0);
+      Serializer s;
+      const char* state = s.serialize((int)counts_->nrows());
+      kv_->put(&key, state);
+      delete[] state;
+      return;
+    }
     pln("Node 0: reducing counts...");
-    SIMap map;
-    Key* own = mk_key(0);
-    merge(kv.get(*own), map);
-    for (size_t i = 1; i < arg.num_nodes; ++i) { // merge other nodes
-      Key* ok = mk_key(i);
-      merge(kv.waitAndGet(*ok), map);
-      delete ok;
+    distinct_ = counts_->nrows();
+    for (size_t i = 1; i < kv_->num_nodes_; ++i) { // merge other nodes
+      Key key(new String(("wc-distinct-" + std::to_string(i)).c_str()), 0);
+      const char* state = kv_->getCharsAndWait(&key);
+      distinct_ += atoi(state);
+      delete[] state;
     }
-    p("Different words: ").pln(map.size());
-    delete own;
+    p("Different words: ").pln(distinct_);
   }
 
-  void merge(DataFrame* df, SIMap& m) {
-    Adder add(m);
-    df->map(add);
-    delete df;
+  /** How many times the given word appears in the file, if this node owns
+   *  it, or 0. */
+  size_t count(const char* word) {
+    for (size_t r = 0; r < counts_->nrows(); ++r) {
+      if (strcmp(counts_->get_string(0, r)->c_str(), word) == 0) {
+        return counts_->get_int(1, r);
+      }
+    }
+    return 0;
   }
 }; // WordcountDemo
@@ -3,12 +3,19 @@
 #include "string.h"
 #include "array.h"
 #include "serial.h"
+#include "buffer.h"
+#include "kernels.h"
+#include <stdint.h>
+#include <math.h>
 
 // Types of chunks.
 class IntChunk;
 class BoolChunk;
 class DoubleChunk;
 class StringChunk;
+class IntChunkView;
+class BoolChunkView;
+class DoubleChunkView;
 
 /**
   * A Chunk is a portion of a column.
@@ -35,6 +42,15 @@ public:
     // returns this Column as a StringChunk*, or nullptr if not a StringChunk*
     virtual StringChunk* as_string() {return nullptr;}
 
+    // returns this Chunk as an IntChunkView*, or nullptr if not one
+    virtual IntChunkView* as_int_view() {return nullptr;}
+
+    // returns this Chunk as a BoolChunkView*, or nullptr if not one
+    virtual BoolChunkView* as_bool_view() {return nullptr;}
+
+    // returns this Chunk as a DoubleChunkView*, or nullptr if not one
+    virtual DoubleChunkView* as_double_view() {return nullptr;}
+
     /** Return the type of this Chunk as a char: 'S', 'B', 'I' and 'D'. */
     char get_type() {
         return type_;
@@ -78,6 +94,13 @@ public:
         if (++size_ == ARR_SIZE) full_ = true;
     }
 
+    /** Pushes n ints, which must fit in the chunk. */
+    void append(const int* vals, size_t n) {
+        arr_->append(vals, n);
+        size_ += n;
+        if (size_ == ARR_SIZE) full_ = true;
+    }
+
     int get(size_t idx) {
         return arr_->get(idx);
     }
@@ -114,6 +137,11 @@ public:
         return arr_->get(idx);
     }
 
+    /** the number of bools in this chunk that are true */
+    size_t count() {
+        return arr_->count();
+    }
+
     // returns this Column as an BoolChunk*, or nullptr if not an BoolChunk*
     virtual BoolChunk* as_bool() {return this;}
 };
@@ -142,6 +170,13 @@ public:
         if (++size_ == ARR_SIZE) full_ = true;
     }
 
+    /** Pushes n doubles, which must fit in the chunk. */
+    void append(const double* vals, size_t n) {
+        arr_->append(vals, n);
+        size_ += n;
+        if (size_ == ARR_SIZE) full_ = true;
+    }
+
     double get(size_t idx) {
         return arr_->get(idx);
     }
@@ -150,6 +185,10 @@ public:
     virtual DoubleChunk* as_double() {return this;}
 };
 
+// one "" shared by every String chunk that fills in a missing value; chunks
+// that own their Strings never delete it
+String EMPTY_STRING("");
+
 /**
   * A portion of a column that holds Strings.
   * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
@@ -157,16 +196,25 @@ public:
 class StringChunk : public Chunk {
 public:
     StringArray* arr_;
+    bool owns_;     // whether deleting the chunk deletes its Strings
+
+    StringChunk() : StringChunk(true) {}
 
-    StringChunk() {
+    StringChunk(bool owns) {
         set_type_('S');
         size_ = 0;
         arr_ = new StringArray();
         full_ = false;
+        owns_ = owns;
     }
 
     ~StringChunk() {
-      arr_->delete_all();
+      if (owns_) {
+        for (size_t i = 0; i < size_; ++i) {
+          String* str = arr_->get(i);
+          if (str != &EMPTY_STRING) delete str;
+        }
+      }
       delete arr_;
     }
 
@@ -179,10 +227,274 @@ public:
         return arr_->get(idx);
     }
 
+    /** the Strings of this chunk, side by side. A chunk holds no more
+     *  Strings than one block of its StringArray, so they are never split
+     *  across blocks. */
+    String** data() {
+        return size_ == 0 ? nullptr : arr_->arr_[0];
+    }
+
     // returns this Column as an StringChunk*, or nullptr if not an StringChunk*
     virtual StringChunk* as_string() {return this;}
 };
 
+/**
+  * A read-only chunk of ints that reads them in place from the buffer
+  * holding the serialized chunk, rather than copying them out of it.
+  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+  */
+class IntChunkView : public Chunk {
+public:
+    Buffer* buf_;        // holds the serialized chunk; we own one reference
+    const int* vals_;    // the ints, inside buf_
+
+    IntChunkView(Buffer* buf, size_t size, const int* vals) {
+        set_type_('I');
+        size_ = size;
+        full_ = true;
+        buf_ = buf;
+        vals_ = vals;
+    }
+
+    ~IntChunkView() {
+      buf_->release();
+    }
+
+    int get(size_t idx) {
+        assert(idx < size_);
+        return vals_[idx];
+    }
+
+    // returns this Chunk as an IntChunkView*
+    virtual IntChunkView* as_int_view() {return this;}
+};
+
+/**
+  * A read-only chunk of bools that reads them in place from the bit-packed
+  * payload of the buffer holding the serialized chunk.
+  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+  */
+class BoolChunkView : public Chunk {
+public:
+    Buffer* buf_;          // holds the serialized chunk; we own one reference
+    const uint8_t* bits_;  // the bools, one per bit, inside buf_
+
+    BoolChunkView(Buffer* buf, size_t size, const uint8_t* bits) {
+        set_type_('B');
+        size_ = size;
+        full_ = true;
+        buf_ = buf;
+        bits_ = bits;
+    }
+
+    ~BoolChunkView() {
+      buf_->release();
+    }
+
+    bool get(size_t idx) {
+        assert(idx < size_);
+        return (bits_[idx / 8] >> (idx % 8)) & 1;
+    }
+
+    /** the number of bools in this chunk that are true */
+    size_t count() {
+        return Kernels::popcount(bits_, size_);
+    }
+
+    /** copies the bools of this chunk into a packed array of its own */
+    BoolArray* to_array() {
+        BoolArray* arr = new BoolArray();
+        arr->append_bits(bits_, size_);
+        return arr;
+    }
+
+    // returns this Chunk as a BoolChunkView*
+    virtual BoolChunkView* as_bool_view() {return this;}
+};
+
+/**
+  * A read-only chunk of doubles that reads them in place from the buffer
+  * holding the serialized chunk, rather than copying them out of it.
+  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+  */
+class DoubleChunkView : public Chunk {
+public:
+    Buffer* buf_;          // holds the serialized chunk; we own one reference
+    const double* vals_;   // the doubles, inside buf_
+
+    DoubleChunkView(Buffer* buf, size_t size, const double* vals) {
+        set_type_('D');
+        size_ = size;
+        full_ = true;
+        buf_ = buf;
+        vals_ = vals;
+    }
+
+    ~DoubleChunkView() {
+      buf_->release();
+    }
+
+    double get(size_t idx) {
+        assert(idx < size_);
+        return vals_[idx];
+    }
+
+    // returns this Chunk as a DoubleChunkView*
+    virtual DoubleChunkView* as_double_view() {return this;}
+};
+
+// bits in the bitmap ChunkStats counts distinct values with
+size_t DISTINCT_BITS = 4096;
+
+/**
+  * What a column knows about one of its chunks without fetching it: how
+  * many values it holds, the smallest and largest of them, and about how
+  * many are distinct. Ints, doubles and bools (as 0 and 1) keep their range
+  * as doubles, Strings as copies of the smallest and largest String. The
+  * distinct count is estimated by linear counting: each value's hash sets
+  * one bit of a DISTINCT_BITS bitmap, and the share of bits left unset
+  * tells how many values there were.
+  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+  */
+class ChunkStats : public Object {
+public:
+    char type_;
+    size_t count_;
+    size_t distinct_;   // estimate
+    double min_;
+    double max_;
+    String* smin_;      // owned; smallest String, for String chunks
+    String* smax_;      // owned; largest String, for String chunks
+
+    ChunkStats(char type) {
+        type_ = type;
+        count_ = 0;
+        distinct_ = 0;
+        min_ = 0;
+        max_ = 0;
+        smin_ = nullptr;
+        smax_ = nullptr;
+    }
+
+    /** Works out the statistics of a chunk being built. */
+    ChunkStats(Chunk* chunk) : ChunkStats(chunk->get_type()) {
+        count_ = chunk->size();
+        if (count_ == 0) return;
+        uint8_t* seen = new uint8_t[DISTINCT_BITS / 8];
+        memset(seen, 0, DISTINCT_BITS / 8);
+        if (type_ == 'I') {
+            const int* v = chunk->as_int()->arr_->data();
+            int lo, hi;
+            Kernels::min_max(v, count_, &lo, &hi);
+            min_ = lo;
+            max_ = hi;
+            for (size_t i = 0; i < count_; ++i) see_(seen, (uint64_t)(int64_t)v[i]);
+        } else if (type_ == 'D') {
+            const double* v = chunk->as_double()->arr_->data();
+            Kernels::min_max(v, count_, &min_, &max_);
+            for (size_t i = 0; i < count_; ++i) {
+                uint64_t bits;
+                memcpy(&bits, &v[i], 8);
+                see_(seen, bits);
+            }
+        } else if (type_ == 'B') {
+            size_t trues = chunk->as_bool()->count();
+            min_ = trues == count_ ? 1 : 0;
+            max_ = trues > 0 ? 1 : 0;
+        } else {
+            StringChunk* sc = chunk->as_string();
+            String* lo = sc->get(0);
+            String* hi = lo;
+            for (size_t i = 0; i < count_; ++i) {
+                String* str = sc->get(i);
+                if (strcmp(str->c_str(), lo->c_str()) < 0) lo = str;
+                if (strcmp(str->c_str(), hi->c_str()) > 0) hi = str;
+                see_(seen, str->hash());
+            }
+            smin_ = lo->clone();
+            smax_ = hi->clone();
+        }
+        if (type_ == 'B') distinct_ = min_ == max_ ? 1 : 2;
+        else distinct_ = estimate_(seen);
+        delete[] seen;
+    }
+
+    ~ChunkStats() {
+        delete smin_;
+        delete smax_;
+    }
+
+    /** Whether some value in the chunk may lie in [lo, hi]. */
+    bool may_match(double lo, double hi) {
+        return count_ > 0 && !(max_ < lo || min_ > hi);
+    }
+
+    /** Whether some String in the chunk may lie in [lo, hi]. */
+    bool may_match(const char* lo, const char* hi) {
+        return count_ > 0 && strcmp(smax_->c_str(), lo) >= 0
+            && strcmp(smin_->c_str(), hi) <= 0;
+    }
+
+    /** Writes the statistics as one entry of a ColumnSerializer's sts line:
+     *  count, distinct, min and max, the Strings as length:bytes. */
+    void write(ByteArray* out) {
+        char buf[96];
+        if (type_ != 'S' || count_ == 0) {
+            snprintf(buf, sizeof(buf), "%zu %zu %.17g %.17g;", count_, distinct_, min_, max_);
+            out->push_string(buf);
+            return;
+        }
+        snprintf(buf, sizeof(buf), "%zu %zu %zu:", count_, distinct_, smin_->size());
+        out->push_string(buf);
+        out->push_string(smin_->c_str());
+        snprintf(buf, sizeof(buf), "%zu:", smax_->size());
+        out->push_string(buf);
+        out->push_string(smax_->c_str());
+        out->push_back(';');
+    }
+
+    /** Reads an entry written by write, advancing *i past it. */
+    static ChunkStats* read(char type, const char* str, size_t* i) {
+        ChunkStats* st = new ChunkStats(type);
+        char* at = (char*)str + *i;
+        st->count_ = strtoull(at, &at, 10);
+        st->distinct_ = strtoull(at, &at, 10);
+        if (type != 'S' || st->count_ == 0) {
+            st->min_ = strtod(at, &at);
+            st->max_ = strtod(at, &at);
+        } else {
+            size_t len = strtoull(at, &at, 10);
+            st->smin_ = new String(at + 1, len);
+            at += len + 1;
+            len = strtoull(at, &at, 10);
+            st->smax_ = new String(at + 1, len);
+            at += len + 1;
+        }
+        assert(*at == ';');
+        *i = at + 1 - str;
+        return st;
+    }
+
+    // sets the bit of the bitmap the hash picks
+    static void see_(uint8_t* seen, uint64_t v) {
+        // fold the high bits down so doubles, which differ there, spread out
+        v ^= v >> 33;
+        v *= 0xFF51AFD7ED558CCDULL;
+        v ^= v >> 33;
+        uint64_t h = v % DISTINCT_BITS;
+        seen[h / 8] |= 1 << (h % 8);
+    }
+
+    // the linear counting estimate from how many bits are still unset
+    size_t estimate_(uint8_t* seen) {
+        size_t set = Kernels::popcount(seen, DISTINCT_BITS);
+        if (set == DISTINCT_BITS) return count_;
+        double m = (double)DISTINCT_BITS;
+        size_t est = (size_t)(m * log(m / (m - set)) + 0.5);
+        return est > count_ ? count_ : est;
+    }
+};
+
 /*************************************************************************
  * ChunkArray::
  * Holds Chunk pointers. The strings are external.  Nullptr is a valid
@@ -207,7 +519,7 @@ public:
     // destructor - delete arr_, its sub-arrays, and their chunks
     ~ChunkArray() {
       for (size_t i = 0; i < num_arr_; ++i) {
-        for (size_t j = 0; j < size_; ++j) {
+        for (size_t j = 0; j < STRING_ARR_SIZE && (i * STRING_ARR_SIZE) + j < size_; ++j) {
           delete arr_[i][j];
         }
         delete[] arr_[i];
@@ -324,21 +636,69 @@ public:
 };
 
 
+/** The ways a ChunkSerializer can write a chunk. get_chunk reads both. */
+enum class ChunkFormat {
+  Text,     // "typ: I\nsiz: ...\narr: ..." lines, readable when debugging
+  Binary    // the versioned binary layout described at ChunkSerializer
+};
+
+static const char CHUNK_MAGIC[3] = {'E', 'A', 'U'};
+static const uint8_t CHUNK_VERSION = 1;
+static const size_t CHUNK_HEADER_SIZE = 16;
+
 /**
   * Serializes Chunk types.
+  *
+  * The binary format starts with a 16 byte header:
+  *   bytes 0-2   magic "EAU"
+  *   byte  3     format version, CHUNK_VERSION
+  *   byte  4     type tag: 'I', 'D', 'B' or 'S'
+  *   bytes 5-7   zero
+  *   bytes 8-15  number of elements
+  * followed by the payload:
+  *   I  4 byte ints
+  *   D  8 byte IEEE doubles
+  *   B  one bit per bool, element i in bit i % 8 of byte i / 8
+  *   S  number of elements + 1 offsets of 8 bytes each, then the characters
+  *      of every string back to back: string i is bytes [off[i], off[i+1])
+  * All numbers are little endian. The header keeps the payload 8 byte
+  * aligned, so ints and doubles are copied out with memcpy in one pass.
   * @authors armani.a@husky.neu.edu, horn.s@husky.neu.edu
   */
 class ChunkSerializer: public Serializer {
 public:
+  ChunkFormat format_;  // how serialize writes chunks
 
+  ChunkSerializer() : ChunkSerializer(ChunkFormat::Binary) {}
+
+  ChunkSerializer(ChunkFormat format) {
+    format_ = format;
+  }
+
+  /** Serializes the chunk in format_. The caller owns the result. */
   const char* serialize(Chunk* chunk) {
+    size_t len;
+    return serialize(chunk, &len);
+  }
+
+  /**
+   * Serializes the chunk in format_ and sets len to the number of bytes
+   * written, not counting the zero that follows them. Binary chunks may
+   * contain zeros, so len is the only way to know their size.
+   */
+  const char* serialize(Chunk* chunk, size_t* len) {
+    if (format_ == ChunkFormat::Binary) return serialize_binary_(chunk, len);
+    const char* str = serialize_text_(chunk);
+    *len = strlen(str);
+    return str;
+  }
+
+  const char* serialize_text_(Chunk* chunk) {
     ByteArray* barr = new ByteArray();
 
     // serialize the type of chunk
     barr->push_string("typ: ");
-    char ser_type[1];
-    ser_type[0] = chunk->type_;
-    barr->push_string(ser_type);
+    barr->push_back(chunk->type_);
 
     // serialize the elements of chunk
     const char* ser_elm;
@@ -365,7 +725,56 @@ public:
     return str;
   }
 
+  const char* serialize_binary_(Chunk* chunk, size_t* len) {
+    size_t n = chunk->size_;
+
+    // size the payload so the whole chunk is one allocation
+    size_t payload;
+    if (chunk->type_ == 'I') payload = n * 4;
+    else if (chunk->type_ == 'D') payload = n * 8;
+    else if (chunk->type_ == 'B') payload = (n + 7) / 8;
+    else {
+      StringArray* strs = chunk->as_string()->arr_;
+      payload = (n + 1) * 8;
+      for (size_t i = 0; i < n; ++i) payload += strs->get(i)->size();
+    }
+
+    *len = CHUNK_HEADER_SIZE + payload;
+    char* buf = new char[*len + 1];
+    buf[*len] = 0;
+    memcpy(buf, CHUNK_MAGIC, 3);
+    buf[3] = CHUNK_VERSION;
+    buf[4] = chunk->type_;
+    buf[5] = buf[6] = buf[7] = 0;
+    put_u64_(&buf[8], n);
+    char* out = &buf[CHUNK_HEADER_SIZE];
+
+    if (chunk->type_ == 'I') {
+      chunk->as_int()->arr_->copy_to((int*)out, 0, n);
+      to_little_endian_(out, n, 4);
+    } else if (chunk->type_ == 'D') {
+      chunk->as_double()->arr_->copy_to((double*)out, 0, n);
+      to_little_endian_(out, n, 8);
+    } else if (chunk->type_ == 'B') {
+      chunk->as_bool()->arr_->copy_bits((uint8_t*)out);
+    } else {
+      StringArray* strs = chunk->as_string()->arr_;
+      char* chars = out + (n + 1) * 8;
+      size_t off = 0;
+      for (size_t i = 0; i < n; ++i) {
+        String* str = strs->get(i);
+        put_u64_(&out[i * 8], off);
+        memcpy(chars + off, str->c_str(), str->size());
+        off += str->size();
+      }
+      put_u64_(&out[n * 8], off);
+    }
+    return buf;
+  }
+
+  /** Reads a chunk written in either format. The caller owns the result. */
   Chunk* get_chunk(const char* str) {
+    if (memcmp(str, CHUNK_MAGIC, 3) == 0) return get_binary_chunk_(str);
     char type;
 
     size_t i = 0;
@@ -418,4 +827,131 @@ public:
 
     return ch;
   }
+
+  /**
+   * Reads the serialized chunk held by buf without copying its values:
+   * int, double and bool chunks come back as views that read straight out
+   * of buf. String chunks are decoded, since each element is its own
+   * String. Takes over the caller's reference to buf.
+   * @param offset: where the chunk starts in buf, which must keep values
+   *        aligned (a multiple of 8)
+   */
+  Chunk* get_view(Buffer* buf, size_t offset = 0) {
+    if (memcmp(buf->data() + offset, CHUNK_MAGIC, 3) != 0) {
+      // text is only written when debugging, so just re-encode it
+      Chunk* c = get_chunk(buf->data() + offset);
+      size_t len;
+      char* bin = (char*)serialize_binary_(c, &len);
+      delete c;
+      buf->release();
+      buf = new Buffer(true, bin, len);
+      offset = 0;
+    }
+
+    char* str = buf->data_ + offset;
+    if ((uint8_t)str[3] != CHUNK_VERSION) {
+      buf->release();
+      return nullptr;
+    }
+    char type = str[4];
+    size_t n = get_u64_(&str[8]);
+    char* in = &str[CHUNK_HEADER_SIZE];
+
+    // on a big endian machine, put the values in its order once, in place
+    if (type == 'I') {
+      to_little_endian_(in, n, 4);
+      return new IntChunkView(buf, n, (const int*)in);
+    } else if (type == 'D') {
+      to_little_endian_(in, n, 8);
+      return new DoubleChunkView(buf, n, (const double*)in);
+    } else if (type == 'B') {
+      return new BoolChunkView(buf, n, (const uint8_t*)in);
+    }
+    Chunk* c = get_binary_chunk_(str);
+    buf->release();
+    return c;
+  }
+
+  Chunk* get_binary_chunk_(const char* str) {
+    if ((uint8_t)str[3] != CHUNK_VERSION) return nullptr;
+    char type = str[4];
+    size_t n = get_u64_(&str[8]);
+    const char* in = &str[CHUNK_HEADER_SIZE];
+
+    if (type == 'I') {
+      IntChunk* c = new IntChunk();
+      if (little_endian_()) c->arr_->append((const int*)in, n);
+      else {
+        int* ints = new int[n];
+        memcpy(ints, in, n * 4);
+        to_little_endian_((char*)ints, n, 4);
+        c->arr_->append(ints, n);
+        delete[] ints;
+      }
+      c->size_ = n;
+      c->full_ = n >= ARR_SIZE;
+      return c;
+    } else if (type == 'D') {
+      DoubleChunk* c = new DoubleChunk();
+      if (little_endian_()) c->arr_->append((const double*)in, n);
+      else {
+        double* dbls = new double[n];
+        memcpy(dbls, in, n * 8);
+        to_little_endian_((char*)dbls, n, 8);
+        c->arr_->append(dbls, n);
+        delete[] dbls;
+      }
+      c->size_ = n;
+      c->full_ = n >= ARR_SIZE;
+      return c;
+    } else if (type == 'B') {
+      BoolChunk* c = new BoolChunk();
+      c->arr_->append_bits((const uint8_t*)in, n);
+      c->size_ = n;
+      c->full_ = n >= BOOL_ARR_SIZE;
+      return c;
+    } else if (type == 'S') {
+      StringChunk* c = new StringChunk();
+      const char* chars = in + (n + 1) * 8;
+      size_t off = get_u64_(in);
+      for (size_t i = 0; i < n; ++i) {
+        size_t end = get_u64_(&in[(i + 1) * 8]);
+        c->push_back(new String(chars + off, end - off));
+        off = end;
+      }
+      return c;
+    }
+    return nullptr;
+  }
+
+  // true if this machine stores numbers little endian, like the format does
+  static bool little_endian_() {
+    uint16_t one = 1;
+    return *(uint8_t*)&one == 1;
+  }
+
+  // reverses the bytes of each of the n values of width bytes in buf,
+  // unless this machine is little endian already. Swapping is its own
+  // inverse, so this also turns little endian values into machine order.
+  static void to_little_endian_(char* buf, size_t n, size_t width) {
+    if (little_endian_()) return;
+    for (size_t i = 0; i < n; ++i) {
+      char* v = buf + i * width;
+      for (size_t a = 0, b = width - 1; a < b; ++a, --b) {
+        char t = v[a];
+        v[a] = v[b];
+        v[b] = t;
+      }
+    }
+  }
+
+  static void put_u64_(char* dst, uint64_t v) {
+    for (size_t i = 0; i < 8; ++i) dst[i] = (char)(v >> (8 * i));
+  }
+
+  static uint64_t get_u64_(const char* src) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) v |= (uint64_t)(uint8_t)src[i] << (8 * i);
+    return v;
+  }
 };
@@ -6,7 +6,9 @@
 #include "object.h"
 #include "key.h"
 #include "kvstore.h"
+#include "shipper.h"
 #include "chunk.h"
+#include "kernels.h"
 #include <math.h>
 #include <stdarg.h>
 #include <string>
@@ -23,6 +25,288 @@ class BoolColumn;
 class DoubleColumn;
 class StringColumn;
 
+// most chunks a column keeps requested ahead of its reader, 0 turns
+// read-ahead off
+size_t READ_AHEAD_MAX = 16;
+
+// finished chunks a column holds back so that it can send them to the
+// store together, one message per node
+size_t PUT_BATCH = 8;
+
+/**
+ * Watches which chunks of a column are read and, once they are read in
+ * order, asks the store to fetch the next ones before they are needed.
+ * How far ahead it reads adapts to how long fetches take: it doubles
+ * whenever the reader still had to wait for a chunk, and shrinks by one
+ * after a long enough run of chunks that were all there in time.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class ReadAhead : public Object {
+public:
+    long last_;       // chunk read before the current one, -1 if none
+    size_t depth_;    // chunks to keep requested ahead of the reader
+    size_t next_;     // first chunk not yet requested
+    size_t on_time_;  // chunks in a row the reader did not wait for
+
+    ReadAhead() {
+        last_ = -1;
+        depth_ = 1;
+        next_ = 0;
+        on_time_ = 0;
+    }
+
+    /**
+     * Called when the reader moves on to a chunk.
+     * @param chunk: the chunk it moved to
+     * @param stalled: whether it had to wait for that chunk to arrive
+     * @param keys: keys of the column's chunks
+     */
+    void moved_to(size_t chunk, bool stalled, KeyArray* keys, KVStore* kv) {
+        bool sequential = last_ != -1 && chunk == (size_t)last_ + 1;
+        last_ = chunk;
+        if (!sequential || READ_AHEAD_MAX == 0) {
+            on_time_ = 0;
+            next_ = chunk + 1;
+            return;
+        }
+        if (stalled) {
+            depth_ = depth_ * 2 > READ_AHEAD_MAX ? READ_AHEAD_MAX : depth_ * 2;
+            on_time_ = 0;
+        } else if (++on_time_ >= 4 * depth_ && depth_ > 1) {
+            --depth_;
+            on_time_ = 0;
+        }
+        if (next_ <= chunk) next_ = chunk + 1;
+        for (; next_ <= chunk + depth_ && next_ < keys->size(); ++next_) {
+            kv->prefetch(keys->get(next_));
+        }
+    }
+};
+
+/**
+ * Visits the values of a column a chunk at a time, each chunk handed over
+ * as one span of contiguous memory, in place in the chunk cache. A span is
+ * only valid during the call. Override the visit for the type of column
+ * visited (see Column::for_each_chunk).
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SpanVisitor : public Object {
+public:
+    virtual void visit(const int* vals, size_t n) { assert(false); }
+    virtual void visit(const double* vals, size_t n) { assert(false); }
+
+    /** n bools, packed 8 to a byte, lowest bit first */
+    virtual void visit(const uint8_t* bits, size_t n) { assert(false); }
+
+    virtual void visit(String** vals, size_t n) { assert(false); }
+};
+
+/**
+ * Aggregates an int, double or bool column a chunk at a time with the
+ * kernels in kernels.h. Each chunk's mean and squared deviations are
+ * merged into the running ones with Chan's update, which stays accurate
+ * where summing squares would not.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class Aggregator : public SpanVisitor {
+public:
+    char op_;        // 's' sum, 'm' min and max, 'v' mean and variance
+    size_t count_;   // values seen, or trues seen for a bool column
+    int64_t isum_;   // sum of an int column, exact
+    double sum_;     // sum of a double column
+    double min_;
+    double max_;
+    double mean_;
+    double m2_;      // sum of squared deviations from mean_
+
+    Aggregator(char op) {
+        op_ = op;
+        count_ = 0;
+        isum_ = 0;
+        sum_ = 0;
+        min_ = 0;
+        max_ = 0;
+        mean_ = 0;
+        m2_ = 0;
+    }
+
+    void visit(const int* vals, size_t n) {
+        if (n == 0) return;
+        if (op_ == 's') {
+            isum_ += Kernels::sum(vals, n);
+        } else if (op_ == 'm') {
+            int lo, hi;
+            Kernels::min_max(vals, n, &lo, &hi);
+            merge_min_max_(lo, hi);
+        } else {
+            double mean = (double)Kernels::sum(vals, n) / n;
+            merge_moments_(n, mean, Kernels::sq_dev(vals, n, mean));
+        }
+        count_ += n;
+    }
+
+    void visit(const double* vals, size_t n) {
+        if (n == 0) return;
+        if (op_ == 's') {
+            sum_ += Kernels::sum(vals, n);
+        } else if (op_ == 'm') {
+            double lo, hi;
+            Kernels::min_max(vals, n, &lo, &hi);
+            merge_min_max_(lo, hi);
+        } else {
+            double mean = Kernels::sum(vals, n) / n;
+            merge_moments_(n, mean, Kernels::sq_dev(vals, n, mean));
+        }
+        count_ += n;
+    }
+
+    void visit(const uint8_t* bits, size_t n) {
+        count_ += Kernels::popcount(bits, n);
+    }
+
+    // widens the running range to take in [lo, hi]
+    void merge_min_max_(double lo, double hi) {
+        if (count_ == 0 || lo < min_) min_ = lo;
+        if (count_ == 0 || hi > max_) max_ = hi;
+    }
+
+    // folds n values with the given mean and squared deviations into the
+    // running ones
+    void merge_moments_(size_t n, double mean, double m2) {
+        double total = (double)(count_ + n);
+        double delta = mean - mean_;
+        mean_ += delta * n / total;
+        m2_ += m2 + delta * delta * count_ * n / total;
+    }
+};
+
+/**
+ * A condition on the rows of a DataFrame, built from comparisons of one
+ * column with a constant joined by and and or. DataFrame::filter evaluates
+ * it a chunk at a time into a bitmask with one bit per row, lowest bit
+ * first; a comparison is a SpanVisitor that sets the bits of the rows that
+ * meet it. Owns the conditions it joins.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class Predicate : public SpanVisitor {
+public:
+    char op_;          // 'c' for a comparison, '&' or '|' to join two
+    Predicate* left_;  // owned; the conditions joined, or nullptr
+    Predicate* right_;
+    size_t col_;       // column compared
+    double val_;       // constant it is compared with
+    String* sval_;     // owned; or this, for a String column
+    bool lt_;          // whether the condition holds for values below,
+    bool eq_;          // equal to, and above the constant
+    bool gt_;
+    uint8_t* bits_;    // not owned; mask being filled
+    size_t pos_;       // row of the next value visited
+
+    /** Compares a numeric column (a bool column as 0 or 1) with val, using
+     *  one of "<", "<=", "==", "!=", ">=" and ">". */
+    Predicate(size_t col, const char* op, double val) {
+        init_(col, op);
+        val_ = val;
+    }
+
+    /** Compares a String column with val, as strcmp orders them. */
+    Predicate(size_t col, const char* op, const char* val) {
+        init_(col, op);
+        sval_ = new String(val);
+    }
+
+    /** Joins two conditions with '&' (both hold) or '|' (either holds). */
+    Predicate(char op, Predicate* left, Predicate* right) {
+        assert(op == '&' || op == '|');
+        assert(left != nullptr && right != nullptr);
+        op_ = op;
+        left_ = left;
+        right_ = right;
+        sval_ = nullptr;
+    }
+
+    ~Predicate() {
+        delete left_;
+        delete right_;
+        delete sval_;
+    }
+
+    void init_(size_t col, const char* op) {
+        op_ = 'c';
+        left_ = nullptr;
+        right_ = nullptr;
+        col_ = col;
+        val_ = 0;
+        sval_ = nullptr;
+        lt_ = strcmp(op, "<") == 0 || strcmp(op, "<=") == 0 || strcmp(op, "!=") == 0;
+        eq_ = strcmp(op, "<=") == 0 || strcmp(op, "==") == 0 || strcmp(op, ">=") == 0;
+        gt_ = strcmp(op, ">") == 0 || strcmp(op, ">=") == 0 || strcmp(op, "!=") == 0;
+        assert(lt_ || eq_ || gt_);
+    }
+
+    /** Makes the comparison set the bits of the rows it visits from now on
+     *  in the given mask, starting at its first row. */
+    void start(uint8_t* bits) {
+        bits_ = bits;
+        pos_ = 0;
+    }
+
+    // Chunks hold a multiple of 8 values, so each one starts on a byte of
+    // the mask; the bits of a byte are gathered before it is stored.
+    void visit(const int* vals, size_t n) {
+        double v = val_;
+        for (size_t i = 0; i < n; i += 8) {
+            uint8_t b = 0;
+            for (size_t j = 0; j < 8 && i + j < n; ++j) {
+                double x = vals[i + j];
+                b |= (uint8_t)((lt_ & (x < v)) | (eq_ & (x == v)) | (gt_ & (x > v))) << j;
+            }
+            bits_[(pos_ + i) / 8] = b;
+        }
+        pos_ += n;
+    }
+
+    void visit(const double* vals, size_t n) {
+        double v = val_;
+        for (size_t i = 0; i < n; i += 8) {
+            uint8_t b = 0;
+            for (size_t j = 0; j < 8 && i + j < n; ++j) {
+                double x = vals[i + j];
+                b |= (uint8_t)((lt_ & (x < v)) | (eq_ & (x == v)) | (gt_ & (x > v))) << j;
+            }
+            bits_[(pos_ + i) / 8] = b;
+        }
+        pos_ += n;
+    }
+
+    void visit(const uint8_t* bits, size_t n) {
+        double v = val_;
+        for (size_t i = 0; i < n; i += 8) {
+            uint8_t b = 0;
+            for (size_t j = 0; j < 8 && i + j < n; ++j) {
+                double x = (bits[i / 8] >> j) & 1;
+                b |= (uint8_t)((lt_ & (x < v)) | (eq_ & (x == v)) | (gt_ & (x > v))) << j;
+            }
+            bits_[(pos_ + i) / 8] = b;
+        }
+        pos_ += n;
+    }
+
+    void visit(String** vals, size_t n) {
+        assert(sval_ != nullptr);
+        const char* v = sval_->c_str();
+        for (size_t i = 0; i < n; i += 8) {
+            uint8_t b = 0;
+            for (size_t j = 0; j < 8 && i + j < n; ++j) {
+                int c = strcmp(vals[i + j]->c_str(), v);
+                b |= (uint8_t)((lt_ & (c < 0)) | (eq_ & (c == 0)) | (gt_ & (c > 0))) << j;
+            }
+            bits_[(pos_ + i) / 8] = b;
+        }
+        pos_ += n;
+    }
+};
+
 /**************************************************************************
  * Column ::
  * Represents one column of a data frame which holds values of a single type.
@@ -41,6 +325,31 @@ public:
     size_t num_chunks_;    // number of bool chunks in this col
     KVStore* kv_;          // where to send chunks
     size_t id_;             // id of this column
+    ReadAhead ahead_;       // fetches chunks ahead of sequential reads
+    KeyArray* pending_keys_;  // keys of finished chunks not sent to kv_ yet
+    ChunkArray* pending_;     // owned; those chunks
+    ChunkStats** stats_;      // owned; what we know of each chunk in keys_
+    size_t num_stats_;
+    size_t stats_capacity_;
+    int home_;                // node every chunk is stored on, or -1 to spread them
+    ChunkShipper* shipper_;   // external; stores the chunks in the background, or nullptr
+
+    Column() {
+        home_ = -1;
+        shipper_ = nullptr;
+        pending_keys_ = new KeyArray();
+        pending_ = new ChunkArray();
+        num_stats_ = 0;
+        stats_capacity_ = 16;
+        stats_ = new ChunkStats*[stats_capacity_];
+    }
+
+    ~Column() {
+        delete pending_keys_;
+        delete pending_;
+        for (size_t i = 0; i < num_stats_; ++i) delete stats_[i];
+        delete[] stats_;
+    }
 
     /** Type converters: Return same column under its actual type, or
      *  nullptr if of the wrong type.  */
@@ -89,6 +398,194 @@ public:
     size_t size() {
         return size_;
     }
+
+    /** the number of values in each chunk of this column, but the last */
+    size_t chunk_len() {
+        return type_ == 'B' ? BOOL_ARR_SIZE : type_ == 'S' ? STRING_ARR_SIZE : ARR_SIZE;
+    }
+
+    /**
+     * Roughly how many bytes the chunks of this column take up in a chunk
+     * cache, from how many values each type packs into a chunk.
+     */
+    size_t bytes() {
+        size_t per_chunk = type_ == 'I' ? ARR_SIZE * sizeof(int)
+                         : type_ == 'D' ? ARR_SIZE * sizeof(double)
+                         : type_ == 'B' ? BOOL_ARR_SIZE / 8
+                         : STRING_ARR_SIZE * 16;
+        return keys_->size() * per_chunk;
+    }
+
+    /**
+     * Brings every chunk of this column into the chunk cache, with one
+     * round trip per node that holds some of them, so that a scan reads
+     * them without waiting.
+     */
+    void preload() {
+        flush_();
+        kv_->load_chunks(keys_);
+    }
+
+    /** What we know of chunk c without fetching it. */
+    ChunkStats* stats(size_t c) {
+        assert(c < num_stats_);
+        return stats_[c];
+    }
+
+    // records the statistics of the next chunk. Takes ownership of them.
+    void add_stats_(ChunkStats* st) {
+        if (num_stats_ == stats_capacity_) {
+            ChunkStats** stats = new ChunkStats*[stats_capacity_ * 2];
+            memcpy(stats, stats_, num_stats_ * sizeof(ChunkStats*));
+            delete[] stats_;
+            stats_ = stats;
+            stats_capacity_ *= 2;
+        }
+        stats_[num_stats_++] = st;
+    }
+
+    /**
+     * Appends the chunks of the given finished column, of the same type, to
+     * this finished one, taking their keys and statistics, as if its values
+     * had been pushed here. The chunks stay where they are stored. Every
+     * chunk of this column must be full, so that rows still map to chunks
+     * by chunk_len(); an empty column gives up its one empty chunk first.
+     * Used to stitch the parts of a cluster ingest together.
+     */
+    void extend_(Column* part) {
+        assert(done_ && part->done_ && part->type_ == type_);
+        if (part->size_ == 0) return;
+        if (size_ == 0) {
+            for (size_t c = 0; c < num_stats_; ++c) delete stats_[c];
+            num_stats_ = 0;
+            delete keys_;
+            keys_ = new KeyArray();
+        }
+        assert(size_ == keys_->size() * chunk_len());
+        for (size_t c = 0; c < part->keys_->size(); ++c) {
+            keys_->push_back(part->keys_->get(c));
+            add_stats_(part->stats_[c]);
+        }
+        part->num_stats_ = 0;
+        size_ += part->size_;
+        num_chunks_ = keys_->size();
+    }
+
+    /**
+     * Hands a finished chunk, stored under the given key, to the store,
+     * recording its statistics first. The chunk goes to home_ if it is
+     * set. Takes ownership of the chunk. Chunks are sent PUT_BATCH at a
+     * time.
+     */
+    void store_(Key* key, Chunk* chunk) {
+        if (home_ != -1) key->setHomeNode(home_);
+        add_stats_(new ChunkStats(chunk));
+        pending_keys_->push_back(key);
+        pending_->push_back(chunk);
+        if (pending_->size() >= PUT_BATCH) flush_();
+    }
+
+    /**
+     * Hands v the values of each chunk of this column in turn, in row order,
+     * each as one contiguous span. Reads ahead like get() does.
+     */
+    void for_each_chunk(SpanVisitor& v) {
+        flush_();
+        ReadAhead ahead;
+        for (size_t c = 0; c < keys_->size(); ++c) visit_chunk_(c, v, &ahead);
+    }
+
+    // hands v the values of chunk c, read by a reader moving through the
+    // column with the given read-ahead
+    void visit_chunk_(size_t c, SpanVisitor& v, ReadAhead* ahead) {
+        Chunk* chunk = pin_(c, ahead);
+        if (type_ == 'I') v.visit(chunk->as_int_view()->vals_, chunk->size());
+        else if (type_ == 'D') v.visit(chunk->as_double_view()->vals_, chunk->size());
+        else if (type_ == 'B') v.visit(chunk->as_bool_view()->bits_, chunk->size());
+        else v.visit(chunk->as_string()->data(), chunk->size());
+        kv_->release_chunk(keys_->get(c));
+    }
+
+    // acquires chunk c for a reader moving through the column with the
+    // given read-ahead. Release it with kv_->release_chunk.
+    Chunk* pin_(size_t c, ReadAhead* ahead) {
+        bool stalled;
+        Chunk* chunk = kv_->acquire_chunk(keys_->get(c), &stalled);
+        ahead->moved_to(c, stalled, keys_, kv_);
+        return chunk;
+    }
+
+    // sends every chunk held back by store_, through shipper_ if set
+    void flush_() {
+        if (pending_->size() == 0) return;
+        if (shipper_ != nullptr) {
+            shipper_->push(pending_keys_, pending_);
+        } else {
+            kv_->put_chunks(pending_keys_, pending_);
+            delete pending_keys_;
+            delete pending_;
+        }
+        pending_keys_ = new KeyArray();
+        pending_ = new ChunkArray();
+    }
+};
+
+/**
+ * One reader's place in a finished column: the chunk it is reading, pinned
+ * in the store's chunk cache. A column's own get() keeps a single place,
+ * so threads reading the same column at once each read through a cursor.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class ColumnCursor : public Object {
+public:
+    Column* col_;
+    Chunk* chunk_;       // chunk being read, or nullptr
+    size_t chunk_no_;    // which chunk of col_ it is
+    ReadAhead ahead_;    // fetches chunks ahead of this reader
+    bool read_ahead_;    // whether to use ahead_
+
+    /** A cursor that reads ahead, unless told the reader skips chunks. */
+    ColumnCursor(Column* col, bool read_ahead = true) {
+        col_ = col;
+        chunk_ = nullptr;
+        chunk_no_ = 0;
+        read_ahead_ = read_ahead;
+    }
+
+    ~ColumnCursor() {
+        if (chunk_ != nullptr) col_->kv_->release_chunk(col_->keys_->get(chunk_no_));
+    }
+
+    int get_int(size_t idx) {
+        return at_(idx)->as_int_view()->get(idx % ARR_SIZE);
+    }
+
+    bool get_bool(size_t idx) {
+        return at_(idx)->as_bool_view()->get(idx % BOOL_ARR_SIZE);
+    }
+
+    double get_double(size_t idx) {
+        return at_(idx)->as_double_view()->get(idx % ARR_SIZE);
+    }
+
+    String* get_string(size_t idx) {
+        return at_(idx)->as_string()->get(idx % STRING_ARR_SIZE);
+    }
+
+    // the chunk holding the value at idx, acquiring it if need be
+    Chunk* at_(size_t idx) {
+        assert(idx < col_->size_);
+        size_t c = idx / col_->chunk_len();
+        if (chunk_ == nullptr || c != chunk_no_) {
+            KVStore* kv = col_->kv_;
+            if (chunk_ != nullptr) kv->release_chunk(col_->keys_->get(chunk_no_));
+            bool stalled;
+            chunk_ = kv->acquire_chunk(col_->keys_->get(c), &stalled);
+            chunk_no_ = c;
+            if (read_ahead_) ahead_.moved_to(c, stalled, col_->keys_, kv);
+        }
+        return chunk_;
+    }
 };
 
 /*************************************************************************
@@ -99,7 +596,8 @@ public:
 class IntColumn : public Column {
 public:
 
-    IntChunk* chunk_;       // current chunk
+    IntChunk* chunk_;       // chunk being built
+    IntChunkView* view_;    // chunk being read, or nullptr
 
     // default constructor - initialize as an empty IntColumn
     IntColumn(KVStore* kv) {
@@ -109,6 +607,7 @@ public:
         keys_ = new KeyArray();
         done_ = false;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
         chunk_ = new IntChunk();
     }
@@ -122,6 +621,7 @@ public:
         set_type_('I');
         done_ = true;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
 
         // each int* in arr_ will be of size
@@ -147,7 +647,7 @@ public:
                 string k = to_string(id_) + "_" + to_string(curr_chunk);
                 Key* key = new Key(new String(k.c_str()), (size_t)id_);
                 keys_->push_back(key);
-                kv_->put(key, chunk_);
+                store_(key, chunk_);
                 ++curr_chunk;
                 chunk_ = new IntChunk();
             }
@@ -158,14 +658,18 @@ public:
         string k = to_string(id_) + "_" + to_string(curr_chunk);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
+        chunk_ = nullptr;
+        flush_();
         va_end(args);
     }
 
     // destructor - delete arr_ and its sub-arrays
     ~IntColumn() {
+      if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
       kv_->kill(id_);
       delete keys_;
+      delete chunk_;
     }
 
     /**
@@ -176,16 +680,17 @@ public:
     int get(size_t idx) {
         assert(idx < size_);
 
-        // we have the chunk this val is in
-        if (chunk_no_ >= 0 && idx / ARR_SIZE == (size_t)chunk_no_) {
-            return chunk_->get(idx % ARR_SIZE);
-        // we don't have the chunk -> get it
-        } else {
+        // we don't have the chunk this val is in -> get it
+        if (view_ == nullptr || idx / ARR_SIZE != (size_t)chunk_no_) {
+            flush_();
+            if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
+            bool stalled;
             Key* k = keys_->get(idx / ARR_SIZE);
-            chunk_ = kv_->get_chunk(k)->as_int();
+            view_ = kv_->acquire_chunk(k, &stalled)->as_int_view();
             chunk_no_ = idx / ARR_SIZE;
-            return chunk_->get(idx % ARR_SIZE);
+            ahead_.moved_to(chunk_no_, stalled, keys_, kv_);
         }
+        return view_->get(idx % ARR_SIZE);
     }
 
     /**
@@ -196,6 +701,26 @@ public:
         return this;
     }
 
+    /**
+     * Copies the n ints starting at the given position into out, a chunk
+     * at a time rather than one get() per value.
+     */
+    void get_range(size_t start, size_t n, int* out) {
+        assert(start + n <= size_);
+        flush_();
+        ReadAhead ahead;
+        while (n > 0) {
+            size_t c = start / ARR_SIZE;
+            size_t off = start % ARR_SIZE;
+            size_t len = ARR_SIZE - off < n ? ARR_SIZE - off : n;
+            memcpy(out, pin_(c, &ahead)->as_int_view()->vals_ + off, len * sizeof(int));
+            kv_->release_chunk(keys_->get(c));
+            out += len;
+            start += len;
+            n -= len;
+        }
+    }
+
     /**
      * push the given val to the end of the column
      * @param val: int to push back
@@ -211,7 +736,7 @@ public:
             string k = to_string(id_) + "_" + to_string(num_chunks_);
             Key* key = new Key(new String(k.c_str()), (size_t)id_);
             keys_->push_back(key);
-            kv_->put(key, chunk_);
+            store_(key, chunk_);
 
             ++num_chunks_;
 
@@ -225,6 +750,30 @@ public:
         }
     }
 
+    /**
+     * push the given n ints to the end of the column, a chunk's worth at
+     * a time
+     */
+    void append(const int* vals, size_t n) {
+        if (done_) return;
+        while (n > 0) {
+            if (chunk_->full_) {
+                string k = to_string(id_) + "_" + to_string(num_chunks_);
+                Key* key = new Key(new String(k.c_str()), (size_t)id_);
+                keys_->push_back(key);
+                store_(key, chunk_);
+                ++num_chunks_;
+                chunk_ = new IntChunk();
+            }
+            size_t room = ARR_SIZE - chunk_->size_;
+            size_t len = n < room ? n : room;
+            chunk_->append(vals, len);
+            size_ += len;
+            vals += len;
+            n -= len;
+        }
+    }
+
     /**
      * this column is finished being constructed - send last chunk
      */
@@ -233,11 +782,13 @@ public:
         string k = to_string(id_) + "_" + to_string(num_chunks_);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
 
         chunk_ = nullptr;
         chunk_no_ = -1;
 
+        flush_();
+
         done_ = true;
     }
 };
@@ -246,13 +797,14 @@ public:
 
 /*************************************************************************
  * BoolColumn::
- * Holds primitive bool values, unwrapped.
+ * Holds primitive bool values, packed one to a bit.
  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
  */
 class BoolColumn : public Column {
 public:
 
-    BoolChunk* chunk_;       // current chunk
+    BoolChunk* chunk_;       // chunk being built
+    BoolChunkView* view_;   // chunk being read, or nullptr
 
     // default constructor - initialize as an empty BoolColumn
     BoolColumn(KVStore* kv) {
@@ -262,6 +814,7 @@ public:
         keys_ = new KeyArray();
         done_ = false;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
         chunk_ = new BoolChunk();
     }
@@ -275,6 +828,7 @@ public:
         set_type_('B');
         done_ = true;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
 
         // each bool chunk in arr_ will be of size
@@ -300,25 +854,29 @@ public:
                 string k = to_string(id_) + "_" + to_string(curr_chunk);
                 Key* key = new Key(new String(k.c_str()), (size_t)id_);
                 keys_->push_back(key);
-                kv_->put(key, chunk_);
+                store_(key, chunk_);
                 ++curr_chunk;
                 chunk_ = new BoolChunk();
             }
             // add the current int to ints
-            chunk_->push_back(va_arg(args, bool));
+            chunk_->push_back((bool)va_arg(args, int));
         }
         // send the last chunk
         string k = to_string(id_) + "_" + to_string(curr_chunk);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
+        chunk_ = nullptr;
+        flush_();
         va_end(args);
     }
 
     // destructor - delete keys
     ~BoolColumn() {
+      if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
       kv_->kill(id_);
       delete keys_;
+      delete chunk_;
     }
 
     /**
@@ -329,16 +887,17 @@ public:
     bool get(size_t idx) {
         assert(idx < size_);
 
-        // we have the chunk this val is in
-        if (chunk_no_ >= 0 && idx / BOOL_ARR_SIZE == (size_t)chunk_no_) {
-            return chunk_->get(idx % BOOL_ARR_SIZE);
-        // we don't have the chunk -> get it
-        } else {
+        // we don't have the chunk this val is in -> get it
+        if (view_ == nullptr || idx / BOOL_ARR_SIZE != (size_t)chunk_no_) {
+            flush_();
+            if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
+            bool stalled;
             Key* k = keys_->get(idx / BOOL_ARR_SIZE);
-            chunk_ = kv_->get_chunk(k)->as_bool();
+            view_ = kv_->acquire_chunk(k, &stalled)->as_bool_view();
             chunk_no_ = idx / BOOL_ARR_SIZE;
-            return chunk_->get(idx % BOOL_ARR_SIZE);
+            ahead_.moved_to(chunk_no_, stalled, keys_, kv_);
         }
+        return view_->get(idx % BOOL_ARR_SIZE);
     }
 
     /**
@@ -349,6 +908,103 @@ public:
         return this;
     }
 
+    /**
+     * Copies the n bools starting at the given position into out, a chunk
+     * at a time rather than one get() per value.
+     */
+    void get_range(size_t start, size_t n, bool* out) {
+        assert(start + n <= size_);
+        flush_();
+        ReadAhead ahead;
+        while (n > 0) {
+            size_t c = start / BOOL_ARR_SIZE;
+            size_t off = start % BOOL_ARR_SIZE;
+            size_t len = BOOL_ARR_SIZE - off < n ? BOOL_ARR_SIZE - off : n;
+            const uint8_t* bits = pin_(c, &ahead)->as_bool_view()->bits_;
+            for (size_t i = 0; i < len; ++i) {
+                out[i] = (bits[(off + i) / 8] >> ((off + i) % 8)) & 1;
+            }
+            kv_->release_chunk(keys_->get(c));
+            out += len;
+            start += len;
+            n -= len;
+        }
+    }
+
+    /** the number of bools in the column that are true, counted a word
+     *  at a time */
+    size_t count() {
+        flush_();
+        size_t count = chunk_ == nullptr ? 0 : chunk_->count();
+        for (size_t c = 0; c < keys_->size(); ++c) {
+            count += kv_->acquire_chunk(keys_->get(c))->as_bool_view()->count();
+            kv_->release_chunk(keys_->get(c));
+        }
+        return count;
+    }
+
+    /** a new column holding this AND that, row by row, computed a word at
+     *  a time. Both columns must be finished and the same size. */
+    BoolColumn* and_(BoolColumn* that) {
+        return combine_(that, '&');
+    }
+
+    /** a new column holding this OR that, row by row, computed a word at
+     *  a time. Both columns must be finished and the same size. */
+    BoolColumn* or_(BoolColumn* that) {
+        return combine_(that, '|');
+    }
+
+    /** a new column holding NOT this, row by row, computed a word at a
+     *  time. This column must be finished. */
+    BoolColumn* not_() {
+        return combine_(nullptr, '!');
+    }
+
+    // applies op ('&', '|' or '!') chunk by chunk into a new, finished
+    // column stored in the same KVStore
+    BoolColumn* combine_(BoolColumn* that, char op) {
+        assert(done_ && (that == nullptr || (that->done_ && that->size_ == size_)));
+        BoolColumn* out = new BoolColumn(kv_);
+        delete out->chunk_;
+        out->chunk_ = nullptr;
+        for (size_t c = 0; c < keys_->size(); ++c) {
+            BoolArray* bits = read_bits_(c);
+            if (op == '!') {
+                bits->negate();
+            } else {
+                BoolArray* other = that->read_bits_(c);
+                if (op == '&') bits->and_with(other);
+                else bits->or_with(other);
+                delete other;
+            }
+            BoolChunk* chunk = new BoolChunk();
+            delete chunk->arr_;
+            chunk->arr_ = bits;
+            chunk->size_ = bits->size();
+            chunk->full_ = chunk->size_ == BOOL_ARR_SIZE;
+
+            string k = to_string(out->id_) + "_" + to_string(c);
+            Key* key = new Key(new String(k.c_str()), (size_t)out->id_);
+            out->keys_->push_back(key);
+            out->store_(key, chunk);
+        }
+        out->size_ = size_;
+        out->num_chunks_ = keys_->size();
+        out->chunk_no_ = -1;
+        out->done_ = true;
+        out->flush_();
+        return out;
+    }
+
+    // copies the bools of the given chunk out of the store, packed
+    BoolArray* read_bits_(size_t c) {
+        flush_();
+        BoolArray* bits = kv_->acquire_chunk(keys_->get(c))->as_bool_view()->to_array();
+        kv_->release_chunk(keys_->get(c));
+        return bits;
+    }
+
     /**
      * push the given val to the end of the column
      * @param val: bool to push back
@@ -364,7 +1020,7 @@ public:
             string k = to_string(id_) + "_" + to_string(num_chunks_);
             Key* key = new Key(new String(k.c_str()), (size_t)id_);
             keys_->push_back(key);
-            kv_->put(key, chunk_);
+            store_(key, chunk_);
 
             ++num_chunks_;
 
@@ -386,11 +1042,13 @@ public:
         string k = to_string(id_) + "_" + to_string(num_chunks_);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
 
         chunk_ = nullptr;
         chunk_no_ = -1;
 
+        flush_();
+
         done_ = true;
     }
 };
@@ -403,7 +1061,8 @@ public:
 class DoubleColumn : public Column {
 public:
 
-    DoubleChunk* chunk_;       // current chunk
+    DoubleChunk* chunk_;       // chunk being built
+    DoubleChunkView* view_; // chunk being read, or nullptr
 
     // default constructor - initialize as an empty DoubleColumn
     DoubleColumn(KVStore* kv) {
@@ -413,6 +1072,7 @@ public:
         keys_ = new KeyArray();
         done_ = false;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
         chunk_ = new DoubleChunk();
     }
@@ -426,6 +1086,7 @@ public:
         set_type_('D');
         done_ = true;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
 
         // each Double chunk in arr_ will be of size
@@ -451,7 +1112,7 @@ public:
                 string k = to_string(id_) + "_" + to_string(curr_chunk);
                 Key* key = new Key(new String(k.c_str()), (size_t)id_);
                 keys_->push_back(key);
-                kv_->put(key, chunk_);
+                store_(key, chunk_);
                 ++curr_chunk;
                 chunk_ = new DoubleChunk();
             }
@@ -462,14 +1123,18 @@ public:
         string k = to_string(id_) + "_" + to_string(curr_chunk);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
+        chunk_ = nullptr;
+        flush_();
         va_end(args);
     }
 
     // destructor - delete arr_ and its sub-arrays
     ~DoubleColumn() {
+      if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
       kv_->kill(id_);
       delete keys_;
+      delete chunk_;
     }
 
     /**
@@ -480,16 +1145,17 @@ public:
     double get(size_t idx) {
         assert(idx < size_);
 
-        // we have the chunk this val is in
-        if (chunk_no_ >= 0 && idx / ARR_SIZE == (size_t)chunk_no_) {
-            return chunk_->get(idx % ARR_SIZE);
-        // we don't have the chunk -> get it
-        } else {
+        // we don't have the chunk this val is in -> get it
+        if (view_ == nullptr || idx / ARR_SIZE != (size_t)chunk_no_) {
+            flush_();
+            if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
+            bool stalled;
             Key* k = keys_->get(idx / ARR_SIZE);
-            chunk_ = kv_->get_chunk(k)->as_double();
+            view_ = kv_->acquire_chunk(k, &stalled)->as_double_view();
             chunk_no_ = idx / ARR_SIZE;
-            return chunk_->get(idx % ARR_SIZE);
+            ahead_.moved_to(chunk_no_, stalled, keys_, kv_);
         }
+        return view_->get(idx % ARR_SIZE);
     }
 
     /**
@@ -500,6 +1166,26 @@ public:
         return this;
     }
 
+    /**
+     * Copies the n doubles starting at the given position into out, a chunk
+     * at a time rather than one get() per value.
+     */
+    void get_range(size_t start, size_t n, double* out) {
+        assert(start + n <= size_);
+        flush_();
+        ReadAhead ahead;
+        while (n > 0) {
+            size_t c = start / ARR_SIZE;
+            size_t off = start % ARR_SIZE;
+            size_t len = ARR_SIZE - off < n ? ARR_SIZE - off : n;
+            memcpy(out, pin_(c, &ahead)->as_double_view()->vals_ + off, len * sizeof(double));
+            kv_->release_chunk(keys_->get(c));
+            out += len;
+            start += len;
+            n -= len;
+        }
+    }
+
     /**
      * push the given val to the end of the column
      * @param val: double to push back
@@ -515,8 +1201,7 @@ public:
             string k = to_string(id_) + "_" + to_string(num_chunks_);
             Key* key = new Key(new String(k.c_str()), (size_t)id_);
             keys_->push_back(key);
-
-            kv_->put(key, chunk_);
+            store_(key, chunk_);
 
             ++num_chunks_;
 
@@ -530,6 +1215,30 @@ public:
         }
     }
 
+    /**
+     * push the given n doubles to the end of the column, a chunk's worth
+     * at a time
+     */
+    void append(const double* vals, size_t n) {
+        if (done_) return;
+        while (n > 0) {
+            if (chunk_->full_) {
+                string k = to_string(id_) + "_" + to_string(num_chunks_);
+                Key* key = new Key(new String(k.c_str()), (size_t)id_);
+                keys_->push_back(key);
+                store_(key, chunk_);
+                ++num_chunks_;
+                chunk_ = new DoubleChunk();
+            }
+            size_t room = ARR_SIZE - chunk_->size_;
+            size_t len = n < room ? n : room;
+            chunk_->append(vals, len);
+            size_ += len;
+            vals += len;
+            n -= len;
+        }
+    }
+
     /**
      * this column is finished being constructed - send last chunk
      */
@@ -538,25 +1247,29 @@ public:
         string k = to_string(id_) + "_" + to_string(num_chunks_);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
 
         chunk_ = nullptr;
         chunk_no_ = -1;
 
+        flush_();
+
         done_ = true;
     }
 };
 
 /*************************************************************************
  * StringColumn::
- * Holds string pointers. The strings are external.  Nullptr is a valid
- * value.
+ * Holds string pointers. The column owns the Strings pushed into it: each
+ * is deleted with the chunk it was built into, once that chunk has been
+ * stored. Nullptr is a valid value.
  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
  */
 class StringColumn : public Column {
 public:
 
-    StringChunk* chunk_;       // current chunk
+    StringChunk* chunk_;       // chunk being built
+    StringChunk* view_;        // chunk being read, or nullptr
 
     // default constructor - initialize as an empty StringColumn
     StringColumn(KVStore* kv) {
@@ -566,6 +1279,7 @@ public:
         keys_ = new KeyArray();
         done_ = false;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
         chunk_ = new StringChunk();
     }
@@ -573,12 +1287,13 @@ public:
     /**
      * constructor with values given - initialize all values into arr_
      * @param n: number of Strings in the args
-     * @param ...: the Strings, handled by va_list etc.
+     * @param ...: the Strings, which the column takes, handled by va_list etc.
      */
     StringColumn(KVStore* kv, int n, ...) {
         set_type_('S');
         done_ = true;
         kv_ = kv;
+        view_ = nullptr;
         id_ = kv->get_id();
 
         // each String chunk in arr_ will be of size
@@ -604,7 +1319,7 @@ public:
                 string k = to_string(id_) + "_" + to_string(curr_chunk);
                 Key* key = new Key(new String(k.c_str()), (size_t)id_);
                 keys_->push_back(key);
-                kv_->put(key, chunk_);
+                store_(key, chunk_);
                 ++curr_chunk;
                 chunk_ = new StringChunk();
             }
@@ -615,14 +1330,18 @@ public:
         string k = to_string(id_) + "_" + to_string(curr_chunk);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
+        chunk_ = nullptr;
+        flush_();
         va_end(args);
     }
 
     // destructor - delete arr_ and its sub-arrays
     ~StringColumn() {
+      if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
       kv_->kill(id_);
       delete keys_;
+      delete chunk_;
     }
 
     /**
@@ -633,16 +1352,17 @@ public:
     String* get(size_t idx) {
         assert(idx < size_);
 
-        // we have the chunk this val is in
-        if (chunk_no_ >= 0 && idx / ARR_SIZE == (size_t)chunk_no_) {
-            return chunk_->get(idx % STRING_ARR_SIZE);
-        // we don't have the chunk -> get it
-        } else {
+        // we don't have the chunk this val is in -> get it
+        if (view_ == nullptr || idx / STRING_ARR_SIZE != (size_t)chunk_no_) {
+            flush_();
+            if (view_ != nullptr) kv_->release_chunk(keys_->get(chunk_no_));
+            bool stalled;
             Key* k = keys_->get(idx / STRING_ARR_SIZE);
-            chunk_ = kv_->get_chunk(k)->as_string();
+            view_ = kv_->acquire_chunk(k, &stalled)->as_string();
             chunk_no_ = idx / STRING_ARR_SIZE;
-            return chunk_->get(idx % STRING_ARR_SIZE);
+            ahead_.moved_to(chunk_no_, stalled, keys_, kv_);
         }
+        return view_->get(idx % STRING_ARR_SIZE);
     }
 
     /**
@@ -654,11 +1374,14 @@ public:
     }
 
     /**
-     * push the given val to the end of the column
+     * push the given val to the end of the column, which takes it
      * @param val: String to push back
      */
     virtual void push_back(String* val) {
-        if (done_) return;
+        if (done_) {
+            delete val;
+            return;
+        }
         // the chunk is full
         if (chunk_->full_) {
             // increment size values
@@ -668,7 +1391,7 @@ public:
             string k = to_string(id_) + "_" + to_string(num_chunks_);
             Key* key = new Key(new String(k.c_str()), (size_t)id_);
             keys_->push_back(key);
-            kv_->put(key, chunk_);
+            store_(key, chunk_);
 
             ++num_chunks_;
 
@@ -690,11 +1413,13 @@ public:
         string k = to_string(id_) + "_" + to_string(num_chunks_);
         Key* key = new Key(new String(k.c_str()), (size_t)id_);
         keys_->push_back(key);
-        kv_->put(key, chunk_);
+        store_(key, chunk_);
 
         chunk_ = nullptr;
         chunk_no_ = -1;
 
+        flush_();
+
         done_ = true;
     }
 };
@@ -713,6 +1438,8 @@ public:
   }
 
   const char* serialize(Column* col) {
+      // chunks get their home nodes once they are sent
+      col->flush_();
       ByteArray* barr = new ByteArray();
 
       // serialize the type
@@ -738,6 +1465,10 @@ public:
       barr->push_string(ser_keys);
       delete[] ser_keys;
 
+      // serialize the statistics of each chunk, all on one line
+      barr->push_string("\n\t\tsts: ");
+      for (size_t c = 0; c < col->num_stats_; ++c) col->stats_[c]->write(barr);
+
       const char* str = barr->as_bytes();
       delete barr;
       return str;
@@ -766,21 +1497,25 @@ public:
     if (type == 'I') {
       IntColumn* c = new IntColumn(kc_);
       delete c->chunk_;
+      c->chunk_ = nullptr;
       col = c;
     }
     else if (type == 'B') {
       BoolColumn* c = new BoolColumn(kc_);
       delete c->chunk_;
+      c->chunk_ = nullptr;
       col = c;
     }
     else if (type == 'D') {
       DoubleColumn* c = new DoubleColumn(kc_);
       delete c->chunk_;
+      c->chunk_ = nullptr;
       col = c;
     }
     else if (type == 'S') {
       StringColumn* c = new StringColumn(kc_);
       delete c->chunk_;
+      c->chunk_ = nullptr;
       col = c;
     }
 
@@ -790,16 +1525,25 @@ public:
     size_t siz = s.get_size(&str[i], &i);
 
     // get id
+    // skip the id: this copy keeps its own, so deleting it leaves the
+    // original column's chunks in place
     i += 2; // id_
-    size_t id = s.get_size(&str[i], &i);
+    s.get_size(&str[i], &i);
 
     // get keys
     i += 2; // kys
     KeyArray* keys = s.get_key_array(&str[i], &i);
 
+    // get the statistics of each chunk
+    while (str[i] == '\n') ++i;
+    i += 7; // sts
+    for (size_t c = 0; c < keys->size(); ++c) {
+      col->add_stats_(ChunkStats::read(type, str, &i));
+    }
+    if (str[i] == '\n') ++i;
+
     delete col->keys_;
     col->keys_ = keys;
-    col->id_ = id;
     col->size_ = siz;
     col->num_chunks_ = keys->size();
     col->done_ = true;
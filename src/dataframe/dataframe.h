@@ -4,6 +4,9 @@
 #include "column.h"
 #include "row.h"
 #include "schema.h"
+#include "group.h"
+#include "join.h"
+#include "sort.h"
 #include "helper.h"
 #include <cstdlib>
 #include "object.h"
@@ -11,6 +14,7 @@
 #include "array.h"
 #include "kvstore.h"
 #include "message.h"
+#include "thread.h"
 
 /****************************************************************************
  * DataFrame::
@@ -25,6 +29,8 @@ class DataFrame : public Object {
   Column** cols_;   // column array representing the values of the DF
   Schema* schema_;  // the schema this DF conforms to
   KVStore* kv_;   // kvstore for columns to use
+  DataFrame* parent_;  // dataframe this one was filtered from, or nullptr
+  size_t* sel_;        // owned; rows of parent_ this one holds, in order
 
   /** Create a data frame with the same columns as the given df but no rows */
   DataFrame(DataFrame& df): DataFrame(*df.schema_, df.kv_) {}
@@ -35,6 +41,8 @@ class DataFrame : public Object {
     schema_ = new Schema(schema);
     cols_ = new Column*[schema_->width()];
     kv_ = kv;
+    parent_ = nullptr;
+    sel_ = nullptr;
 
     // populates cols_ with empty columns
     for (size_t i = 0; i < schema_->width(); ++i) {
@@ -46,11 +54,13 @@ class DataFrame : public Object {
   // destructor - delete schema, cols_, and its cols
   ~DataFrame() {
     for (size_t i = 0; i < schema_->width(); ++i) {
+      if (cols_[i] == nullptr) continue;
       cols_[i]->delete_all();
       delete cols_[i];
     }
     delete[] cols_;
     delete schema_;
+    delete[] sel_;
   }
 
   const char* serialize(DataFrame* df) {
@@ -64,7 +74,7 @@ class DataFrame : public Object {
       for (size_t i = 0; i < scm.width(); ++i) {
           if (i != 0) barr->push_back('\n');
           barr->push_string("\tcol:\n");
-          const char* ser_col = s.serialize(df->cols_[i]);
+          const char* ser_col = s.serialize(df->column(i));
           barr->push_string(ser_col);
           delete[] ser_col;
       }
@@ -100,7 +110,8 @@ class DataFrame : public Object {
 
   /**
    *  create and return a df of 1 col with the values in from of size sz,
-   *  and make it the value of the given key in the kvstore */
+   *  and make it the value of the given key in the kvstore. Strings are
+   *  copied. */
   DataFrame* from_array(Key* key, KVStore* kv, size_t sz, Array* from);
 
   /**
@@ -122,7 +133,7 @@ class DataFrame : public Object {
 
   /**
    *  Create and return a df of 1 value (scalar). String Version.
-   *  Possible uses are a concatenated String.
+   *  Possible uses are a concatenated String, which is copied.
    *  Also assigns the dataframe to a key in the KDFMapping. */
   DataFrame* from_scalar(Key* key, KVStore* kv, String* val);
 
@@ -196,28 +207,143 @@ class DataFrame : public Object {
       return c;
   }
 
+  /** The column at the given index. A column of a filtered dataframe is
+    * copied out of its parent the first time it is asked for. */
+  Column* column(size_t i) {
+    if (cols_[i] == nullptr) cols_[i] = gather_(parent_->column(i), sel_, nrows());
+    return cols_[i];
+  }
+
+  /** Copies every column of a filtered dataframe that has not been copied
+    * yet out of its parent, after which the parent may be deleted. */
+  void materialize() {
+    for (size_t i = 0; i < ncols(); ++i) column(i);
+  }
+
+  /**
+   * A dataframe of the rows r accepts, in order. Like the one returned by
+   * filter(Predicate&), it copies no column until it is used.
+   */
+  DataFrame* filter(Rower& r) {
+    preload_();
+    ColumnCursor** cursors = new ColumnCursor*[ncols()];
+    for (size_t i = 0; i < ncols(); ++i) cursors[i] = new ColumnCursor(column(i));
+    Row row(*schema_);
+    size_t n = 0, capacity = 1024;
+    size_t* sel = new size_t[capacity];
+    for (size_t i = 0; i < nrows(); ++i) {
+      fill_row(i, row, cursors);
+      if (!r.accept(row)) continue;
+      if (n == capacity) {
+        size_t* tmp = new size_t[capacity * 2];
+        memcpy(tmp, sel, n * sizeof(size_t));
+        delete[] sel;
+        sel = tmp;
+        capacity *= 2;
+      }
+      sel[n++] = i;
+    }
+    for (size_t i = 0; i < ncols(); ++i) delete cursors[i];
+    delete[] cursors;
+    return child_(sel, n);
+  }
+
+  /**
+   * A dataframe of the rows that meet p, in order. Only the columns p
+   * compares are read, a chunk at a time, into a bitmask of the rows that
+   * pass. The result keeps the numbers of those rows rather than copies of
+   * them; each of its columns is copied out of this dataframe the first
+   * time it is used, so filtering a wide dataframe and reading a few of
+   * its columns copies only those. This dataframe must outlive the result
+   * unless the result is materialized first.
+   */
+  DataFrame* filter(Predicate& p) {
+    uint8_t* bits = new uint8_t[(nrows() + 7) / 8];
+    select_(p, bits);
+    size_t n = Kernels::popcount(bits, nrows());
+    size_t* sel = new size_t[n];
+    size_t k = 0;
+    for (size_t b = 0; b < (nrows() + 7) / 8; ++b) {
+      for (unsigned int v = bits[b]; v != 0; v &= v - 1) {
+        sel[k++] = b * 8 + __builtin_ctz(v);
+      }
+    }
+    delete[] bits;
+    return child_(sel, n);
+  }
+
+  // sets the bits of the rows that meet p in the given mask
+  void select_(Predicate& p, uint8_t* bits) {
+    if (p.op_ == 'c') {
+      assert(p.col_ < ncols());
+      assert((schema_->col_type(p.col_) == 'S') == (p.sval_ != nullptr));
+      p.start(bits);
+      column(p.col_)->for_each_chunk(p);
+      return;
+    }
+    size_t bytes = (nrows() + 7) / 8;
+    select_(*p.left_, bits);
+    uint8_t* other = new uint8_t[bytes];
+    select_(*p.right_, other);
+    if (p.op_ == '&') for (size_t b = 0; b < bytes; ++b) bits[b] &= other[b];
+    else for (size_t b = 0; b < bytes; ++b) bits[b] |= other[b];
+    delete[] other;
+  }
+
+  // a dataframe of the n rows of this one numbered in sel, which it takes
+  DataFrame* child_(size_t* sel, size_t n) {
+    DataFrame* df = new DataFrame(*schema_, kv_);
+    for (size_t i = 0; i < ncols(); ++i) {
+      delete df->cols_[i];
+      df->cols_[i] = nullptr;
+    }
+    df->schema_->numrows_ = n;
+    df->parent_ = this;
+    df->sel_ = sel;
+    return df;
+  }
+
+  // a column holding the values of from at the n given rows, or 0, false,
+  // 0.0 or EMPTY_STRING where the row is NO_ROW, stored on the given node if
+  // any
+  Column* gather_(Column* from, size_t* rows, size_t n, int home = -1) {
+    char type = from->get_type();
+    Column* c = get_new_col_(type);
+    c->home_ = home;
+    ColumnCursor cursor(from);
+    for (size_t k = 0; k < n; ++k) {
+      size_t i = rows[k];
+      if (type == 'I') c->push_back(i == NO_ROW ? 0 : cursor.get_int(i));
+      else if (type == 'B') c->push_back(i == NO_ROW ? false : cursor.get_bool(i));
+      else if (type == 'D') c->push_back(i == NO_ROW ? 0.0 : cursor.get_double(i));
+      else c->push_back(i == NO_ROW ? &EMPTY_STRING : cursor.get_string(i)->clone());
+    }
+    c->finalize();
+    return c;
+  }
+
   /** Return the value at the given column and row. Accessing rows or
    *  columns out of bounds, or request the wrong type is undefined.*/
   int get_int(size_t col, size_t row) {
-    IntColumn* ic = cols_[col]->as_int();
+    IntColumn* ic = column(col)->as_int();
     assert(ic != nullptr);
     return ic->get(row);
   }
 
   bool get_bool(size_t col, size_t row) {
-    BoolColumn* bc = cols_[col]->as_bool();
+    BoolColumn* bc = column(col)->as_bool();
     assert(bc != nullptr);
     return bc->get(row);
   }
 
   double get_double(size_t col, size_t row) {
-    DoubleColumn* dc = cols_[col]->as_double();
+    DoubleColumn* dc = column(col)->as_double();
     assert(dc != nullptr);
     return dc->get(row);
   }
 
   String* get_string(size_t col, size_t row) {
-    StringColumn* sc = cols_[col]->as_string();
+    StringColumn* sc = column(col)->as_string();
     assert(sc != nullptr);
     return sc->get(row);
   }
@@ -231,22 +357,35 @@ class DataFrame : public Object {
     for (size_t i = 0; i < schema_->width(); ++i) {
       char typ = schema_->col_type(i);
       if (typ == 'I') {
-        IntColumn* ic = cols_[i]->as_int();
+        IntColumn* ic = column(i)->as_int();
         row.set(i, ic->get(idx));
       } else if (typ == 'B') {
-        BoolColumn* bc = cols_[i]->as_bool();
+        BoolColumn* bc = column(i)->as_bool();
         row.set(i, bc->get(idx));
       } else if (typ == 'D') {
-        DoubleColumn* dc = cols_[i]->as_double();
+        DoubleColumn* dc = column(i)->as_double();
         row.set(i, dc->get(idx));
       } else {
-        StringColumn* sc = cols_[i]->as_string();
+        StringColumn* sc = column(i)->as_string();
         row.set(i, sc->get(idx));
       }
     }
     row.set_idx(idx);
   }
 
+  /** Like fill_row, but reads each column through its own cursor (one per
+    * column, in order), so that several threads can fill rows at once. */
+  void fill_row(size_t idx, Row& row, ColumnCursor** cursors) {
+    for (size_t i = 0; i < schema_->width(); ++i) {
+      char typ = schema_->col_type(i);
+      if (typ == 'I') row.set(i, cursors[i]->get_int(idx));
+      else if (typ == 'B') row.set(i, cursors[i]->get_bool(idx));
+      else if (typ == 'D') row.set(i, cursors[i]->get_double(idx));
+      else row.set(i, cursors[i]->get_string(idx));
+    }
+    row.set_idx(idx);
+  }
+
   /** Add a row at the end of this dataframe. The row is expected to have
    *  the right schema and be filled with values, otherwise undedined.  */
   void add_row(Row& row) {
@@ -274,7 +413,7 @@ class DataFrame : public Object {
   /** finalize all columns, should be called after calling add_row many times */
   void finalize_all() {
     for (size_t i = 0; i < ncols(); ++i) {
-      Column* c = cols_[i];
+      Column* c = column(i);
       if (c->type_ == 'I') c->as_int()->finalize();
       else if (c->type_ == 'D') c->as_double()->finalize();
       else if (c->type_ == 'B') c->as_bool()->finalize();
@@ -292,8 +431,63 @@ class DataFrame : public Object {
     return schema_->width();
   }
 
+  /** Aggregates of an int or double column, computed a chunk at a time
+    * with the kernels in kernels.h rather than a row at a time. The sum of
+    * an int column is exact up to 2^53. min and max need at least one row.
+    * variance is the population variance. */
+  double sum(size_t col) {
+    Aggregator a('s');
+    aggregate_(col, a);
+    return (double)a.isum_ + a.sum_;
+  }
+
+  double min(size_t col) {
+    Aggregator a('m');
+    aggregate_(col, a);
+    assert(a.count_ > 0);
+    return a.min_;
+  }
+
+  double max(size_t col) {
+    Aggregator a('m');
+    aggregate_(col, a);
+    assert(a.count_ > 0);
+    return a.max_;
+  }
+
+  double mean(size_t col) {
+    Aggregator a('v');
+    aggregate_(col, a);
+    return a.mean_;
+  }
+
+  double variance(size_t col) {
+    Aggregator a('v');
+    aggregate_(col, a);
+    return a.count_ == 0 ? 0 : a.m2_ / a.count_;
+  }
+
+  /** The number of true values of a bool column, or of values of an int
+    * or double column. */
+  size_t count(size_t col) {
+    assert(col < ncols());
+    if (schema_->col_type(col) != 'B') return nrows();
+    Aggregator a('c');
+    column(col)->for_each_chunk(a);
+    return a.count_;
+  }
+
+  // runs the aggregator over an int or double column
+  void aggregate_(size_t col, Aggregator& a) {
+    assert(col < ncols());
+    char type = schema_->col_type(col);
+    assert(type == 'I' || type == 'D');
+    column(col)->for_each_chunk(a);
+  }
+
   /** Visit rows in order */
   void map(Rower& r) {
+    preload_();
     Row* row = new Row(*schema_);
     for (size_t i = 0; i < schema_->length(); ++i) {
       fill_row(i, *row);
@@ -301,8 +495,611 @@ class DataFrame : public Object {
     }
     delete row;
   }
+
+  /**
+   * Visit rows on the given number of threads. The rows are split into
+   * that many ranges on chunk boundaries, each visited in order by its own
+   * clone of r, and the clones are joined back into r in row order.
+   * Falls back to map when there is only one range.
+   */
+  void pmap(Rower& r, size_t threads);
+
+  /**
+   * Visit, in order, the rows whose value in the given int, double or bool
+   * (as 0 or 1) column lies in [lo, hi]. Chunks of that column whose
+   * statistics rule the range out are never fetched, nor are the chunks of
+   * other columns that hold no matching row.
+   */
+  void map_range(size_t col, double lo, double hi, Rower& r) {
+    assert(col < ncols() && schema_->col_type(col) != 'S');
+    scan_range_(col, lo, hi, nullptr, nullptr, r);
+  }
+
+  /** Like map_range, over a String column, comparing with strcmp. */
+  void map_range(size_t col, const char* lo, const char* hi, Rower& r) {
+    assert(col < ncols() && schema_->col_type(col) == 'S');
+    scan_range_(col, 0, 0, lo, hi, r);
+  }
+
+  // Visits the rows whose value in col lies in [lo, hi], or in [slo, shi]
+  // for a String column. The chunks of col that may match are fetched
+  // together up front if they fit comfortably in the chunk cache; nothing
+  // is read ahead, since the next chunk may be one that is skipped.
+  void scan_range_(size_t col, double lo, double hi, const char* slo,
+                   const char* shi, Rower& r) {
+    for (size_t i = 0; i < ncols(); ++i) column(i)->flush_();
+    Column* pc = column(col);
+    char type = pc->get_type();
+    KeyArray* keys = pc->keys_;
+    KeyArray* wanted = new KeyArray();
+    for (size_t c = 0; c < keys->size(); ++c) {
+      ChunkStats* st = pc->stats(c);
+      if (slo != nullptr ? st->may_match(slo, shi) : st->may_match(lo, hi)) {
+        wanted->push_back(keys->get(c));
+      }
+    }
+    if (wanted->size() > 0 && pc->bytes() / keys->size() * wanted->size()
+        <= kv_->cache_->budget_ / 2) {
+      kv_->load_chunks(wanted);
+    }
+    delete wanted;
+
+    ColumnCursor** cursors = new ColumnCursor*[ncols()];
+    for (size_t i = 0; i < ncols(); ++i) cursors[i] = new ColumnCursor(column(i), false);
+    Row* row = new Row(*schema_);
+    size_t len = pc->chunk_len();
+    for (size_t c = 0; c < keys->size(); ++c) {
+      ChunkStats* st = pc->stats(c);
+      if (slo != nullptr ? !st->may_match(slo, shi) : !st->may_match(lo, hi)) continue;
+      size_t end = (c + 1) * len > nrows() ? nrows() : (c + 1) * len;
+      for (size_t i = c * len; i < end; ++i) {
+        bool in;
+        if (type == 'S') {
+          const char* v = cursors[col]->get_string(i)->c_str();
+          in = strcmp(v, slo) >= 0 && strcmp(v, shi) <= 0;
+        } else {
+          double v = type == 'I' ? cursors[col]->get_int(i)
+                   : type == 'D' ? cursors[col]->get_double(i)
+                   : cursors[col]->get_bool(i);
+          in = v >= lo && v <= hi;
+        }
+        if (!in) continue;
+        fill_row(i, *row, cursors);
+        r.accept(*row);
+      }
+    }
+    delete row;
+    for (size_t i = 0; i < ncols(); ++i) delete cursors[i];
+    delete[] cursors;
+  }
+
+  /**
+   * Visit, in order, only the rows stored on this node. A row belongs to
+   * the node that holds its value in the first column; values of the other
+   * columns that live elsewhere are fetched as usual. Run on every node,
+   * local_map visits each row exactly once across the cluster.
+   */
+  void local_map(Rower& r) {
+    if (ncols() == 0) return;
+    for (size_t i = 0; i < ncols(); ++i) column(i)->flush_();
+    KeyArray* keys = column(0)->keys_;
+    size_t len = column(0)->chunk_len();
+    ColumnCursor** cursors = new ColumnCursor*[ncols()];
+    for (size_t i = 0; i < ncols(); ++i) cursors[i] = new ColumnCursor(column(i));
+    Row* row = new Row(*schema_);
+    for (size_t c = 0; c < keys->size(); ++c) {
+      if (keys->get(c)->getHomeNode() != (int)kv_->index()) continue;
+      size_t end = (c + 1) * len > nrows() ? nrows() : (c + 1) * len;
+      for (size_t i = c * len; i < end; ++i) {
+        fill_row(i, *row, cursors);
+        r.accept(*row);
+      }
+    }
+    delete row;
+    for (size_t i = 0; i < ncols(); ++i) delete cursors[i];
+    delete[] cursors;
+  }
+
+  /**
+   * Runs r over the rows stored on this node, and gathers what every node
+   * computed on node 0. Every node calls this on its copy of the dataframe
+   * with the same name. The other nodes ship the serialized state of their
+   * rower to node 0, under keys made from the name, where it is joined into
+   * node 0's rower in node order. Only node 0's r ends up covering every
+   * row. Each call needs a name of its own, since the states are left in
+   * node 0's store.
+   */
+  void map_reduce(Rower& r, const char* name) {
+    local_map(r);
+    if (kv_->index() != 0) {
+      string k = string(name) + "-" + to_string(kv_->index());
+      Key key(new String(k.c_str()), 0);
+      const char* state = r.serialize();
+      kv_->put(&key, state);
+      delete[] state;
+      return;
+    }
+    for (size_t node = 1; node < kv_->num_nodes_; ++node) {
+      string k = string(name) + "-" + to_string(node);
+      Key key(new String(k.c_str()), 0);
+      const char* state = kv_->takeCharsAndWait(&key);
+      r.join_delete(r.deserialize(state));
+      delete[] state;
+    }
+  }
+
+  /**
+   * Groups the rows by their values in the given int, bool or String
+   * columns and computes the given aggregates of each group, on the given
+   * number of threads. Each thread fills a hash table of its own, and the
+   * tables are merged at the end. Returns a dataframe with one row per
+   * group, as GroupTable::to_dataframe lays it out, in no particular order.
+   */
+  DataFrame* group_by(IntArray& key_cols, Aggs& aggs, size_t threads = 1) {
+    GroupRower r(*schema_, key_cols, aggs);
+    pmap(r, threads);
+    return r.table_->to_dataframe(kv_);
+  }
+
+  /**
+   * Like group_by, over the whole cluster; run on every node. Each node
+   * groups the rows stored on it, then sends each of its groups to the
+   * node that owns the group's keys, chosen by their hash, under keys
+   * named after the given name. Each node returns a dataframe of the
+   * groups it owns, merged from every node's part of them.
+   */
+  DataFrame* group_by(IntArray& key_cols, Aggs& aggs, const char* name) {
+    GroupRower r(*schema_, key_cols, aggs);
+    local_map(r);
+    size_t me = kv_->index();
+    size_t nodes = kv_->num_nodes_;
+    for (size_t node = 0; node < nodes; ++node) {
+      if (node == me) continue;
+      string k = string(name) + "-" + to_string(me) + "-" + to_string(node);
+      Key key(new String(k.c_str()), (int)node);
+      const char* part = r.table_->serialize(node, nodes);
+      kv_->put(&key, part);
+      delete[] part;
+    }
+    GroupTable mine(*r.table_);
+    mine.merge(*r.table_, me, nodes);
+    for (size_t node = 0; node < nodes; ++node) {
+      if (node == me) continue;
+      string k = string(name) + "-" + to_string(node) + "-" + to_string(me);
+      Key key(new String(k.c_str()), (int)me);
+      const char* part = kv_->takeCharsAndWait(&key);
+      mine.merge(part);
+      delete[] part;
+    }
+    return mine.to_dataframe(kv_);
+  }
+
+  /**
+   * Joins this dataframe, the left side, with other where left_col of
+   * this one equals right_col of other. Both must be int, bool or String
+   * columns of the same type. The result has this dataframe's columns and
+   * then other's, with a row for every pair of rows whose keys are equal.
+   * A left join also keeps each row of this dataframe that meets no row of
+   * other. Columns have no missing values, so such a row gets 0, false,
+   * 0.0 or "" in other's columns. The smaller side is put in a hash table
+   * and the other side probes it a chunk at a time. Rows come out in no
+   * particular order.
+   */
+  DataFrame* join(DataFrame& other, size_t left_col, size_t right_col, bool left = false) {
+    return join_(other, left_col, right_col, left, -1);
+  }
+
+  // join, with the result stored on the given node if any
+  DataFrame* join_(DataFrame& other, size_t left_col, size_t right_col, bool left, int home) {
+    check_join_(other, left_col, right_col);
+    bool build_left = nrows() < other.nrows();
+    DataFrame& build = build_left ? *this : other;
+    JoinTable table(build.nrows());
+    build.column(build_left ? left_col : right_col)->for_each_chunk(table);
+    RowPairs pairs;
+    JoinProbe probe(&table, &pairs, build_left, left && !build_left);
+    (build_left ? other.column(right_col) : column(left_col))->for_each_chunk(probe);
+    if (left && build_left) {
+      for (size_t r = 0; r < table.rows_; ++r) {
+        if (!table.matched_[r]) pairs.push_back(r, NO_ROW);
+      }
+    }
+    return joined_(other, pairs, home);
+  }
+
+  /**
+   * Like join, over the whole cluster; run on every node. Each node
+   * returns its part of the result, stored on it. If the smaller side (the
+   * right side, for a left join) is no bigger than BROADCAST_JOIN_BYTES,
+   * every node reads all of it into a hash table, and probes with the rows
+   * of the other side whose keys are stored on that node. Otherwise both
+   * sides are shuffled. Each node splits the rows stored on it by the hash
+   * of their key and sends each node its rows in one Put per side, under
+   * keys named after the given name. Each node then joins the rows it was
+   * sent.
+   */
+  DataFrame* join(DataFrame& other, size_t left_col, size_t right_col,
+                  const char* name, bool left = false) {
+    check_join_(other, left_col, right_col);
+    size_t me = kv_->index();
+    bool build_left = !left && bytes_() < other.bytes_();
+    DataFrame& build = build_left ? *this : other;
+    if (build.bytes_() <= BROADCAST_JOIN_BYTES) {
+      JoinTable table(build.nrows());
+      build.column(build_left ? left_col : right_col)->for_each_chunk(table);
+      RowPairs pairs;
+      JoinProbe probe(&table, &pairs, build_left, left);
+      Column* pc = build_left ? other.column(right_col) : column(left_col);
+      pc->flush_();
+      ReadAhead ahead;
+      for (size_t c = 0; c < pc->keys_->size(); ++c) {
+        if (pc->keys_->get(c)->getHomeNode() != (int)me) continue;
+        probe.pos_ = c * pc->chunk_len();
+        pc->visit_chunk_(c, probe, &ahead);
+      }
+      return joined_(other, pairs, me);
+    }
+
+    ShuffleRower lrows(left_col, kv_->num_nodes_);
+    ShuffleRower rrows(right_col, kv_->num_nodes_);
+    local_map(lrows);
+    other.local_map(rrows);
+    DataFrame* lpart = shuffled_(*schema_, lrows, name, "l");
+    DataFrame* rpart = shuffled_(*other.schema_, rrows, name, "r");
+    DataFrame* result = lpart->join_(*rpart, left_col, right_col, left, me);
+    delete lpart;
+    delete rpart;
+    return result;
+  }
+
+  // asserts that the key columns can be joined
+  void check_join_(DataFrame& other, size_t left_col, size_t right_col) {
+    assert(left_col < ncols() && right_col < other.ncols());
+    char type = schema_->col_type(left_col);
+    assert(type != 'D' && type == other.schema_->col_type(right_col));
+  }
+
+  // the bytes of all of this dataframe's chunks
+  size_t bytes_() {
+    size_t bytes = 0;
+    for (size_t i = 0; i < ncols(); ++i) bytes += column(i)->bytes();
+    return bytes;
+  }
+
+  // a dataframe of the columns of this one at the left rows of the pairs
+  // and those of other at the right rows, stored on the given node if any
+  DataFrame* joined_(DataFrame& other, RowPairs& pairs, int home) {
+    Schema scm;
+    DataFrame* df = new DataFrame(scm, kv_);
+    for (size_t i = 0; i < ncols(); ++i) {
+      df->add_column(gather_(column(i), pairs.left_, pairs.size(), home));
+    }
+    for (size_t i = 0; i < other.ncols(); ++i) {
+      df->add_column(other.gather_(other.column(i), pairs.right_, pairs.size(), home));
+    }
+    return df;
+  }
+
+  // Sends each other node the rows split off for it, and builds a
+  // dataframe, stored on this node, of the rows every node sent this one.
+  DataFrame* shuffled_(Schema& schema, ShuffleRower& rows, const char* name,
+                       const char* side) {
+    size_t me = kv_->index();
+    for (size_t node = 0; node < kv_->num_nodes_; ++node) {
+      if (node == me) continue;
+      string k = string(name) + "-" + side + "-" + to_string(me) + "-" + to_string(node);
+      Key key(new String(k.c_str()), (int)node);
+      const char* part = rows.part(node);
+      kv_->put(&key, part);
+      delete[] part;
+    }
+    DataFrame* df = new DataFrame(schema, kv_);
+    for (size_t i = 0; i < df->ncols(); ++i) df->cols_[i]->home_ = me;
+    Row row(schema);
+    for (size_t node = 0; node < kv_->num_nodes_; ++node) {
+      const char* part;
+      if (node == me) {
+        part = rows.part(me);
+      } else {
+        string k = string(name) + "-" + side + "-" + to_string(node) + "-" + to_string(me);
+        Key key(new String(k.c_str()), (int)me);
+        part = kv_->takeCharsAndWait(&key);
+      }
+      for (size_t i = 0; part[i] != 0;) {
+        row.read(part, &i);
+        df->add_row(row);
+      }
+      delete[] part;
+    }
+    df->finalize_all();
+    return df;
+  }
+
+  /**
+   * A new dataframe of this one's rows, sorted by their values in the
+   * given column, ascending or descending. Rows with equal values keep
+   * their order. Each chunk of the column is sorted on its own, on the
+   * given number of threads, into a run of row numbers (see SortRun),
+   * and the runs are merged, copying each row into the new columns as it
+   * comes out. If the runs would take more than SORT_BUDGET bytes, they
+   * are written to a temporary file as they are sorted and merged from
+   * there, SORT_FAN_IN at a time (see RunMerger::narrow). Since the
+   * result's chunks hold consecutive ranges of the column's values, range
+   * scans of it skip most of them.
+   * @returns the sorted dataframe, or nullptr if the runs could not be
+   *          written to disk or read back
+   */
+  DataFrame* sort_by(size_t col, bool asc = true, size_t threads = 1) {
+    return sort_by_(col, asc, threads, -1);
+  }
+
+  // sort_by, with the result stored on the given node if any
+  DataFrame* sort_by_(size_t col, bool asc, size_t threads, int home) {
+    assert(col < ncols());
+    Column* key = column(col);
+    key->flush_();
+    size_t chunks = key->keys_->size();
+    size_t bytes = nrows() * 2 * sizeof(size_t);
+    if (schema_->col_type(col) == 'S') bytes += key->bytes();
+    SpillFile* files[2] = {nullptr, nullptr};
+    if (bytes > SORT_BUDGET) {
+      files[0] = new SpillFile();
+      files[1] = new SpillFile();
+    }
+    SortRun** runs = new SortRun*[chunks];
+    SortTask** tasks = new SortTask*[chunks];
+    {
+      ThreadPool pool(threads);
+      for (size_t c = 0; c < chunks; ++c) {
+        runs[c] = new SortRun(c * key->chunk_len(), asc);
+        tasks[c] = new SortTask(key, c, runs[c], files[0]);
+        pool.submit(tasks[c]);
+      }
+      pool.wait();
+    }
+    for (size_t c = 0; c < chunks; ++c) delete tasks[c];
+    delete[] tasks;
+    bool ok = true;
+    for (size_t c = 0; c < chunks; ++c) ok = ok && !runs[c]->failed_;
+    if (ok && files[0] != nullptr) ok = RunMerger::narrow(&runs, &chunks, &files[0], &files[1]);
+    DataFrame* df = ok ? merged_(runs, chunks, home) : nullptr;
+    for (size_t c = 0; c < chunks; ++c) {
+      ok = ok && !runs[c]->failed_;
+      delete runs[c];
+    }
+    delete[] runs;
+    delete files[0];
+    delete files[1];
+    if (ok) return df;
+    delete df;
+    return nullptr;
+  }
+
+  // a dataframe of this one's rows in the order the given sorted runs
+  // merge them in, stored on the given node if any
+  DataFrame* merged_(SortRun** runs, size_t n, int home) {
+    Schema scm(*schema_);
+    DataFrame* df = new DataFrame(scm, kv_);
+    ColumnCursor** cursors = new ColumnCursor*[ncols()];
+    for (size_t i = 0; i < ncols(); ++i) {
+      cursors[i] = new ColumnCursor(column(i));
+      df->cols_[i]->home_ = home;
+    }
+    RunMerger merger(runs, n);
+    for (size_t r; merger.next(&r);) {
+      for (size_t i = 0; i < ncols(); ++i) {
+        Column* c = df->cols_[i];
+        char type = c->get_type();
+        if (type == 'I') c->push_back(cursors[i]->get_int(r));
+        else if (type == 'B') c->push_back(cursors[i]->get_bool(r));
+        else if (type == 'D') c->push_back(cursors[i]->get_double(r));
+        else c->push_back(cursors[i]->get_string(r)->clone());
+      }
+    }
+    df->schema_->numrows_ = nrows();
+    df->finalize_all();
+    for (size_t i = 0; i < ncols(); ++i) delete cursors[i];
+    delete[] cursors;
+    return df;
+  }
+
+  /**
+   * Like sort_by, over the whole cluster; run on every node. Each node
+   * returns its part of the result, stored on it: node 0 the smallest
+   * values (the largest, descending), the last node the largest. Each
+   * node samples about SORT_SAMPLES values of the column stored on it and
+   * sends them to node 0, which sorts the samples and picks one splitter
+   * per node boundary from them, evenly spaced, and sends the splitters
+   * to every node. Each node then sends every row stored on it to the
+   * node whose range between splitters holds its value, and sorts the
+   * rows it was sent. Keys are named after the given name.
+   * @returns this node's part, or nullptr if sorting it failed like
+   *          sort_by's can
+   */
+  DataFrame* sort_by(size_t col, bool asc, const char* name) {
+    assert(col < ncols());
+    size_t me = kv_->index();
+    size_t nodes = kv_->num_nodes_;
+    bool strings = schema_->col_type(col) == 'S';
+    Column* key = column(col);
+    key->flush_();
+    size_t local = 0;
+    for (size_t c = 0; c < key->keys_->size(); ++c) {
+      if (key->keys_->get(c)->getHomeNode() == (int)me) local += key->chunk_len();
+    }
+    SortSampler sampler(asc, local / SORT_SAMPLES + 1);
+    ReadAhead ahead;
+    for (size_t c = 0; c < key->keys_->size(); ++c) {
+      if (key->keys_->get(c)->getHomeNode() == (int)me) key->visit_chunk_(c, sampler, &ahead);
+    }
+    sampler.samples_.push_back('\0');
+
+    SortRun splitters(0, asc);
+    string prefix = string(name) + "-";
+    if (me != 0) {
+      Key sk(new String((prefix + "sample-" + to_string(me)).c_str()), 0);
+      kv_->put(&sk, sampler.samples_.data());
+      Key k(new String((prefix + "split-" + to_string(me)).c_str()), (int)me);
+      const char* text = kv_->takeCharsAndWait(&k);
+      splitters.read(&text, 1, strings);
+      delete[] text;
+    } else {
+      const char** texts = new const char*[nodes];
+      texts[0] = sampler.samples_.data();
+      for (size_t node = 1; node < nodes; ++node) {
+        Key k(new String((prefix + "sample-" + to_string(node)).c_str()), 0);
+        texts[node] = kv_->takeCharsAndWait(&k);
+      }
+      SortRun samples(0, asc);
+      samples.read(texts, nodes, strings);
+      samples.sort();
+      for (size_t node = 1; node < nodes; ++node) delete[] texts[node];
+      delete[] texts;
+      ByteArray chosen;
+      for (size_t node = 1; node < nodes && samples.n_ > 0; ++node) {
+        samples.write(node * samples.n_ / nodes, &chosen);
+      }
+      chosen.push_back('\0');
+      for (size_t node = 1; node < nodes; ++node) {
+        Key k(new String((prefix + "split-" + to_string(node)).c_str()), (int)node);
+        kv_->put(&k, chosen.data());
+      }
+      const char* text = chosen.data();
+      splitters.read(&text, 1, strings);
+    }
+
+    RangeRower rows(col, nodes, &splitters);
+    local_map(rows);
+    DataFrame* part = shuffled_(*schema_, rows, name, "s");
+    DataFrame* result = part->sort_by_(col, asc, 1, me);
+    delete part;
+    return result;
+  }
+
+  // The fewest rows that end on a chunk boundary in every column, which
+  // are the units pmap splits the rows into.
+  size_t split_len_() {
+    size_t len = 1;
+    for (size_t i = 0; i < ncols(); ++i) {
+      size_t a = len;
+      size_t b = column(i)->chunk_len();
+      while (b != 0) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+      }
+      len = len / a * column(i)->chunk_len();
+    }
+    return len;
+  }
+
+  // Fetches every chunk of the dataframe up front, one round trip per
+  // node, if they all fit comfortably in the chunk cache. Otherwise they
+  // would evict each other, so they are fetched as the scan reaches them.
+  void preload_() {
+    size_t bytes = 0;
+    for (size_t i = 0; i < ncols(); ++i) bytes += column(i)->bytes();
+    if (bytes > kv_->cache_->budget_ / 2) return;
+    for (size_t i = 0; i < ncols(); ++i) column(i)->preload();
+  }
 };
 
+/**
+ * Visits one range of the rows of a dataframe with one rower, reading the
+ * columns through cursors of its own. Run by DataFrame::pmap.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class PMapTask : public Task {
+public:
+  DataFrame* df_;
+  Rower* rower_;   // not owned
+  size_t start_;   // first row to visit
+  size_t end_;     // one past the last row to visit
+
+  PMapTask(DataFrame* df, Rower* rower, size_t start, size_t end) {
+    df_ = df;
+    rower_ = rower;
+    start_ = start;
+    end_ = end;
+  }
+
+  void run() {
+    size_t width = df_->ncols();
+    ColumnCursor** cursors = new ColumnCursor*[width];
+    for (size_t i = 0; i < width; ++i) cursors[i] = new ColumnCursor(df_->column(i));
+    Row row(*df_->schema_);
+    for (size_t i = start_; i < end_; ++i) {
+      df_->fill_row(i, row, cursors);
+      rower_->accept(row);
+    }
+    for (size_t i = 0; i < width; ++i) delete cursors[i];
+    delete[] cursors;
+  }
+};
+
+void DataFrame::pmap(Rower& r, size_t threads) {
+  size_t step = split_len_();
+  size_t pieces = (nrows() + step - 1) / step;
+  if (threads > pieces) threads = pieces;
+  if (threads <= 1) {
+    map(r);
+    return;
+  }
+  preload_();
+
+  // clone every rower before any of them starts changing r
+  Rower** rowers = new Rower*[threads];
+  rowers[0] = &r;
+  for (size_t t = 1; t < threads; ++t) rowers[t] = r.clone();
+
+  PMapTask** tasks = new PMapTask*[threads];
+  ThreadPool pool(threads);
+  for (size_t t = 0; t < threads; ++t) {
+    size_t start = pieces * t / threads * step;
+    size_t end = pieces * (t + 1) / threads * step;
+    if (end > nrows()) end = nrows();
+    tasks[t] = new PMapTask(this, rowers[t], start, end);
+    pool.submit(tasks[t]);
+  }
+  pool.wait();
+
+  for (size_t t = 0; t < threads; ++t) {
+    if (t > 0) r.join_delete(rowers[t]);
+    delete tasks[t];
+  }
+  delete[] tasks;
+  delete[] rowers;
+}
+
+DataFrame* GroupTable::to_dataframe(KVStore* kv) {
+  Schema scm;
+  DataFrame* df = new DataFrame(scm, kv);
+  size_t naggs = aggs_->size();
+  for (size_t k = 0; k < num_keys_; ++k) {
+    Column* c = df->get_new_col_(key_types_[k]);
+    for (size_t g = 0; g < groups_; ++g) {
+      size_t at = g * num_keys_ + k;
+      if (key_types_[k] == 'I') c->push_back((int)ikeys_[at]);
+      else if (key_types_[k] == 'B') c->push_back(ikeys_[at] != 0);
+      else c->push_back(skeys_[at]->clone());
+    }
+    c->finalize();
+    df->add_column(c);
+  }
+  for (size_t a = 0; a < naggs; ++a) {
+    char op = aggs_->ops_[a];
+    Column* c = df->get_new_col_(op == 'c' ? 'I' : 'D');
+    for (size_t g = 0; g < groups_; ++g) {
+      if (op == 'c') c->push_back((int)counts_[g]);
+      else if (op == 'm') c->push_back(accs_[g * naggs + a] / counts_[g]);
+      else c->push_back(accs_[g * naggs + a]);
+    }
+    c->finalize();
+    df->add_column(c);
+  }
+  return df;
+}
+
 /*************************************************************************
  * DFArray::
  * Holds DF pointers. The strings are external.  Nullptr is a valid
@@ -471,7 +1268,7 @@ DataFrame* DataFrame::from_array(Key* key, KVStore* kv, size_t sz, Array* from)
     StringArray* sa = from->as_string();
     StringColumn* sc = c->as_string();
     for (size_t i = 0; i < sz; ++i) {
-      sc->push_back(sa->get(i));
+      sc->push_back(sa->get(i)->clone());
     }
     sc->finalize();
     df->schema_->add_column('S');
@@ -569,7 +1366,7 @@ DataFrame* DataFrame::from_scalar(Key* key, KVStore* kv, String* val) {
 
   Column* c = get_new_col_('S');
   StringColumn* sc = c->as_string();
-  sc->push_back(val);
+  sc->push_back(val->clone());
   df->schema_->add_column('S');
   df->schema_->numrows_ = 1;
   sc->finalize();
@@ -593,23 +1390,22 @@ DataFrame* KVStore::get(Key* key) {
   DataFrame df_(scm, this);
   // this chunk is stored here
   if (key->getHomeNode() == (int)index()) {
-    int ind = -1;
-    for (size_t i = 0; i < size_; ++i) {
-      if (key->equals(keys_->get(i))) {
-        ind = i;
-        break;
-      }
-    }
-    if (ind == -1) {
+    lock_.lock();
+    int ind = find(key);
+    char* val = ind == -1 ? nullptr : duplicate(values_->get(ind)->c_str());
+    lock_.unlock();
+    if (val == nullptr) {
       return nullptr;
     }
-    DataFrame* df = df_.get_dataframe(values_->get(ind)->c_str());
+    DataFrame* df = df_.get_dataframe(val);
+    delete[] val;
     return df;
   } else {
     Get g(index(), key->getHomeNode(), msg_id_++, key);
-    send_m(&g);
-    Reply* r = dynamic_cast<Reply*>(recv_m());
-    return df_.get_dataframe(r->value_);
+    Reply* r = request_(&g);
+    DataFrame* df = r->had_it_ ? df_.get_dataframe(r->value_) : nullptr;
+    delete r;
+    return df;
   }
 }
 
@@ -619,86 +1415,38 @@ DataFrame* KVStore::get(Key* key) {
  * @returns the value that corresponds with the given key
  */
 DataFrame* KVStore::getAndWait(Key* key) {
-
-  //printf("GET AND WAIT CALLED by %zu\n", index());
-
   Schema scm("");
   DataFrame df_(scm, this);
-  size_t to_node = key->getHomeNode();
-  bool found = false;
-  //cout << key->getName()->c_str() << ' ' << key->getHomeNode() << endl;
-  // No need for networking if key is in this node.
-  if (to_node == index()) {
-    while(!found) {
-      for (size_t i = 0; i < keys_->size(); i++) {
-        if (keys_->get(i)->equals(key)) {
-          found = true;
-          //printf("GET AND WAIT RETURNED FOR %zu\n", index());
-          return df_.get_dataframe(values_->get(i)->c_str());
-        }
-      }
-    }
-  } else {
-    // Need to request from a different node.
-    bool had_it = false;
-    const char* val;
-    while (!had_it) {
-      Get g(index(), to_node, msg_id_++, key);
-      send_m(&g);
-      Message* msg = recv_m();
-
-      // Handle other types of messages while waiting for a reply.
-      while(msg->kind_ != MsgKind::Reply){
-        handle_message(msg);
-        msg = recv_m();
-      }
-
-      Reply* r = dynamic_cast<Reply*>(msg);
-      if (r->had_it_) {
-        had_it = true;
-        val = r->value_;
-      } else {
-        // Try again until the reply has a value.
-        cout << "\033[0;31mNODE DID NOT HAVE VALUE. TRYING AGAIN.\033[0m" << endl;
-        getAndWait(key);
-      }
-    }
-    return df_.get_dataframe(val);
-  }
-  return nullptr;
+  const char* val = getCharsAndWait(key);
+  DataFrame* df = df_.get_dataframe(val);
+  delete[] val;
+  return df;
 }
 
 /**
  * Gets the dataframe at a specific key as chars. Blocking.
  * @param key: the key whose value we want to get
- * @returns the value that corresponds with the given key
+ * @returns a copy of the value that corresponds with the given key
  */
 const char* KVStore::getCharsAndWait(Key* key) {
-  printf("GET AND WAIT CALLED by %zu\n", index());
-  Schema scm("");
-  DataFrame df_(scm, this);
   size_t to_node = key->getHomeNode();
-  bool found = false;
   // No need for networking if key is in this node.
   if (to_node == index()) {
-    while(!found) {
-      for (size_t i = 0; i < keys_->size(); i++) {
-        if (keys_->get(i)->equals(key)) {
-          found = true;
-          printf("GET AND WAIT RETURNED FOR %zu\n", index());
-          return values_->get(i)->c_str();
-        }
-      }
-    }
+    // every insert notifies the lock, so sleep until ours arrives
+    lock_.lock();
+    int ind;
+    while ((ind = find(key)) == -1) lock_.wait();
+    char* val = duplicate(values_->get(ind)->c_str());
+    lock_.unlock();
+    return val;
   } else {
-    // Need to request from a different node.
-    // TODO FIX BLOCKING
+    // Need to request from a different node, which replies once it has it.
     WaitAndGet g(index(), to_node, msg_id_++, key);
-    send_m(&g);
-    Reply* r = dynamic_cast<Reply*>(recv_m());
-    return r->value_;
+    Reply* r = request_(&g);
+    char* val = duplicate(r->value_);
+    delete r;
+    return val;
   }
-  return nullptr;
 }
 
 /**
@@ -720,9 +1468,9 @@ void KVStore::put(Key* key, DataFrame* value) {
   // does this chunk belong here
   if (key->getHomeNode() == (int)index()) {
     // yes - add to map
-    keys_->push_back(key);
-    values_->push_back(new String(df_.serialize(value)));
-    ++size_;
+    const char* ser = df_.serialize(value);
+    insert_(key, new String(ser));
+    delete[] ser;
   } else {
     // TODO: no - send to correct node
   }
@@ -0,0 +1,430 @@
+// lang::CwC
+
+#pragma once
+#include "row.h"
+#include "schema.h"
+#include "column.h"
+#include "array.h"
+#include "string.h"
+
+/**
+ * The aggregates a group_by computes for each group, in order. Each is
+ * one of 'c' (count of rows), 's' (sum), 'n' (min), 'x' (max) or 'm'
+ * (mean) of an int, double or bool (as 0 or 1) column.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class Aggs : public Object {
+public:
+  char* ops_;
+  size_t* cols_;     // column each aggregate reads; unused for a count
+  size_t size_;
+  size_t capacity_;
+
+  Aggs() {
+    size_ = 0;
+    capacity_ = 4;
+    ops_ = new char[capacity_];
+    cols_ = new size_t[capacity_];
+  }
+
+  Aggs(Aggs& from) : Aggs() {
+    for (size_t a = 0; a < from.size_; ++a) add_(from.ops_[a], from.cols_[a]);
+  }
+
+  ~Aggs() {
+    delete[] ops_;
+    delete[] cols_;
+  }
+
+  Aggs& count() { return add_('c', 0); }
+  Aggs& sum(size_t col) { return add_('s', col); }
+  Aggs& min(size_t col) { return add_('n', col); }
+  Aggs& max(size_t col) { return add_('x', col); }
+  Aggs& mean(size_t col) { return add_('m', col); }
+
+  size_t size() {
+    return size_;
+  }
+
+  Aggs& add_(char op, size_t col) {
+    if (size_ == capacity_) {
+      char* ops = new char[capacity_ * 2];
+      size_t* cols = new size_t[capacity_ * 2];
+      memcpy(ops, ops_, size_);
+      memcpy(cols, cols_, size_ * sizeof(size_t));
+      delete[] ops_;
+      delete[] cols_;
+      ops_ = ops;
+      cols_ = cols;
+      capacity_ *= 2;
+    }
+    ops_[size_] = op;
+    cols_[size_++] = col;
+    return *this;
+  }
+};
+
+/**
+ * A hash table of groups of rows that agree on their key columns, each
+ * with a running count and aggregates. The table is open addressed and
+ * probed linearly. Each slot is one 64-bit word, holding the top half of
+ * its group's hash and the group's number. A probe reads consecutive words
+ * and looks at a group's keys only when the hash matches. The groups'
+ * keys and aggregates live in flat arrays indexed by group number.
+ * Key columns may be int, bool or String columns. Owns copies of its
+ * String keys.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class GroupTable : public Object {
+public:
+  size_t num_keys_;
+  size_t* key_cols_;   // owned; columns of the rows grouped on
+  char* key_types_;    // owned; their types
+  Aggs* aggs_;         // owned
+  size_t groups_;      // number of groups
+  size_t capacity_;    // room for groups in the arrays below
+  uint64_t* hashes_;   // hash of each group's keys
+  int64_t* ikeys_;     // num_keys_ per group; int and bool keys
+  String** skeys_;     // num_keys_ per group; owned String keys
+  size_t* counts_;     // rows in each group
+  double* accs_;       // aggs_->size() per group; running aggregates
+  uint64_t* slots_;    // 0 if empty, else hash >> 32 << 32 | (group + 1)
+  size_t mask_;        // number of slots - 1, a power of two less one
+  int64_t* row_ikeys_; // the keys of the row being added
+  String** row_skeys_;
+
+  GroupTable(Schema& schema, IntArray& key_cols, Aggs& aggs) {
+    num_keys_ = key_cols.size();
+    key_cols_ = new size_t[num_keys_];
+    key_types_ = new char[num_keys_];
+    for (size_t k = 0; k < num_keys_; ++k) {
+      key_cols_[k] = key_cols.get(k);
+      assert(key_cols_[k] < schema.width());
+      key_types_[k] = schema.col_type(key_cols_[k]);
+      assert(key_types_[k] != 'D');
+    }
+    aggs_ = new Aggs(aggs);
+    for (size_t a = 0; a < aggs_->size(); ++a) {
+      if (aggs_->ops_[a] == 'c') continue;
+      assert(aggs_->cols_[a] < schema.width());
+      assert(schema.col_type(aggs_->cols_[a]) != 'S');
+    }
+    init_();
+  }
+
+  GroupTable(GroupTable& from) {
+    num_keys_ = from.num_keys_;
+    key_cols_ = new size_t[num_keys_];
+    key_types_ = new char[num_keys_];
+    memcpy(key_cols_, from.key_cols_, num_keys_ * sizeof(size_t));
+    memcpy(key_types_, from.key_types_, num_keys_);
+    aggs_ = new Aggs(*from.aggs_);
+    init_();
+  }
+
+  ~GroupTable() {
+    for (size_t i = 0; i < groups_ * num_keys_; ++i) delete skeys_[i];
+    delete[] key_cols_;
+    delete[] key_types_;
+    delete aggs_;
+    delete[] hashes_;
+    delete[] ikeys_;
+    delete[] skeys_;
+    delete[] counts_;
+    delete[] accs_;
+    delete[] slots_;
+    delete[] row_ikeys_;
+    delete[] row_skeys_;
+  }
+
+  void init_() {
+    groups_ = 0;
+    capacity_ = 64;
+    hashes_ = new uint64_t[capacity_];
+    ikeys_ = new int64_t[capacity_ * num_keys_];
+    skeys_ = new String*[capacity_ * num_keys_];
+    counts_ = new size_t[capacity_];
+    accs_ = new double[capacity_ * aggs_->size()];
+    mask_ = 2 * capacity_ - 1;
+    slots_ = new uint64_t[mask_ + 1];
+    memset(slots_, 0, (mask_ + 1) * sizeof(uint64_t));
+    row_ikeys_ = new int64_t[num_keys_];
+    row_skeys_ = new String*[num_keys_];
+  }
+
+  size_t size() {
+    return groups_;
+  }
+
+  /** Counts the row into its group, starting the group if it is new. */
+  void add(Row& row) {
+    uint64_t h = 0;
+    for (size_t k = 0; k < num_keys_; ++k) {
+      size_t c = key_cols_[k];
+      if (key_types_[k] == 'S') {
+        row_skeys_[k] = row.get_string(c);
+        row_ikeys_[k] = 0;
+        h = mix_(h ^ row_skeys_[k]->hash());
+      } else {
+        row_ikeys_[k] = key_types_[k] == 'I' ? row.get_int(c) : row.get_bool(c);
+        row_skeys_[k] = nullptr;
+        h = mix_(h ^ (uint64_t)row_ikeys_[k]);
+      }
+    }
+    size_t g = find_(h, row_ikeys_, row_skeys_);
+    double* acc = &accs_[g * aggs_->size()];
+    bool first = counts_[g]++ == 0;
+    for (size_t a = 0; a < aggs_->size(); ++a) {
+      char op = aggs_->ops_[a];
+      if (op == 'c') continue;
+      size_t c = aggs_->cols_[a];
+      char type = row.col_type(c);
+      double v = type == 'I' ? row.get_int(c)
+               : type == 'D' ? row.get_double(c) : row.get_bool(c);
+      if (op == 's' || op == 'm') acc[a] += v;
+      else if (first || (op == 'n' ? v < acc[a] : v > acc[a])) acc[a] = v;
+    }
+  }
+
+  /** Folds in every group of another table over the same keys and
+   *  aggregates. */
+  void merge(GroupTable& other) {
+    for (size_t g = 0; g < other.groups_; ++g) merge_group_(other, g);
+  }
+
+  /** Like merge, taking only the groups owned by the given node of a
+   *  cluster of the given size. */
+  void merge(GroupTable& other, size_t node, size_t nodes) {
+    for (size_t g = 0; g < other.groups_; ++g) {
+      if (owner(other.hashes_[g], nodes) == node) merge_group_(other, g);
+    }
+  }
+
+  /** The node of a cluster of the given size that owns the group with the
+   *  given hash. */
+  static size_t owner(uint64_t hash, size_t nodes) {
+    return (hash >> 16) % nodes;
+  }
+
+  /**
+   * Writes the groups owned by the given node of a cluster of the given
+   * size, one to a line: its keys, its count and its aggregates. Strings
+   * are written as their length, a colon and their bytes.
+   */
+  const char* serialize(size_t node, size_t nodes) {
+    ByteArray out;
+    char buf[32];
+    size_t naggs = aggs_->size();
+    for (size_t g = 0; g < groups_; ++g) {
+      if (owner(hashes_[g], nodes) != node) continue;
+      for (size_t k = 0; k < num_keys_; ++k) {
+        String* s = skeys_[g * num_keys_ + k];
+        if (s == nullptr) {
+          snprintf(buf, sizeof(buf), "%lld ", (long long)ikeys_[g * num_keys_ + k]);
+          out.push_string(buf);
+        } else {
+          snprintf(buf, sizeof(buf), "%zu:", s->size());
+          out.push_string(buf);
+          out.append(s->c_str(), s->size());
+          out.push_back(' ');
+        }
+      }
+      snprintf(buf, sizeof(buf), "%zu", counts_[g]);
+      out.push_string(buf);
+      for (size_t a = 0; a < naggs; ++a) {
+        snprintf(buf, sizeof(buf), " %.17g", accs_[g * naggs + a]);
+        out.push_string(buf);
+      }
+      out.push_back('\n');
+    }
+    out.push_back(0);
+    char* str = new char[out.size()];
+    memcpy(str, out.data(), out.size());
+    return str;
+  }
+
+  /** Folds in the groups written by serialize on a table over the same
+   *  keys and aggregates. */
+  void merge(const char* str) {
+    GroupTable part(*this);
+    char* at = (char*)str;
+    size_t naggs = aggs_->size();
+    while (*at != 0) {
+      uint64_t h = 0;
+      for (size_t k = 0; k < num_keys_; ++k) {
+        if (key_types_[k] == 'S') {
+          size_t len = strtoull(at, &at, 10);
+          part.row_skeys_[k] = new String(at + 1, len);
+          part.row_ikeys_[k] = 0;
+          at += len + 2;
+          h = mix_(h ^ part.row_skeys_[k]->hash());
+        } else {
+          part.row_ikeys_[k] = strtoll(at, &at, 10);
+          part.row_skeys_[k] = nullptr;
+          h = mix_(h ^ (uint64_t)part.row_ikeys_[k]);
+        }
+      }
+      size_t g = part.find_(h, part.row_ikeys_, part.row_skeys_);
+      for (size_t k = 0; k < num_keys_; ++k) delete part.row_skeys_[k];
+      part.counts_[g] = strtoull(at, &at, 10);
+      for (size_t a = 0; a < naggs; ++a) part.accs_[g * naggs + a] = strtod(at, &at);
+      assert(*at == '\n');
+      ++at;
+    }
+    merge(part);
+  }
+
+  /**
+   * Builds a dataframe with a row per group: its keys, in the key columns'
+   * types, then its aggregates. A count is an int column; sums, mins,
+   * maxes and means are double columns.
+   */
+  DataFrame* to_dataframe(KVStore* kv);
+
+  // folds group g of other into this table
+  void merge_group_(GroupTable& other, size_t g) {
+    size_t mine = find_(other.hashes_[g], &other.ikeys_[g * num_keys_],
+                        &other.skeys_[g * num_keys_]);
+    size_t naggs = aggs_->size();
+    double* acc = &accs_[mine * naggs];
+    double* from = &other.accs_[g * naggs];
+    bool first = counts_[mine] == 0;
+    counts_[mine] += other.counts_[g];
+    for (size_t a = 0; a < naggs; ++a) {
+      char op = aggs_->ops_[a];
+      if (op == 's' || op == 'm') acc[a] += from[a];
+      else if (op == 'n') acc[a] = first || from[a] < acc[a] ? from[a] : acc[a];
+      else if (op == 'x') acc[a] = first || from[a] > acc[a] ? from[a] : acc[a];
+    }
+  }
+
+  // the group with the given hash and keys, started empty if there is none
+  size_t find_(uint64_t h, int64_t* ikeys, String** skeys) {
+    uint64_t tag = h >> 32 << 32;
+    for (size_t s = h & mask_;; s = (s + 1) & mask_) {
+      uint64_t slot = slots_[s];
+      if (slot == 0) {
+        size_t g = start_(h, ikeys, skeys);
+        slots_[s] = tag | (g + 1);
+        if (2 * groups_ > mask_) grow_slots_();
+        return g;
+      }
+      if ((slot >> 32 << 32) != tag) continue;
+      size_t g = (slot & 0xFFFFFFFF) - 1;
+      if (same_keys_(g, ikeys, skeys)) return g;
+    }
+  }
+
+  bool same_keys_(size_t g, int64_t* ikeys, String** skeys) {
+    for (size_t k = 0; k < num_keys_; ++k) {
+      String* s = skeys_[g * num_keys_ + k];
+      if (s == nullptr) {
+        if (ikeys_[g * num_keys_ + k] != ikeys[k]) return false;
+      } else if (!s->equals(skeys[k])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // appends an empty group with the given hash and keys
+  size_t start_(uint64_t h, int64_t* ikeys, String** skeys) {
+    if (groups_ == capacity_) grow_groups_();
+    size_t g = groups_++;
+    hashes_[g] = h;
+    for (size_t k = 0; k < num_keys_; ++k) {
+      ikeys_[g * num_keys_ + k] = ikeys[k];
+      skeys_[g * num_keys_ + k] = skeys[k] == nullptr ? nullptr : skeys[k]->clone();
+    }
+    counts_[g] = 0;
+    for (size_t a = 0; a < aggs_->size(); ++a) accs_[g * aggs_->size() + a] = 0;
+    return g;
+  }
+
+  void grow_groups_() {
+    size_t cap = capacity_ * 2;
+    size_t naggs = aggs_->size();
+    uint64_t* hashes = new uint64_t[cap];
+    int64_t* ikeys = new int64_t[cap * num_keys_];
+    String** skeys = new String*[cap * num_keys_];
+    size_t* counts = new size_t[cap];
+    double* accs = new double[cap * naggs];
+    memcpy(hashes, hashes_, groups_ * sizeof(uint64_t));
+    memcpy(ikeys, ikeys_, groups_ * num_keys_ * sizeof(int64_t));
+    memcpy(skeys, skeys_, groups_ * num_keys_ * sizeof(String*));
+    memcpy(counts, counts_, groups_ * sizeof(size_t));
+    memcpy(accs, accs_, groups_ * naggs * sizeof(double));
+    delete[] hashes_;
+    delete[] ikeys_;
+    delete[] skeys_;
+    delete[] counts_;
+    delete[] accs_;
+    hashes_ = hashes;
+    ikeys_ = ikeys;
+    skeys_ = skeys;
+    counts_ = counts;
+    accs_ = accs;
+    capacity_ = cap;
+  }
+
+  // doubles the slots, putting each group back where its hash leads
+  void grow_slots_() {
+    delete[] slots_;
+    mask_ = 2 * mask_ + 1;
+    slots_ = new uint64_t[mask_ + 1];
+    memset(slots_, 0, (mask_ + 1) * sizeof(uint64_t));
+    for (size_t g = 0; g < groups_; ++g) {
+      size_t s = hashes_[g] & mask_;
+      while (slots_[s] != 0) s = (s + 1) & mask_;
+      slots_[s] = hashes_[g] >> 32 << 32 | (g + 1);
+    }
+  }
+
+  // spreads the bits of a key's hash over all 64
+  static uint64_t mix_(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+};
+
+/**
+ * Groups the rows it visits into a GroupTable. Clones start empty tables
+ * over the same keys and aggregates and are joined by merging, so pmap
+ * builds one table per thread and merges them at the end.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class GroupRower : public Rower {
+public:
+  GroupTable* table_;  // owned
+
+  GroupRower(Schema& schema, IntArray& key_cols, Aggs& aggs) {
+    table_ = new GroupTable(schema, key_cols, aggs);
+  }
+
+  GroupRower(GroupTable& like) {
+    table_ = new GroupTable(like);
+  }
+
+  ~GroupRower() {
+    delete table_;
+  }
+
+  bool accept(Row& r) {
+    table_->add(r);
+    return false;
+  }
+
+  void join_delete(Rower* other) {
+    GroupRower* o = dynamic_cast<GroupRower*>(other);
+    table_->merge(*o->table_);
+    delete o;
+  }
+
+  Rower* clone() {
+    return new GroupRower(*table_);
+  }
+};
@@ -0,0 +1,265 @@
+// lang::CwC
+
+#pragma once
+#include "group.h"
+
+// row number standing for no row, on the side of a left join that missed
+size_t NO_ROW = (size_t)-1;
+
+// largest dataframe, in bytes, a cluster join copies to every node rather
+// than shuffling both sides by key
+size_t BROADCAST_JOIN_BYTES = 16 * 1024 * 1024;
+
+/**
+ * Pairs of row numbers, one from each side of a join, that belong in the
+ * same row of its result.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class RowPairs : public Object {
+public:
+  size_t* left_;
+  size_t* right_;
+  size_t size_;
+  size_t capacity_;
+
+  RowPairs() {
+    size_ = 0;
+    capacity_ = 1024;
+    left_ = new size_t[capacity_];
+    right_ = new size_t[capacity_];
+  }
+
+  ~RowPairs() {
+    delete[] left_;
+    delete[] right_;
+  }
+
+  void push_back(size_t left, size_t right) {
+    if (size_ == capacity_) {
+      size_t* l = new size_t[capacity_ * 2];
+      size_t* r = new size_t[capacity_ * 2];
+      memcpy(l, left_, size_ * sizeof(size_t));
+      memcpy(r, right_, size_ * sizeof(size_t));
+      delete[] left_;
+      delete[] right_;
+      left_ = l;
+      right_ = r;
+      capacity_ *= 2;
+    }
+    left_[size_] = left;
+    right_[size_++] = right;
+  }
+
+  size_t size() {
+    return size_;
+  }
+};
+
+/**
+ * A hash table from the values of one int, bool or String column, the
+ * build side of a join, to the rows holding them. It is filled by visiting
+ * the column's chunks in order. Rows with equal hashes are chained through
+ * next_, and each bucket of heads_ holds the first row of its chain, so
+ * the whole table is a few flat arrays. Owns copies of its String keys.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class JoinTable : public SpanVisitor {
+public:
+  size_t rows_;        // rows added so far
+  uint64_t* hashes_;   // hash of each row's key
+  int64_t* ikeys_;     // each row's int or bool key
+  String** skeys_;     // or its String key, owned
+  size_t* heads_;      // each bucket's first row, plus one; 0 if empty
+  size_t* next_;       // the next row of each row's chain, plus one
+  bool* matched_;      // whether each row has met a probe
+  size_t mask_;        // number of buckets - 1
+
+  /** An empty table with room for the given number of rows. */
+  JoinTable(size_t rows) {
+    rows_ = 0;
+    hashes_ = new uint64_t[rows];
+    ikeys_ = new int64_t[rows];
+    skeys_ = new String*[rows];
+    next_ = new size_t[rows];
+    matched_ = new bool[rows];
+    memset(matched_, 0, rows);
+    mask_ = 15;
+    while (mask_ + 1 < 2 * rows) mask_ = 2 * mask_ + 1;
+    heads_ = new size_t[mask_ + 1];
+    memset(heads_, 0, (mask_ + 1) * sizeof(size_t));
+  }
+
+  ~JoinTable() {
+    for (size_t r = 0; r < rows_; ++r) delete skeys_[r];
+    delete[] hashes_;
+    delete[] ikeys_;
+    delete[] skeys_;
+    delete[] next_;
+    delete[] matched_;
+    delete[] heads_;
+  }
+
+  static uint64_t hash(int64_t key) {
+    return GroupTable::mix_((uint64_t)key);
+  }
+
+  static uint64_t hash(String* key) {
+    return GroupTable::mix_(key->hash());
+  }
+
+  void visit(const int* vals, size_t n) {
+    for (size_t i = 0; i < n; ++i) add_(hash(vals[i]), vals[i], nullptr);
+  }
+
+  void visit(const uint8_t* bits, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      int64_t b = (bits[i / 8] >> (i % 8)) & 1;
+      add_(hash(b), b, nullptr);
+    }
+  }
+
+  void visit(String** vals, size_t n) {
+    for (size_t i = 0; i < n; ++i) add_(hash(vals[i]), 0, vals[i]->clone());
+  }
+
+  /** The first row holding the given key, plus one, or 0 if none does. */
+  size_t first(uint64_t h, int64_t ikey, String* skey) {
+    return match_(heads_[h & mask_], h, ikey, skey);
+  }
+
+  /** The row after the given one (plus one) holding the same key, plus
+   *  one, or 0 if there is none. */
+  size_t next(size_t r, uint64_t h, int64_t ikey, String* skey) {
+    return match_(next_[r - 1], h, ikey, skey);
+  }
+
+  // the first row from r (plus one) on along its chain holding the key
+  size_t match_(size_t r, uint64_t h, int64_t ikey, String* skey) {
+    for (; r != 0; r = next_[r - 1]) {
+      size_t row = r - 1;
+      if (hashes_[row] != h) continue;
+      if (skey == nullptr ? ikeys_[row] == ikey : skey->equals(skeys_[row])) return r;
+    }
+    return 0;
+  }
+
+  // adds the next row, pushing it on the front of its bucket's chain
+  void add_(uint64_t h, int64_t ikey, String* skey) {
+    size_t row = rows_++;
+    hashes_[row] = h;
+    ikeys_[row] = ikey;
+    skeys_[row] = skey;
+    next_[row] = heads_[h & mask_];
+    heads_[h & mask_] = row + 1;
+  }
+};
+
+/**
+ * Probes a JoinTable with the values of the key column of the other side
+ * of a join, a chunk at a time, pairing each probing row with every build
+ * row holding the same key. In a left join whose left side probes, a row
+ * that meets no key is paired with NO_ROW.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class JoinProbe : public SpanVisitor {
+public:
+  JoinTable* table_;   // not owned
+  RowPairs* pairs_;    // not owned; where pairs go
+  bool build_left_;    // whether the table holds the left side
+  bool keep_misses_;   // whether to pair missing probe rows with NO_ROW
+  size_t pos_;         // row of the next value visited
+
+  JoinProbe(JoinTable* table, RowPairs* pairs, bool build_left, bool keep_misses) {
+    table_ = table;
+    pairs_ = pairs;
+    build_left_ = build_left;
+    keep_misses_ = keep_misses;
+    pos_ = 0;
+  }
+
+  void visit(const int* vals, size_t n) {
+    for (size_t i = 0; i < n; ++i) probe_(JoinTable::hash(vals[i]), vals[i], nullptr);
+  }
+
+  void visit(const uint8_t* bits, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      int64_t b = (bits[i / 8] >> (i % 8)) & 1;
+      probe_(JoinTable::hash(b), b, nullptr);
+    }
+  }
+
+  void visit(String** vals, size_t n) {
+    for (size_t i = 0; i < n; ++i) probe_(JoinTable::hash(vals[i]), 0, vals[i]);
+  }
+
+  void probe_(uint64_t h, int64_t ikey, String* skey) {
+    size_t r = table_->first(h, ikey, skey);
+    if (r == 0 && keep_misses_) pairs_->push_back(pos_, NO_ROW);
+    for (; r != 0; r = table_->next(r, h, ikey, skey)) {
+      table_->matched_[r - 1] = true;
+      if (build_left_) pairs_->push_back(r - 1, pos_);
+      else pairs_->push_back(pos_, r - 1);
+    }
+    ++pos_;
+  }
+};
+
+/**
+ * Splits the rows it visits by the hash of their key, writing each with
+ * Row::write to the text bound for the node that owns its key. Used to
+ * shuffle both sides of a cluster join; subclasses may pick the node
+ * another way.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class ShuffleRower : public Rower {
+public:
+  size_t col_;          // key column
+  size_t nodes_;
+  ByteArray** parts_;   // owned; the text for each node
+
+  ShuffleRower(size_t col, size_t nodes) {
+    col_ = col;
+    nodes_ = nodes;
+    parts_ = new ByteArray*[nodes];
+    for (size_t n = 0; n < nodes; ++n) parts_[n] = new ByteArray();
+  }
+
+  ~ShuffleRower() {
+    for (size_t n = 0; n < nodes_; ++n) delete parts_[n];
+    delete[] parts_;
+  }
+
+  bool accept(Row& r) {
+    r.write(parts_[node_of_(r)]);
+    return false;
+  }
+
+  /** The node the given row goes to. */
+  virtual size_t node_of_(Row& r) {
+    char type = r.col_type(col_);
+    uint64_t h = type == 'S' ? JoinTable::hash(r.get_string(col_))
+               : JoinTable::hash(type == 'I' ? r.get_int(col_) : r.get_bool(col_));
+    return GroupTable::owner(h, nodes_);
+  }
+
+  void join_delete(Rower* other) {
+    ShuffleRower* o = dynamic_cast<ShuffleRower*>(other);
+    for (size_t n = 0; n < nodes_; ++n) {
+      parts_[n]->append(o->parts_[n]->data(), o->parts_[n]->size());
+    }
+    delete o;
+  }
+
+  Rower* clone() {
+    return new ShuffleRower(col_, nodes_);
+  }
+
+  /** The text bound for the given node, as a new C string. */
+  const char* part(size_t node) {
+    ByteArray* out = parts_[node];
+    char* str = new char[out->size() + 1];
+    if (out->size() > 0) memcpy(str, out->data(), out->size());
+    str[out->size()] = 0;
+    return str;
+  }
+};
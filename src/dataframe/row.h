@@ -2,6 +2,7 @@
 
 #pragma once
 #include "schema.h"
+#include "serial.h"
 
 /** @designers: vitekj@me.com, course staff */
 
@@ -73,100 +74,77 @@ public:
  * This class represents a single row of data constructed according to a
  * dataframe's schema. The purpose of this class is to make it easier to add
  * read/write complete rows. Internally a dataframe hold data in columns.
- * Rows have pointer equality.
+ * The fields of a row live side by side in one buffer, each at an offset
+ * worked out from the schema when the row is built, so setting and getting
+ * fields never allocates. Rows have pointer equality.
  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
  */
 class Row : public Object {
 public:
 
-  // the values of this array as a list of columns as arrays.
-  // each column is of size 1, idx 0 contains the row's val at that col.
-  Array** columns_;
-
   Schema* schema_;    // the schema this row conforms to
   size_t size_;       // the number of fields in the row
   size_t curIdx_;     // the idx of the DF this row represents
+  size_t* offsets_;   // where each field starts in data_
+  char* data_;        // the fields; bools take a byte, Strings a pointer
 
   /** Build a row following a schema. */
   Row(Schema& scm) {
-    // initialize values
     schema_ = new Schema(scm);
     size_ = schema_->width();
     curIdx_ = 0;
-    columns_ = new Array*[schema_->width()];
+    offsets_ = new size_t[size_];
 
-    // for loop to populate columns_ with columns of correct types
-    for (size_t i = 0; i < schema_->width(); ++i) {
-      char type = schema_->col_type(i);
-      Array* c;
-      if (type == 'I') {
-        c = new IntArray();
-      } else if (type == 'B') {
-        c = new BoolArray();
-      } else if (type == 'D') {
-        c = new DoubleArray();
-      } else if (type == 'S') {
-        c = new StringArray();
-      } else {
-        assert(false);
-      }
-      columns_[i] = c;
+    // give each field a slot aligned to its size
+    size_t len = 0;
+    for (size_t i = 0; i < size_; ++i) {
+      size_t width = field_size_(schema_->col_type(i));
+      len = (len + width - 1) / width * width;
+      offsets_[i] = len;
+      len += width;
     }
+    data_ = new char[len == 0 ? 1 : len];
+    memset(data_, 0, len);
   }
 
-  // destructor - delete schema, columns_, and cols in columns_
+  // destructor - delete schema and the fields
   ~Row() {
     delete schema_;
-    for (size_t i = 0; i < size_; ++i) {
-      delete columns_[i];
-    }
-    delete[] columns_;
+    delete[] offsets_;
+    delete[] data_;
+  }
+
+  // bytes a field of the given type takes up in data_
+  static size_t field_size_(char type) {
+    if (type == 'I') return sizeof(int);
+    if (type == 'B') return sizeof(bool);
+    if (type == 'D') return sizeof(double);
+    assert(type == 'S');
+    return sizeof(String*);
   }
 
   /** Setters: set the given column with the given value. Setting a column with
     * a value of the wrong type is undefined.
-    * Make sure the value type matches up with the given col,
-    * if we already have columns of size 1 then replace the 0th idx,
-    * else push back the given value.
     */
   void set(size_t col, int val) {
     assert(schema_->col_type(col) == 'I');
-    IntArray* c = dynamic_cast<IntArray*>(columns_[col]);
-    if (c->size() == 0) {
-      c->push_back(val);
-    } else {
-      c->set(0, val);
-    }
+    *(int*)(data_ + offsets_[col]) = val;
   }
 
   void set(size_t col, double val) {
     assert(schema_->col_type(col) == 'D');
-    DoubleArray* c = dynamic_cast<DoubleArray*>(columns_[col]);
-    if (c->size() == 0) {
-      c->push_back(val);
-    } else {
-      c->set(0, val);
-    }
+    *(double*)(data_ + offsets_[col]) = val;
   };
 
   void set(size_t col, bool val) {
     assert(schema_->col_type(col) == 'B');
-    BoolArray* c = dynamic_cast<BoolArray*>(columns_[col]);
-    if (c->size() == 0) {
-      c->push_back(val);
-    } else {
-      c->set(0, val);
-    }
+    *(bool*)(data_ + offsets_[col]) = val;
   }
-  /** Acquire ownership of the string. */
+
+  /** Keeps the pointer, not a copy. The row does not delete the string. */
   void set(size_t col, String* val) {
     assert(schema_->col_type(col) == 'S');
-    StringArray* c = dynamic_cast<StringArray*>(columns_[col]);
-    if (c->size() == 0) {
-      c->push_back(val);
-    } else {
-      c->set(0, val);
-    }
+    *(String**)(data_ + offsets_[col]) = val;
   }
 
   /** Set/get the index of this row (ie. its position in the dataframe. This is
@@ -181,33 +159,27 @@ public:
 
   /** Getters: get the value at the given column. If the column is not
     * of the requested type, the result is undefined.
-    * Make sure column is of given type,
-    * then return the value from that column in this row.
     */
   int get_int(size_t col){
     assert(schema_->col_type(col) == 'I');
-    IntArray* ic = columns_[col]->as_int();
-    return ic->get(0);
+    return *(int*)(data_ + offsets_[col]);
   }
   bool get_bool(size_t col){
     assert(schema_->col_type(col) == 'B');
-    BoolArray* bc = columns_[col]->as_bool();
-    return bc->get(0);
+    return *(bool*)(data_ + offsets_[col]);
   }
   double get_double(size_t col){
     assert(schema_->col_type(col) == 'D');
-    DoubleArray* dc = columns_[col]->as_double();
-    return dc->get(0);
+    return *(double*)(data_ + offsets_[col]);
   }
   String* get_string(size_t col){
     assert(schema_->col_type(col) == 'S');
-    StringArray* sc = columns_[col]->as_string();
-    return sc->get(0);
+    return *(String**)(data_ + offsets_[col]);
   }
 
   /** Number of fields in the row. */
   size_t width() {
-    return schema_->width();
+    return size_;
   };
 
   /** Type of the field at the given position. An idx >= width is  undefined. */
@@ -216,29 +188,55 @@ public:
     return schema_->col_type(idx);
   };
 
+  /** Appends the fields to out, each followed by a space: ints, bools as
+    * 0 or 1, doubles exactly, and Strings as their length, a colon and
+    * their bytes. */
+  void write(ByteArray* out) {
+    char buf[32];
+    for (size_t i = 0; i < size_; ++i) {
+      char type = schema_->col_type(i);
+      if (type == 'I') snprintf(buf, sizeof(buf), "%d ", get_int(i));
+      else if (type == 'B') snprintf(buf, sizeof(buf), "%d ", get_bool(i) ? 1 : 0);
+      else if (type == 'D') snprintf(buf, sizeof(buf), "%.17g ", get_double(i));
+      else snprintf(buf, sizeof(buf), "%zu:", get_string(i)->size());
+      out->push_string(buf);
+      if (type == 'S') {
+        out->append(get_string(i)->c_str(), get_string(i)->size());
+        out->push_back(' ');
+      }
+    }
+  }
+
+  /** Sets the fields from ones written by write, advancing *i past them.
+    * The Strings read are new, and owned by the caller. */
+  void read(const char* str, size_t* i) {
+    char* at = (char*)str + *i;
+    for (size_t c = 0; c < size_; ++c) {
+      char type = schema_->col_type(c);
+      if (type == 'I') set(c, (int)strtol(at, &at, 10));
+      else if (type == 'B') set(c, strtol(at, &at, 10) != 0);
+      else if (type == 'D') set(c, strtod(at, &at));
+      else {
+        size_t len = strtoull(at, &at, 10);
+        set(c, new String(at + 1, len));
+        at += len + 1;
+      }
+      ++at;
+    }
+    *i = at - str;
+  }
+
   /** Given a Fielder, visit every field of this row.
     * Calling this method before the row's fields have been set is undefined. */
   void visit(size_t idx, Fielder& f) {
-    assert(columns_ != nullptr);
-
     // for loop - for each value, call the given fielder's accept method
     for (size_t i = 0; i < size_; ++i) {
       char type = schema_->col_type(i);
-      if (type == 'I') {
-        IntArray* ic = columns_[i]->as_int();
-        f.accept(ic->get(0));
-      } else if (type == 'B') {
-        BoolArray* bc = columns_[i]->as_bool();
-        f.accept(bc->get(0));
-      } else if (type == 'D') {
-        DoubleArray* dc = columns_[i]->as_double();
-        f.accept(dc->get(0));
-      } else if (type == 'S') {
-        StringArray* sc = columns_[i]->as_string();
-        f.accept(sc->get(0));
-      } else {
-        assert(false);
-      }
+      if (type == 'I') f.accept(get_int(i));
+      else if (type == 'B') f.accept(get_bool(i));
+      else if (type == 'D') f.accept(get_double(i));
+      else if (type == 'S') f.accept(get_string(i));
+      else assert(false);
     }
   }
 };
@@ -268,6 +266,22 @@ class Rower : public Object {
   /** Returns a clone of this rower */
   virtual Rower* clone () = 0;
 
+  /** Writes the state of this rower as a null terminated string, so that
+      it can be joined on another node (see DataFrame::map_reduce). The
+      caller owns the string. Rowers used with map_reduce override this
+      and deserialize. */
+  virtual const char* serialize() {
+    assert(false && "This rower cannot be shipped to another node.");
+    return nullptr;
+  }
+
+  /** Returns a new rower holding the state written by serialize, ready to
+      be joined into this one. */
+  virtual Rower* deserialize(const char* state) {
+    assert(false && "This rower cannot be shipped to another node.");
+    return nullptr;
+  }
+
 };
 
 /**
@@ -314,7 +328,7 @@ public:
   bool accept(Row& r) {
     // second col of df is bool; we want all rows where that is true
     assert(r.schema_->col_type(1) == 'B');
-    return r.columns_[1]->as_bool()->get(0);
+    return r.get_bool(1);
   }
 
 
@@ -398,9 +412,22 @@ public:
     delete s;
   }
 
-  /** Returns a clone of this rower */
+  /** Returns a clone of this rower, with a sum of its own starting at 0 */
   Rower* clone () {
-    return new SumRower(*this);
+    return new SumRower();
+  }
+
+  /** Writes the sum */
+  const char* serialize() {
+    Serializer s;
+    return s.serialize(sum_);
+  }
+
+  /** Returns a rower holding the written sum */
+  Rower* deserialize(const char* state) {
+    SumRower* s = new SumRower();
+    s->sum_ = atoi(state);
+    return s;
   }
 
 };
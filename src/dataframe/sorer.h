@@ -8,11 +8,417 @@
 #include <fstream>
 #include <chrono>
 #include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "object.h"
 #include "dataframe.h"
+#include "kernels.h"
+#include "thread.h"
 
 using namespace std;
 
+// bytes of the file each task of a parallel ingest parses
+size_t SOR_RANGE_BYTES = 16 * 1024 * 1024;
+
+/**
+ * Parses the value of a SoR field from its bytes, in one pass, without
+ * copying, allocating or throwing. A value is a number if all of it is: a
+ * '+' or '-', digits, and for a double a '.' with digits on at least one
+ * side of it and an exponent, 'e' and digits with their own sign, if any.
+ * authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SorField: public Object {
+public:
+    /**
+     * Parses the given value. Returns 'B' for an unsigned 0 or 1, 'I' for
+     * another whole number that fits in an int, 'D' for any other number,
+     * including a whole number too big for an int, and 'S' for anything
+     * else. Sets *i to a 'B' or 'I' value and *d to every number's value.
+     */
+    static char parse(const char* p, size_t len, int* i, double* d) {
+        const char* end = p + len;
+        const char* at = p;
+        bool negative = at < end && *at == '-';
+        if (at < end && (*at == '-' || *at == '+')) at++;
+        uint64_t mantissa = 0;
+        int digits = 0;     // significant digits in mantissa
+        int exp10 = 0;      // power of ten to scale mantissa by
+        bool seen = false;  // whether there is any digit
+        bool whole = true;
+        for (; at < end && *at >= '0' && *at <= '9'; at++) {
+            seen = true;
+            add_digit_(*at, &mantissa, &digits, &exp10, false);
+        }
+        if (at < end && *at == '.') {
+            whole = false;
+            for (at++; at < end && *at >= '0' && *at <= '9'; at++) {
+                seen = true;
+                add_digit_(*at, &mantissa, &digits, &exp10, true);
+            }
+        }
+        if (!seen) return 'S';
+        if (at < end && (*at == 'e' || *at == 'E')) {
+            whole = false;
+            at++;
+            bool eneg = at < end && *at == '-';
+            if (at < end && (*at == '-' || *at == '+')) at++;
+            if (at == end) return 'S';
+            int e = 0;
+            for (; at < end && *at >= '0' && *at <= '9'; at++) {
+                if (e < 100000) e = e * 10 + (*at - '0');
+            }
+            exp10 += eneg ? -e : e;
+        }
+        if (at != end) return 'S';
+        if (whole && exp10 == 0 && mantissa <= 2147483647ULL + negative) {
+            *i = negative ? (int)(0 - mantissa) : (int)mantissa;
+            *d = *i;
+            return len == 1 && mantissa <= 1 ? 'B' : 'I';
+        }
+        *d = to_double_(p, len, mantissa, digits, exp10, negative);
+        return 'D';
+    }
+
+    // adds a digit to the mantissa while it holds fewer than 19, and
+    // counts any past that in the exponent instead
+    static void add_digit_(char c, uint64_t* mantissa, int* digits, int* exp10, bool fraction) {
+        if (*digits < 19) {
+            *mantissa = *mantissa * 10 + (c - '0');
+            if (*mantissa != 0) (*digits)++;
+            if (fraction) (*exp10)--;
+        } else if (!fraction) {
+            (*exp10)++;
+        }
+    }
+
+    // The value of a number. A mantissa of up to 53 bits times a power of
+    // ten up to 22 is exact, so it is rounded once, correctly. Other
+    // numbers are left to strtod, on a copy of them on the stack.
+    static double to_double_(const char* p, size_t len, uint64_t mantissa, int digits,
+                             int exp10, bool negative) {
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        double v;
+        if (mantissa < (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+            v = (double)mantissa;
+            v = exp10 < 0 ? v / powers[-exp10] : v * powers[exp10];
+            return negative ? -v : v;
+        }
+        char buf[128];
+        if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+        memcpy(buf, p, len);
+        buf[len] = 0;
+        return strtod(buf, nullptr);
+    }
+};
+
+/**
+ * Splits SoR text into lines and the lines into fields. The positions of
+ * every '<', '>', '"' and newline are found up front, 64 bytes a word,
+ * with Kernels::match_bytes, and only those positions are visited after
+ * that. For each field of a line it gives where its value starts and
+ * ends, without quotes or the spaces around it, and flags it as quoted or
+ * malformed: a field is malformed if it holds more than one value, has
+ * anything but spaces around a quoted value, or is not closed on its line.
+ * A field with no value is empty, not malformed.
+ * authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SorTokenizer: public Object {
+public:
+    static const uint8_t QUOTED = 1;
+    static const uint8_t MALFORMED = 2;
+
+    const char* data;    // external
+    size_t size;
+    uint64_t* marks;     // a bit for each delimiter of data
+    size_t pos;          // start of the next line
+    size_t line_end;     // end of the current line, before its newline
+    size_t fields;       // fields of the current line
+    size_t capacity;
+    size_t* starts;      // where each field's value starts in data
+    size_t* ends;        // and ends
+    uint8_t* flags;
+    bool malformed;      // whether any field of the line is
+
+    SorTokenizer(const char* data, size_t size)
+    : data(data), size(size), pos(0), line_end(0), fields(0), capacity(16),
+      malformed(false) {
+        marks = new uint64_t[size / 64 + 1];
+        marks[size / 64] = 0;
+        Kernels::match_bytes(data, size, "<>\"\n", marks);
+        starts = new size_t[capacity];
+        ends = new size_t[capacity];
+        flags = new uint8_t[capacity];
+    }
+
+    ~SorTokenizer() {
+        delete[] marks;
+        delete[] starts;
+        delete[] ends;
+        delete[] flags;
+    }
+
+    /** Splits the next line into fields. @returns false if there is none */
+    bool next_line() {
+        if (pos >= size) return false;
+        fields = 0;
+        malformed = false;
+        size_t at = pos;
+        while (true) {
+            size_t m = next_mark_(at);
+            if (m == size || data[m] == '\n') {
+                line_end = m;
+                pos = m + 1;
+                return true;
+            }
+            // a '>' or '"' outside a field is ignored
+            at = data[m] == '<' ? field_(m + 1) : m + 1;
+        }
+    }
+
+    /** The length of the value of the given field. */
+    size_t len(size_t field) {
+        return ends[field] - starts[field];
+    }
+
+    // reads the field opened just before the given position, and returns
+    // where to look for the next one
+    size_t field_(size_t open) {
+        size_t m = next_mark_(open);
+        if (m < size && data[m] == '"') {
+            uint8_t flag = QUOTED | (spaces_(open, m) ? 0 : MALFORMED);
+            size_t close = next_mark_(m + 1);
+            while (close < size && data[close] != '"' && data[close] != '\n') {
+                close = next_mark_(close + 1);
+            }
+            if (close == size || data[close] == '\n') {
+                push_(m + 1, close, flag | MALFORMED);
+                return close;
+            }
+            size_t shut = next_mark_(close + 1);
+            if (shut == size || data[shut] != '>' || !spaces_(close + 1, shut)) {
+                push_(m + 1, close, flag | MALFORMED);
+                return shut;
+            }
+            push_(m + 1, close, flag);
+            return shut + 1;
+        }
+        if (m == size || data[m] != '>') {
+            push_(open, m, MALFORMED);
+            return m;
+        }
+        size_t start = open, end = m;
+        while (start < end && data[start] == ' ') start++;
+        while (end > start && data[end - 1] == ' ') end--;
+        push_(start, end, memchr(data + start, ' ', end - start) ? MALFORMED : 0);
+        return m + 1;
+    }
+
+    // the first delimiter at or after the given position, or size
+    size_t next_mark_(size_t at) {
+        if (at >= size) return size;
+        size_t word = at / 64;
+        uint64_t bits = marks[word] & (~0ULL << (at % 64));
+        while (bits == 0) {
+            if (++word > size / 64) return size;
+            bits = marks[word];
+        }
+        size_t m = word * 64 + __builtin_ctzll(bits);
+        return m < size ? m : size;
+    }
+
+    // whether the bytes from start up to end are all spaces
+    bool spaces_(size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) {
+            if (data[i] != ' ') return false;
+        }
+        return true;
+    }
+
+    void push_(size_t start, size_t end, uint8_t flag) {
+        if (fields == capacity) {
+            capacity *= 2;
+            size_t* s = new size_t[capacity];
+            size_t* e = new size_t[capacity];
+            uint8_t* f = new uint8_t[capacity];
+            memcpy(s, starts, fields * sizeof(size_t));
+            memcpy(e, ends, fields * sizeof(size_t));
+            memcpy(f, flags, fields);
+            delete[] starts;
+            delete[] ends;
+            delete[] flags;
+            starts = s;
+            ends = e;
+            flags = f;
+        }
+        starts[fields] = start;
+        ends[fields] = end;
+        flags[fields++] = flag;
+        malformed = malformed || (flag & MALFORMED);
+    }
+};
+
+/**
+ * The rows parsed out of one byte range of a SoR file, kept as one vector
+ * of values per column until they are appended to the dataframe's columns
+ * in file order. Owns its Strings until then. A counting range only checks
+ * its rows and counts them, keeping no values.
+ * authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SorRange: public Object {
+public:
+    const char* start;   // first line of the range, in the mapped file
+    const char* end;     // just past its last line
+    Schema* schema;      // external
+    size_t rows;
+    bool counting;
+    vector<vector<int>> ints;
+    vector<vector<double>> doubles;
+    vector<vector<char>> bools;
+    vector<vector<String*>> strings;
+
+    SorRange(const char* start, const char* end, Schema* schema, bool counting = false)
+    : start(start), end(end), schema(schema), rows(0), counting(counting), ints(schema->width()),
+      doubles(schema->width()), bools(schema->width()), strings(schema->width()) {}
+
+    ~SorRange() {
+        for (size_t i = 0; i < strings.size(); i++) {
+            for (size_t r = 0; r < strings[i].size(); r++) delete strings[i][r];
+        }
+    }
+
+    /** Parses every line of the range, keeping the rows that are well
+     *  formed and fit the schema, like Sorer::generate_dataframe(). */
+    void parse() {
+        size_t width = schema->width();
+        const char** spans = new const char*[width];
+        size_t* lens = new size_t[width];
+        SorTokenizer tok(start, end - start);
+        while (tok.next_line()) {
+            if (tok.malformed || tok.fields != width) continue;
+            bool missing = false;
+            for (size_t i = 0; i < width; i++) {
+                spans[i] = start + tok.starts[i];
+                lens[i] = tok.len(i);
+                missing = missing || lens[i] == 0;
+            }
+            if (!missing) add_(spans, lens);
+        }
+        delete[] spans;
+        delete[] lens;
+    }
+
+    // converts the values of a row to the schema's types, and keeps the
+    // row if they all convert
+    void add_(const char** spans, size_t* lens) {
+        size_t width = schema->width();
+        for (size_t i = 0; i < width; i++) {
+            char type = schema->col_type(i);
+            int n;
+            double f;
+            char parsed = type == 'S' ? 'S' : SorField::parse(spans[i], lens[i], &n, &f);
+            if (type == 'I') {
+                if (parsed != 'I' && parsed != 'B') break;
+                ints[i].push_back(n);
+            } else if (type == 'D') {
+                if (parsed == 'S') break;
+                doubles[i].push_back(f);
+            } else if (type == 'B') {
+                if (parsed != 'B') break;
+                bools[i].push_back(n == 1);
+            } else {
+                strings[i].push_back(nullptr);
+            }
+            if (i + 1 < width) continue;
+            // every value converted: make the Strings and keep the row
+            for (size_t s = 0; s < width && !counting; s++) {
+                if (schema->col_type(s) != 'S') continue;
+                strings[s].back() = new String(spans[s], lens[s]);
+            }
+            rows++;
+            if (counting) drop_();
+            return;
+        }
+        // a value did not convert: drop the ones before it
+        drop_();
+    }
+
+    // drops the values of the row being added, past those kept
+    void drop_() {
+        size_t kept = counting ? 0 : rows;
+        for (size_t i = 0; i < schema->width(); i++) {
+            if (ints[i].size() > kept) ints[i].pop_back();
+            if (doubles[i].size() > kept) doubles[i].pop_back();
+            if (bools[i].size() > kept) bools[i].pop_back();
+            if (strings[i].size() > kept) strings[i].pop_back();
+        }
+    }
+
+    /** Appends the rows to the columns of the given dataframe, which takes
+     *  the Strings. Ints and doubles are copied into the columns' chunks a
+     *  run at a time. The first `skip` rows are written with Row::write to
+     *  `skipped` instead. */
+    void append_to(DataFrame* df, size_t skip = 0, ByteArray* skipped = nullptr) {
+        assert(skip <= rows);
+        if (skip > 0) write_(skip, skipped);
+        size_t n = rows - skip;
+        for (size_t i = 0; i < schema->width(); i++) {
+            Column* c = df->cols_[i];
+            char type = schema->col_type(i);
+            if (n == 0) continue;
+            if (type == 'I') c->as_int()->append(&ints[i][skip], n);
+            else if (type == 'D') c->as_double()->append(&doubles[i][skip], n);
+            else if (type == 'B') {
+                for (size_t r = skip; r < rows; r++) c->push_back(bools[i][r] != 0);
+            } else {
+                for (size_t r = skip; r < rows; r++) c->push_back(strings[i][r]);
+                vector<String*>().swap(strings[i]);
+            }
+        }
+        df->schema_->numrows_ += n;
+    }
+
+    // writes the first n rows to out, deleting their Strings
+    void write_(size_t n, ByteArray* out) {
+        Row row(*schema);
+        for (size_t r = 0; r < n; r++) {
+            for (size_t i = 0; i < schema->width(); i++) {
+                char type = schema->col_type(i);
+                if (type == 'I') row.set(i, ints[i][r]);
+                else if (type == 'D') row.set(i, doubles[i][r]);
+                else if (type == 'B') row.set(i, bools[i][r] != 0);
+                else row.set(i, strings[i][r]);
+            }
+            row.write(out);
+        }
+        for (size_t i = 0; i < schema->width(); i++) {
+            if (schema->col_type(i) != 'S') continue;
+            for (size_t r = 0; r < n; r++) {
+                delete strings[i][r];
+                strings[i][r] = nullptr;
+            }
+        }
+    }
+};
+
+/**
+ * Parses one range of a SoR file. Run by Sorer::generate_dataframe(size_t).
+ * authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SorTask: public Task {
+public:
+    SorRange* range;   // external
+
+    SorTask(SorRange* range) : range(range) {}
+
+    void run() {
+        range->parse();
+    }
+};
+
 class Sorer: public Object {
 public:
     string filename, longest_line;
@@ -49,6 +455,13 @@ public:
         find_bool_int_true_schema();
     }
 
+    /** Reads the `len` bytes from `from` of the file with the given
+     *  schema, rather than one inferred from the file. */
+    Sorer(string filename, size_t from, size_t len, Schema& scm, KVStore* kc_)
+    : filename(filename), from(from), len(len), kc(kc_) {
+        schema = new Schema(scm);
+    }
+
     ~Sorer() {
         delete schema;
     }
@@ -79,13 +492,13 @@ public:
        // compare to two rows of the same size to find correct schema.
        if(goodrows.size() > 1) {
          srand (time(NULL));
-         int rand1 = rand() % (goodrows.size() + 1);
+         int rand1 = rand() % goodrows.size();
          this_thread::sleep_for(chrono::milliseconds(10));
          srand(time(NULL));
-         int rand2 = rand() % (goodrows.size() + 1);
+         int rand2 = rand() % goodrows.size();
          if (rand1 == rand2) {
-           rand1 = rand() % (goodrows.size() + 1);
-           rand2 = rand() % (goodrows.size() + 1);
+           rand1 = rand() % goodrows.size();
+           rand2 = rand() % goodrows.size();
          }
          longest_line = goodrows.at(rand1);
          Schema* temp1 = make_schema();
@@ -122,63 +535,14 @@ public:
             // loop through first 500 lines in file
             while (getline(file, line) && lines_read < 500) {
                 lines_read++;
-                int fields = 0;
+                SorTokenizer tok(line.c_str(), line.size());
+                tok.next_line();
+                int fields = tok.fields;
                 int empty_fields = 0;
-                bool well_formed = true;
-                bool open_found = false;
-                bool other_found = false;
-                bool quotes_found = false;
-                bool quotes_ended = false;
-                bool space_found = false;
-                // loop through characters in the line
-                for (size_t i = 0; line[i] != 0; i++) {
-                    // found a field
-                    if (line[i] == '<' && !quotes_found) {
-                    fields++;
-                    open_found = true;
-                    }
-                    // found a space after another character and without quotes
-                    else if (other_found && !quotes_found && line[i] == ' ') {
-                    space_found = true;
-                    }
-                    // found quotes without seeing anything else
-                    else if (open_found && line[i] == '\"' && !other_found && !quotes_found) {
-                    quotes_found = true;
-                    other_found = true;
-                    open_found = false;
-                    }
-                    // found something after the opening of the field
-                    else if (open_found && !other_found && line[i] != ' ' && line[i] != '>') {
-                    other_found = true;
-                    open_found = false;
-                    }
-                    // found the end of the field
-                    else if (line[i] == '>' && !quotes_found) {
-                    if (!other_found) {
-                        empty_fields += 1;
-                    }
-                    other_found = false;
-                    space_found = false;
-                    open_found = false;
-                    quotes_found = false;
-                    quotes_ended = false;
-                    }
-                    // character after quote
-                    else if (quotes_ended && line[i] != ' ') {
-                        well_formed = false;
-                        break;
-                    }
-                    // found a quote after another -> quotes ended
-                    else if (quotes_found && line[i] == '\"') {
-                        quotes_ended = true;
-                        quotes_found = false;
-                    }
-                    // found a space in the middle of the field-> out of the running
-                    else if (space_found && !quotes_found) {
-                        well_formed = false;
-                        break;
-                    }
+                for (size_t f = 0; f < tok.fields; f++) {
+                    if (tok.len(f) == 0) empty_fields++;
                 }
+                bool well_formed = !tok.malformed;
                 // this row was well formed and it's the longest row so far
                 // OR: this row was well formed and it has the same amount of
                 //     fields as the longest so far, with less empty fields
@@ -210,65 +574,16 @@ public:
      * authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
      */
     Schema* make_schema() {
-
-        string line = longest_line;
         string types = "";
-        // loop through characters
-        for (size_t character = 0; line[character] != 0; character++) {
-            string field = "";
-            // found a field
-            if(line[character] == '<') {
-                // loop through the characters of this field
-                while (line[character] != '>') {
-                    character++;
-                    // found a quote -> add to field regardless of spaces
-                    if (line[character] == '\"') {
-                        field += line[character];
-                        character++;
-                        while (line[character] != '\"') {
-                            field += line[character];
-                            character++;
-                        }
-                        field += line[character];
-                    } else if (line[character] != ' ' && line[character] != '>') {
-                        field += line[character];
-                    }
-                }
-                // Case: field is empty -> BOOL
-                if (field.size() == 0) {
-                    types += 'B';
-                    continue;
-                }
-                // Case: found a + or - (DOUBLE || INT) -> trim field
-                if (field[0] == '+' || field[0] == '-') {
-                    field = field.substr(1, field.length());
-                }
-                // Case: found a period. (DOUBLE || STRING)
-                if (field.find('.') != string::npos) {
-                    // try stod -> succeed = double, fail = string
-                    try {
-                        stod(field);
-                        types += 'D';
-                    } catch (...) {
-                        types += 'S';
-                    }
-                }
-
-                // Case: no period (INT || STRING)
-                else {
-                    // try stoi -> succeed = int || bool (0, 1), fail = string
-                    try {
-                        int n = stoi(field);
-                        if (n > 1) {
-                            types += 'I';
-                        } else {
-                            types += 'B';
-                        }
-                    } catch (...) {
-                        types += 'S';
-                    }
-                }
-            }
+        SorTokenizer tok(longest_line.c_str(), longest_line.size());
+        tok.next_line();
+        for (size_t f = 0; f < tok.fields; f++) {
+            int n;
+            double d;
+            // Case: field is empty -> BOOL; quoted -> STRING
+            if (tok.len(f) == 0) types += 'B';
+            else if (tok.flags[f] & SorTokenizer::QUOTED) types += 'S';
+            else types += SorField::parse(longest_line.c_str() + tok.starts[f], tok.len(f), &n, &d);
         }
         Schema* scm = new Schema(types.c_str());
         return scm;
@@ -281,7 +596,8 @@ public:
      */
     DataFrame* generate_dataframe() {
         DataFrame* df = new DataFrame(*schema, kc);
-        vector<Row> validated_rows;
+        // one row, refilled for every line
+        Row validated(*schema);
 
         string line;
         size_t bytes_read = 0;
@@ -314,67 +630,14 @@ public:
                     break;
                 }
 
+                bytes_read += line.length();
+                SorTokenizer tok(line.c_str(), line.size());
+                tok.next_line();
                 // this row is well formed so we can add to database
-                bool well_formed = true;
-                int num_field = 0;  // num of fields in this row
+                bool well_formed = !tok.malformed;
                 vector<string> tmp; // fields in this row (before validating types)
-
-                // loop through characters in this row
-                for (size_t character = 0; line[character] != 0; character++) {
-                    // NOTE: every time we increment character, we increment bytes read
-                    bytes_read++;
-                    string field = "";
-                    // found a field
-                    if(line[character] == '<') {
-                    bool other_found = false;
-                    bool space_found = false;
-                    bool quotes_found = false;
-                    character++;
-                    bytes_read++;
-                    // loop through the field
-                    while (line[character] != '>') {
-                        // found a quote
-                        if (line[character] == '\"') {
-                        quotes_found = true;
-                        character++;
-                        bytes_read++;
-                        // while still in the quote, add all to field
-                        while (line[character] != '\"') {
-                            field += line[character];
-                            character++;
-                            bytes_read++;
-                        }
-                        }
-                        // we've found something in the field
-                        else if (line[character] != ' ' && line[character] != '>' && !space_found && !quotes_found) {
-                        other_found = true;
-                        field += line[character];
-                        }
-                        // found a space after value
-                        else if (line[character] == ' ' && other_found) {
-                        space_found = true;
-                        }
-                        // found a value and then a space and then another value -> not well formed
-                        else if (space_found) {
-                        well_formed = false;
-                        }
-                        // something found after quotes
-                        else if (quotes_found && line[character] != ' ') {
-                        well_formed = false;
-                        }
-                        // found end of field
-                        if (line[character] == '>') {
-                        other_found = false;
-                        space_found = false;
-                        }
-                        character++;
-                        bytes_read++;
-                    }
-
-                    // increment num of fields, add field to tmp
-                    num_field++;
-                    tmp.push_back(field);
-                    }
+                for (size_t f = 0; f < tok.fields; f++) {
+                    tmp.push_back(line.substr(tok.starts[f], tok.len(f)));
                 }
                 // something in the row is not well formed -> throw out row
                 if (!well_formed) {
@@ -382,7 +645,6 @@ public:
                 }
 
                 // Only add in if it fits the schema.
-                Row validated(*schema);
                 // Determines if we throw out the row or not.
                 bool isValidated = true;
                 if (tmp.size() != schema->width()) continue;
@@ -399,57 +661,21 @@ public:
                         validated.set(i, str);
                         //delete str;
                     }
-                    // Case: Double, push back if one of <DOUBLE> <INT> <BOOL>
-                    else if(schema->col_type(i) == 'D') {
-                        try {
-                            double f = stod(tmp[i]);
-                            //string toAdd = "";
-                            //toAdd += tmp[i];
-                            //if (tmp[i].find('.') == string::npos) {
-                            //    toAdd += ".0";
-                            //}
-                            validated.set(i, f);
-                        } catch (...) {
-                            try {
-                                double f = stoll(tmp[i]);
-                                //string toAdd = "";
-                                //toAdd += tmp[i];
-                                //if (tmp[i].find('.') == string::npos) {
-                                //    toAdd += ".0";
-                                //}
-                                validated.set(i, f);
-                            } catch ( ...) {
-                                isValidated = false;
-                                break;
-                            }
-                        }
-                    }
-                    // Case: Int, push back if one of <INT> <BOOL>
-                    else if (schema->col_type(i) == 'I') {
-                        // Anything with a period is thrown out.
-                        if (tmp[i].find('.') != string::npos) {
+                    else {
+                        int n;
+                        double f;
+                        char parsed = SorField::parse(tmp[i].c_str(), tmp[i].size(), &n, &f);
+                        char type = schema->col_type(i);
+                        // Case: Double, push back if one of <DOUBLE> <INT> <BOOL>
+                        if (type == 'D' && parsed != 'S') validated.set(i, f);
+                        // Case: Int, push back if one of <INT> <BOOL>
+                        else if (type == 'I' && (parsed == 'I' || parsed == 'B')) validated.set(i, n);
+                        // Case: Bool, push back if one of <BOOL>
+                        else if (type == 'B' && parsed == 'B') validated.set(i, n == 1);
+                        else {
                             isValidated = false;
                             break;
                         }
-                        try {
-                            int n = stoi(tmp[i]);
-                            validated.set(i, n);
-                        } catch (...) {
-                            try {
-                                long long int n = stoll(tmp[i]);
-                                validated.set(i, (int)n);
-                            } catch ( ...) {
-                                isValidated = false;
-                                break;
-                            }
-                        }
-                    }
-
-                    // Case: Bool, push back if one of <BOOL>
-                    else if (schema->col_type(i) == 'B') {
-                        if (strcmp(tmp[i].c_str(), "1") == 0) validated.set(i, true);
-                        else if (strcmp(tmp[i].c_str(), "0") == 0) validated.set(i, false);
-                        else isValidated = false;
                     }
                 } // End creation of validated row
                 if (isValidated) {
@@ -463,4 +689,301 @@ public:
         df->finalize_all();
         return df;
     }
+
+    /**
+     * Like generate_dataframe(), but reads the file through a memory map
+     * and parses it on the given number of threads. The bytes from `from`
+     * are cut into ranges of about SOR_RANGE_BYTES, each moved forward to
+     * the start of a line, and each range is parsed by a task of its own
+     * into vectors of values per column (see SorRange). The ranges are
+     * parsed a pool's worth at a time and appended to the dataframe's
+     * chunks in file order. Finished chunks go to a ChunkShipper, which
+     * stores them on their nodes in the background while parsing goes on,
+     * and the pages of each range are dropped once it is appended, as are
+     * the Strings of each String chunk once it is stored. So the memory
+     * used, apart from the chunks this node ends up storing, depends on
+     * the pool size, SOR_RANGE_BYTES and SHIP_QUEUE, not on how big the
+     * file is. It is not small for String columns, though: a parsed String
+     * takes several times the bytes it was read from, so a round of ranges
+     * can hold several times threads * SOR_RANGE_BYTES; lower
+     * SOR_RANGE_BYTES to use less. Every line that starts within the `len`
+     * bytes from `from` is read; the first one only if it starts right at
+     * `from`.
+     * @returns a generated dataframe based on the file and schema.
+     * authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+     */
+    DataFrame* generate_dataframe(size_t threads) {
+        DataFrame* df = new DataFrame(*schema, kc);
+        ChunkShipper shipper(kc);
+        for (size_t i = 0; i < df->ncols(); i++) df->cols_[i]->shipper_ = &shipper;
+        parse_(df, threads, 0, nullptr);
+        df->finalize_all();
+        shipper.drain();
+        for (size_t i = 0; i < df->ncols(); i++) df->cols_[i]->shipper_ = nullptr;
+        return df;
+    }
+
+    /** The number of rows generate_dataframe(threads) would read, found
+     *  by checking every line of the window without keeping any values. */
+    size_t count_rows(size_t threads) {
+        return parse_(nullptr, threads, 0, nullptr);
+    }
+
+    // parses the window on the given number of threads, appending its rows
+    // to the dataframe but for the first `skip`, which are written to
+    // `skipped`; with no dataframe, only counts them. Returns how many rows
+    // the window has.
+    size_t parse_(DataFrame* df, size_t threads, size_t skip, ByteArray* skipped) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cout << "unable to open file" << endl;
+            exit(1);
+        }
+        struct stat st;
+        fstat(fd, &st);
+        size_t size = st.st_size;
+        if (size == 0) {
+            close(fd);
+            return 0;
+        }
+        const char* data = (const char*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        assert(data != MAP_FAILED);
+        madvise((void*)data, size, MADV_SEQUENTIAL);
+
+        size_t stop = from + len < size ? from + len : size;
+        size_t at = line_start_(data, size, from < size ? from : size);
+        stop = line_start_(data, size, stop);
+        if (threads == 0) threads = 1;
+        SorRange** ranges = new SorRange*[threads];
+        SorTask** tasks = new SorTask*[threads];
+        ThreadPool pool(threads);
+        size_t rows = 0;
+        while (at < stop) {
+            size_t n = 0;
+            for (; n < threads && at < stop; n++) {
+                size_t next = at + SOR_RANGE_BYTES < stop ? at + SOR_RANGE_BYTES : stop;
+                next = line_start_(data, size, next);
+                ranges[n] = new SorRange(data + at, data + next, schema, df == nullptr);
+                tasks[n] = new SorTask(ranges[n]);
+                pool.submit(tasks[n]);
+                at = next;
+            }
+            pool.wait();
+            for (size_t i = 0; i < n; i++) {
+                size_t left = skip < ranges[i]->rows ? skip : ranges[i]->rows;
+                if (df != nullptr) ranges[i]->append_to(df, left, skipped);
+                skip -= left;
+                rows += ranges[i]->rows;
+                drop_pages_(data, ranges[i]->start, ranges[i]->end);
+                delete ranges[i];
+                delete tasks[i];
+            }
+        }
+        delete[] ranges;
+        delete[] tasks;
+        munmap((void*)data, size);
+        close(fd);
+        return rows;
+    }
+
+    /**
+     * Loads a SoR file that every node can read, such as one on shared
+     * storage, as one dataframe spread over the cluster. Every node calls
+     * this with the same name, which keys the messages it sends. Node 0
+     * infers the schema and sends every node it and a plan: an equal slice
+     * of the file's bytes each. Every node counts the rows of its slice,
+     * and node 0 tells them all the counts, so each knows where its rows
+     * fall among the dataframe's. The rows are grouped into runs of
+     * DataFrame::split_len_(), which end on a chunk boundary in every
+     * column, and each group is stored on the node holding its first row:
+     * a node parses its slice, on the given number of threads, into
+     * columns kept on itself, sending the rows before its first group to
+     * the node that holds that group, which appends them to its own. So
+     * only those rows cross the network. Node 0 then puts the keys of all
+     * the nodes' chunks, in order, into one dataframe, and sends it back.
+     * @returns the whole dataframe; deleting it deletes the chunks stored
+     *          on this node, which other nodes may still be reading.
+     * authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+     */
+    static DataFrame* load_cluster(string filename, KVStore* kc, const char* name,
+                                   size_t threads = 1) {
+        size_t me = kc->index();
+        size_t nodes = kc->num_nodes_;
+        string prefix = string(name) + "-";
+
+        // the schema and the slice of the file to read
+        char* plan = nullptr;
+        if (me == 0) {
+            Sorer inferred(filename, kc);
+            size_t size = inferred.len;
+            const char* types = inferred.schema->types_->c_str();
+            for (size_t node = nodes; node-- > 0;) {
+                size_t start = size * node / nodes;
+                size_t end = size * (node + 1) / nodes;
+                char* text = new char[strlen(types) + 64];
+                sprintf(text, "%zu %zu %s", start, end - start, types);
+                if (node == 0) {
+                    plan = text;
+                    continue;
+                }
+                Key key(new String((prefix + "plan-" + to_string(node)).c_str()), (int)node);
+                kc->put(&key, text);
+                delete[] text;
+            }
+        } else {
+            Key key(new String((prefix + "plan-" + to_string(me)).c_str()), (int)me);
+            plan = (char*)kc->takeCharsAndWait(&key);
+        }
+        size_t start, len;
+        int at = 0;
+        sscanf(plan, "%zu %zu %n", &start, &len, &at);
+        Schema scm(plan + at);
+        delete[] plan;
+        Sorer sorer(filename, start, len, scm, kc);
+
+        // every node's number of rows
+        size_t* counts = new size_t[nodes];
+        counts[me] = sorer.count_rows(threads);
+        char buf[32];
+        if (me != 0) {
+            Key key(new String((prefix + "count-" + to_string(me)).c_str()), 0);
+            snprintf(buf, sizeof(buf), "%zu", counts[me]);
+            kc->put(&key, buf);
+            Key all(new String((prefix + "counts-" + to_string(me)).c_str()), (int)me);
+            const char* text = kc->takeCharsAndWait(&all);
+            char* end = (char*)text;
+            for (size_t node = 0; node < nodes; node++) counts[node] = strtoull(end, &end, 10);
+            delete[] text;
+        } else {
+            ByteArray all;
+            for (size_t node = 0; node < nodes; node++) {
+                if (node != 0) {
+                    Key key(new String((prefix + "count-" + to_string(node)).c_str()), 0);
+                    const char* text = kc->takeCharsAndWait(&key);
+                    counts[node] = strtoull(text, nullptr, 10);
+                    delete[] text;
+                }
+                snprintf(buf, sizeof(buf), "%zu ", counts[node]);
+                all.push_string(buf);
+            }
+            const char* text = all.as_bytes();
+            for (size_t node = 1; node < nodes; node++) {
+                Key key(new String((prefix + "counts-" + to_string(node)).c_str()), (int)node);
+                kc->put(&key, text);
+            }
+            delete[] text;
+        }
+
+        // this node's rows, but for those before its first group, which go
+        // to the node holding that group; then the rows others send it
+        DataFrame* part = new DataFrame(*sorer.schema, kc);
+        for (size_t i = 0; i < part->ncols(); i++) part->cols_[i]->home_ = me;
+        size_t step = part->split_len_();
+        size_t head = head_rows_(counts, me, step);
+        ByteArray skipped;
+        size_t rows = sorer.parse_(part, threads, head, &skipped);
+        assert(rows == counts[me]);
+        if (head > 0) {
+            size_t first = first_row_(counts, me);
+            size_t owner = owner_(counts, nodes, first - first % step);
+            Key key(new String((prefix + "head-" + to_string(me)).c_str()), (int)owner);
+            const char* text = skipped.as_bytes();
+            kc->put(&key, text);
+            delete[] text;
+        }
+        Row row(*sorer.schema);
+        for (size_t node = me + 1; node < nodes; node++) {
+            size_t first = first_row_(counts, node);
+            if (head_rows_(counts, node, step) == 0) continue;
+            if (owner_(counts, nodes, first - first % step) != me) continue;
+            Key key(new String((prefix + "head-" + to_string(node)).c_str()), (int)me);
+            const char* text = kc->takeCharsAndWait(&key);
+            for (size_t i = 0; text[i] != 0;) {
+                row.read(text, &i);
+                part->add_row(row);
+            }
+            delete[] text;
+        }
+        part->finalize_all();
+        delete[] counts;
+
+        // the keys of every node's chunks, in order
+        const char* mine = part->serialize(part);
+        DataFrame* df;
+        if (me == 0) {
+            df = part->get_dataframe(mine);
+            for (size_t node = 1; node < nodes; node++) {
+                Key key(new String((prefix + "part-" + to_string(node)).c_str()), 0);
+                const char* text = kc->takeCharsAndWait(&key);
+                DataFrame* theirs = part->get_dataframe(text);
+                for (size_t i = 0; i < df->ncols(); i++) df->cols_[i]->extend_(theirs->cols_[i]);
+                delete theirs;
+                delete[] text;
+            }
+            if (df->ncols() > 0) df->schema_->numrows_ = df->cols_[0]->size();
+            const char* whole = df->serialize(df);
+            for (size_t node = 1; node < nodes; node++) {
+                Key key(new String((prefix + "frame-" + to_string(node)).c_str()), (int)node);
+                kc->put(&key, whole);
+            }
+            delete[] whole;
+        } else {
+            Key key(new String((prefix + "part-" + to_string(me)).c_str()), 0);
+            kc->put(&key, mine);
+            Key frame(new String((prefix + "frame-" + to_string(me)).c_str()), (int)me);
+            const char* whole = kc->takeCharsAndWait(&frame);
+            df = part->get_dataframe(whole);
+            delete[] whole;
+        }
+        delete[] mine;
+
+        // the whole dataframe's columns take over this node's chunks, which
+        // the part's would delete along with themselves
+        for (size_t i = 0; i < df->ncols(); i++) {
+            df->cols_[i]->id_ = part->cols_[i]->id_;
+            part->cols_[i]->id_ = kc->get_id();
+        }
+        delete part;
+        return df;
+    }
+
+    // the index, in the whole dataframe, of the given node's first row
+    static size_t first_row_(size_t* counts, size_t node) {
+        size_t first = 0;
+        for (size_t n = 0; n < node; n++) first += counts[n];
+        return first;
+    }
+
+    // how many of the given node's first rows belong to a group of `step`
+    // rows that starts on an earlier node
+    static size_t head_rows_(size_t* counts, size_t node, size_t step) {
+        size_t into = first_row_(counts, node) % step;
+        if (into == 0) return 0;
+        return step - into < counts[node] ? step - into : counts[node];
+    }
+
+    // the node holding the given row of the whole dataframe
+    static size_t owner_(size_t* counts, size_t nodes, size_t row) {
+        for (size_t n = 0; n < nodes; n++) {
+            if (row < counts[n]) return n;
+            row -= counts[n];
+        }
+        return nodes - 1;
+    }
+
+    // lets go of the whole pages of the mapped file from start to end,
+    // which have been read
+    void drop_pages_(const char* data, const char* start, const char* end) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t from = (start - data + page - 1) / page * page;
+        size_t to = (end - data) / page * page;
+        if (to > from) madvise((void*)(data + from), to - from, MADV_DONTNEED);
+    }
+
+    // the first line starting at or after the given byte of the file
+    size_t line_start_(const char* data, size_t size, size_t at) {
+        if (at == 0 || at >= size || data[at - 1] == '\n') return at;
+        const char* nl = (const char*)memchr(data + at, '\n', size - at);
+        return nl == nullptr ? size : nl - data + 1;
+    }
 };
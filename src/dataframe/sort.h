@@ -0,0 +1,638 @@
+// lang::CwC
+
+#pragma once
+#include "column.h"
+#include "join.h"
+#include "thread.h"
+#include <stdio.h>
+#include <unistd.h>
+
+// bytes of sorted runs a sort keeps in memory; past this, runs are written
+// to a temporary file on local disk and merged from there
+size_t SORT_BUDGET = 256 * 1024 * 1024;
+
+// most spilled runs a merge reads at once; a sort that spills more merges
+// them this many at a time into longer runs first
+size_t SORT_FAN_IN = 64;
+
+// keys each node samples to choose the splitters of a cluster sort
+size_t SORT_SAMPLES = 1024;
+
+/**
+ * A temporary file on local disk that sorted runs are spilled to, one
+ * after another, each at its own offset. Runs write it from several
+ * threads at once and read it back with pread, so a sort holds one file
+ * descriptor however many runs it spills.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SpillFile : public Object {
+public:
+  FILE* file_;   // owned; nullptr if it could not be made
+  size_t end_;   // bytes written or being written
+  Lock lock_;    // guards end_
+
+  SpillFile() {
+    file_ = tmpfile();
+    end_ = 0;
+  }
+
+  ~SpillFile() {
+    if (file_ != nullptr) fclose(file_);
+  }
+
+  /** Writes n bytes at the end of the file, putting where they start in
+   *  *at. @returns false if they could not all be written */
+  bool append(const char* data, size_t n, size_t* at) {
+    if (file_ == nullptr) return false;
+    lock_.lock();
+    *at = end_;
+    end_ += n;
+    lock_.unlock();
+    for (size_t done = 0; done < n;) {
+      ssize_t wrote = pwrite(fileno(file_), data + done, n - done, *at + done);
+      if (wrote <= 0) return false;
+      done += wrote;
+    }
+    return true;
+  }
+
+  /** Reads up to n bytes from the given offset. @returns how many were
+   *  read, 0 on an error */
+  size_t read(char* into, size_t n, size_t at) {
+    ssize_t got = pread(fileno(file_), into, n, at);
+    return got < 0 ? 0 : got;
+  }
+
+  /** Empties the file, once none of the runs in it are needed. */
+  void clear() {
+    if (file_ != nullptr && ftruncate(fileno(file_), 0) == 0) end_ = 0;
+  }
+};
+
+/**
+ * The rows of one chunk of a column, sorted by their values there. Int,
+ * double and bool values are turned into unsigned keys that sort in the
+ * same order and radix sorted, eight bits a pass; passes over a byte every
+ * key shares are skipped. A descending sort flips the keys. A String
+ * column's values are merge sorted with strcmp. Both sorts are stable.
+ * A run can be spilled to a SpillFile and read back in order, a buffer
+ * at a time, or written as text and read back, which is how a cluster
+ * sort ships the keys it samples and the splitters chosen from them.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SortRun : public SpanVisitor {
+public:
+  size_t n_;         // rows in the run
+  size_t first_;     // row of the chunk's first value
+  bool asc_;
+  bool strings_;     // whether the keys are Strings
+  uint64_t* keys_;   // owned; ordered keys, for a non-String column
+  String** skeys_;   // owned; copies of the Strings, for a String column
+  size_t* rows_;     // owned; the row of each key
+  SpillFile* file_;  // external; where the run was spilled, or nullptr
+  size_t offset_;    // the next byte of the spilled run to read
+  size_t end_;       // just past its last byte
+  char* buf_;        // owned; bytes read ahead from the file
+  size_t buf_len_;
+  size_t buf_at_;
+  bool failed_;      // whether spilling or reading the run failed
+  size_t at_;        // records read so far
+  uint64_t key_;     // the record read last
+  String* skey_;     // owned if the run was spilled
+  size_t row_;
+
+  // bytes of a spilled run read from the file at once
+  static const size_t READ_BYTES = 64 * 1024;
+
+  SortRun(size_t first, bool asc) {
+    n_ = 0;
+    first_ = first;
+    asc_ = asc;
+    strings_ = false;
+    keys_ = nullptr;
+    skeys_ = nullptr;
+    rows_ = nullptr;
+    file_ = nullptr;
+    offset_ = 0;
+    end_ = 0;
+    buf_ = nullptr;
+    buf_len_ = 0;
+    buf_at_ = 0;
+    failed_ = false;
+    at_ = 0;
+    skey_ = nullptr;
+  }
+
+  ~SortRun() {
+    if (skeys_ != nullptr) {
+      for (size_t i = 0; i < n_; ++i) delete skeys_[i];
+    }
+    if (file_ != nullptr) delete skey_;
+    delete[] keys_;
+    delete[] skeys_;
+    delete[] rows_;
+    delete[] buf_;
+  }
+
+  static uint64_t ordered(int v) {
+    return (uint32_t)v ^ 0x80000000u;
+  }
+
+  static uint64_t ordered(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    return bits >> 63 ? ~bits : bits | (1ULL << 63);
+  }
+
+  void visit(const int* vals, size_t n) {
+    start_(n, false);
+    for (size_t i = 0; i < n; ++i) keys_[i] = asc_ ? ordered(vals[i]) : ~ordered(vals[i]);
+  }
+
+  void visit(const double* vals, size_t n) {
+    start_(n, false);
+    for (size_t i = 0; i < n; ++i) keys_[i] = asc_ ? ordered(vals[i]) : ~ordered(vals[i]);
+  }
+
+  void visit(const uint8_t* bits, size_t n) {
+    start_(n, false);
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t b = (bits[i / 8] >> (i % 8)) & 1;
+      keys_[i] = asc_ ? b : ~b;
+    }
+  }
+
+  void visit(String** vals, size_t n) {
+    start_(n, true);
+    for (size_t i = 0; i < n; ++i) skeys_[i] = vals[i]->clone();
+  }
+
+  void start_(size_t n, bool strings) {
+    n_ = n;
+    strings_ = strings;
+    rows_ = new size_t[n];
+    for (size_t i = 0; i < n; ++i) rows_[i] = first_ + i;
+    if (strings) skeys_ = new String*[n];
+    else keys_ = new uint64_t[n];
+  }
+
+  /** Sorts the keys read from the chunk. */
+  void sort() {
+    if (keys_ != nullptr) radix_sort_();
+    else merge_sort_(0, n_);
+  }
+
+  /** The key of the given row's value in the given column. */
+  uint64_t key(Row& r, size_t col) {
+    char type = r.col_type(col);
+    uint64_t k = type == 'I' ? ordered(r.get_int(col))
+               : type == 'D' ? ordered(r.get_double(col)) : r.get_bool(col);
+    return asc_ ? k : ~k;
+  }
+
+  /** How many keys of this sorted run go before the given row's value in
+   *  the given column. */
+  size_t rank(Row& r, size_t col) {
+    uint64_t k = strings_ ? 0 : key(r, col);
+    String* sk = strings_ ? r.get_string(col) : nullptr;
+    size_t lo = 0, hi = n_;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      bool before;
+      if (strings_) {
+        int c = strcmp(skeys_[mid]->c_str(), sk->c_str());
+        before = asc_ ? c < 0 : c > 0;
+      } else {
+        before = keys_[mid] < k;
+      }
+      if (before) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  /** Writes the i-th key as text. */
+  void write(size_t i, ByteArray* out) {
+    char buf[32];
+    if (strings_) snprintf(buf, sizeof(buf), "%zu:", skeys_[i]->size());
+    else snprintf(buf, sizeof(buf), "%llu ", (unsigned long long)keys_[i]);
+    out->push_string(buf);
+    if (strings_) {
+      out->append(skeys_[i]->c_str(), skeys_[i]->size());
+      out->push_back(' ');
+    }
+  }
+
+  /** Fills an empty run with the keys in the given texts, as written by
+   *  write. */
+  void read(const char** texts, size_t count, bool strings) {
+    size_t n = 0;
+    for (size_t t = 0; t < count; ++t) {
+      for (char* at = (char*)texts[t]; *at != 0; ++n) at = skip_(at, strings, n, false);
+    }
+    start_(n, strings);
+    n = 0;
+    for (size_t t = 0; t < count; ++t) {
+      for (char* at = (char*)texts[t]; *at != 0; ++n) at = skip_(at, strings, n, true);
+    }
+  }
+
+  // reads the key written at at, stores it as the n-th if told to, and
+  // returns where the next key starts
+  char* skip_(char* at, bool strings, size_t n, bool store) {
+    if (!strings) {
+      uint64_t k = strtoull(at, &at, 10);
+      if (store) keys_[n] = k;
+      return at + 1;
+    }
+    size_t len = strtoull(at, &at, 10);
+    if (store) skeys_[n] = new String(at + 1, len);
+    return at + len + 2;
+  }
+
+  /** Bytes the run takes in memory. */
+  size_t bytes() {
+    size_t bytes = n_ * (sizeof(size_t) + (strings_ ? sizeof(String*) : 8));
+    if (strings_) {
+      for (size_t i = 0; i < n_; ++i) bytes += sizeof(String) + skeys_[i]->size();
+    }
+    return bytes;
+  }
+
+  /** Writes the sorted run to the given spill file and frees it from
+   *  memory. @returns false, and marks the run failed, if it could not be
+   *  written */
+  bool spill(SpillFile* file) {
+    ByteArray out;
+    for (size_t i = 0; i < n_; ++i) {
+      put_record_(&out, strings_ ? 0 : keys_[i], strings_ ? skeys_[i] : nullptr, rows_[i]);
+      if (strings_) delete skeys_[i];
+    }
+    file_ = file;
+    failed_ = !file->append(out.data(), out.size(), &offset_);
+    end_ = offset_ + out.size();
+    delete[] keys_;
+    delete[] skeys_;
+    delete[] rows_;
+    keys_ = nullptr;
+    skeys_ = nullptr;
+    rows_ = nullptr;
+    skey_ = nullptr;
+    return !failed_;
+  }
+
+  /**
+   * Makes this empty run the merge of the given spilled ones, written to
+   * the given spill file, a buffer at a time.
+   * @returns false, and marks the run failed, if one of them could not be
+   *          read or this one written
+   */
+  bool merge(SortRun** runs, size_t n, SpillFile* out);
+
+  // appends the merged records in buf to the file, right after those
+  // written before, and empties it
+  void write_(ByteArray* buf, bool* first) {
+    size_t at = 0;
+    if (!failed_ && !file_->append(buf->data(), buf->size(), &at)) failed_ = true;
+    if (*first) offset_ = at;
+    *first = false;
+    end_ = at + buf->size();
+    buf->size_ = 0;
+  }
+
+  // writes a record of a spilled run: the key, or the String's length and
+  // bytes, then the row
+  static void put_record_(ByteArray* out, uint64_t key, String* skey, size_t row) {
+    if (skey == nullptr) {
+      out->append((const char*)&key, 8);
+    } else {
+      size_t len = skey->size();
+      out->append((const char*)&len, sizeof(size_t));
+      out->append(skey->c_str(), len);
+    }
+    out->append((const char*)&row, sizeof(size_t));
+  }
+
+  /** Reads the next record in order into key_ or skey_, and row_.
+   *  @returns false if there is none, or it could not be read */
+  bool next() {
+    if (at_ == n_ || failed_) return false;
+    if (file_ == nullptr) {
+      if (strings_) skey_ = skeys_[at_];
+      else key_ = keys_[at_];
+      row_ = rows_[at_];
+    } else if (!strings_) {
+      if (!read_(&key_, 8) || !read_(&row_, sizeof(size_t))) return false;
+    } else {
+      size_t len;
+      if (!read_(&len, sizeof(size_t))) return false;
+      char* str = new char[len + 1];
+      str[len] = 0;
+      delete skey_;
+      skey_ = new String(true, str, len);
+      if (!read_(str, len) || !read_(&row_, sizeof(size_t))) return false;
+    }
+    ++at_;
+    return true;
+  }
+
+  // copies the next n bytes of the spilled run into dst, reading the file
+  // READ_BYTES at a time. Marks the run failed if it cannot.
+  bool read_(void* dst, size_t n) {
+    char* to = (char*)dst;
+    while (n > 0) {
+      if (buf_at_ == buf_len_) {
+        if (buf_ == nullptr) buf_ = new char[READ_BYTES];
+        size_t want = end_ - offset_ < READ_BYTES ? end_ - offset_ : READ_BYTES;
+        buf_len_ = want == 0 ? 0 : file_->read(buf_, want, offset_);
+        buf_at_ = 0;
+        if (buf_len_ == 0) {
+          failed_ = true;
+          return false;
+        }
+        offset_ += buf_len_;
+      }
+      size_t take = n < buf_len_ - buf_at_ ? n : buf_len_ - buf_at_;
+      memcpy(to, buf_ + buf_at_, take);
+      buf_at_ += take;
+      to += take;
+      n -= take;
+    }
+    return true;
+  }
+
+  /** Whether this run's record goes before the other's: the smaller key,
+   *  or for equal keys the earlier row, so that merging is stable. */
+  bool before(SortRun* other) {
+    if (!strings_) {
+      if (key_ != other->key_) return key_ < other->key_;
+    } else {
+      int c = strcmp(skey_->c_str(), other->skey_->c_str());
+      if (c != 0) return asc_ ? c < 0 : c > 0;
+    }
+    return row_ < other->row_;
+  }
+
+  void radix_sort_() {
+    uint64_t* keys = new uint64_t[n_];
+    size_t* rows = new size_t[n_];
+    size_t counts[256];
+    for (size_t shift = 0; shift < 64; shift += 8) {
+      memset(counts, 0, sizeof(counts));
+      for (size_t i = 0; i < n_; ++i) ++counts[(keys_[i] >> shift) & 0xFF];
+      if (n_ == 0 || counts[(keys_[0] >> shift) & 0xFF] == n_) continue;
+      size_t sum = 0;
+      for (size_t b = 0; b < 256; ++b) {
+        size_t c = counts[b];
+        counts[b] = sum;
+        sum += c;
+      }
+      for (size_t i = 0; i < n_; ++i) {
+        size_t at = counts[(keys_[i] >> shift) & 0xFF]++;
+        keys[at] = keys_[i];
+        rows[at] = rows_[i];
+      }
+      uint64_t* tk = keys_;
+      keys_ = keys;
+      keys = tk;
+      size_t* tr = rows_;
+      rows_ = rows;
+      rows = tr;
+    }
+    delete[] keys;
+    delete[] rows;
+  }
+
+  // sorts the Strings from lo up to hi, carrying their rows along
+  void merge_sort_(size_t lo, size_t hi) {
+    if (hi - lo < 2) return;
+    size_t mid = lo + (hi - lo) / 2;
+    merge_sort_(lo, mid);
+    merge_sort_(mid, hi);
+    String** skeys = new String*[hi - lo];
+    size_t* rows = new size_t[hi - lo];
+    size_t a = lo, b = mid, k = 0;
+    while (a < mid || b < hi) {
+      bool left = b == hi;
+      if (a < mid && b < hi) {
+        int c = strcmp(skeys_[a]->c_str(), skeys_[b]->c_str());
+        left = asc_ ? c <= 0 : c >= 0;
+      }
+      size_t from = left ? a++ : b++;
+      skeys[k] = skeys_[from];
+      rows[k++] = rows_[from];
+    }
+    memcpy(&skeys_[lo], skeys, (hi - lo) * sizeof(String*));
+    memcpy(&rows_[lo], rows, (hi - lo) * sizeof(size_t));
+    delete[] skeys;
+    delete[] rows;
+  }
+};
+
+/**
+ * Reads one chunk of a column into a run and sorts it, spilling it to
+ * disk if told to. Run by DataFrame::sort_by, one task per chunk.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SortTask : public Task {
+public:
+  Column* col_;
+  size_t chunk_;
+  SortRun* run_;       // not owned
+  SpillFile* spill_;   // not owned; where to spill the run, or nullptr
+
+  SortTask(Column* col, size_t chunk, SortRun* run, SpillFile* spill) {
+    col_ = col;
+    chunk_ = chunk;
+    run_ = run;
+    spill_ = spill;
+  }
+
+  void run() {
+    ReadAhead ahead;
+    col_->visit_chunk_(chunk_, *run_, &ahead);
+    run_->sort();
+    if (spill_ != nullptr) run_->spill(spill_);
+  }
+};
+
+/**
+ * Merges sorted runs, handing out their rows in order. The runs sit in a
+ * binary heap ordered by their current records. narrow() first cuts down
+ * the number of spilled runs a merge has to read at once.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class RunMerger : public Object {
+public:
+  SortRun** heap_;   // not owned
+  size_t size_;
+
+  RunMerger(SortRun** runs, size_t n) {
+    heap_ = new SortRun*[n];
+    size_ = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (!runs[i]->next()) continue;
+      heap_[size_] = runs[i];
+      up_(size_++);
+    }
+  }
+
+  ~RunMerger() {
+    delete[] heap_;
+  }
+
+  /**
+   * Merges the n spilled runs in *runs SORT_FAN_IN at a time, into runs
+   * written to *out, and again from there back to *in, until at most
+   * SORT_FAN_IN are left. Replaces the runs in *runs, and their number in
+   * *n, with the merged ones. Each pass empties the file it read.
+   * @returns false if a run could not be read or written
+   */
+  static bool narrow(SortRun*** runs, size_t* n, SpillFile** in, SpillFile** out) {
+    size_t fan = SORT_FAN_IN < 2 ? 2 : SORT_FAN_IN;
+    bool ok = true;
+    while (ok && *n > fan) {
+      size_t m = (*n + fan - 1) / fan;
+      SortRun** merged = new SortRun*[m];
+      for (size_t g = 0; g < m; ++g) {
+        size_t lo = g * fan;
+        size_t hi = lo + fan < *n ? lo + fan : *n;
+        merged[g] = new SortRun(0, (*runs)[lo]->asc_);
+        ok = ok && merged[g]->merge(*runs + lo, hi - lo, *out);
+      }
+      for (size_t i = 0; i < *n; ++i) delete (*runs)[i];
+      delete[] *runs;
+      *runs = merged;
+      *n = m;
+      (*in)->clear();
+      SpillFile* t = *in;
+      *in = *out;
+      *out = t;
+    }
+    return ok;
+  }
+
+  /** The run holding the next record in order, or nullptr if none is
+   *  left. */
+  SortRun* top() {
+    return size_ == 0 ? nullptr : heap_[0];
+  }
+
+  /** Puts the next row in order in *row. @returns false if none is left */
+  bool next(size_t* row) {
+    if (size_ == 0) return false;
+    SortRun* top = heap_[0];
+    *row = top->row_;
+    if (!top->next()) heap_[0] = heap_[--size_];
+    down_(0);
+    return true;
+  }
+
+  void up_(size_t i) {
+    while (i > 0 && heap_[i]->before(heap_[(i - 1) / 2])) {
+      swap_(i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  }
+
+  void down_(size_t i) {
+    while (true) {
+      size_t least = i;
+      size_t l = 2 * i + 1, r = 2 * i + 2;
+      if (l < size_ && heap_[l]->before(heap_[least])) least = l;
+      if (r < size_ && heap_[r]->before(heap_[least])) least = r;
+      if (least == i) return;
+      swap_(i, least);
+      i = least;
+    }
+  }
+
+  void swap_(size_t a, size_t b) {
+    SortRun* t = heap_[a];
+    heap_[a] = heap_[b];
+    heap_[b] = t;
+  }
+};
+
+// defined after the RunMerger it merges with
+bool SortRun::merge(SortRun** runs, size_t n, SpillFile* out) {
+  strings_ = runs[0]->strings_;
+  file_ = out;
+  ByteArray buf;
+  bool first = true;
+  RunMerger merger(runs, n);
+  for (SortRun* top; !failed_ && (top = merger.top()) != nullptr;) {
+    put_record_(&buf, top->key_, strings_ ? top->skey_ : nullptr, top->row_);
+    ++n_;
+    size_t row;
+    merger.next(&row);
+    if (buf.size() >= READ_BYTES * 16) write_(&buf, &first);
+  }
+  write_(&buf, &first);
+  for (size_t i = 0; i < n; ++i) failed_ = failed_ || runs[i]->failed_;
+  return !failed_;
+}
+
+/**
+ * Writes every so many of the values it visits, as SortRun keys in text,
+ * to sample the key column of a cluster sort.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class SortSampler : public SpanVisitor {
+public:
+  SortRun run_;        // holds the keys of the chunk being visited
+  size_t step_;        // values between samples
+  size_t skip_;        // values left before the next sample
+  ByteArray samples_;
+
+  SortSampler(bool asc, size_t step) : run_(0, asc) {
+    step_ = step;
+    skip_ = 0;
+  }
+
+  void visit(const int* vals, size_t n) { run_.visit(vals, n); sample_(); }
+  void visit(const double* vals, size_t n) { run_.visit(vals, n); sample_(); }
+  void visit(const uint8_t* bits, size_t n) { run_.visit(bits, n); sample_(); }
+  void visit(String** vals, size_t n) { run_.visit(vals, n); sample_(); }
+
+  // writes the samples of the chunk in run_, then empties run_
+  void sample_() {
+    size_t i = skip_;
+    for (; i < run_.n_; i += step_) run_.write(i, &samples_);
+    skip_ = i - run_.n_;
+    if (run_.strings_) {
+      for (size_t k = 0; k < run_.n_; ++k) delete run_.skeys_[k];
+    }
+    delete[] run_.keys_;
+    delete[] run_.skeys_;
+    delete[] run_.rows_;
+    run_.keys_ = nullptr;
+    run_.skeys_ = nullptr;
+    run_.rows_ = nullptr;
+    run_.n_ = 0;
+  }
+};
+
+/**
+ * Splits the rows it visits into ranges of their key, given by sorted
+ * splitters, writing each to the text bound for the node that owns its
+ * range. Used to shuffle the rows of a cluster sort, so that node 0 gets
+ * the first range and the last node the last.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class RangeRower : public ShuffleRower {
+public:
+  SortRun* splitters_;   // not owned
+
+  RangeRower(size_t col, size_t nodes, SortRun* splitters) : ShuffleRower(col, nodes) {
+    splitters_ = splitters;
+  }
+
+  size_t node_of_(Row& r) {
+    return splitters_->rank(r, col_);
+  }
+
+  Rower* clone() {
+    return new RangeRower(col_, nodes_, splitters_);
+  }
+};
@@ -0,0 +1,250 @@
+// lang::CwC
+#pragma once
+
+#include "object.h"
+#include "key.h"
+#include "chunk.h"
+#include "keyindex.h"
+#include "thread.h"
+
+// default number of bytes of chunks a node keeps cached
+size_t CHUNK_CACHE_BUDGET = 64 * 1024 * 1024;
+
+/**
+  * One chunk held by a ChunkCache, and its place in the cache's
+  * least recently used list.
+  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+  */
+class CacheEntry : public Object {
+public:
+  Key* key_;          // owned copy of the key the chunk is stored under
+  Chunk* chunk_;      // owned
+  size_t bytes_;      // memory charged for the chunk
+  size_t pins_;       // number of readers using the chunk right now
+  size_t slot_;       // position in ChunkCache::entries_
+  CacheEntry* prev_;  // next more recently used entry
+  CacheEntry* next_;  // next less recently used entry
+
+  CacheEntry(Key* key, Chunk* chunk, size_t bytes) {
+    key_ = new Key(key->getName()->clone(), key->getHomeNode());
+    key_->setCreatorID(key->getCreatorID());
+    chunk_ = chunk;
+    bytes_ = bytes;
+    pins_ = 0;
+    prev_ = nullptr;
+    next_ = nullptr;
+  }
+
+  ~CacheEntry() {
+    delete key_;
+    delete chunk_;
+  }
+};
+
+/**
+  * A node-wide cache of decoded chunks, keyed by Key and bounded by a
+  * budget of bytes, shared by every column on the node. A reader acquires
+  * a chunk, reads it for as long as it needs, and releases it. Chunks in
+  * use are never evicted; when the cache is over budget the least recently
+  * used chunks that are not in use are. Counts hits, misses and evictions.
+  * Safe to use from several threads.
+  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+  */
+class ChunkCache : public Object {
+public:
+  CacheEntry** entries_;  // the cached chunks, in no particular order
+  size_t size_;           // number of entries
+  size_t capacity_;       // room in entries_
+  KeyIndex index_;        // key of each entry to its slot in entries_
+  CacheEntry* head_;      // most recently used entry
+  CacheEntry* tail_;      // least recently used entry
+  size_t budget_;         // bytes we try to stay under
+  size_t bytes_;          // bytes charged for every cached chunk
+  size_t hits_;
+  size_t misses_;
+  size_t evictions_;
+  Lock lock_;
+
+  ChunkCache() : ChunkCache(CHUNK_CACHE_BUDGET) {}
+
+  ChunkCache(size_t budget) {
+    size_ = 0;
+    capacity_ = 16;
+    entries_ = new CacheEntry*[capacity_];
+    head_ = nullptr;
+    tail_ = nullptr;
+    budget_ = budget;
+    bytes_ = 0;
+    hits_ = 0;
+    misses_ = 0;
+    evictions_ = 0;
+  }
+
+  ~ChunkCache() {
+    for (size_t i = 0; i < size_; ++i) delete entries_[i];
+    delete[] entries_;
+  }
+
+  /**
+   * Looks up the chunk stored under the given key and marks it in use.
+   * @returns the chunk, which stays valid until it is released, or
+   *          nullptr if it is not cached
+   */
+  Chunk* acquire(Key* key) {
+    lock_.lock();
+    int slot = index_.get(key);
+    if (slot == -1) {
+      ++misses_;
+      lock_.unlock();
+      return nullptr;
+    }
+    CacheEntry* e = entries_[slot];
+    ++e->pins_;
+    ++hits_;
+    unlink_(e);
+    push_front_(e);
+    lock_.unlock();
+    return e->chunk_;
+  }
+
+  /** Whether the chunk stored under the given key is cached. Does not
+   *  count as a hit or a miss. */
+  bool contains(Key* key) {
+    lock_.lock();
+    bool found = index_.get(key) != -1;
+    lock_.unlock();
+    return found;
+  }
+
+  /**
+   * Caches a chunk fetched after acquire missed, and marks it in use.
+   * Takes ownership of the chunk. If another reader cached the same key
+   * first, the given chunk is deleted and theirs is returned instead.
+   * @param bytes: memory to charge for the chunk
+   * @returns the cached chunk, which stays valid until it is released
+   */
+  Chunk* add(Key* key, Chunk* chunk, size_t bytes) {
+    lock_.lock();
+    int slot = index_.get(key);
+    if (slot != -1) {
+      delete chunk;
+      CacheEntry* e = entries_[slot];
+      ++e->pins_;
+      lock_.unlock();
+      return e->chunk_;
+    }
+    if (size_ == capacity_) {
+      CacheEntry** entries = new CacheEntry*[capacity_ * 2];
+      memcpy(entries, entries_, size_ * sizeof(CacheEntry*));
+      delete[] entries_;
+      entries_ = entries;
+      capacity_ *= 2;
+    }
+    CacheEntry* e = new CacheEntry(key, chunk, bytes);
+    e->pins_ = 1;
+    e->slot_ = size_;
+    entries_[size_++] = e;
+    index_.put(e->key_, e->slot_);
+    push_front_(e);
+    bytes_ += bytes;
+    evict_();
+    lock_.unlock();
+    return chunk;
+  }
+
+  /** Marks the chunk stored under the given key as no longer in use by
+   *  one of its readers. */
+  void release(Key* key) {
+    lock_.lock();
+    int slot = index_.get(key);
+    assert(slot != -1);
+    CacheEntry* e = entries_[slot];
+    assert(e->pins_ > 0);
+    --e->pins_;
+    evict_();
+    lock_.unlock();
+  }
+
+  /** Forgets every chunk not in use whose key was made by the given
+   *  creator, once that creator's chunks are gone from the store. */
+  void drop(size_t creator_id) {
+    lock_.lock();
+    for (size_t i = 0; i < size_;) {
+      CacheEntry* e = entries_[i];
+      if (e->pins_ == 0 && e->key_->getCreatorID() == creator_id) remove_(e);
+      else ++i;
+    }
+    lock_.unlock();
+  }
+
+  /** Changes the byte budget, evicting chunks to meet it. */
+  void set_budget(size_t budget) {
+    lock_.lock();
+    budget_ = budget;
+    evict_();
+    lock_.unlock();
+  }
+
+  size_t size() {
+    return size_;
+  }
+
+  size_t bytes() {
+    return bytes_;
+  }
+
+  size_t hits() {
+    return hits_;
+  }
+
+  size_t misses() {
+    return misses_;
+  }
+
+  size_t evictions() {
+    return evictions_;
+  }
+
+  // evict least recently used chunks not in use until we are in budget
+  void evict_() {
+    CacheEntry* e = tail_;
+    while (bytes_ > budget_ && e != nullptr) {
+      CacheEntry* prev = e->prev_;
+      if (e->pins_ == 0) {
+        remove_(e);
+        ++evictions_;
+      }
+      e = prev;
+    }
+  }
+
+  // delete an entry, moving the last entry into its slot
+  void remove_(CacheEntry* e) {
+    unlink_(e);
+    index_.remove(e->key_);
+    CacheEntry* last = entries_[--size_];
+    if (last != e) {
+      last->slot_ = e->slot_;
+      entries_[e->slot_] = last;
+      index_.put(last->key_, last->slot_);
+    }
+    bytes_ -= e->bytes_;
+    delete e;
+  }
+
+  void unlink_(CacheEntry* e) {
+    if (e->prev_ != nullptr) e->prev_->next_ = e->next_;
+    else head_ = e->next_;
+    if (e->next_ != nullptr) e->next_->prev_ = e->prev_;
+    else tail_ = e->prev_;
+    e->prev_ = nullptr;
+    e->next_ = nullptr;
+  }
+
+  void push_front_(CacheEntry* e) {
+    e->next_ = head_;
+    if (head_ != nullptr) head_->prev_ = e;
+    head_ = e;
+    if (tail_ == nullptr) tail_ = e;
+  }
+};
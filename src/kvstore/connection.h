@@ -0,0 +1,285 @@
+// lang::CwC
+#pragma once
+
+#include "object.h"
+#include "message.h"
+#include "thread.h"
+#include "network.h"
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* NodeInfo
+ * Each node is identified by its node id and socket address.
+ * Once a node has been talked to, conn holds the long-lived connection
+ * used to send it messages.
+ * authors: vitek@me.com, horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class NodeInfo : public Object {
+public:
+  unsigned id;
+  sockaddr_in address;
+  Connection* conn = nullptr;  // connection to this node, not owned
+  Lock lock;                   // guards conn
+};
+
+/**
+ * Keeps one long-lived TCP connection per peer and moves framed messages
+ * over them. Connections are opened lazily on the first send to a peer, or
+ * adopted when the peer connects to us first, and then reused for every
+ * later message in both directions. Requests and replies are matched by
+ * Message::id_, so any number of requests may be in flight on one
+ * connection at once. Inbound traffic on every connection is served by a
+ * single Reactor.
+ * @authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class ConnectionManager : public Object {
+public:
+  size_t me_;           // index of this node
+  NodeInfo** nodes_;    // directory of all nodes, not owned
+  size_t num_nodes_;
+  int listen_;          // listening socket of this node
+  Reactor* reactor_;    // owns every connection
+  MessageSerializer ms_;
+
+  ConnectionManager(size_t me, int listen) {
+    me_ = me;
+    nodes_ = nullptr;
+    num_nodes_ = 0;
+    listen_ = listen;
+    reactor_ = new Reactor(listen);
+  }
+
+  ~ConnectionManager() {
+    delete reactor_;
+    close(listen_);
+  }
+
+  /** Sets the directory used to look up and hold peer connections. */
+  void set_nodes(NodeInfo** nodes, size_t num_nodes) {
+    nodes_ = nodes;
+    num_nodes_ = num_nodes;
+  }
+
+  /**
+   * Sends the message to its target over the connection to that node,
+   * opening the connection first if there is none yet. Never waits for
+   * the peer to read it.
+   */
+  void send_m(Message* msg) {
+    assert(msg->target() < num_nodes_ && msg->target() != me_);
+    NodeInfo* tgt = nodes_[msg->target()];
+    const char* meta = ms_.serialize(msg);
+    size_t body_len = 0;
+    const char* body = ms_.payload(msg, &body_len);
+
+    FrameHeader hdr;
+    hdr.magic = FRAME_MAGIC;
+    hdr.kind = (uint32_t)msg->get_kind();
+    hdr.id = msg->id_;
+    hdr.meta_len = strlen(meta);
+    hdr.body_len = body_len;
+
+    tgt->lock.lock();
+    if (tgt->conn == nullptr) connect_(tgt);
+    Connection* c = tgt->conn;
+    tgt->lock.unlock();
+    bool ok = c->send_frame(&hdr, meta, body);
+    delete[] meta;
+    if (!ok) {
+      printf("Unable to send to node %zu: %s\n", msg->target(), strerror(errno));
+      exit(1);
+    }
+  }
+
+  /**
+   * Blocks until one whole frame has been read from the connection and
+   * returns the message it holds, or nullptr if the connection was closed.
+   * Only used during registration, before the reactor runs.
+   */
+  Message* recv_m(Connection* c) {
+    Message* msg = nullptr;
+    int r;
+    while ((r = c->read_frame(&ms_, &msg)) == 0) wait_for(c->fd_, POLLIN);
+    return r == 1 ? msg : nullptr;
+  }
+
+  /** Accepts a connection on the listening socket, blocking until one
+   *  arrives. Only used during registration, before the reactor runs. */
+  Connection* accept_() {
+    sockaddr_in sender;
+    socklen_t addrlen = sizeof(sender);
+    int fd;
+    while ((fd = accept(listen_, (sockaddr*)&sender, &addrlen)) < 0) {
+      assert((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+             && "Unable to accept connection.");
+      wait_for(listen_, POLLIN);
+    }
+    return new Connection(fd);
+  }
+
+  /**
+   * Records that the given connection leads to the given node. It is used
+   * to send to that node unless we already have a connection to it.
+   */
+  void adopt(size_t node, Connection* c) {
+    assert(node < num_nodes_);
+    NodeInfo* n = nodes_[node];
+    n->lock.lock();
+    if (n->conn == nullptr || !n->conn->open_) n->conn = c;
+    n->lock.unlock();
+  }
+
+  /** Forgets a connection whose peer has gone away. */
+  void drop(Connection* c) {
+    for (size_t i = 0; i < num_nodes_; ++i) {
+      if (i == me_) continue;
+      nodes_[i]->lock.lock();
+      if (nodes_[i]->conn == c) nodes_[i]->conn = nullptr;
+      nodes_[i]->lock.unlock();
+    }
+  }
+
+  /** Hands a connection to the reactor, which then owns it. */
+  void watch(Connection* c) {
+    reactor_->add(c);
+  }
+
+  /** Serves every connection until the handler is finished. */
+  void run(MessageHandler* h) {
+    reactor_->run(h);
+  }
+
+  /** Interrupts the reactor so it checks whether it is finished. */
+  void wake() {
+    reactor_->wake();
+  }
+
+  // Opens the connection to the given node and introduces ourselves with
+  // a Register message so it can reuse the connection to reach us.
+  // Called with the node's lock held.
+  void connect_(NodeInfo* tgt) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0 && "Unable to make client socket.\n");
+    if (connect(fd, (sockaddr*)&tgt->address, sizeof(tgt->address)) < 0) {
+      printf("Error conecting: %s\n", strerror( errno ) );
+      printf("Unable to connect to remote node %u.\n", tgt->id);
+      exit(1); // Teardown? TODO
+    }
+    Connection* c = new Connection(fd);
+    watch(c);
+    tgt->conn = c;
+
+    NodeInfo* me = nodes_[me_];
+    Register hello(me_, tgt->id, 0, me->address, ntohs(me->address.sin_port));
+    const char* meta = ms_.serialize(&hello);
+    FrameHeader hdr;
+    hdr.magic = FRAME_MAGIC;
+    hdr.kind = (uint32_t)MsgKind::Register;
+    hdr.id = 0;
+    hdr.meta_len = strlen(meta);
+    hdr.body_len = 0;
+    bool ok = c->send_frame(&hdr, meta, "");
+    delete[] meta;
+    assert(ok && "Unable to introduce ourselves to remote node.");
+  }
+};
+
+/**
+ * Requests waiting for their replies, keyed by message id. A requester
+ * registers the id before sending, the receiving thread delivers the
+ * Reply carrying that id, and the requester is woken up to collect it.
+ * @authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class ReplyTable : public Object {
+public:
+  size_t* ids_;      // ids of outstanding requests
+  Reply** replies_;  // delivered reply for each id, nullptr until it arrives
+  size_t size_;
+  size_t capacity_;
+  Lock lock_;
+
+  ReplyTable() {
+    size_ = 0;
+    capacity_ = 16;
+    ids_ = new size_t[capacity_];
+    replies_ = new Reply*[capacity_];
+  }
+
+  ~ReplyTable() {
+    for (size_t i = 0; i < size_; ++i) delete replies_[i];
+    delete[] ids_;
+    delete[] replies_;
+  }
+
+  /** Registers a request whose reply will be waited for. */
+  void expect(size_t id) {
+    lock_.lock();
+    if (size_ == capacity_) {
+      size_t* ids = new size_t[capacity_ * 2];
+      Reply** replies = new Reply*[capacity_ * 2];
+      memcpy(ids, ids_, size_ * sizeof(size_t));
+      memcpy(replies, replies_, size_ * sizeof(Reply*));
+      delete[] ids_;
+      delete[] replies_;
+      ids_ = ids;
+      replies_ = replies;
+      capacity_ *= 2;
+    }
+    ids_[size_] = id;
+    replies_[size_] = nullptr;
+    ++size_;
+    lock_.unlock();
+  }
+
+  /**
+   * Hands a reply to the request it answers.
+   * @returns false if no request is waiting for it
+   */
+  bool deliver(Reply* r) {
+    lock_.lock();
+    for (size_t i = 0; i < size_; ++i) {
+      if (ids_[i] == r->id_ && replies_[i] == nullptr) {
+        replies_[i] = r;
+        lock_.notify_all();
+        lock_.unlock();
+        return true;
+      }
+    }
+    lock_.unlock();
+    return false;
+  }
+
+  /** Whether the reply to the given request has arrived. */
+  bool ready(size_t id) {
+    lock_.lock();
+    bool arrived = false;
+    for (size_t i = 0; i < size_; ++i) {
+      if (ids_[i] == id && replies_[i] != nullptr) arrived = true;
+    }
+    lock_.unlock();
+    return arrived;
+  }
+
+  /** Blocks until the reply to the given request arrives and returns it.
+   *  The caller owns the reply. */
+  Reply* wait(size_t id) {
+    lock_.lock();
+    while (true) {
+      for (size_t i = 0; i < size_; ++i) {
+        if (ids_[i] == id && replies_[i] != nullptr) {
+          Reply* r = replies_[i];
+          --size_;
+          ids_[i] = ids_[size_];
+          replies_[i] = replies_[size_];
+          lock_.unlock();
+          return r;
+        }
+      }
+      lock_.wait();
+    }
+  }
+};
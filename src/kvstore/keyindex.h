@@ -0,0 +1,149 @@
+// lang::CwC
+#pragma once
+
+#include "object.h"
+#include "key.h"
+#include "array.h"
+
+/**
+  * An open-addressing (linear probing) hash index from Keys to the slot
+  * at which they are stored in a KVStore's parallel key/value arrays.
+  * Keys are hashed with Key::hash(), which is cached on the key, and the
+  * full hash is kept in the table so that Key::equals is only called when
+  * two hashes match. Removal uses backward shifting, so there are no
+  * tombstones and probe sequences never degrade over time.
+  * Does NOT take ownership of the keys.
+  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+  */
+class KeyIndex : public Object {
+public:
+
+    Key** keys_;        // key in each bucket, nullptr if the bucket is empty
+    size_t* hashes_;    // cached hash of the key in each bucket
+    size_t* slots_;     // slot in the kvstore arrays for each bucket
+    size_t capacity_;   // number of buckets, always a power of two
+    size_t size_;       // number of keys in the index
+
+    KeyIndex() {
+        size_ = 0;
+        alloc_(16);
+    }
+
+    ~KeyIndex() {
+        free_();
+    }
+
+    /** Number of keys in the index. */
+    size_t size() {
+        return size_;
+    }
+
+    /**
+     * Returns the slot the given key was inserted with, or -1 if the key
+     * is not in the index.
+     */
+    int get(Key* key) {
+        size_t h = key->hash();
+        size_t mask = capacity_ - 1;
+        for (size_t i = bucket_(h); keys_[i] != nullptr; i = (i + 1) & mask) {
+            if (hashes_[i] == h && key->equals(keys_[i])) return (int)slots_[i];
+        }
+        return -1;
+    }
+
+    /**
+     * Maps the given key to the given slot. If an equal key is already in
+     * the index, its slot is replaced.
+     */
+    void put(Key* key, size_t slot) {
+        if ((size_ + 1) * 2 > capacity_) grow_();
+        size_t h = key->hash();
+        size_t mask = capacity_ - 1;
+        size_t i = bucket_(h);
+        for (; keys_[i] != nullptr; i = (i + 1) & mask) {
+            if (hashes_[i] == h && key->equals(keys_[i])) {
+                slots_[i] = slot;
+                return;
+            }
+        }
+        keys_[i] = key;
+        hashes_[i] = h;
+        slots_[i] = slot;
+        ++size_;
+    }
+
+    /** Removes the given key from the index, if present. */
+    void remove(Key* key) {
+        size_t h = key->hash();
+        size_t mask = capacity_ - 1;
+        size_t i = bucket_(h);
+        for (; keys_[i] != nullptr; i = (i + 1) & mask) {
+            if (hashes_[i] == h && key->equals(keys_[i])) break;
+        }
+        if (keys_[i] == nullptr) return;
+
+        // shift back any following entry whose home bucket lies at or
+        // before the hole, so that lookups never stop early
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; keys_[j] != nullptr; j = (j + 1) & mask) {
+            size_t home = bucket_(hashes_[j]);
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                keys_[hole] = keys_[j];
+                hashes_[hole] = hashes_[j];
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        keys_[hole] = nullptr;
+        --size_;
+    }
+
+    /** Empties the index and indexes every key of the given array by its
+     *  position in that array. */
+    void rebuild(KeyArray* keys) {
+        free_();
+        size_ = 0;
+        size_t cap = 16;
+        while (cap < keys->size() * 2) cap *= 2;
+        alloc_(cap);
+        for (size_t i = 0; i < keys->size(); ++i) put(keys->get(i), i);
+    }
+
+    /** Mixes the (weak) key hash so that the high bits pick the bucket. */
+    size_t bucket_(size_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h & (capacity_ - 1);
+    }
+
+    void alloc_(size_t cap) {
+        capacity_ = cap;
+        keys_ = new Key*[cap];
+        hashes_ = new size_t[cap];
+        slots_ = new size_t[cap];
+        for (size_t i = 0; i < cap; ++i) keys_[i] = nullptr;
+    }
+
+    void free_() {
+        delete[] keys_;
+        delete[] hashes_;
+        delete[] slots_;
+    }
+
+    // double the number of buckets and reinsert every key
+    void grow_() {
+        Key** keys = keys_;
+        size_t* hashes = hashes_;
+        size_t* slots = slots_;
+        size_t cap = capacity_;
+        alloc_(cap * 2);
+        size_ = 0;
+        for (size_t i = 0; i < cap; ++i) {
+            if (keys[i] != nullptr) put(keys[i], slots[i]);
+        }
+        delete[] keys;
+        delete[] hashes;
+        delete[] slots;
+    }
+};
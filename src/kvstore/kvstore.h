@@ -8,6 +8,11 @@
 #include <cstdio>
 #include "message.h"
 #include "key.h"
+#include "keyindex.h"
+#include "chunkcache.h"
+#include "prefetch.h"
+#include "thread.h"
+#include "connection.h"
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -17,14 +22,28 @@ using namespace std;
 
 class DataFrame;
 
-/* NodeInfo
- * Each node is identified by its node id and socket address.
- * authors: vitek@me.com, horn.s@husky.neu.edu, armani.a@husky.neu.edu
+/**
+ * A WaitAndGet whose key, or a MultiGet some of whose keys, have not been
+ * put on this node yet. It is parked here and answered as soon as they
+ * arrive, so the receiving thread never blocks on it.
  */
-class NodeInfo : public Object {
+class ParkedGet : public Object {
 public:
-  unsigned id;
-  sockaddr_in address;
+  Message* msg_;   // owned, along with the keys it asks for
+  ParkedGet* next_;
+
+  ParkedGet(Message* msg, ParkedGet* next) {
+    msg_ = msg;
+    next_ = next;
+  }
+
+  ~ParkedGet() {
+    WaitAndGet* wag = dynamic_cast<WaitAndGet*>(msg_);
+    if (wag != nullptr) delete wag->get_key();
+    MultiGet* mg = dynamic_cast<MultiGet*>(msg_);
+    if (mg != nullptr) mg->keys_->delete_all();
+    delete msg_;
+  }
 };
 
 /**
@@ -38,6 +57,9 @@ class KVStore : public Object {
     NodeInfo* me_;
 		KeyArray* keys_;
     StringArray* values_;
+    KeyIndex* index_;  // key -> position in keys_/values_
+    ChunkCache* cache_;  // decoded chunks, shared by every column on this node
+    PrefetchTable* prefetched_;  // chunks requested ahead of their readers
     size_t num_nodes_;
 		size_t next_node_;
 		size_t size_;
@@ -46,8 +68,13 @@ class KVStore : public Object {
 
     NodeInfo** nodes_;  // All nodes in the system.
     int sock_;         // Socket of this node.
-    size_t msg_id_;    // Unique message id that will increment each time.
-    size_t num_done_;  // number of nodes that are complete
+    atomic<size_t> msg_id_;    // Unique message id that will increment each time.
+    atomic<size_t> num_done_;  // number of nodes that are complete
+    atomic<bool> done_;        // whether this node has torn down
+    ConnectionManager* conns_; // connections to the other nodes
+    ReplyTable replies_;       // requests waiting for their reply
+    ParkedGet* parked_;        // WaitAndGets for keys not stored yet
+    Lock lock_;                // guards the map, notified on every insert
 
 		KVStore() {
 			keys_ = new KeyArray();
@@ -55,6 +82,14 @@ class KVStore : public Object {
       num_nodes_ = 1;
 			next_node_ = 0;
 			values_ = new StringArray();
+      index_ = new KeyIndex();
+      cache_ = new ChunkCache();
+      prefetched_ = new PrefetchTable();
+      msg_id_ = 0;
+      num_done_ = 0;
+      done_ = false;
+      conns_ = nullptr;
+      parked_ = nullptr;
       NodeInfo* ni = new NodeInfo();
       ni->id = 0;
       me_ = ni;
@@ -65,9 +100,15 @@ class KVStore : public Object {
 			assert(num_nodes != 0);
       keys_ = new KeyArray();
 			values_ = new StringArray();
+      index_ = new KeyIndex();
+      cache_ = new ChunkCache();
+      prefetched_ = new PrefetchTable();
 			num_nodes_ = num_nodes;
 			next_node_ = 0;
+			size_ = 0;
       num_done_ = 0;
+      done_ = false;
+      parked_ = nullptr;
 
       me_ = n;
       msg_id_ = 0;
@@ -80,6 +121,15 @@ class KVStore : public Object {
 		~KVStore() {
 			delete keys_;
       delete values_;
+      delete index_;
+      delete cache_;
+      delete prefetched_;
+      delete conns_;
+      while (parked_ != nullptr) {
+        ParkedGet* next = parked_->next_;
+        delete parked_;
+        parked_ = next;
+      }
       delete me_;
 		}
 
@@ -99,12 +149,94 @@ class KVStore : public Object {
 			return ms;
 		}
 
+		/**
+		 * Removes every pair whose key was created by the given column.
+		 * Surviving pairs are compacted into fresh arrays in a single pass
+		 * and the index is rebuilt over their new positions.
+		 */
 		void kill(size_t col_id) {
+			lock_.lock();
+			KeyArray* keys = new KeyArray();
+			StringArray* values = new StringArray();
 			for (size_t i = 0; i < keys_->size(); ++i) {
-				if (keys_->get(i)->getCreatorID() == col_id) {
-					keys_->remove(i);
-					values_->remove(i);
-					--i;
+				Key* k = keys_->get(i);
+				if (k->getCreatorID() == col_id) {
+					delete k;
+					delete values_->get(i);
+				} else {
+					keys->push_back(k);
+					values->push_back(values_->get(i));
+				}
+			}
+			delete keys_;
+			delete values_;
+			keys_ = keys;
+			values_ = values;
+			size_ = keys_->size();
+			index_->rebuild(keys_);
+			lock_.unlock();
+			long id;
+			while ((id = prefetched_->take_creator(col_id)) != -1) delete replies_.wait(id);
+			cache_->drop(col_id);
+		}
+
+		/**
+		 * Finds where the given key is stored on this node. When other nodes
+		 * are connected, the caller must hold lock_.
+		 * @returns the position of the key in keys_/values_, or -1 if absent
+		 */
+		int find(Key* key) {
+			return index_->get(key);
+		}
+
+		/**
+		 * Stores the pair on this node, replacing the value if the key is
+		 * already present. Takes ownership of the value. Answers any parked
+		 * request waiting on the key and wakes local waiters.
+		 * @returns whether the key itself was stored; if not, the stored key
+		 *          equal to it was kept and the caller still owns this one
+		 */
+		bool insert_(Key* key, String* value) {
+			lock_.lock();
+			int ind = find(key);
+			bool stored = ind == -1;
+			if (!stored) {
+				delete values_->get(ind);
+				values_->set(ind, value);
+			} else {
+				index_->put(key, keys_->size());
+				keys_->push_back(key);
+				values_->push_back(value);
+				++size_;
+			}
+			release_parked_(key, value);
+			lock_.notify_all();
+			lock_.unlock();
+			return stored;
+		}
+
+		// Replies to, and forgets, every parked WaitAndGet for the given key
+		// and every parked MultiGet whose last missing key it was.
+		// Called with lock_ held.
+		void release_parked_(Key* key, String* value) {
+			ParkedGet** link = &parked_;
+			while (*link != nullptr) {
+				ParkedGet* pg = *link;
+				bool answered = false;
+				WaitAndGet* wag = dynamic_cast<WaitAndGet*>(pg->msg_);
+				MultiGet* mg = dynamic_cast<MultiGet*>(pg->msg_);
+				if (wag != nullptr && wag->get_key()->equals(key)) {
+					Reply r(index(), wag->sender(), wag->id_, value->c_str(), 1, value->size());
+					conns_->send_m(&r);
+					answered = true;
+				} else if (mg != nullptr) {
+					answered = reply_multi_(mg);
+				}
+				if (answered) {
+					*link = pg->next_;
+					delete pg;
+				} else {
+					link = &pg->next_;
 				}
 			}
 		}
@@ -117,26 +249,216 @@ class KVStore : public Object {
 		Chunk* get_chunk(Key* key) {
 			// this chunk is stored here
 			if (key->getHomeNode() == (int)index()) {
-				int ind = -1;
-				for (size_t i = 0; i < size_; ++i) {
-					if (key->equals(keys_->get(i))) {
-						ind = i;
-						break;
-					}
-				}
-				if (ind == -1) {
-					return nullptr;
-				}
-				Chunk* chunk = cs_.get_chunk(values_->get(ind)->c_str());
+				lock_.lock();
+				int ind = find(key);
+				Chunk* chunk = nullptr;
+				if (ind != -1) chunk = cs_.get_chunk(values_->get(ind)->c_str());
+				lock_.unlock();
+				return chunk;
+			} else {
+        // chunks are written once, so wait for a Put still on its way
+        WaitAndGet g(index(), key->getHomeNode(), msg_id_++, key);
+        Reply* r = request_(&g);
+        Chunk* chunk = cs_.get_chunk(r->value_);
+        delete r;
+        return chunk;
+      }
+		}
+
+		/**
+		 * Gets the chunk at a specific key as a read-only view over its
+		 * serialized bytes (see ChunkSerializer::get_view). A remote chunk is
+		 * read in place from the payload of the reply that brought it.
+		 * @returns the chunk, or nullptr if a local key is missing
+		 */
+		Chunk* get_view(Key* key) {
+			Buffer* buf = fetch_(key);
+			return buf == nullptr ? nullptr : cs_.get_view(buf);
+		}
+
+		/**
+		 * Gets the chunk at a specific key through this node's chunk cache,
+		 * fetching and caching it on a miss. The chunk stays valid until it
+		 * is handed back with release_chunk.
+		 * @param stalled: if given, set to whether we had to wait for the
+		 *        chunk to come from another node
+		 */
+		Chunk* acquire_chunk(Key* key, bool* stalled = nullptr) {
+			bool waited = false;
+			Chunk* chunk = cache_->acquire(key);
+			if (chunk != nullptr) {
+				if (stalled != nullptr) *stalled = waited;
 				return chunk;
+			}
+			Buffer* buf;
+			long id = prefetched_->take(key);
+			if (id != -1) {
+				// it was requested ahead of time and may already be here
+				waited = !replies_.ready(id);
+				buf = payload_(replies_.wait(id));
+			} else {
+				waited = key->getHomeNode() != (int)index();
+				buf = fetch_(key);
+			}
+			if (stalled != nullptr) *stalled = waited;
+			assert(buf != nullptr && "No chunk stored at key.");
+			size_t bytes = buf->size();
+			return cache_->add(key, cs_.get_view(buf), bytes);
+		}
+
+		/** Hands back a chunk gotten from acquire_chunk. */
+		void release_chunk(Key* key) {
+			cache_->release(key);
+		}
+
+		/**
+		 * Starts fetching the chunk at a remote key without waiting for it,
+		 * so that a later acquire_chunk finds it on its way or already here.
+		 * Does nothing for local keys and for chunks that are cached or
+		 * already on their way.
+		 */
+		void prefetch(Key* key) {
+			if (key->getHomeNode() == (int)index() || cache_->contains(key)) return;
+			WaitAndGet g(index(), key->getHomeNode(), msg_id_++, key);
+			if (!prefetched_->add(key, g.id_)) return;
+			replies_.expect(g.id_);
+			send_m(&g);
+		}
+
+		// Gets the serialized chunk at a key in a buffer of its own, or
+		// nullptr if a local key is missing. A remote chunk is the payload
+		// of the reply that brought it.
+		Buffer* fetch_(Key* key) {
+			if (key->getHomeNode() == (int)index()) {
+				lock_.lock();
+				int ind = find(key);
+				Buffer* buf = nullptr;
+				if (ind != -1) {
+					String* value = values_->get(ind);
+					buf = new Buffer(value->c_str(), value->size());
+				}
+				lock_.unlock();
+				return buf;
 			} else {
-        Get g(index(), key->getHomeNode(), msg_id_++, key);
-        send_m(&g);
-        Reply* r = dynamic_cast<Reply*>(recv_m());
-        return cs_.get_chunk(r->value_);
+        WaitAndGet g(index(), key->getHomeNode(), msg_id_++, key);
+        return payload_(request_(&g));
       }
 		}
 
+		/**
+		 * Gets the chunks at many keys as views, like get_view. Remote keys
+		 * are asked for with one MultiGet per node, all of them sent before
+		 * waiting on any, so this takes one round trip however many chunks
+		 * there are.
+		 * @returns the chunks in the order of the keys, owned by the caller;
+		 *          a missing local key gives nullptr
+		 */
+		ChunkArray* get_chunks(KeyArray* keys) {
+			size_t n = keys->size();
+			Buffer** bufs = new Buffer*[n];
+			size_t* offsets = new size_t[n];
+			size_t* lens = new size_t[n];
+			fetch_all_(keys, bufs, offsets, lens);
+			ChunkArray* chunks = new ChunkArray();
+			for (size_t i = 0; i < n; ++i) {
+				if (bufs[i] == nullptr) chunks->push_back(nullptr);
+				else chunks->push_back(cs_.get_view(bufs[i], offsets[i]));
+			}
+			delete[] bufs;
+			delete[] offsets;
+			delete[] lens;
+			return chunks;
+		}
+
+		/**
+		 * Brings the chunks at the given keys into this node's chunk cache,
+		 * fetching the ones it does not hold with one round trip, so that
+		 * reading them all afterwards never waits on the network.
+		 */
+		void load_chunks(KeyArray* keys) {
+			KeyArray* missing = new KeyArray();
+			for (size_t i = 0; i < keys->size(); ++i) {
+				if (!cache_->contains(keys->get(i))) missing->push_back(keys->get(i));
+			}
+			size_t n = missing->size();
+			Buffer** bufs = new Buffer*[n];
+			size_t* offsets = new size_t[n];
+			size_t* lens = new size_t[n];
+			fetch_all_(missing, bufs, offsets, lens);
+			for (size_t i = 0; i < n; ++i) {
+				if (bufs[i] == nullptr) continue;
+				Key* key = missing->get(i);
+				cache_->add(key, cs_.get_view(bufs[i], offsets[i]), lens[i]);
+				cache_->release(key);
+			}
+			delete[] bufs;
+			delete[] offsets;
+			delete[] lens;
+			delete missing;
+		}
+
+		// Fetches the serialized chunk at each key, like fetch_, sending one
+		// MultiGet per remote node before waiting on any. bufs[i] gets its
+		// own reference to a buffer holding chunk i, lens[i] bytes long, at
+		// offsets[i].
+		void fetch_all_(KeyArray* keys, Buffer** bufs, size_t* offsets, size_t* lens) {
+			size_t n = keys->size();
+			long* ids = new long[num_nodes_];
+			for (size_t node = 0; node < num_nodes_; ++node) {
+				ids[node] = -1;
+				if (node == index()) continue;
+				KeyArray* ask = new KeyArray();
+				for (size_t i = 0; i < n; ++i) {
+					if (keys->get(i)->getHomeNode() == (int)node) ask->push_back(keys->get(i));
+				}
+				if (ask->size() == 0) {
+					delete ask;
+					continue;
+				}
+				MultiGet mg(index(), node, msg_id_++, ask);
+				ids[node] = mg.id_;
+				replies_.expect(mg.id_);
+				send_m(&mg);
+			}
+
+			// read the local chunks while the others are on their way
+			for (size_t i = 0; i < n; ++i) {
+				if (keys->get(i)->getHomeNode() == (int)index()) {
+					bufs[i] = fetch_(keys->get(i));
+					offsets[i] = 0;
+					lens[i] = bufs[i] == nullptr ? 0 : bufs[i]->size();
+				}
+			}
+
+			for (size_t node = 0; node < num_nodes_; ++node) {
+				if (ids[node] == -1) continue;
+				MultiReply* r = dynamic_cast<MultiReply*>(replies_.wait(ids[node]));
+				Buffer* buf = new Buffer(true, r->body_, r->len_);
+				r->body_ = nullptr;
+				size_t j = 0;
+				size_t offset = 0;
+				for (size_t i = 0; i < n; ++i) {
+					if (keys->get(i)->getHomeNode() != (int)node) continue;
+					bufs[i] = buf->retain();
+					offsets[i] = offset;
+					lens[i] = r->lens_[j++];
+					offset += padded_len(lens[i]);
+				}
+				delete r;
+				buf->release();
+			}
+			delete[] ids;
+		}
+
+		// Takes the payload of a reply, keeping the received bytes instead of
+		// copying them, and deletes the reply.
+		Buffer* payload_(Reply* r) {
+			Buffer* buf = new Buffer(true, r->body_, r->len_);
+			r->body_ = nullptr;
+			delete r;
+			return buf;
+		}
+
     /**
 		 * Gets the dataframe at a specific key.
 		 * @param key: the key whose value we want to get
@@ -168,18 +490,82 @@ class KVStore : public Object {
 			if (next_node_ >= num_nodes_) next_node_ = 0;
 			// does this chunk belong here
 			if (key->getHomeNode() == (int)index()) {
-				// yes - add to map
-				keys_->push_back(key);
-        String* s = new String(cs_.serialize(value));
-				values_->push_back(s);
-
-				++size_;
+				// yes - add to map, handing the serialized bytes to the store
+				size_t len;
+				char* ser = (char*)cs_.serialize(value, &len);
+				insert_(key, new String(true, ser, len));
 			} else {
-        Put p(index(), key->getHomeNode(), msg_id_++, key, cs_.serialize(value));
+        size_t len;
+        const char* ser = cs_.serialize(value, &len);
+        Put p(index(), key->getHomeNode(), msg_id_++, key, ser, len);
         send_m(&p);
+        delete[] ser;
 			}
 		}
 
+		/**
+		 * Stores many chunks at once, choosing the home node of each key
+		 * that has none the way put does. The chunks bound for each other
+		 * node travel together in one MultiPut.
+		 * @param keys: the keys, which are handed to the store like put's
+		 * @param chunks: the chunk for each key, still owned by the caller
+		 */
+		void put_chunks(KeyArray* keys, ChunkArray* chunks) {
+			size_t n = keys->size();
+			assert(chunks->size() == n);
+			char** sers = new char*[n];
+			size_t* lens = new size_t[n];
+			for (size_t i = 0; i < n; ++i) {
+				Key* key = keys->get(i);
+				if (key->getHomeNode() == -1) {
+					key->setHomeNode(get_next_node());
+					++next_node_;
+					if (next_node_ >= num_nodes_) next_node_ = 0;
+				}
+				sers[i] = (char*)cs_.serialize(chunks->get(i), &lens[i]);
+			}
+
+			for (size_t node = 0; node < num_nodes_; ++node) {
+				if (node == index()) continue;
+				KeyArray* send = new KeyArray();
+				size_t len = 0;
+				for (size_t i = 0; i < n; ++i) {
+					if (keys->get(i)->getHomeNode() != (int)node) continue;
+					send->push_back(keys->get(i));
+					len += padded_len(lens[i]);
+				}
+				if (send->size() == 0) {
+					delete send;
+					continue;
+				}
+				size_t* send_lens = new size_t[send->size()];
+				char* body = new char[len];
+				size_t j = 0;
+				size_t offset = 0;
+				for (size_t i = 0; i < n; ++i) {
+					if (keys->get(i)->getHomeNode() != (int)node) continue;
+					memcpy(&body[offset], sers[i], lens[i]);
+					memset(&body[offset + lens[i]], 0, padded_len(lens[i]) - lens[i]);
+					send_lens[j++] = lens[i];
+					offset += padded_len(lens[i]);
+				}
+				MultiPut mp(index(), node, msg_id_++, send, send_lens, body, len);
+				send_m(&mp);
+				delete[] body;
+			}
+
+			// the local chunks hand their serialized bytes to the store
+			for (size_t i = 0; i < n; ++i) {
+				if (keys->get(i)->getHomeNode() == (int)index()) {
+					insert_(keys->get(i), new String(true, sers[i], lens[i]));
+				} else {
+					delete[] sers[i];
+				}
+			}
+			delete[] sers;
+			delete[] lens;
+		}
+
     /**
 		 * Sets the value at the specified key to the value.
 		 * If the key already exists, its value is replaced.
@@ -225,14 +611,21 @@ class KVStore : public Object {
       nodes_ = new NodeInfo*[num_nodes_];
       nodes_[0] = me_;
       for(size_t i = 1; i < num_nodes_; ++i) nodes_[i] = new NodeInfo();
+      conns_->set_nodes(nodes_, num_nodes_);
 
       // Loop over nodes, cast their messages to registration messgaes.
+      // Each client's connection is kept as the connection to that client.
       for(size_t i = 1; i < num_nodes_; ++i) {
-        Register* msg = dynamic_cast<Register*>(recv_m());
+        Connection* conn = conns_->accept_();
+        Register* msg = dynamic_cast<Register*>(conns_->recv_m(conn));
+        assert(msg != nullptr && "Expected a registration message.");
         nodes_[msg->sender()]->id = msg->sender();
         nodes_[msg->sender()]->address.sin_family = AF_INET;
         nodes_[msg->sender()]->address.sin_addr = msg->client().sin_addr;
         nodes_[msg->sender()]->address.sin_port = msg->client().sin_port;
+        conns_->adopt(msg->sender(), conn);
+        conns_->watch(conn);
+        delete msg;
       }
 
       // Create their ports and addresses to be sent off.
@@ -249,6 +642,9 @@ class KVStore : public Object {
         send_m(ipd);
         delete ipd;
       }
+      delete[] ports;
+      addresses->delete_all();
+      delete addresses;
 
       printf("Completed Server Initialization\n");
     }
@@ -258,35 +654,34 @@ class KVStore : public Object {
       sleep(3); // Have clients wait until server is ready.
       init_sock_();
 
-      nodes_ = new NodeInfo*[1];
+      nodes_ = new NodeInfo*[num_nodes_];
       nodes_[0] = new NodeInfo();
       nodes_[0]->id = 0;
       nodes_[0]->address.sin_family = AF_INET;
       nodes_[0]->address.sin_port = htons(server_port);
       if(inet_pton(AF_INET, server_adr, &nodes_[0]->address.sin_addr) <= 0)
         assert(false && "Invalid server IP address format");
+      for (size_t i = 1; i < num_nodes_; ++i) nodes_[i] = new NodeInfo();
+      nodes_[index()]->address = getMyIP();
+      conns_->set_nodes(nodes_, num_nodes_);
 
-      // Send a registration message.
+      // Send a registration message, which opens the connection to the server.
       Register msg(index(), 0, msg_id_++, getMyIP(), port());
       send_m(&msg);
 
-      // Receive a directory from server node.
-      Directory* ipd = dynamic_cast<Directory*>(recv_m());
-      NodeInfo** nodes = new NodeInfo*[num_nodes_];
-      nodes[0] = nodes_[0];
+      // Receive a directory from server node on that connection.
+      Directory* ipd = dynamic_cast<Directory*>(conns_->recv_m(nodes_[0]->conn));
+      assert(ipd != nullptr && "Expected a directory message.");
       for (size_t i = 0; i < ipd->clients(); ++i) {
-        nodes[i+1] = new NodeInfo();
-        nodes[i+1]->id = i+1;
-        nodes[i+1]->address.sin_family = AF_INET;
-        nodes[i+1]->address.sin_port = htons(ipd->ports()[i]);
+        nodes_[i+1]->id = i+1;
+        nodes_[i+1]->address.sin_family = AF_INET;
+        nodes_[i+1]->address.sin_port = htons(ipd->ports()[i]);
         if (inet_pton(AF_INET, ipd->addresses()->get(i)->c_str(),
-                      &nodes[i+1]->address.sin_addr) <= 0) {
+                      &nodes_[i+1]->address.sin_addr) <= 0) {
           printf("Invalid IP directory-address found for node %zu", i+1);
           exit(1); // Teardown? TODO
         }
       }
-      delete[] nodes_;
-      nodes_ = nodes; // replace the existing nodes with new nodes.
       delete ipd;
 
       printf("Completed Client %zu Initialization\n", index());
@@ -306,53 +701,23 @@ class KVStore : public Object {
       me_->address.sin_family = AF_INET;
       assert(bind(sock_, (sockaddr*)&addr, sizeof(addr)) >= 0);
       assert(listen(sock_, 100) >= 0); // We can have 100 connections queued.
+      conns_ = new ConnectionManager(index(), sock_);
     }
 
-    // Based on message target, create connection to appropriate server.
-    // Then, serializes the message.
+    // Sends the message over the long-lived connection to its target.
     void send_m(Message * msg) {
-      MessageSerializer s;
-      NodeInfo* tgt = nodes_[msg->target()];
-      int conn = socket(AF_INET, SOCK_STREAM, 0);
-      assert(conn >= 0 && "Unable to make client socket.\n");
-
-      if (connect(conn, (sockaddr*)&tgt->address, sizeof(tgt->address)) < 0) {
-        printf("Error conecting: %s\n", strerror( errno ) );
-        printf("Unable to connect to remote node.\n");
-        cout << index() << ' ' << msg->target_ << ' ' << (char)msg->get_kind() << endl;
-        exit(1); // Teardown? TODO
-      }
-      const char* buf = s.serialize(msg);
-      size_t size = strlen(buf) + 1;
-      //printf("SIZE OF SENT MESSAGE WAS %zu\n", size);
-      if (size < 5000) printf("\033[0;33mNode %zu Sent:\n%s\033[0m\n", index(), buf);
-      else printf("\033[0;33mNode %zu Sent:\n%c\033[0m\n", index(), (char)msg->get_kind());
-      send(conn, &size, sizeof(size_t), 0);
-      send(conn, buf, size, 0);
-      close(conn);
-      delete[] buf;
+      conns_->send_m(msg);
     }
 
-    // Listens on the socket and when a message is available - reads it.
-    // Message is deserialized and returned.
-    Message* recv_m() {
-      sockaddr_in sender;
-      socklen_t addrlen = sizeof(sender);
-      int req = accept(sock_, (sockaddr*) &sender, &addrlen);
-      size_t size = 0;
-      if(read(req, &size, sizeof(size_t)) == 0) {
-        printf("Unable to read");
-        exit(1);
-      }
-      char buf[360000];
-      size_t rd = 0;
-      while (rd != size) rd += read(req, buf + rd, size - rd);
-      MessageSerializer s;
-      Message* msg = s.get_message(buf);
-      if (rd < 5000) printf("\033[0;34mNode %zu Received:\n%s\033[0m\n", index(), buf);
-      else printf("\033[0;34mNode %zu Received:\n%c\033[0m\n", index(), (char)msg->get_kind());
-      close(req);
-      return msg;
+    /**
+      * Sends a request and blocks until the reply carrying its id arrives.
+      * Other requests may be in flight on the same connection meanwhile.
+      * The caller owns the returned reply.
+      */
+    Reply* request_(Message* msg) {
+      replies_.expect(msg->id_);
+      send_m(msg);
+      return replies_.wait(msg->id_);
     }
 
     /**
@@ -362,74 +727,145 @@ class KVStore : public Object {
     void put(Key* k, const char* value) {
       size_t to_node = k->getHomeNode();
       if (to_node == index()) {
-        keys_->push_back(k);
-        values_->push_back(new String(value));
+        insert_(k, new String(value));
       } else {
         Put p(index(), to_node, msg_id_++, k, value);
         send_m(&p);
       }
     }
 
-    /* Returns the value stored for a key. If key does not belong to this
-       node, contact the correct node via the network. */
-    void getChars(Key* k, size_t tgt) {
-    
+    /* Replies to request id of node tgt with the value stored here for
+       the key, or with an empty reply if there is none. */
+    void getChars(Key* k, size_t tgt, size_t id) {
       size_t to_node = k->getHomeNode();
       assert(to_node == index());
-      // No need for networking if key is in this node.
-      if (to_node == index()) {
-        for (size_t i = 0; i < keys_->size(); i++) {
-          if (keys_->get(i)->equals(k)) {
-            Reply r(index(), tgt, ++msg_id_, values_->get(i)->c_str(), 1);
-            send_m(&r);
-            return ;
-          }
-        }
-        Reply r(index(), tgt, ++msg_id_, "", 0);
+      lock_.lock();
+      int ind = find(k);
+      if (ind != -1) {
+        String* value = values_->get(ind);
+        Reply r(index(), tgt, id, value->c_str(), 1, value->size());
+        send_m(&r);
+      } else {
+        Reply r(index(), tgt, id, "", 0);
         send_m(&r);
-        return ;
-      }/**
-      else {
-        // Need to request from a different node.
-        Get g(index(), to_node, msg_id_++, k);
-        send_m(&g);
-        Reply* r = dynamic_cast<Reply*>(recv_m());
-        return r->value_;
       }
-      */
+      lock_.unlock();
     }
 
     /* Returns the value stored for a key. If key does not belong to this
-       node, contact the correct node via the network. BLOCKING. */
+       node, contact the correct node via the network. BLOCKING.
+       The caller owns the returned value. */
     const char* getCharsAndWait(Key* k);
 
+    /* Waits for the value of a key stored on this node, then removes the
+       pair and returns the value. For values read exactly once, such as
+       the parts nodes send each other, so that they do not pile up and a
+       later exchange under the same name cannot read them. BLOCKING.
+       The caller owns the returned value. */
+    const char* takeCharsAndWait(Key* k) {
+      assert(k->getHomeNode() == (int)index());
+      lock_.lock();
+      int ind;
+      while ((ind = find(k)) == -1) lock_.wait();
+      Key* key = keys_->get(ind);
+      String* value = values_->get(ind);
+      index_->remove(key);
+      // move the last pair into the hole so every other slot stays put
+      Key* last_key = keys_->pop_back();
+      String* last_value = values_->pop_back();
+      if ((size_t)ind < keys_->size()) {
+        keys_->set(ind, last_key);
+        values_->set(ind, last_value);
+        index_->put(last_key, ind);
+      }
+      --size_;
+      lock_.unlock();
+      char* val = duplicate(value->c_str());
+      delete key;
+      delete value;
+      return val;
+    }
+
     /**
       * In response to a get message, send a reply with the value for the
       * given key.
       */
-    void reply(Key* k, size_t tgt) {
-      getChars(k, tgt);
+    void reply(Key* k, size_t tgt, size_t id) {
+      getChars(k, tgt, id);
     }
 
     /**
-      * In response to a get message, send a reply with the value for the
-      * given key. BLOCKING.
+      * In response to a WaitAndGet message, send a reply with the value for
+      * the given key. If the key is not here yet, the request is parked and
+      * answered when it is put. Takes ownership of the message.
+      */
+    void replyAndWait(WaitAndGet* wag) {
+      lock_.lock();
+      int ind = find(wag->get_key());
+      if (ind != -1) {
+        String* value = values_->get(ind);
+        Reply r(index(), wag->sender(), wag->id_, value->c_str(), 1, value->size());
+        send_m(&r);
+        delete wag->get_key();
+        delete wag;
+      } else {
+        parked_ = new ParkedGet(wag, parked_);
+      }
+      lock_.unlock();
+    }
+
+    /**
+      * In response to a MultiGet message, send one reply with the values for
+      * all of its keys, once they are all here. Until then the request is
+      * parked. Takes ownership of the message and its keys.
       */
-    void replyAndWait(Key* k, size_t tgt) {
-      cout << "***************************************" << endl;
-      const char* value = getCharsAndWait(k);
-      Reply r(index(), tgt, ++msg_id_, value, 1);
+    void replyAndWait(MultiGet* mg) {
+      lock_.lock();
+      if (reply_multi_(mg)) {
+        mg->keys_->delete_all();
+        delete mg;
+      } else {
+        parked_ = new ParkedGet(mg, parked_);
+      }
+      lock_.unlock();
+    }
+
+    // Sends the MultiReply to a MultiGet if every key it asks for is stored
+    // here. Called with lock_ held. Returns whether it replied.
+    bool reply_multi_(MultiGet* mg) {
+      size_t n = mg->keys_->size();
+      size_t len = 0;
+      for (size_t i = 0; i < n; ++i) {
+        int ind = find(mg->keys_->get(i));
+        if (ind == -1) return false;
+        len += padded_len(values_->get(ind)->size());
+      }
+      size_t* lens = new size_t[n];
+      char* body = new char[len];
+      size_t offset = 0;
+      for (size_t i = 0; i < n; ++i) {
+        String* value = values_->get(find(mg->keys_->get(i)));
+        lens[i] = value->size();
+        memcpy(&body[offset], value->c_str(), lens[i]);
+        memset(&body[offset + lens[i]], 0, padded_len(lens[i]) - lens[i]);
+        offset += padded_len(lens[i]);
+      }
+      MultiReply r(index(), mg->sender(), mg->id_, n, lens, body, len);
       send_m(&r);
+      delete[] body;
+      return true;
     }
 
-    // tell the server we are done
+    // tell the other nodes we are done
     void teardown() {
       for (size_t i = 0; i < num_nodes_; ++i) {
         if (i != index()) {
-          Kill kill(index(), i, ++msg_id_);
+          Kill kill(index(), i, msg_id_++);
           send_m(&kill);
         }
       }
+      done_ = true;
+      conns_->wake();
     }
 
     // get the number of nodes that are done
@@ -437,55 +873,100 @@ class KVStore : public Object {
       return num_done_;
     }
 
-    /** handle what to do with a received message */
+    /** handle what to do with a received message, which is consumed */
     void handle_message(Message* received) {
       MsgKind kind = received->get_kind();
       if (kind == MsgKind::Get) {
-        cout << "\033[0;31mHANDLING GET\033[0m" << endl;
-
         Get* g_received = dynamic_cast<Get*>(received);
-        reply(g_received->get_key(), g_received->sender());
+        reply(g_received->get_key(), g_received->sender(), g_received->id_);
+        delete g_received->get_key();
       } else if (kind == MsgKind::Put) {
-        cout << "\033[0;31mHANDLING PUT\033[0m" << endl;
-
         Put* p_received = dynamic_cast<Put*>(received);
-        put(p_received->get_key(), p_received->get_value());
+        // steal the received payload rather than copying it
+        String* value = new String(true, p_received->body_, p_received->len_);
+        p_received->body_ = nullptr;
+        if (!insert_(p_received->get_key(), value)) delete p_received->get_key();
       } else if (kind == MsgKind::WaitAndGet) {
-        cout << "\033[0;31mHANDLING WAITANDGET\033[0m" << endl;
-
-        WaitAndGet* w_received = dynamic_cast<WaitAndGet*>(received);
-        replyAndWait(w_received->get_key(), w_received->sender());
+        replyAndWait(dynamic_cast<WaitAndGet*>(received));
+        return;
+      } else if (kind == MsgKind::MultiGet) {
+        replyAndWait(dynamic_cast<MultiGet*>(received));
+        return;
+      } else if (kind == MsgKind::MultiPut) {
+        MultiPut* mp = dynamic_cast<MultiPut*>(received);
+        size_t offset = 0;
+        for (size_t i = 0; i < mp->keys_->size(); ++i) {
+          Key* key = mp->keys_->get(i);
+          if (!insert_(key, new String(&mp->value_[offset], mp->lens_[i]))) delete key;
+          offset += padded_len(mp->lens_[i]);
+        }
+      } else if (kind == MsgKind::Reply || kind == MsgKind::MultiReply) {
+        if (replies_.deliver(dynamic_cast<Reply*>(received))) return;
       } else if (kind == MsgKind::Kill) {
         cout << "\033[0;34m"<< "NODE IN NETWORK WAS KILLED" << "\033[0m" << endl;
         num_done_++;
       }
+      delete received;
     }
 
     /**
-      * Infinitely loops while looking for messages that arrive.
-      * Depending on the message kind, perform some action.
+      * Serves every connection from an epoll reactor until this node and all
+      * the others are done, handing each message to handle_message. Sleeps
+      * while there is nothing to read.
       */
-    void begin_receiving() {
-      struct timeval tv;
-      tv.tv_sec = 0;
-      tv.tv_usec = 0;
-      fd_set read_fds;
-
-      int status;
-
-      while(1) {
-        FD_ZERO(&read_fds);
-        FD_SET(sock_, &read_fds);
-        status = select(sock_ + 1, &read_fds, NULL, NULL, &tv);
-        if (status < 0) {
-          printf("Error in select.");
-          close(sock_);
-          exit(1);
-        }
-        for (int i = 0; i <= sock_; ++i) {
-          Message* received = recv_m();
-          handle_message(received);
-        }
-      }
+    void begin_receiving();
+};
+
+/**
+  * Connects a KVStore to the reactor serving its connections.
+  * @authors: armani.a@husky.neu.edu, horn.s@husky.neu.edu
+  */
+class KVStoreHandler : public MessageHandler {
+public:
+  KVStore* kv_;
+
+  KVStoreHandler(KVStore* kv) {
+    kv_ = kv;
+  }
+
+  void handle(Message* msg, Connection* from) {
+    // a peer introducing itself on a connection it opened
+    if (msg->get_kind() == MsgKind::Register) {
+      kv_->conns_->adopt(msg->sender(), from);
+      delete msg;
+      return;
     }
+    kv_->handle_message(msg);
+  }
+
+  void closed(Connection* c) {
+    kv_->conns_->drop(c);
+  }
+
+  bool finished() {
+    return kv_->done_ && kv_->num_done_ >= kv_->num_nodes_ - 1;
+  }
+};
+
+void KVStore::begin_receiving() {
+  KVStoreHandler h(this);
+  conns_->run(&h);
+}
+
+/**
+  * A thread dedicated to keeping a network node alive and receiving messages.
+  * @authors: armani.a@husky.neu.edu, horn.s@husky.neu.edu
+  */
+class NetworkThread : public Thread {
+public:
+  KVStore* k_;
+
+  NetworkThread(KVStore* k) {
+    k_ = k;
+    start();
+  }
+
+  void run() {
+    k_->begin_receiving();
+  }
 };
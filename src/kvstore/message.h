@@ -9,7 +9,14 @@
 
 enum class MsgKind {Ack='a', Nack='n', Put='p',
                     Reply='r',  Get='g', WaitAndGet='w',
-                    Kill='k',   Register='t',  Directory='d', Text='x'};
+                    Kill='k',   Register='t',  Directory='d', Text='x',
+                    MultiGet='m', MultiPut='u', MultiReply='y'};
+
+/** Bytes a value takes up in the payload of a Multi message, which starts
+ *  every value on an 8 byte boundary so chunks can be read in place. */
+inline size_t padded_len(size_t len) {
+    return (len + 7) & ~(size_t)7;
+}
 
 class Message : public Object {
 public:
@@ -18,12 +25,18 @@ public:
     size_t sender_; // the index of the sender node
     size_t target_; // the index of the receiver node
     size_t id_;     // an id t unique within the node
+    char* body_;    // owned; raw payload received with this message, or nullptr
 
     Message(MsgKind kind, size_t sender, size_t target, size_t id) {
         kind_ = kind;
         sender_ = sender;
         target_ = target;
         id_ = id;
+        body_ = nullptr;
+    }
+
+    ~Message() {
+        delete[] body_;
     }
 
     MsgKind get_kind() {
@@ -156,11 +169,16 @@ class Put : public Message {
 public:
     Key* k_;
     const char* value_;
+    size_t len_;    // bytes in value_, which may hold zeros
 
     Put(size_t sender, size_t target, size_t id, Key* key, const char* value)
+    : Put(sender, target, id, key, value, strlen(value)) {}
+
+    Put(size_t sender, size_t target, size_t id, Key* key, const char* value, size_t len)
     : Message(MsgKind::Put, sender, target, id) {
         k_ = key;
         value_ = value;
+        len_ = len;
     }
 
     Key* get_key() {
@@ -176,9 +194,82 @@ class Reply : public Message {
 public:
     bool had_it_;
     const char* value_;
+    size_t len_;    // bytes in value_, which may hold zeros
 
     Reply(size_t sender, size_t target, size_t id, const char* value, bool had)
-    : Message(MsgKind::Reply, sender, target, id), had_it_(had), value_(value) {}
+    : Reply(sender, target, id, value, had, strlen(value)) {}
+
+    Reply(size_t sender, size_t target, size_t id, const char* value, bool had, size_t len)
+    : Reply(MsgKind::Reply, sender, target, id, value, had, len) {}
+
+    Reply(MsgKind kind, size_t sender, size_t target, size_t id, const char* value,
+          bool had, size_t len)
+    : Message(kind, sender, target, id), had_it_(had), value_(value), len_(len) {}
+};
+
+/**
+ * Asks for the values of many keys stored on the target node at once,
+ * waiting for any that have not been put yet. Answered by one MultiReply.
+ */
+class MultiGet : public Message {
+public:
+    KeyArray* keys_;   // owned; the keys themselves are not
+
+    MultiGet(size_t sender, size_t target, size_t id, KeyArray* keys)
+    : Message(MsgKind::MultiGet, sender, target, id) {
+        keys_ = keys;
+    }
+
+    ~MultiGet() {
+        delete keys_;
+    }
+};
+
+/**
+ * Stores many values on the target node at once. The payload holds the
+ * values back to back, each starting on an 8 byte boundary (padded_len).
+ */
+class MultiPut : public Message {
+public:
+    KeyArray* keys_;     // owned; the keys themselves are not
+    size_t* lens_;       // owned; bytes in each value
+    const char* value_;  // the payload
+    size_t len_;         // bytes in the payload
+
+    MultiPut(size_t sender, size_t target, size_t id, KeyArray* keys,
+             size_t* lens, const char* value, size_t len)
+    : Message(MsgKind::MultiPut, sender, target, id) {
+        keys_ = keys;
+        lens_ = lens;
+        value_ = value;
+        len_ = len;
+    }
+
+    ~MultiPut() {
+        delete keys_;
+        delete[] lens_;
+    }
+};
+
+/**
+ * Answers a MultiGet with the values of all its keys, in the order they
+ * were asked for, laid out like the payload of a MultiPut.
+ */
+class MultiReply : public Reply {
+public:
+    size_t count_;   // number of values
+    size_t* lens_;   // owned; bytes in each value
+
+    MultiReply(size_t sender, size_t target, size_t id, size_t count,
+               size_t* lens, const char* value, size_t len)
+    : Reply(MsgKind::MultiReply, sender, target, id, value, true, len) {
+        count_ = count;
+        lens_ = lens;
+    }
+
+    ~MultiReply() {
+        delete[] lens_;
+    }
 };
 
 /**
@@ -235,13 +326,62 @@ public:
           barr->push_string(ser_rep);
           delete[] ser_rep;
       }
+      else if(kind == MsgKind::MultiGet) {
+          const char* ser_mg = serialize_(dynamic_cast<MultiGet*>(msg));
+          barr->push_string(ser_mg);
+          delete[] ser_mg;
+      }
+      else if(kind == MsgKind::MultiPut) {
+          const char* ser_mp = serialize_(dynamic_cast<MultiPut*>(msg));
+          barr->push_string(ser_mp);
+          delete[] ser_mp;
+      }
+      else if(kind == MsgKind::MultiReply) {
+          const char* ser_mr = serialize_(dynamic_cast<MultiReply*>(msg));
+          barr->push_string(ser_mr);
+          delete[] ser_mr;
+      }
 
       const char* str = barr->as_bytes();
       delete barr;
       return str;
   }
 
+  /**
+   * The raw payload of a message, sent after its serialized fields rather
+   * than inside them: the value of a Put or a Reply, or the values of a
+   * MultiPut or a MultiReply.
+   * @returns the payload, or nullptr if the message has none
+   */
+  const char* payload(Message* msg, size_t* len) {
+      if (msg->kind_ == MsgKind::Put) {
+          Put* p = dynamic_cast<Put*>(msg);
+          *len = p->len_;
+          return p->value_;
+      } else if (msg->kind_ == MsgKind::MultiPut) {
+          MultiPut* mp = dynamic_cast<MultiPut*>(msg);
+          *len = mp->len_;
+          return mp->value_;
+      } else if (msg->kind_ == MsgKind::Reply || msg->kind_ == MsgKind::MultiReply) {
+          Reply* r = dynamic_cast<Reply*>(msg);
+          *len = r->len_;
+          return r->value_;
+      }
+      *len = 0;
+      return nullptr;
+  }
+
   Message* get_message(const char* str) {
+      char* body = new char[1];
+      body[0] = 0;
+      return get_message(str, body, 0);
+  }
+
+  /**
+   * Deserializes a message whose payload was received separately.
+   * Takes ownership of body, which holds body_len bytes followed by a zero.
+   */
+  Message* get_message(const char* str, char* body, size_t body_len) {
       MsgKind kind;
       size_t sender, target, idx, new_line_loc, i;
 
@@ -275,8 +415,15 @@ public:
 
       // create base message object
       Message* msg = new Message(kind, sender, target, idx);
+      msg->body_ = body;
 
       // get derived message object and return
+      if (kind == MsgKind::Put) return get_put_(&str[i], msg, body_len);
+      else if (kind == MsgKind::Reply) return get_reply_(&str[i], msg, body_len);
+      else if (kind == MsgKind::MultiPut) return get_multi_put_(&str[i], msg, body_len);
+      else if (kind == MsgKind::MultiReply) return get_multi_reply_(&str[i], msg, body_len);
+      delete[] msg->body_;
+      msg->body_ = nullptr;
       if (kind == MsgKind::Ack) return get_ack_(&str[i], msg);
       else if (kind == MsgKind::Register) return get_register_(&str[i], msg);
       else if (kind == MsgKind::Directory) return get_directory_(&str[i], msg);
@@ -284,8 +431,7 @@ public:
       else if (kind == MsgKind::Text) return get_text_(&str[i], msg);
       else if (kind == MsgKind::Get) return get_get_(&str[i], msg);
       else if (kind == MsgKind::WaitAndGet) return get_wag_(&str[i], msg);
-      else if (kind == MsgKind::Put) return get_put_(&str[i], msg);
-      else if (kind == MsgKind::Reply) return get_reply_(&str[i], msg);
+      else if (kind == MsgKind::MultiGet) return get_multi_get_(&str[i], msg);
       return msg;
   }
 
@@ -563,10 +709,6 @@ public:
       barr->push_string(ser_key);
       delete[] ser_key;
 
-      // serialize the value
-      barr->push_string("\nval: ");
-      barr->push_string(p->value_);
-
       const char* str = barr->as_bytes();
       delete barr;
       return str;
@@ -580,10 +722,6 @@ public:
       if (r->had_it_) barr->push_back('1');
       else barr->push_back('0');
 
-      // serialize the value
-      barr->push_string("\nval: ");
-      barr->push_string(r->value_);
-
       const char* str = barr->as_bytes();
       delete barr;
       return str;
@@ -611,6 +749,7 @@ public:
       // Make Get Object
       Get* get = new Get(msg->sender_, msg->target_, msg->id_, k);
 
+      delete msg;
       return get;
   }
 
@@ -636,10 +775,11 @@ public:
       // Make WAG Object
       WaitAndGet* wag = new WaitAndGet(msg->sender_, msg->target_, msg->id_, k);
 
+      delete msg;
       return wag;
   }
 
-  Message* get_put_(const char* str, Message* msg) {
+  Message* get_put_(const char* str, Message* msg, size_t body_len) {
       assert(msg->kind_ == MsgKind::Put);
 
       // go through lines of str
@@ -655,19 +795,19 @@ public:
               i += 9;
               k = Serializer::get_key(&str[i], &i);
           }
-          else if (strcmp(type_buff, "val") == 0) {
-            i += 5;
-          }
           else break;
       }
 
-      // Make put Object
-      Put* put = new Put(msg->sender_, msg->target_, msg->id_, k, &str[i]);
+      // Make put Object, its value is the payload of the message
+      Put* put = new Put(msg->sender_, msg->target_, msg->id_, k, msg->body_, body_len);
+      put->body_ = msg->body_;
+      msg->body_ = nullptr;
 
+      delete msg;
       return put;
   }
 
-  Message* get_reply_(const char* str, Message* msg) {
+  Message* get_reply_(const char* str, Message* msg, size_t body_len) {
       assert(msg->kind_ == MsgKind::Reply);
 
       size_t i = 0;
@@ -684,16 +824,117 @@ public:
               else had_it = false;
               i += 2;
           }
-          else if (strcmp(type_buff, "val") == 0) {
-            i += 5;
-          }
           else break;
       }
 
-      // Make reply Object
-      Reply* r = new Reply(msg->sender_, msg->target_, msg->id_, &str[i], had_it);
+      // Make reply Object, its value is the payload of the message
+      Reply* r = new Reply(msg->sender_, msg->target_, msg->id_, msg->body_, had_it, body_len);
+      r->body_ = msg->body_;
+      msg->body_ = nullptr;
 
+      delete msg;
       return r;
   }
 
+  const char* serialize_(MultiGet* mg) {
+      ByteArray* barr = new ByteArray();
+
+      // serialize the keys
+      barr->push_string("\nkys:\n");
+      const char* ser_keys = Serializer::serialize(mg->keys_);
+      barr->push_string(ser_keys);
+      delete[] ser_keys;
+
+      const char* str = barr->as_bytes();
+      delete barr;
+      return str;
+  }
+
+  const char* serialize_(MultiPut* mp) {
+      ByteArray* barr = new ByteArray();
+
+      // serialize the keys, then the length of each value
+      barr->push_string("\nkys:\n");
+      const char* ser_keys = Serializer::serialize(mp->keys_);
+      barr->push_string(ser_keys);
+      delete[] ser_keys;
+      serialize_lens_(barr, mp->lens_, mp->keys_->size());
+
+      const char* str = barr->as_bytes();
+      delete barr;
+      return str;
+  }
+
+  const char* serialize_(MultiReply* mr) {
+      ByteArray* barr = new ByteArray();
+
+      // serialize the number of values, then the length of each
+      barr->push_string("\ncnt: ");
+      const char* ser_cnt = Serializer::serialize(mr->count_);
+      barr->push_string(ser_cnt);
+      delete[] ser_cnt;
+      serialize_lens_(barr, mr->lens_, mr->count_);
+
+      const char* str = barr->as_bytes();
+      delete barr;
+      return str;
+  }
+
+  // one "len: " line per value
+  void serialize_lens_(ByteArray* barr, size_t* lens, size_t count) {
+      for (size_t i = 0; i < count; ++i) {
+          barr->push_string("\nlen: ");
+          const char* ser_len = Serializer::serialize(lens[i]);
+          barr->push_string(ser_len);
+          delete[] ser_len;
+      }
+  }
+
+  Message* get_multi_get_(const char* str, Message* msg) {
+      assert(msg->kind_ == MsgKind::MultiGet);
+
+      size_t i = 0;
+      KeyArray* keys = Serializer::get_key_array(str, &i);
+
+      MultiGet* mg = new MultiGet(msg->sender_, msg->target_, msg->id_, keys);
+      delete msg;
+      return mg;
+  }
+
+  Message* get_multi_put_(const char* str, Message* msg, size_t body_len) {
+      assert(msg->kind_ == MsgKind::MultiPut);
+
+      size_t i = 0;
+      KeyArray* keys = Serializer::get_key_array(str, &i);
+      size_t* lens = new size_t[keys->size()];
+      for (size_t j = 0; j < keys->size(); ++j) lens[j] = get_size(&str[i], &i);
+
+      // its values are the payload of the message
+      MultiPut* mp = new MultiPut(msg->sender_, msg->target_, msg->id_, keys,
+                                  lens, msg->body_, body_len);
+      mp->body_ = msg->body_;
+      msg->body_ = nullptr;
+
+      delete msg;
+      return mp;
+  }
+
+  Message* get_multi_reply_(const char* str, Message* msg, size_t body_len) {
+      assert(msg->kind_ == MsgKind::MultiReply);
+
+      size_t i = 0;
+      size_t count = get_size(str, &i);
+      size_t* lens = new size_t[count];
+      for (size_t j = 0; j < count; ++j) lens[j] = get_size(&str[i], &i);
+
+      // its values are the payload of the message
+      MultiReply* mr = new MultiReply(msg->sender_, msg->target_, msg->id_, count,
+                                      lens, msg->body_, body_len);
+      mr->body_ = msg->body_;
+      msg->body_ = nullptr;
+
+      delete msg;
+      return mr;
+  }
+
 };
@@ -0,0 +1,395 @@
+// lang::CwC
+#pragma once
+
+#include "object.h"
+#include "message.h"
+#include "thread.h"
+#include <cstdio>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+static const uint32_t FRAME_MAGIC = 0x32554145;  // "EAU2"
+
+/**
+ * Fixed-size header sent in front of every message on a connection.
+ * The meta section is the MessageSerializer text of the message, the body
+ * is its raw payload (the value of a Put or Reply), sent without copying
+ * it into the text.
+ * @authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+struct FrameHeader {
+  uint32_t magic;     // FRAME_MAGIC, catches a desynchronized stream
+  uint32_t kind;      // MsgKind of the message
+  uint64_t id;        // Message::id_, replies carry the id of their request
+  uint64_t meta_len;  // bytes of serialized message fields
+  uint64_t body_len;  // bytes of raw payload
+};
+
+/** Blocks until the socket is ready for the given poll events. */
+inline void wait_for(int fd, short events) {
+  pollfd p;
+  p.fd = fd;
+  p.events = events;
+  while (poll(&p, 1, -1) < 0 && errno == EINTR) {}
+}
+
+/**
+ * One long-lived connection to a peer. Inbound bytes are reassembled into
+ * frames as they arrive, however they are split, without ever blocking.
+ * Outbound frames are written straight to the socket when it has room;
+ * whatever does not fit is queued and written by the reactor when the
+ * socket drains, so neither senders nor the reactor wait on a slow peer.
+ * @authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class Connection : public Object {
+public:
+  int fd_;
+  bool open_;
+
+  // frame being received
+  FrameHeader hdr_;
+  size_t got_;        // bytes of the current frame received so far
+  char* meta_;        // owned until the frame is complete
+  char* body_;        // handed to the message once the frame is complete
+
+  // bytes accepted by send but not yet written
+  char* out_;
+  size_t out_start_;
+  size_t out_end_;
+  size_t out_cap_;
+  Lock out_lock_;     // guards out_ and keeps frames from interleaving
+
+  Connection(int fd) {
+    fd_ = fd;
+    open_ = true;
+    got_ = 0;
+    meta_ = nullptr;
+    body_ = nullptr;
+    out_ = nullptr;
+    out_start_ = out_end_ = out_cap_ = 0;
+    int opt = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  }
+
+  ~Connection() {
+    close(fd_);
+    delete[] meta_;
+    delete[] body_;
+    delete[] out_;
+  }
+
+  /** Makes the socket nonblocking, as required before it joins a reactor. */
+  void set_nonblocking() {
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+  }
+
+  /**
+   * Reads as much of the current frame as is available.
+   * @returns 1 and sets msg when a whole frame has arrived, 0 if more
+   *   bytes are needed and none are available, -1 if the peer is gone
+   */
+  int read_frame(MessageSerializer* ms, Message** msg) {
+    while (true) {
+      char* dst;
+      size_t want;
+      size_t meta_end = sizeof(hdr_) + (got_ >= sizeof(hdr_) ? hdr_.meta_len : 0);
+      if (got_ < sizeof(hdr_)) {
+        dst = (char*)&hdr_ + got_;
+        want = sizeof(hdr_) - got_;
+      } else if (got_ < meta_end) {
+        dst = meta_ + (got_ - sizeof(hdr_));
+        want = meta_end - got_;
+      } else if (got_ < meta_end + hdr_.body_len) {
+        dst = body_ + (got_ - meta_end);
+        want = meta_end + hdr_.body_len - got_;
+      } else {
+        // the whole frame is here
+        meta_[hdr_.meta_len] = 0;
+        body_[hdr_.body_len] = 0;
+        *msg = ms->get_message(meta_, body_, hdr_.body_len);
+        delete[] meta_;
+        meta_ = nullptr;
+        body_ = nullptr;
+        got_ = 0;
+        return 1;
+      }
+
+      ssize_t n = read(fd_, dst, want);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+      if (n <= 0) return -1;
+      got_ += n;
+      if (got_ == sizeof(hdr_) && (size_t)n == want) {
+        assert(hdr_.magic == FRAME_MAGIC && "Corrupt frame on connection");
+        meta_ = new char[hdr_.meta_len + 1];
+        body_ = new char[hdr_.body_len + 1];
+      }
+    }
+  }
+
+  /**
+   * Sends a frame without blocking: writes what the socket takes now and
+   * queues the rest for flush(). Returns false if the connection failed.
+   */
+  bool send_frame(FrameHeader* hdr, const char* meta, const char* body) {
+    iovec iov[3];
+    iov[0].iov_base = (void*)hdr;
+    iov[0].iov_len = sizeof(FrameHeader);
+    iov[1].iov_base = (void*)meta;
+    iov[1].iov_len = hdr->meta_len;
+    iov[2].iov_base = (void*)body;
+    iov[2].iov_len = hdr->body_len;
+    msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 3;
+
+    out_lock_.lock();
+    size_t sent = 0;
+    // only write directly if nothing queued is waiting to go first
+    if (out_start_ == out_end_) {
+      while (true) {
+        ssize_t n = sendmsg(fd_, &mh, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+          out_lock_.unlock();
+          return false;
+        }
+        if (n > 0) sent = n;
+        break;
+      }
+    }
+    // queue whatever the socket did not take
+    for (size_t i = 0, off = 0; i < 3; off += iov[i].iov_len, ++i) {
+      if (sent >= off + iov[i].iov_len) continue;
+      size_t skip = sent > off ? sent - off : 0;
+      enqueue_((const char*)iov[i].iov_base + skip, iov[i].iov_len - skip);
+    }
+    out_lock_.unlock();
+    return true;
+  }
+
+  /**
+   * Writes queued bytes until they run out or the socket is full.
+   * Returns false if the connection failed.
+   */
+  bool flush() {
+    out_lock_.lock();
+    bool ok = true;
+    while (out_start_ < out_end_) {
+      ssize_t n = send(fd_, out_ + out_start_, out_end_ - out_start_, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      if (n <= 0) {
+        ok = false;
+        break;
+      }
+      out_start_ += n;
+    }
+    if (out_start_ == out_end_) out_start_ = out_end_ = 0;
+    out_lock_.unlock();
+    return ok;
+  }
+
+  /** Whether some queued bytes have not been written yet. */
+  bool pending() {
+    out_lock_.lock();
+    bool p = out_start_ < out_end_;
+    out_lock_.unlock();
+    return p;
+  }
+
+  // appends bytes to the outbound queue, called with out_lock_ held
+  void enqueue_(const char* buf, size_t len) {
+    if (out_end_ + len > out_cap_) {
+      size_t live = out_end_ - out_start_;
+      size_t cap = out_cap_ == 0 ? 4096 : out_cap_;
+      while (cap < live + len) cap *= 2;
+      char* grown = new char[cap];
+      memcpy(grown, out_ + out_start_, live);
+      delete[] out_;
+      out_ = grown;
+      out_cap_ = cap;
+      out_start_ = 0;
+      out_end_ = live;
+    }
+    memcpy(out_ + out_end_, buf, len);
+    out_end_ += len;
+  }
+};
+
+/**
+ * Receives the messages a Reactor reassembles.
+ * @authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class MessageHandler : public Object {
+public:
+  /** Handles a message that arrived on the given connection. The message
+   *  is consumed. */
+  virtual void handle(Message* msg, Connection* from) { delete msg; }
+
+  /** Called when the peer of a connection goes away. */
+  virtual void closed(Connection* c) {}
+
+  /** Whether the reactor should stop. Checked whenever it wakes up. */
+  virtual bool finished() { return false; }
+};
+
+/**
+ * An edge-triggered epoll event loop. It accepts connections on the
+ * listening socket, reads partial frames from every connection without
+ * blocking, dispatches each complete Message to a MessageHandler and
+ * finishes queued writes when sockets drain. While there is nothing to do
+ * it sleeps in epoll_wait, so it serves any number of peers from one
+ * thread at no idle CPU. Owns every Connection added to it.
+ * @authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class Reactor : public Object {
+public:
+  int epfd_;
+  int wake_;              // eventfd used to interrupt epoll_wait
+  int listen_;            // listening socket, -1 if none
+  Connection** conns_;    // every connection ever added
+  size_t num_conns_;
+  size_t cap_conns_;
+  Lock lock_;             // guards conns_
+  MessageSerializer ms_;
+
+  Reactor(int listen) {
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    assert(epfd_ >= 0 && "Unable to create epoll instance.");
+    wake_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(wake_ >= 0 && "Unable to create eventfd.");
+    cap_conns_ = 16;
+    num_conns_ = 0;
+    conns_ = new Connection*[cap_conns_];
+    listen_ = listen;
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wake_;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, wake_, &ev);
+    if (listen_ >= 0) {
+      fcntl(listen_, F_SETFL, fcntl(listen_, F_GETFL, 0) | O_NONBLOCK);
+      ev.events = EPOLLIN | EPOLLET;
+      ev.data.ptr = &listen_;
+      epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_, &ev);
+    }
+  }
+
+  ~Reactor() {
+    for (size_t i = 0; i < num_conns_; ++i) delete conns_[i];
+    delete[] conns_;
+    close(wake_);
+    close(epfd_);
+  }
+
+  /** Makes the connection nonblocking and starts watching it. */
+  void add(Connection* c) {
+    c->set_nonblocking();
+    lock_.lock();
+    if (num_conns_ == cap_conns_) {
+      Connection** grown = new Connection*[cap_conns_ * 2];
+      memcpy(grown, conns_, num_conns_ * sizeof(Connection*));
+      delete[] conns_;
+      conns_ = grown;
+      cap_conns_ *= 2;
+    }
+    conns_[num_conns_++] = c;
+    lock_.unlock();
+
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, c->fd_, &ev);
+  }
+
+  /** Interrupts epoll_wait so that the handler's finished() is checked. */
+  void wake() {
+    uint64_t one = 1;
+    while (write(wake_, &one, sizeof(one)) < 0 && errno == EINTR) {}
+  }
+
+  /**
+   * Runs the event loop until the handler is finished, then writes out
+   * anything still queued so that final messages reach their peers.
+   */
+  void run(MessageHandler* h) {
+    epoll_event events[64];
+    while (!h->finished()) {
+      int n = epoll_wait(epfd_, events, 64, -1);
+      if (n < 0) {
+        assert(errno == EINTR && "epoll_wait failed");
+        continue;
+      }
+      for (int i = 0; i < n; ++i) {
+        void* tag = events[i].data.ptr;
+        if (tag == &wake_) {
+          uint64_t count;
+          while (read(wake_, &count, sizeof(count)) < 0 && errno == EINTR) {}
+        } else if (tag == &listen_) {
+          accept_all_();
+        } else {
+          ready_((Connection*)tag, events[i].events, h);
+        }
+      }
+    }
+    drain_();
+  }
+
+  // accepts every pending connection, the listening socket is edge-triggered
+  void accept_all_() {
+    while (true) {
+      int fd = accept(listen_, nullptr, nullptr);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        return;
+      }
+      add(new Connection(fd));
+    }
+  }
+
+  // handles readiness of one connection
+  void ready_(Connection* c, uint32_t events, MessageHandler* h) {
+    if (!c->open_) return;
+    bool alive = true;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+      // edge-triggered: read until the socket has nothing more
+      Message* msg;
+      int r;
+      while ((r = c->read_frame(&ms_, &msg)) == 1) h->handle(msg, c);
+      alive = r == 0;
+    }
+    if (alive && (events & EPOLLOUT)) alive = c->flush();
+    if (!alive) {
+      epoll_ctl(epfd_, EPOLL_CTL_DEL, c->fd_, nullptr);
+      c->open_ = false;
+      // the descriptor stays allocated until the connection is deleted, so
+      // a sender still holding it cannot write to a reused descriptor
+      shutdown(c->fd_, SHUT_RDWR);
+      h->closed(c);
+    }
+  }
+
+  // blocks until every open connection has written its queued bytes
+  void drain_() {
+    lock_.lock();
+    for (size_t i = 0; i < num_conns_; ++i) {
+      Connection* c = conns_[i];
+      while (c->open_ && c->pending()) {
+        wait_for(c->fd_, POLLOUT);
+        if (!c->flush()) break;
+      }
+    }
+    lock_.unlock();
+  }
+};
@@ -0,0 +1,109 @@
+// lang::CwC
+#pragma once
+
+#include "object.h"
+#include "key.h"
+#include "thread.h"
+
+/**
+ * Chunks that were requested ahead of time and not yet claimed, keyed by
+ * the chunk's key, each with the id of the request that fetches it. Holds
+ * only a few entries at a time (how far readers read ahead), so lookups
+ * simply scan it.
+ * @authors: horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class PrefetchTable : public Object {
+public:
+  Key** keys_;       // owned copies of the keys on their way
+  size_t* ids_;      // request id fetching each key
+  size_t size_;
+  size_t capacity_;
+  Lock lock_;
+
+  PrefetchTable() {
+    size_ = 0;
+    capacity_ = 16;
+    keys_ = new Key*[capacity_];
+    ids_ = new size_t[capacity_];
+  }
+
+  ~PrefetchTable() {
+    for (size_t i = 0; i < size_; ++i) delete keys_[i];
+    delete[] keys_;
+    delete[] ids_;
+  }
+
+  /**
+   * Records that the request with the given id is fetching the key.
+   * @returns false, recording nothing, if the key is already on its way
+   */
+  bool add(Key* key, size_t id) {
+    lock_.lock();
+    if (find_(key) != -1) {
+      lock_.unlock();
+      return false;
+    }
+    if (size_ == capacity_) {
+      Key** keys = new Key*[capacity_ * 2];
+      size_t* ids = new size_t[capacity_ * 2];
+      memcpy(keys, keys_, size_ * sizeof(Key*));
+      memcpy(ids, ids_, size_ * sizeof(size_t));
+      delete[] keys_;
+      delete[] ids_;
+      keys_ = keys;
+      ids_ = ids;
+      capacity_ *= 2;
+    }
+    Key* copy = new Key(key->getName()->clone(), key->getHomeNode());
+    copy->setCreatorID(key->getCreatorID());
+    keys_[size_] = copy;
+    ids_[size_] = id;
+    ++size_;
+    lock_.unlock();
+    return true;
+  }
+
+  /**
+   * Claims the request fetching the given key, so nobody else waits on it.
+   * @returns its id, or -1 if the key is not on its way
+   */
+  long take(Key* key) {
+    lock_.lock();
+    int i = find_(key);
+    long id = i == -1 ? -1 : (long)remove_(i);
+    lock_.unlock();
+    return id;
+  }
+
+  /**
+   * Claims a request fetching any key made by the given creator.
+   * @returns its id, or -1 if there is none
+   */
+  long take_creator(size_t creator_id) {
+    lock_.lock();
+    long id = -1;
+    for (size_t i = 0; i < size_ && id == -1; ++i) {
+      if (keys_[i]->getCreatorID() == creator_id) id = (long)remove_(i);
+    }
+    lock_.unlock();
+    return id;
+  }
+
+  // position of the key in keys_, or -1. Called with lock_ held.
+  int find_(Key* key) {
+    for (size_t i = 0; i < size_; ++i) {
+      if (keys_[i]->equals(key)) return (int)i;
+    }
+    return -1;
+  }
+
+  // forget the entry at i, returning its id. Called with lock_ held.
+  size_t remove_(size_t i) {
+    size_t id = ids_[i];
+    delete keys_[i];
+    --size_;
+    keys_[i] = keys_[size_];
+    ids_[i] = ids_[size_];
+    return id;
+  }
+};
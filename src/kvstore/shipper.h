@@ -0,0 +1,103 @@
+// lang::CwC
+#pragma once
+
+#include "object.h"
+#include "kvstore.h"
+#include "thread.h"
+
+// batches of chunks a ChunkShipper holds before whoever hands it more
+// waits for it to catch up
+size_t SHIP_QUEUE = 4;
+
+/**
+ * Stores batches of finished chunks on a thread of its own, so that the
+ * columns filling them can keep going while earlier chunks are serialized
+ * and sent to their home nodes. The queue is bounded: push waits while it
+ * holds SHIP_QUEUE batches, which caps the chunks in flight however much
+ * data goes through it. Used by ingest, with Column::shipper_.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class ChunkShipper : public Thread {
+public:
+  KVStore* kv_;           // external
+  KeyArray** keys_;       // owned; queued batches, from head_ on
+  ChunkArray** chunks_;
+  size_t capacity_;
+  size_t head_;
+  size_t count_;          // batches queued
+  bool busy_;             // whether a batch is being stored
+  bool closed_;           // set when the shipper is destroyed
+  Lock lock_;             // guards the queue, notified whenever it changes
+
+  ChunkShipper(KVStore* kv) {
+    kv_ = kv;
+    capacity_ = SHIP_QUEUE > 0 ? SHIP_QUEUE : 1;
+    keys_ = new KeyArray*[capacity_];
+    chunks_ = new ChunkArray*[capacity_];
+    head_ = 0;
+    count_ = 0;
+    busy_ = false;
+    closed_ = false;
+    start();
+  }
+
+  /** Stores whatever is still queued, then stops the thread. */
+  ~ChunkShipper() {
+    lock_.lock();
+    closed_ = true;
+    lock_.notify_all();
+    lock_.unlock();
+    join();
+    delete[] keys_;
+    delete[] chunks_;
+  }
+
+  /**
+   * Queues a batch of chunks, under the given keys, to be stored like
+   * KVStore::put_chunks does, waiting first while the queue is full.
+   * Takes both arrays and the chunks; the keys stay the caller's.
+   */
+  void push(KeyArray* keys, ChunkArray* chunks) {
+    lock_.lock();
+    while (count_ == capacity_) lock_.wait();
+    keys_[(head_ + count_) % capacity_] = keys;
+    chunks_[(head_ + count_) % capacity_] = chunks;
+    ++count_;
+    lock_.notify_all();
+    lock_.unlock();
+  }
+
+  /** Waits until every batch pushed so far has been stored. */
+  void drain() {
+    lock_.lock();
+    while (count_ > 0 || busy_) lock_.wait();
+    lock_.unlock();
+  }
+
+  void run() {
+    while (true) {
+      lock_.lock();
+      while (count_ == 0 && !closed_) lock_.wait();
+      if (count_ == 0) {
+        lock_.unlock();
+        return;
+      }
+      KeyArray* keys = keys_[head_];
+      ChunkArray* chunks = chunks_[head_];
+      head_ = (head_ + 1) % capacity_;
+      --count_;
+      busy_ = true;
+      lock_.notify_all();
+      lock_.unlock();
+
+      kv_->put_chunks(keys, chunks);
+      delete keys;
+      delete chunks;
+
+      lock_.lock();
+      busy_ = false;
+      lock_.notify_all();
+      lock_.unlock();
+    }
+  }
+};
@@ -5,6 +5,7 @@
 #include "key.h"
 #include <math.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 using namespace std;
 
@@ -89,65 +90,40 @@ public:
 class IntArray : public Array {
 public:
 
-    int** arr_;         // internal array of int arrays
-    size_t num_arr_;    // number of int arrays in arr_
-    size_t size_;       // number of ints total in arr_
+    int* vals_;          // the ints, one after another
+    size_t size_;       // number of ints in vals_
+    size_t capacity_;   // room in vals_
 
 
     // default constructor - initialize as an empty IntArray
     IntArray() {
         set_type_('I');
         size_ = 0;
-        num_arr_ = 0;
-        arr_ = new int*[0];
+        capacity_ = 0;
+        vals_ = nullptr;
     }
 
     /**
-     * constructor with values given - initialize all values into arr_
+     * constructor with values given - initialize all values into vals_
      * @param n: number of ints in the args
      * @param ...: the ints, handled by va_list etc.
      */
     IntArray(int n, ...) {
         set_type_('I');
-
-        // each int* in arr_ will be of size
-        int* ints = new int[ARR_SIZE];
-
-        // set the number of num_arr_ we will have based on n
-        if (n % ARR_SIZE == 0) num_arr_ = n / ARR_SIZE;
-        else num_arr_ = (n / ARR_SIZE) + 1;
-
-        // initialize arr_ and n
-        arr_ = new int*[num_arr_];
         size_t sn = n;
-        size_ = n;
+        size_ = sn;
+        capacity_ = sn;
+        vals_ = new int[capacity_];
 
-        size_t curr_arr = 0;    // the current int* we are at in arr_
         va_list args;           // args given
         va_start(args, n);
-
-        // for loop to fill arr_
-        for (size_t i = 0; i < sn; ++i) {
-            // our array of size 10 is filled - add to arr_
-            if (i % ARR_SIZE == 0 && i != 0) {
-                arr_[curr_arr] = ints;
-                ++curr_arr;
-                ints = new int[ARR_SIZE];
-            }
-            // add the current int to ints
-            ints[i % ARR_SIZE] = va_arg(args, int);
-        }
-        // add the last array into arr_
-        arr_[curr_arr] = ints;
+        for (size_t i = 0; i < sn; ++i) vals_[i] = va_arg(args, int);
         va_end(args);
     }
 
-    // destructor - delete arr_ and its sub-arrays
+    // destructor - delete vals_
     ~IntArray() {
-        for (size_t i = 0; i < num_arr_; ++i) {
-            delete[] arr_[i];
-        }
-        delete[] arr_;
+        delete[] vals_;
     }
 
     /**
@@ -157,7 +133,7 @@ public:
      */
     int get(size_t idx) {
         assert(idx < size_);
-        return arr_[idx / ARR_SIZE][idx % ARR_SIZE];
+        return vals_[idx];
     }
 
     /**
@@ -173,34 +149,8 @@ public:
      * @param val: int to push back
      */
     virtual void push_back(int val) {
-        // the last int* in arr_ is full
-        // copy int*s into a new int** - copies pointers but not payload
-        if (size_ % ARR_SIZE == 0) {
-            // increment size values
-            ++size_;
-            ++num_arr_;
-
-            // create new int* and initialize with val at first idx
-            int* ints = new int[ARR_SIZE];
-            ints[0] = val;
-
-            // set up a temp int**, overwrite arr_ with new int**
-            int** tmp = arr_;
-            arr_ = new int*[num_arr_];
-
-            // for loop copy values from temp into arr_
-            for (size_t i = 0; i < num_arr_ - 1; ++i) {
-                arr_[i] = tmp[i];
-            }
-
-            // add new int* into arr_ and delete the temp
-            arr_[num_arr_ - 1] = ints;
-            delete[] tmp;
-        // we have room in the last int* of arr_ - add the val
-        } else {
-            arr_[size_ / ARR_SIZE][size_ % ARR_SIZE] = val;
-            ++size_;
-        }
+        if (size_ == capacity_) reserve(size_ + 1);
+        vals_[size_++] = val;
     }
 
     /**
@@ -210,21 +160,56 @@ public:
      */
     void set(size_t idx, int val) {
         assert(idx < size_);
-        arr_[idx / ARR_SIZE][idx % ARR_SIZE] = val;
+        vals_[idx] = val;
+    }
+
+    /**
+     * push n ints to the end of the Array with a single copy
+     * @param vals: the ints to push back
+     * @param n: number of ints in vals
+     */
+    void append(const int* vals, size_t n) {
+        if (size_ + n > capacity_) reserve(size_ + n);
+        memcpy(&vals_[size_], vals, n * sizeof(int));
+        size_ += n;
+    }
+
+    /**
+     * copy n ints starting at the given index into dst
+     * @param dst: where to copy the ints to, with room for n of them
+     * @param start: index of the first int to copy
+     * @param n: number of ints to copy
+     */
+    void copy_to(int* dst, size_t start, size_t n) {
+        assert(start + n <= size_);
+        memcpy(dst, &vals_[start], n * sizeof(int));
+    }
+
+    /**
+     * makes room for at least n ints, at least doubling the room each
+     * time it grows so that pushing back is amortized O(1)
+     */
+    void reserve(size_t n) {
+        if (n <= capacity_) return;
+        size_t cap = capacity_ < 16 ? 16 : capacity_ * 2;
+        if (cap < n) cap = n;
+        int* vals = new int[cap];
+        if (size_ > 0) memcpy(vals, vals_, size_ * sizeof(int));
+        delete[] vals_;
+        vals_ = vals;
+        capacity_ = cap;
+    }
+
+    /** the ints of this Array, one after another; valid until it grows */
+    int* data() {
+        return vals_;
     }
 
     /** remove int at given idx */
     void remove(size_t idx) {
         assert(idx < size_);
-        if (idx == size_ - 1) {
-            arr_[idx / ARR_SIZE][idx % ARR_SIZE] = 0;
-        } else {
-            for (size_t i = idx; i < size_; ++i) {
-                set(i, arr_[(i + 1) / ARR_SIZE][(i + 1) % ARR_SIZE]);
-            }
-        }
+        memmove(&vals_[idx], &vals_[idx + 1], (size_ - idx - 1) * sizeof(int));
         --size_;
-        if (size_ % ARR_SIZE == 0) --num_arr_;
     }
 
     /**
@@ -240,70 +225,41 @@ public:
 
 /*************************************************************************
  * BoolArray::
- * Holds primitive bool values, unwrapped.
+ * Holds primitive bool values, packed one to a bit.
  * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
  */
 class BoolArray : public Array {
 public:
 
-    bool** arr_;        // internal array of bool arrays
-    size_t num_arr_;    // number of bool arrays in arr_
-    size_t size_;       // number of bools total in arr_
+    uint64_t* words_;   // the bools, 64 to a word, lowest bit first; bits
+                        // past the last bool are always 0
+    size_t size_;       // number of bools in words_
+    size_t capacity_;   // room in words_, in words
+
 
     // default constructor - initialize as an empty BoolArray
     BoolArray() {
         set_type_('B');
         size_ = 0;
-        num_arr_ = 0;
-        arr_ = new bool*[0];
+        capacity_ = 0;
+        words_ = nullptr;
     }
 
     /**
-     * constructor with values given - initialize all values into arr_
+     * constructor with values given - initialize all values into words_
      * @param n: number of bools in the args
      * @param ...: the bools, handled by va_list etc.
      */
-    BoolArray(int n, ...) {
-        set_type_('B');
-
-        // each bool* in arr_ will be of size
-        bool* bools = new bool[BOOL_ARR_SIZE];
-
-        // set the number of num_arr_ we will have based on n
-        if (n % BOOL_ARR_SIZE == 0) num_arr_ = n / BOOL_ARR_SIZE;
-        else num_arr_ = (n / BOOL_ARR_SIZE) + 1;
-
-        // initialize arr_ and n
-        arr_ = new bool*[num_arr_];
-        size_t sn = n;
-        size_ = n;
-
-        size_t curr_arr_ = 0;   // the current bool* we are at in arr)
+    BoolArray(int n, ...) : BoolArray() {
         va_list args;           // args given
         va_start(args, n);
-
-        // for loop to fill arr_
-        for (size_t i = 0; i < sn; ++i) {
-            // our array of size is filled - add to arr_
-            if (i % BOOL_ARR_SIZE == 0 && i != 0) {
-                arr_[curr_arr_] = bools;
-                ++curr_arr_;
-                bools = new bool[BOOL_ARR_SIZE];
-            }
-            // add the current bool to bools
-            bools[i % BOOL_ARR_SIZE] = va_arg(args, int);
-        }
-        // add the last array into arr_
-        arr_[curr_arr_] = bools;
+        for (int i = 0; i < n; ++i) push_back((bool)va_arg(args, int));
         va_end(args);
     }
 
-    // destructor - delete arr_ and its sub-arrays
+    // destructor - delete words_
     ~BoolArray() {
-        for (size_t i = 0; i < num_arr_; ++i) {
-            delete[] arr_[i];
-        }
-        delete[] arr_;
+        delete[] words_;
     }
 
     /**
@@ -313,7 +269,7 @@ public:
      */
     bool get(size_t idx) {
         assert(idx < size_);
-        return arr_[idx / BOOL_ARR_SIZE][idx % BOOL_ARR_SIZE];
+        return (words_[idx / 64] >> (idx % 64)) & 1;
     }
 
     /**
@@ -329,34 +285,12 @@ public:
      * @param val: bool to push back
      */
     virtual void push_back(bool val) {
-        // the last bool* in arr_ is full
-        // copy bool*s into a new bool** - copies pointers but not payload
-        if (size_ % BOOL_ARR_SIZE == 0) {
-            // increment size values
-            ++size_;
-            ++num_arr_;
-
-            // create new bool* and initialize with val at first idx
-            bool* bools = new bool[BOOL_ARR_SIZE];
-            bools[0] = val;
-
-            // set up a temp bool**, overwrite arr_ with new bool**
-            bool** tmp = arr_;
-            arr_ = new bool*[num_arr_];
-
-            // for loop copy values from temp into arr_
-            for (size_t i = 0; i < num_arr_ - 1; ++i) {
-                arr_[i] = tmp[i];
-            }
-
-            // add new bool* into arr_ and delete the temp
-            arr_[num_arr_ - 1] = bools;
-            delete[] tmp;
-        // we have room in the last bool* of arr_ - add the val
-        } else {
-            arr_[size_ / BOOL_ARR_SIZE][size_ % BOOL_ARR_SIZE] = val;
-            ++size_;
+        if (size_ % 64 == 0) {
+            if (size_ / 64 == capacity_) reserve(size_ + 1);
+            words_[size_ / 64] = 0;
         }
+        words_[size_ / 64] |= (uint64_t)val << (size_ % 64);
+        ++size_;
     }
 
     /**
@@ -366,12 +300,119 @@ public:
      */
     void set(size_t idx, bool val) {
         assert(idx < size_);
-        arr_[idx / BOOL_ARR_SIZE][idx % BOOL_ARR_SIZE] = val;
+        uint64_t bit = (uint64_t)1 << (idx % 64);
+        if (val) words_[idx / 64] |= bit;
+        else words_[idx / 64] &= ~bit;
     }
 
     /**
-     * get the amount of ints in the Array
-     * @returns the amount of ints in the Array
+     * push n bools to the end of the Array
+     * @param vals: the bools to push back
+     * @param n: number of bools in vals
+     */
+    void append(const bool* vals, size_t n) {
+        reserve(size_ + n);
+        for (size_t i = 0; i < n; ++i) push_back(vals[i]);
+    }
+
+    /**
+     * push n bools packed 8 to a byte, lowest bit first, to the end of the
+     * Array; whole words at a time when the Array ends on a word boundary
+     * @param bits: the packed bools
+     * @param n: number of bools in bits
+     */
+    void append_bits(const uint8_t* bits, size_t n) {
+        reserve(size_ + n);
+        size_t i = 0;
+        if (size_ % 64 == 0) {
+            size_t w = size_ / 64;
+            for (; i + 64 <= n; i += 64) {
+                uint64_t word = 0;
+                for (size_t b = 0; b < 8; ++b) word |= (uint64_t)bits[i / 8 + b] << (8 * b);
+                words_[w++] = word;
+            }
+            size_ += i;
+        }
+        for (; i < n; ++i) push_back((bits[i / 8] >> (i % 8)) & 1);
+    }
+
+    /**
+     * copy n bools starting at the given index into dst
+     * @param dst: where to copy the bools to, with room for n of them
+     * @param start: index of the first bool to copy
+     * @param n: number of bools to copy
+     */
+    void copy_to(bool* dst, size_t start, size_t n) {
+        assert(start + n <= size_);
+        for (size_t i = 0; i < n; ++i) dst[i] = get(start + i);
+    }
+
+    /**
+     * copy the bools packed 8 to a byte, lowest bit first, into dst,
+     * which has room for (size() + 7) / 8 bytes
+     */
+    void copy_bits(uint8_t* dst) {
+        for (size_t i = 0; i < (size_ + 7) / 8; ++i) {
+            dst[i] = (uint8_t)(words_[i / 8] >> (8 * (i % 8)));
+        }
+    }
+
+    /**
+     * makes room for at least n bools, at least doubling the room each
+     * time it grows so that pushing back is amortized O(1)
+     */
+    void reserve(size_t n) {
+        size_t need = (n + 63) / 64;
+        if (need <= capacity_) return;
+        size_t cap = capacity_ < 16 ? 16 : capacity_ * 2;
+        if (cap < need) cap = need;
+        uint64_t* words = new uint64_t[cap];
+        if (capacity_ > 0) memcpy(words, words_, num_words() * sizeof(uint64_t));
+        delete[] words_;
+        words_ = words;
+        capacity_ = cap;
+    }
+
+    /** the words holding the bools; valid until the Array grows */
+    uint64_t* data() {
+        return words_;
+    }
+
+    /** number of words in use by the bools */
+    size_t num_words() {
+        return (size_ + 63) / 64;
+    }
+
+    /** the number of bools that are true, a word at a time */
+    size_t count() {
+        size_t count = 0;
+        for (size_t i = 0; i < num_words(); ++i) count += __builtin_popcountll(words_[i]);
+        return count;
+    }
+
+    /** ANDs each bool with the bool at the same index of that, which must
+     *  be as long as this, a word at a time */
+    void and_with(BoolArray* that) {
+        assert(that->size_ == size_);
+        for (size_t i = 0; i < num_words(); ++i) words_[i] &= that->words_[i];
+    }
+
+    /** ORs each bool with the bool at the same index of that, which must
+     *  be as long as this, a word at a time */
+    void or_with(BoolArray* that) {
+        assert(that->size_ == size_);
+        for (size_t i = 0; i < num_words(); ++i) words_[i] |= that->words_[i];
+    }
+
+    /** flips every bool, a word at a time */
+    void negate() {
+        for (size_t i = 0; i < num_words(); ++i) words_[i] = ~words_[i];
+        if (size_ % 64 != 0) words_[size_ / 64] &= ((uint64_t)1 << (size_ % 64)) - 1;
+    }
+
+    /**
+     * get the amount of bools in the Array
+     * @returns the amount of bools in the Array
      */
     size_t size() {
         return size_;
@@ -386,64 +427,40 @@ public:
 class DoubleArray : public Array {
 public:
 
-    double** arr_;       // internal array of double arrays
-    size_t num_arr_;    // number of double arrays in arr_
-    size_t size_;       // number of doubles total in arr_
+    double* vals_;          // the doubles, one after another
+    size_t size_;       // number of doubles in vals_
+    size_t capacity_;   // room in vals_
 
-    // default constructor - initialize as empty DoubleArray
+
+    // default constructor - initialize as an empty DoubleArray
     DoubleArray() {
         set_type_('D');
         size_ = 0;
-        num_arr_ = 0;
-        arr_ = new double*[0];
+        capacity_ = 0;
+        vals_ = nullptr;
     }
 
     /**
-     * constructor with values given - initialize all values into arr_
+     * constructor with values given - initialize all values into vals_
      * @param n: number of doubles in the args
      * @param ...: the doubles, handled by va_list etc.
      */
     DoubleArray(double n, ...) {
         set_type_('D');
+        size_t sn = (size_t)n;
+        size_ = sn;
+        capacity_ = sn;
+        vals_ = new double[capacity_];
 
-        // each bool* in arr_ will be of size
-        double* doubles = new double[ARR_SIZE];
-
-        // set the number of num_arr_ we will have based on n
-        if ((size_t)ceil(n) % ARR_SIZE == 0) num_arr_ = n / ARR_SIZE;
-        else num_arr_ = (n / ARR_SIZE) + 1;
-
-        // initialize arr_ and n
-        arr_ = new double*[num_arr_];
-        size_t sn = n;
-        size_ = n;
-
-        size_t curr_arr_ = 0;   // the current double* we are at in arr_
         va_list args;           // args given
         va_start(args, n);
-
-        // for loop to fill arr_
-        for (size_t i = 0; i < sn; ++i) {
-            // our array of size is filled - add to arr_
-            if (i % ARR_SIZE == 0 && i != 0) {
-                arr_[curr_arr_] = doubles;
-                ++curr_arr_;
-                doubles = new double[ARR_SIZE];
-            }
-            // add the current double into doubles
-            doubles[i % ARR_SIZE] = va_arg(args, double);
-        }
-        // add the last array into arr_
-        arr_[curr_arr_] = doubles;
+        for (size_t i = 0; i < sn; ++i) vals_[i] = va_arg(args, double);
         va_end(args);
     }
 
-    // destructor - delete arr_ and its sub-arrays
+    // destructor - delete vals_
     ~DoubleArray() {
-        for (size_t i = 0; i < num_arr_; ++i) {
-            delete[] arr_[i];
-        }
-        delete[] arr_;
+        delete[] vals_;
     }
 
     /** returns true if this is equal to that */
@@ -474,7 +491,7 @@ public:
      */
     double get(size_t idx) {
         assert(idx < size_);
-        return arr_[idx / ARR_SIZE][idx % ARR_SIZE];
+        return vals_[idx];
     }
 
     /**
@@ -490,34 +507,8 @@ public:
      * @param val: double to push back
      */
     virtual void push_back(double val) {
-        // the last double* in arr_ is full
-        // copy double*s into a new double** - copies pointers but not payload
-        if (size_ % ARR_SIZE == 0) {
-            // increment size values
-            ++size_;
-            ++num_arr_;
-
-            // create new double* and initialize val at first idx
-            double* doubles = new double[ARR_SIZE];
-            doubles[0] = val;
-
-            // set up a temp double**, overwrite arr_ with new double**
-            double** tmp = arr_;
-            arr_ = new double*[num_arr_];
-
-            // for loop to copy values from temp into arr_
-            for (size_t i = 0; i < num_arr_ - 1; ++i) {
-                arr_[i] = tmp[i];
-            }
-
-            // add new double* into arr_ and delete the temp
-            arr_[num_arr_ - 1] = doubles;
-            delete[] tmp;
-        // we have room in the last double* of arr_ - add the val
-        } else {
-            arr_[size_ / ARR_SIZE][size_ % ARR_SIZE] = val;
-            ++size_;
-        }
+        if (size_ == capacity_) reserve(size_ + 1);
+        vals_[size_++] = val;
     }
 
     /**
@@ -527,7 +518,49 @@ public:
      */
     void set(size_t idx, double val) {
         assert(idx < size_);
-        arr_[idx / ARR_SIZE][idx % ARR_SIZE] = val;
+        vals_[idx] = val;
+    }
+
+    /**
+     * push n doubles to the end of the Array with a single copy
+     * @param vals: the doubles to push back
+     * @param n: number of doubles in vals
+     */
+    void append(const double* vals, size_t n) {
+        if (size_ + n > capacity_) reserve(size_ + n);
+        memcpy(&vals_[size_], vals, n * sizeof(double));
+        size_ += n;
+    }
+
+    /**
+     * copy n doubles starting at the given index into dst
+     * @param dst: where to copy the doubles to, with room for n of them
+     * @param start: index of the first double to copy
+     * @param n: number of doubles to copy
+     */
+    void copy_to(double* dst, size_t start, size_t n) {
+        assert(start + n <= size_);
+        memcpy(dst, &vals_[start], n * sizeof(double));
+    }
+
+    /**
+     * makes room for at least n doubles, at least doubling the room each
+     * time it grows so that pushing back is amortized O(1)
+     */
+    void reserve(size_t n) {
+        if (n <= capacity_) return;
+        size_t cap = capacity_ < 16 ? 16 : capacity_ * 2;
+        if (cap < n) cap = n;
+        double* vals = new double[cap];
+        if (size_ > 0) memcpy(vals, vals_, size_ * sizeof(double));
+        delete[] vals_;
+        vals_ = vals;
+        capacity_ = cap;
+    }
+
+    /** the doubles of this Array, one after another; valid until it grows */
+    double* data() {
+        return vals_;
     }
 
     /**
@@ -725,6 +758,15 @@ public:
         if (size_ % STRING_ARR_SIZE == 0) --num_arr_;
     }
 
+    /** remove the last String and return it, without deleting it */
+    String* pop_back() {
+        assert(size_ > 0);
+        --size_;
+        String* s = arr_[size_ / STRING_ARR_SIZE][size_ % STRING_ARR_SIZE];
+        if (size_ % STRING_ARR_SIZE == 0) delete[] arr_[--num_arr_];
+        return s;
+    }
+
     /**
      * get the amount of Strings in the Array
      * @returns the amount of Strings in the Array
@@ -742,100 +784,27 @@ public:
 class ByteArray : public Array {
 public:
 
-    char** arr_;         // internal array of char arrays
-    size_t num_arr_;    // number of char arrays in arr_
-    size_t size_;       // number of chars total in arr_
+    char* vals_;         // the chars, one after another
+    size_t size_;       // number of chars in vals_
+    size_t capacity_;   // room in vals_
 
 
     // default constructor - initialize as an empty ByteArray
     ByteArray() {
         set_type_('C');
         size_ = 0;
-        num_arr_ = 0;
-        arr_ = new char*[0];
+        capacity_ = 0;
+        vals_ = nullptr;
     }
 
-    /** NOT USED
-     * constructor with values given - initialize all values into arr_
-     * @param n: number of chars in the args
-     * @param ...: the chars, handled by va_list etc.
-     *
-    ByteArray(int n, ...) {
-        set_type_('C');
-
-        // each char* in arr_ will be of size 10
-        char* chars = new char[10];
-
-        // set the number of num_arr_ we will have based on n
-        if (n % 10 == 0) num_arr_ = n / 10;
-        else num_arr_ = (n / 10) + 1;
-
-        // initialize arr_ and n
-        arr_ = new char*[num_arr_];
-        //arr_[0] = chars;
-        size_ = n;
-
-        size_t curr_arr = 0;    // the current char* we are at in arr_
-        va_list args;           // args given
-        va_start(args, n);
-
-        // for loop to fill arr_
-        for (size_t i = 0; i < n; ++i) {
-            // our array of size 10 is filled - add to arr_
-            if (i % 10 == 0 && i != 0) {
-                arr_[curr_arr] = chars;
-                ++curr_arr;
-                chars = new char[10];
-            }
-            // add the current char to chars
-            chars[i % 10] = va_arg(args, char);
-        }
-        // add the last array into arr_
-        arr_[curr_arr] = chars;
-        va_end(args);
-    }*/
-
     // constructor turning a string into a ByteArray
-    ByteArray(const char* str) {
-      set_type_('C');
-
-      size_t sz = strlen(str);
-
-      // each char* in arr_ will be of size 10
-      char* chars = new char[STRING_ARR_SIZE];
-
-      // set the number of num_arr_ we will have based on n
-      if (sz % BOOL_ARR_SIZE == 0) num_arr_ = sz / BOOL_ARR_SIZE;
-      else num_arr_ = (sz / BOOL_ARR_SIZE) + 1;
-
-      // initialize arr_ and n
-      arr_ = new char*[num_arr_];
-      //arr_[0] = chars;
-      size_ = sz;
-
-      size_t curr_arr = 0;    // the current char* we are at in arr_
-
-      // for loop to fill arr_
-      for (size_t i = 0; i < sz; ++i) {
-          // our array of size 10 is filled - add to arr_
-          if (i % BOOL_ARR_SIZE == 0 && i != 0) {
-              arr_[curr_arr] = chars;
-              ++curr_arr;
-              chars = new char[BOOL_ARR_SIZE];
-          }
-          // add the current char to chars
-          chars[i % BOOL_ARR_SIZE] = str[i];
-      }
-      // add the last array into arr_
-      arr_[curr_arr] = chars;
+    ByteArray(const char* str) : ByteArray() {
+      push_string(str);
     }
 
-    // destructor - delete arr_ and its sub-arrays
+    // destructor - delete vals_
     ~ByteArray() {
-        for (size_t i = 0; i < num_arr_; ++i) {
-            delete[] arr_[i];
-        }
-        delete[] arr_;
+        delete[] vals_;
     }
 
     /**
@@ -845,7 +814,7 @@ public:
      */
     char get(size_t idx) {
         assert(idx < size_);
-        return arr_[idx / BOOL_ARR_SIZE][idx % BOOL_ARR_SIZE];
+        return vals_[idx];
     }
 
     /**
@@ -861,41 +830,44 @@ public:
      * @param val: char to push back
      */
     virtual void push_back(char val) {
-        // the last char* in arr_ is full
-        // copy char*s into a new char** - copies pointers but not payload
-        if (size_ % BOOL_ARR_SIZE == 0) {
-            // increment size values
-            ++size_;
-            ++num_arr_;
-
-            // create new char* and initialize with val at first idx
-            char* chars = new char[BOOL_ARR_SIZE];
-            chars[0] = val;
+        if (size_ == capacity_) reserve(size_ + 1);
+        vals_[size_++] = val;
+    }
 
-            // set up a temp char**, overwrite arr_ with new char**
-            char** tmp = arr_;
-            arr_ = new char*[num_arr_];
+    /** adds the given string to the back of the array */
+    void push_string(const char* str) {
+      append(str, strlen(str));
+    }
 
-            // for loop copy values from temp into arr_
-            for (size_t i = 0; i < num_arr_ - 1; ++i) {
-                arr_[i] = tmp[i];
-            }
+    /**
+     * push n chars to the end of the Array with a single copy
+     * @param vals: the chars to push back
+     * @param n: number of chars in vals
+     */
+    void append(const char* vals, size_t n) {
+        if (size_ + n > capacity_) reserve(size_ + n);
+        memcpy(&vals_[size_], vals, n);
+        size_ += n;
+    }
 
-            // add new char* into arr_ and delete the temp
-            arr_[num_arr_ - 1] = chars;
-            delete[] tmp;
-        // we have room in the last char* of arr_ - add the val
-        } else {
-            arr_[size_ / BOOL_ARR_SIZE][size_ % BOOL_ARR_SIZE] = val;
-            ++size_;
-        }
+    /**
+     * makes room for at least n chars, at least doubling the room each
+     * time it grows so that pushing back is amortized O(1)
+     */
+    void reserve(size_t n) {
+        if (n <= capacity_) return;
+        size_t cap = capacity_ < 64 ? 64 : capacity_ * 2;
+        if (cap < n) cap = n;
+        char* vals = new char[cap];
+        if (size_ > 0) memcpy(vals, vals_, size_);
+        delete[] vals_;
+        vals_ = vals;
+        capacity_ = cap;
     }
 
-    /** adds the given string to the back of the array */
-    void push_string(const char* str) {
-      for (size_t i = 0; str[i] != 0; ++i) {
-        push_back((char)str[i]);
-      }
+    /** the chars of this Array, one after another; valid until it grows */
+    char* data() {
+        return vals_;
     }
 
     /**
@@ -905,7 +877,7 @@ public:
      */
     void set(size_t idx, char val) {
         assert(idx < size_);
-        arr_[idx / BOOL_ARR_SIZE][idx % BOOL_ARR_SIZE] = val;
+        vals_[idx] = val;
     }
 
     /**
@@ -919,9 +891,7 @@ public:
     /** returns this byte array as a string of bytes*/
     const char* as_bytes() {
       char* str = new char[size_ + 1];
-      for (size_t i = 0; i < size_; ++i) {
-        str[i] = get(i);
-      }
+      if (size_ > 0) memcpy(str, vals_, size_);
       str[size_] = 0;
       return str;
     }
@@ -1113,6 +1083,15 @@ public:
         if (size_ % STRING_ARR_SIZE == 0) --num_arr_;
     }
 
+    /** remove the last Key and return it, without deleting it */
+    Key* pop_back() {
+        assert(size_ > 0);
+        --size_;
+        Key* k = arr_[size_ / STRING_ARR_SIZE][size_ % STRING_ARR_SIZE];
+        if (size_ % STRING_ARR_SIZE == 0) delete[] arr_[--num_arr_];
+        return k;
+    }
+
     /**
      * get the amount of Keys in the Array
      * @returns the amount of Keys in the Array
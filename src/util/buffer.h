@@ -0,0 +1,59 @@
+#pragma once
+
+#include "object.h"
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+/**
+  * Authors: armani.a@husky.neu.edu, horn.s@husky.neu.edu
+  * A block of bytes shared by everything that reads from it, such as the
+  * payload of a received message and the chunk views pointing into it.
+  * Starts with one reference, held by whoever made it. Each new holder
+  * calls retain(), every holder calls release() when done, and the last
+  * release frees the bytes and the Buffer itself.
+  */
+class Buffer : public Object {
+public:
+  char* data_;                // owned; the bytes
+  size_t size_;               // number of bytes in data_
+  std::atomic<size_t> refs_;  // number of holders
+
+  /** Takes ownership of data, which must come from new[]. */
+  Buffer(bool steal, char* data, size_t size) : refs_(1) {
+    assert(steal);
+    data_ = data;
+    size_ = size;
+  }
+
+  /** Makes a buffer holding a copy of the given bytes. */
+  Buffer(const char* data, size_t size) : refs_(1) {
+    data_ = new char[size + 1];
+    memcpy(data_, data, size);
+    data_[size] = 0;
+    size_ = size;
+  }
+
+  ~Buffer() {
+    delete[] data_;
+  }
+
+  /** Adds a holder. */
+  Buffer* retain() {
+    refs_++;
+    return this;
+  }
+
+  /** Removes a holder, freeing the buffer if it was the last one. */
+  void release() {
+    if (--refs_ == 0) delete this;
+  }
+
+  const char* data() {
+    return data_;
+  }
+
+  size_t size() {
+    return size_;
+  }
+};
@@ -0,0 +1,456 @@
+#pragma once
+//lang::Cpp
+
+#include "object.h"
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EAU2_X86 1
+#endif
+
+// whether the kernels may use SSE2 and AVX2 on CPUs that have them. Turned
+// off, every kernel runs its plain loop.
+bool USE_SIMD = true;
+
+/**
+  * Authors: armani.a@husky.neu.edu, horn.s@husky.neu.edu
+  * Aggregate kernels over spans of contiguous memory, such as the chunks a
+  * column hands out with for_each_chunk, and a byte matcher SoR text is
+  * tokenized with. Each kernel has a plain loop, an
+  * SSE2 version and an AVX2 version, and picks the best one the CPU running
+  * it supports, checked once. Floating point sums are added in several
+  * lanes at once, so they may round differently from a loop in order.
+  * This class has no data; every method is static.
+  */
+class Kernels : public Object {
+public:
+
+  /** Which kernels run: 2 for AVX2, 1 for SSE2, 0 for the plain loops. */
+  static int level() {
+#ifdef EAU2_X86
+    static int level = cpu_level_();
+    return USE_SIMD ? level : 0;
+#else
+    return 0;
+#endif
+  }
+
+  /** The sum of n ints, without overflowing. */
+  static int64_t sum(const int* v, size_t n) {
+#ifdef EAU2_X86
+    if (level() == 2) return sum_avx2_(v, n);
+    if (level() == 1) return sum_sse2_(v, n);
+#endif
+    int64_t s = 0;
+    for (size_t i = 0; i < n; ++i) s += v[i];
+    return s;
+  }
+
+  /** The sum of n doubles. */
+  static double sum(const double* v, size_t n) {
+#ifdef EAU2_X86
+    if (level() == 2) return sum_avx2_(v, n);
+    if (level() == 1) return sum_sse2_(v, n);
+#endif
+    double s = 0;
+    for (size_t i = 0; i < n; ++i) s += v[i];
+    return s;
+  }
+
+  /** The smallest and largest of n ints, n > 0. */
+  static void min_max(const int* v, size_t n, int* mn, int* mx) {
+    size_t i = 0;
+    int lo = v[0];
+    int hi = v[0];
+#ifdef EAU2_X86
+    if (level() == 2) i = min_max_avx2_(v, n, &lo, &hi);
+    else if (level() == 1) i = min_max_sse2_(v, n, &lo, &hi);
+#endif
+    for (; i < n; ++i) {
+      if (v[i] < lo) lo = v[i];
+      if (v[i] > hi) hi = v[i];
+    }
+    *mn = lo;
+    *mx = hi;
+  }
+
+  /** The smallest and largest of n doubles, n > 0. */
+  static void min_max(const double* v, size_t n, double* mn, double* mx) {
+    size_t i = 0;
+    double lo = v[0];
+    double hi = v[0];
+#ifdef EAU2_X86
+    if (level() == 2) i = min_max_avx2_(v, n, &lo, &hi);
+    else if (level() == 1) i = min_max_sse2_(v, n, &lo, &hi);
+#endif
+    for (; i < n; ++i) {
+      if (v[i] < lo) lo = v[i];
+      if (v[i] > hi) hi = v[i];
+    }
+    *mn = lo;
+    *mx = hi;
+  }
+
+  /** The sum of the squared differences of n ints from the given mean. */
+  static double sq_dev(const int* v, size_t n, double mean) {
+    size_t i = 0;
+    double s = 0;
+#ifdef EAU2_X86
+    if (level() == 2) i = sq_dev_avx2_(v, n, mean, &s);
+    else if (level() == 1) i = sq_dev_sse2_(v, n, mean, &s);
+#endif
+    for (; i < n; ++i) s += (v[i] - mean) * (v[i] - mean);
+    return s;
+  }
+
+  /** The sum of the squared differences of n doubles from the given mean. */
+  static double sq_dev(const double* v, size_t n, double mean) {
+    size_t i = 0;
+    double s = 0;
+#ifdef EAU2_X86
+    if (level() == 2) i = sq_dev_avx2_(v, n, mean, &s);
+    else if (level() == 1) i = sq_dev_sse2_(v, n, mean, &s);
+#endif
+    for (; i < n; ++i) s += (v[i] - mean) * (v[i] - mean);
+    return s;
+  }
+
+  /** The number of set bits among the first n bits, packed 8 to a byte,
+   *  lowest bit first. */
+  static size_t popcount(const uint8_t* bits, size_t n) {
+    size_t bytes = n / 8;
+    size_t count = 0;
+    size_t i = 0;
+#ifdef EAU2_X86
+    if (level() == 2) i = popcount_avx2_(bits, bytes, &count);
+    else if (level() == 1 && has_popcnt_()) i = popcount_popcnt_(bits, bytes, &count);
+#endif
+    for (; i + 8 <= bytes; i += 8) {
+      uint64_t word;
+      memcpy(&word, &bits[i], 8);
+      count += __builtin_popcountll(word);
+    }
+    for (; i < bytes; ++i) count += __builtin_popcount(bits[i]);
+    if (n % 8 != 0) count += __builtin_popcount(bits[bytes] & ((1u << (n % 8)) - 1));
+    return count;
+  }
+
+  /** Sets bit i of bits, packed 64 to a word, lowest bit first, if byte i
+   *  of the n at p is one of the four bytes of set, and clears the others,
+   *  up to the end of the last word. Repeat a byte to look for fewer. */
+  static void match_bytes(const char* p, size_t n, const char* set, uint64_t* bits) {
+    size_t i = 0;
+#ifdef EAU2_X86
+    if (level() == 2) i = match_bytes_avx2_(p, n, set, bits);
+    else if (level() == 1) i = match_bytes_sse2_(p, n, set, bits);
+#endif
+    for (; i < n; i += 64) {
+      uint64_t word = 0;
+      size_t end = n - i < 64 ? n - i : 64;
+      for (size_t b = 0; b < end; ++b) {
+        char c = p[i + b];
+        if (c == set[0] || c == set[1] || c == set[2] || c == set[3]) word |= 1ULL << b;
+      }
+      bits[i / 64] = word;
+    }
+  }
+
+#ifdef EAU2_X86
+  static int cpu_level_() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 2 : 1;
+  }
+
+  static bool has_popcnt_() {
+    static bool popcnt = __builtin_cpu_supports("popcnt");
+    return popcnt;
+  }
+
+  static int64_t sum_sse2_(const int* v, size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+      __m128i sign = _mm_srai_epi32(x, 31);
+      acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, sign));
+      acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, sign));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    int64_t s = lanes[0] + lanes[1];
+    for (; i < n; ++i) s += v[i];
+    return s;
+  }
+
+  __attribute__((target("avx2")))
+  static int64_t sum_avx2_(const int* v, size_t n) {
+    __m256i a0 = _mm256_setzero_si256();
+    __m256i a1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+      a0 = _mm256_add_epi64(a0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+      a1 = _mm256_add_epi64(a1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(a0, a1));
+    int64_t s = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < n; ++i) s += v[i];
+    return s;
+  }
+
+  static double sum_sse2_(const double* v, size_t n) {
+    __m128d a0 = _mm_setzero_pd();
+    __m128d a1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      a0 = _mm_add_pd(a0, _mm_loadu_pd(v + i));
+      a1 = _mm_add_pd(a1, _mm_loadu_pd(v + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+    double s = lanes[0] + lanes[1];
+    for (; i < n; ++i) s += v[i];
+    return s;
+  }
+
+  __attribute__((target("avx2")))
+  static double sum_avx2_(const double* v, size_t n) {
+    __m256d a0 = _mm256_setzero_pd();
+    __m256d a1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      a0 = _mm256_add_pd(a0, _mm256_loadu_pd(v + i));
+      a1 = _mm256_add_pd(a1, _mm256_loadu_pd(v + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(a0, a1));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; ++i) s += v[i];
+    return s;
+  }
+
+  // SSE2 has no min or max of 32 bit ints, so compare and select.
+  // Returns how many values it looked at; the caller finishes the rest.
+  static size_t min_max_sse2_(const int* v, size_t n, int* lo, int* hi) {
+    if (n < 4) return 0;
+    __m128i mn = _mm_loadu_si128((const __m128i*)v);
+    __m128i mx = mn;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+      __m128i lt = _mm_cmplt_epi32(x, mn);
+      mn = _mm_or_si128(_mm_and_si128(lt, x), _mm_andnot_si128(lt, mn));
+      __m128i gt = _mm_cmpgt_epi32(x, mx);
+      mx = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, mx));
+    }
+    int lanes[8];
+    _mm_storeu_si128((__m128i*)lanes, mn);
+    _mm_storeu_si128((__m128i*)(lanes + 4), mx);
+    for (size_t j = 0; j < 4; ++j) {
+      if (lanes[j] < *lo) *lo = lanes[j];
+      if (lanes[4 + j] > *hi) *hi = lanes[4 + j];
+    }
+    return i;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t min_max_avx2_(const int* v, size_t n, int* lo, int* hi) {
+    if (n < 8) return 0;
+    __m256i mn = _mm256_loadu_si256((const __m256i*)v);
+    __m256i mx = mn;
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+      __m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+      mn = _mm256_min_epi32(mn, x);
+      mx = _mm256_max_epi32(mx, x);
+    }
+    int lanes[16];
+    _mm256_storeu_si256((__m256i*)lanes, mn);
+    _mm256_storeu_si256((__m256i*)(lanes + 8), mx);
+    for (size_t j = 0; j < 8; ++j) {
+      if (lanes[j] < *lo) *lo = lanes[j];
+      if (lanes[8 + j] > *hi) *hi = lanes[8 + j];
+    }
+    return i;
+  }
+
+  static size_t min_max_sse2_(const double* v, size_t n, double* lo, double* hi) {
+    if (n < 2) return 0;
+    __m128d mn = _mm_loadu_pd(v);
+    __m128d mx = mn;
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) {
+      __m128d x = _mm_loadu_pd(v + i);
+      mn = _mm_min_pd(mn, x);
+      mx = _mm_max_pd(mx, x);
+    }
+    double lanes[4];
+    _mm_storeu_pd(lanes, mn);
+    _mm_storeu_pd(lanes + 2, mx);
+    for (size_t j = 0; j < 2; ++j) {
+      if (lanes[j] < *lo) *lo = lanes[j];
+      if (lanes[2 + j] > *hi) *hi = lanes[2 + j];
+    }
+    return i;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t min_max_avx2_(const double* v, size_t n, double* lo, double* hi) {
+    if (n < 4) return 0;
+    __m256d mn = _mm256_loadu_pd(v);
+    __m256d mx = mn;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+      __m256d x = _mm256_loadu_pd(v + i);
+      mn = _mm256_min_pd(mn, x);
+      mx = _mm256_max_pd(mx, x);
+    }
+    double lanes[8];
+    _mm256_storeu_pd(lanes, mn);
+    _mm256_storeu_pd(lanes + 4, mx);
+    for (size_t j = 0; j < 4; ++j) {
+      if (lanes[j] < *lo) *lo = lanes[j];
+      if (lanes[4 + j] > *hi) *hi = lanes[4 + j];
+    }
+    return i;
+  }
+
+  static size_t sq_dev_sse2_(const int* v, size_t n, double mean, double* s) {
+    __m128d m = _mm_set1_pd(mean);
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+      __m128i x = _mm_loadl_epi64((const __m128i*)(v + i));
+      __m128d d = _mm_sub_pd(_mm_cvtepi32_pd(x), m);
+      acc = _mm_add_pd(acc, _mm_mul_pd(d, d));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    *s += lanes[0] + lanes[1];
+    return i;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t sq_dev_avx2_(const int* v, size_t n, double mean, double* s) {
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+      __m256d d = _mm256_sub_pd(_mm256_cvtepi32_pd(x), m);
+      acc = _mm256_add_pd(acc, _mm256_mul_pd(d, d));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    *s += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    return i;
+  }
+
+  static size_t sq_dev_sse2_(const double* v, size_t n, double mean, double* s) {
+    __m128d m = _mm_set1_pd(mean);
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+      __m128d d = _mm_sub_pd(_mm_loadu_pd(v + i), m);
+      acc = _mm_add_pd(acc, _mm_mul_pd(d, d));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    *s += lanes[0] + lanes[1];
+    return i;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t sq_dev_avx2_(const double* v, size_t n, double mean, double* s) {
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m256d d = _mm256_sub_pd(_mm256_loadu_pd(v + i), m);
+      acc = _mm256_add_pd(acc, _mm256_mul_pd(d, d));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    *s += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    return i;
+  }
+
+  // the plain loop, compiled with the popcnt instruction
+  __attribute__((target("popcnt")))
+  static size_t popcount_popcnt_(const uint8_t* bits, size_t bytes, size_t* count) {
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+      uint64_t word;
+      memcpy(&word, &bits[i], 8);
+      *count += __builtin_popcountll(word);
+    }
+    return i;
+  }
+
+  // Looks up the bit count of each half byte with a shuffle, and adds the
+  // counts up a byte lane at a time with sad.
+  __attribute__((target("avx2")))
+  static size_t popcount_avx2_(const uint8_t* bits, size_t bytes, size_t* count) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i*)(bits + i));
+      __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(x, low));
+      __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi),
+                                                  _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    *count += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return i;
+  }
+
+  // Compares 16 bytes at a time with each byte of the set, and gathers
+  // the matches of four loads into a word with movemask.
+  static size_t match_bytes_sse2_(const char* p, size_t n, const char* set, uint64_t* bits) {
+    __m128i s0 = _mm_set1_epi8(set[0]);
+    __m128i s1 = _mm_set1_epi8(set[1]);
+    __m128i s2 = _mm_set1_epi8(set[2]);
+    __m128i s3 = _mm_set1_epi8(set[3]);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+      uint64_t word = 0;
+      for (size_t k = 0; k < 4; ++k) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(p + i + 16 * k));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, s0), _mm_cmpeq_epi8(x, s1)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(x, s2), _mm_cmpeq_epi8(x, s3)));
+        word |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << (16 * k);
+      }
+      bits[i / 64] = word;
+    }
+    return i;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t match_bytes_avx2_(const char* p, size_t n, const char* set, uint64_t* bits) {
+    __m256i s0 = _mm256_set1_epi8(set[0]);
+    __m256i s1 = _mm256_set1_epi8(set[1]);
+    __m256i s2 = _mm256_set1_epi8(set[2]);
+    __m256i s3 = _mm256_set1_epi8(set[3]);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+      uint64_t word = 0;
+      for (size_t k = 0; k < 2; ++k) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(p + i + 32 * k));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, s0), _mm256_cmpeq_epi8(x, s1)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, s2), _mm256_cmpeq_epi8(x, s3)));
+        word |= (uint64_t)(uint32_t)_mm256_movemask_epi8(m) << (32 * k);
+      }
+      bits[i / 64] = word;
+    }
+    return i;
+  }
+#endif
+};
@@ -59,11 +59,13 @@ public:
   void setName(String* s) {
     assert(s != nullptr);
     name_ = s;
+    hash_ = 0;
   }
 
   // Sets the home node of this key, if it needs to be changed for some reason.
   void setHomeNode(size_t n) {
     homeNode_ = n;
+    hash_ = 0;
   }
 
   // Sets the creator id of this key, if it needs to be changed for some reason.
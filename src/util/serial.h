@@ -24,7 +24,7 @@ public:
   // Serializes an unsigned int.
   const char* serialize(size_t sz) {
       ByteArray* barr = new ByteArray();
-      char siz[16];
+      char siz[32];
       sprintf(siz, "%zu", sz);
       barr->push_string(siz);
       const char* str = barr->as_bytes();
@@ -136,7 +136,7 @@ public:
       char buff[new_line_loc - n + 1];
       memcpy(buff, &str[n], new_line_loc - n);
       buff[new_line_loc - n] = 0;
-      sz = atoi(buff);
+      sz = strtoull(buff, nullptr, 10);
 
       (*i) += new_line_loc + 1;
 
@@ -1,6 +1,7 @@
+#pragma once
+
 #include "object.h"
 #include "string.h"
-#include "kvstore.h"
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -67,20 +68,125 @@ public:
     void notify_all() { cv_.notify_all(); }
 };
 
+/** A unit of work run by a ThreadPool. */
+class Task : public Object {
+public:
+    /** Subclass responsibility, the work to do */
+    virtual void run() = 0;
+};
+
+class ThreadPool;
+
+/** One of the threads of a ThreadPool, running its tasks until it closes. */
+class PoolWorker : public Thread {
+public:
+    ThreadPool* pool_;
+
+    PoolWorker(ThreadPool* pool) {
+        pool_ = pool;
+        start();
+    }
+
+    void run();
+};
+
 /**
-  * A thread dedicated to keeping a network node alive and receiving messages.
-  * @authors: armani.a@husky.neu.edu, horn.s@husky.neu.edu
-  */
-class NetworkThread : public Thread {
+ * A fixed set of threads running submitted tasks, oldest first. Tasks are
+ * not owned by the pool and must outlive it running them; wait() blocks
+ * until every task submitted so far has finished.
+ * @authors horn.s@husky.neu.edu, armani.a@husky.neu.edu
+ */
+class ThreadPool : public Object {
 public:
-  KVStore* k_;
+    PoolWorker** workers_;
+    size_t num_threads_;
+    Task** tasks_;      // queued tasks, from head_ up to tail_
+    size_t head_;
+    size_t tail_;
+    size_t capacity_;   // room in tasks_
+    size_t running_;    // tasks taken off the queue and not finished yet
+    bool closed_;       // set when the pool is destroyed
+    Lock lock_;         // guards the queue, notified whenever it changes
 
-  NetworkThread(KVStore* k) {
-    k_ = k;
-    start();
-  }
+    ThreadPool(size_t threads) {
+        assert(threads > 0);
+        capacity_ = 16;
+        tasks_ = new Task*[capacity_];
+        head_ = 0;
+        tail_ = 0;
+        running_ = 0;
+        closed_ = false;
+        num_threads_ = threads;
+        workers_ = new PoolWorker*[threads];
+        for (size_t i = 0; i < threads; ++i) workers_[i] = new PoolWorker(this);
+    }
+
+    // finishes the queued tasks, then stops and joins the threads
+    ~ThreadPool() {
+        lock_.lock();
+        closed_ = true;
+        lock_.notify_all();
+        lock_.unlock();
+        for (size_t i = 0; i < num_threads_; ++i) {
+            workers_[i]->join();
+            delete workers_[i];
+        }
+        delete[] workers_;
+        delete[] tasks_;
+    }
 
-  void run() {
-    k_->begin_receiving();
-  }
+    /** Queues a task to run on one of the threads. */
+    void submit(Task* task) {
+        lock_.lock();
+        if (tail_ == capacity_) {
+            // slide the queue down, growing it if it is more than half full
+            size_t queued = tail_ - head_;
+            Task** tasks = tasks_;
+            if (queued * 2 > capacity_) {
+                capacity_ *= 2;
+                tasks = new Task*[capacity_];
+            }
+            memmove(tasks, &tasks_[head_], queued * sizeof(Task*));
+            if (tasks != tasks_) delete[] tasks_;
+            tasks_ = tasks;
+            head_ = 0;
+            tail_ = queued;
+        }
+        tasks_[tail_++] = task;
+        lock_.notify_all();
+        lock_.unlock();
+    }
+
+    /** Blocks until every submitted task has finished. */
+    void wait() {
+        lock_.lock();
+        while (head_ != tail_ || running_ > 0) lock_.wait();
+        lock_.unlock();
+    }
+
+    /** The number of threads in the pool. */
+    size_t size() {
+        return num_threads_;
+    }
+
+    // runs queued tasks until the pool closes; the body of every worker
+    void work_() {
+        lock_.lock();
+        while (true) {
+            while (head_ == tail_ && !closed_) lock_.wait();
+            if (head_ == tail_) break;
+            Task* task = tasks_[head_++];
+            ++running_;
+            lock_.unlock();
+            task->run();
+            lock_.lock();
+            --running_;
+            lock_.notify_all();
+        }
+        lock_.unlock();
+    }
 };
+
+void PoolWorker::run() {
+    pool_->work_();
+}
@@ -0,0 +1,829 @@
+#include "dataframe.h"
+#include "sorer.h"
+#include "thread.h"
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <iostream>
+
+using namespace std;
+
+/** Nanoseconds elapsed since the given time point. */
+double ns_since(chrono::steady_clock::time_point start) {
+    return (double)chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * The lookup KVStore used before it was indexed: a linear scan comparing
+ * the key against every stored key.
+ */
+int linear_find(KVStore* kv, Key* key) {
+    KeyArray* keys = kv->getKeys();
+    for (size_t i = 0; i < keys->size(); ++i) {
+        if (key->equals(keys->get(i))) return i;
+    }
+    return -1;
+}
+
+/**
+ * Fills a KVStore with n keys, then times lookups of existing keys through
+ * the hash index and through a linear scan.
+ */
+void bench_lookup(size_t n) {
+    KVStore kv;
+    for (size_t i = 0; i < n; ++i) {
+        kv.put(new Key(new String(("key-" + to_string(i)).c_str()), 0), "v");
+    }
+
+    size_t lookups = 100000;
+    Key** probes = new Key*[lookups];
+    for (size_t i = 0; i < lookups; ++i) {
+        size_t k = (i * 2654435761u) % n;
+        probes[i] = new Key(new String(("key-" + to_string(k)).c_str()), 0);
+    }
+
+    size_t found = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i) found += kv.find(probes[i]) != -1;
+    double hashed = ns_since(start) / lookups;
+    assert(found == lookups);
+
+    // the linear scan is O(n) per lookup, so only sample enough to time it
+    size_t scans = n >= 100000 ? 20 : 2000;
+    found = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < scans; ++i) found += linear_find(&kv, probes[i]) != -1;
+    double linear = ns_since(start) / scans;
+    assert(found == scans);
+
+    printf("%8zu keys: index %8.1f ns/lookup, linear scan %12.1f ns/lookup\n",
+           n, hashed, linear);
+
+    for (size_t i = 0; i < lookups; ++i) delete probes[i];
+    delete[] probes;
+    kv.getKeys()->delete_all();
+    kv.getValues()->delete_all();
+    kv.keys_ = new KeyArray();
+    kv.values_ = new StringArray();
+}
+
+/**
+ * Times serializing and deserializing one full chunk in the given format,
+ * averaged over reps round trips.
+ * @returns microseconds per serialize plus deserialize
+ */
+double time_chunk(Chunk* chunk, ChunkFormat format, size_t reps) {
+    ChunkSerializer cs(format);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < reps; ++i) {
+        const char* ser = cs.serialize(chunk);
+        Chunk* back = cs.get_chunk(ser);
+        assert(back->size() == chunk->size());
+        delete back;
+        delete[] ser;
+    }
+    return ns_since(start) / reps / 1000;
+}
+
+/** Compares the text and binary chunk formats on a full chunk of each type. */
+void bench_chunk_format() {
+    IntChunk ic;
+    DoubleChunk dc;
+    BoolChunk bc;
+    StringChunk sc;
+    for (size_t i = 0; i < ARR_SIZE; ++i) ic.push_back((int)(i * 7919));
+    for (size_t i = 0; i < ARR_SIZE; ++i) dc.push_back(i * 0.25);
+    for (size_t i = 0; i < BOOL_ARR_SIZE; ++i) bc.push_back(i % 3 == 0);
+    for (size_t i = 0; i < STRING_ARR_SIZE; ++i) {
+        sc.push_back(new String(("word-" + to_string(i)).c_str()));
+    }
+    Chunk* chunks[4] = {&ic, &dc, &bc, &sc};
+    for (size_t i = 0; i < 4; ++i) {
+        double text = time_chunk(chunks[i], ChunkFormat::Text, 20);
+        double binary = time_chunk(chunks[i], ChunkFormat::Binary, 200);
+        printf("  %c chunk of %6zu: text %9.1f us, binary %7.1f us, %5.1fx\n",
+               chunks[i]->get_type(), chunks[i]->size(), text, binary, text / binary);
+    }
+}
+
+/**
+ * The layout arrays used before they were contiguous: fixed size blocks
+ * behind a spine of block pointers that is copied whenever a block is
+ * added, filled one char at a time.
+ */
+class BlockedBytes {
+public:
+    char** arr_;
+    size_t num_arr_;
+    size_t size_;
+
+    BlockedBytes() {
+        arr_ = new char*[0];
+        num_arr_ = 0;
+        size_ = 0;
+    }
+
+    ~BlockedBytes() {
+        for (size_t i = 0; i < num_arr_; ++i) delete[] arr_[i];
+        delete[] arr_;
+    }
+
+    void push_back(char val) {
+        if (size_ % BOOL_ARR_SIZE == 0) {
+            char** tmp = arr_;
+            arr_ = new char*[num_arr_ + 1];
+            for (size_t i = 0; i < num_arr_; ++i) arr_[i] = tmp[i];
+            arr_[num_arr_++] = new char[BOOL_ARR_SIZE];
+            delete[] tmp;
+        }
+        arr_[size_ / BOOL_ARR_SIZE][size_ % BOOL_ARR_SIZE] = val;
+        ++size_;
+    }
+
+    void push_string(const char* str) {
+        for (size_t i = 0; str[i] != 0; ++i) push_back(str[i]);
+    }
+
+    const char* as_bytes() {
+        char* str = new char[size_ + 1];
+        for (size_t i = 0; i < size_; ++i) str[i] = arr_[i / BOOL_ARR_SIZE][i % BOOL_ARR_SIZE];
+        str[size_] = 0;
+        return str;
+    }
+};
+
+/**
+ * Builds a serialized string out of many short pieces, the way the
+ * serializers do, with the old blocked layout and with ByteArray.
+ */
+void bench_arrays(size_t mb) {
+    size_t pieces = mb * 1024 * 1024 / 16;
+    const char* piece = "0123456789abcde,";
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    BlockedBytes* blocked = new BlockedBytes();
+    for (size_t i = 0; i < pieces; ++i) blocked->push_string(piece);
+    delete[] blocked->as_bytes();
+    delete blocked;
+    double old_ms = ns_since(start) / 1e6;
+    start = chrono::steady_clock::now();
+    ByteArray* bytes = new ByteArray();
+    for (size_t i = 0; i < pieces; ++i) bytes->push_string(piece);
+    delete[] bytes->as_bytes();
+    delete bytes;
+    double new_ms = ns_since(start) / 1e6;
+    printf("  %zu MB string: blocked %7.1f ms, contiguous %6.1f ms, %5.1fx\n",
+           mb, old_ms, new_ms, old_ms / new_ms);
+}
+
+/**
+ * Counts and ANDs n bools held one per byte, the way BoolArray held them
+ * before, and packed 64 to a word.
+ */
+void bench_bools(size_t n) {
+    bool* a = new bool[n];
+    bool* b = new bool[n];
+    BoolArray pa;
+    BoolArray pb;
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = (i * 2654435761u) % 7 < 3;
+        b[i] = i % 3 == 0;
+        pa.push_back(a[i]);
+        pb.push_back(b[i]);
+    }
+    size_t reps = 10;
+    size_t count = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t r = 0; r < reps; ++r) {
+        for (size_t i = 0; i < n; ++i) a[i] = a[i] && b[i];
+        for (size_t i = 0; i < n; ++i) count += a[i];
+    }
+    double bytes_ms = ns_since(start) / reps / 1e6;
+    start = chrono::steady_clock::now();
+    for (size_t r = 0; r < reps; ++r) {
+        pa.and_with(&pb);
+        count -= pa.count();
+    }
+    double packed_ms = ns_since(start) / reps / 1e6;
+    assert(count == 0);
+    printf("  %zu bools AND + count: bytes %6.2f ms, packed %5.2f ms, %5.1fx; "
+           "%zu vs %zu bytes\n", n, bytes_ms, packed_ms, bytes_ms / packed_ms,
+           n, pa.num_words() * 8);
+    delete[] a;
+    delete[] b;
+}
+
+/**
+ * Sums an int column of n rows with map and with pmap on 1 to 8 threads.
+ */
+void bench_pmap(size_t n) {
+    KVStore kv;
+    IntColumn* col = new IntColumn(&kv);
+    for (size_t i = 0; i < n; ++i) col->push_back((int)(i % 100));
+    col->finalize();
+    Schema scm;
+    DataFrame* df = new DataFrame(scm, &kv);
+    df->add_column(col);
+
+    SumRower warm;
+    df->map(warm);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    SumRower seq;
+    df->map(seq);
+    double map_ms = ns_since(start) / 1e6;
+    printf("  %zu rows, map:        %7.1f ms\n", n, map_ms);
+    for (size_t threads = 1; threads <= 8; threads *= 2) {
+        start = chrono::steady_clock::now();
+        SumRower par;
+        df->pmap(par, threads);
+        double ms = ns_since(start) / 1e6;
+        assert(par.getSum() == seq.getSum());
+        printf("  %zu rows, pmap on %zu: %7.1f ms, %4.2fx\n", n, threads, ms, map_ms / ms);
+    }
+    printf("  (%u hardware threads)\n", thread::hardware_concurrency());
+    delete df;
+}
+
+/** Sums the int spans it is handed. */
+class IntSpanSum : public SpanVisitor {
+public:
+    long sum_ = 0;
+
+    void visit(const int* vals, size_t n) {
+        for (size_t i = 0; i < n; ++i) sum_ += vals[i];
+    }
+};
+
+/**
+ * Sums an int column of n rows with one get() per value, with get_range
+ * into a buffer of one chunk, and with for_each_chunk over the chunks in
+ * place.
+ */
+void bench_column_access(size_t n) {
+    KVStore kv;
+    IntColumn* col = new IntColumn(&kv);
+    for (size_t i = 0; i < n; ++i) col->push_back((int)(i % 100));
+    col->finalize();
+    col->preload();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    long get_sum = 0;
+    for (size_t i = 0; i < n; ++i) get_sum += col->get(i);
+    double get_ms = ns_since(start) / 1e6;
+
+    start = chrono::steady_clock::now();
+    long range_sum = 0;
+    int* buf = new int[ARR_SIZE];
+    for (size_t i = 0; i < n; i += ARR_SIZE) {
+        size_t len = n - i < ARR_SIZE ? n - i : ARR_SIZE;
+        col->get_range(i, len, buf);
+        for (size_t j = 0; j < len; ++j) range_sum += buf[j];
+    }
+    double range_ms = ns_since(start) / 1e6;
+    delete[] buf;
+
+    start = chrono::steady_clock::now();
+    IntSpanSum spans;
+    col->for_each_chunk(spans);
+    double span_ms = ns_since(start) / 1e6;
+
+    assert(get_sum == range_sum && get_sum == spans.sum_);
+    printf("  %zu ints, get(): %6.1f ms, get_range: %5.1f ms (%4.1fx), "
+           "for_each_chunk: %5.1f ms (%4.1fx)\n", n, get_ms, range_ms,
+           get_ms / range_ms, span_ms, get_ms / span_ms);
+    delete col;
+}
+
+/**
+ * Sums an int and a double column of n rows with SumRower through map,
+ * and with DataFrame::sum using the plain and the SIMD kernels.
+ */
+void bench_aggregates(size_t n) {
+    KVStore kv;
+    IntColumn* ic = new IntColumn(&kv);
+    DoubleColumn* dc = new DoubleColumn(&kv);
+    for (size_t i = 0; i < n; ++i) {
+        ic->push_back((int)(i % 1000));
+        dc->push_back((i % 1000) / 4.0);
+    }
+    ic->finalize();
+    dc->finalize();
+    Schema scm;
+    DataFrame* df = new DataFrame(scm, &kv);
+    df->add_column(ic);
+    df->add_column(dc);
+    df->sum(0);
+    df->sum(1);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    SumRower rower;
+    df->map(rower);
+    double rower_ms = ns_since(start) / 1e6;
+    printf("  %zu rows, SumRower map:       %7.2f ms\n", n, rower_ms);
+    for (size_t simd = 0; simd < 2; ++simd) {
+        USE_SIMD = simd == 1;
+        start = chrono::steady_clock::now();
+        double isum = df->sum(0);
+        double int_ms = ns_since(start) / 1e6;
+        start = chrono::steady_clock::now();
+        double dsum = df->sum(1);
+        double dbl_ms = ns_since(start) / 1e6;
+        assert(isum == 4 * dsum);
+        printf("  %zu rows, sum %s: int %6.2f ms (%5.1fx), double %6.2f ms, "
+               "%4.1f GB/s\n", n, simd ? "SIMD " : "plain", int_ms,
+               rower_ms / int_ms, dbl_ms, n * sizeof(double) / dbl_ms / 1e6);
+    }
+    printf("  (kernel level %d)\n", Kernels::level());
+    delete df;
+}
+
+/** Counts the rows whose int in the first column lies in [lo, hi]. */
+class InRangeRower : public Rower {
+public:
+    int lo_, hi_;
+    size_t rows_;
+
+    InRangeRower(int lo, int hi) {
+        lo_ = lo;
+        hi_ = hi;
+        rows_ = 0;
+    }
+
+    bool accept(Row& r) {
+        int v = r.get_int(0);
+        if (v >= lo_ && v <= hi_) ++rows_;
+        return false;
+    }
+
+    void join_delete(Rower* other) {
+        rows_ += dynamic_cast<InRangeRower*>(other)->rows_;
+        delete other;
+    }
+
+    Rower* clone() {
+        return new InRangeRower(lo_, hi_);
+    }
+};
+
+/**
+ * Times a selective range query over a sorted int column read alongside a
+ * double column, as a full map with a filtering rower and as a map_range
+ * that skips chunks by their zone maps.
+ */
+void bench_range_scan(size_t n) {
+    KVStore kv;
+    IntColumn* ic = new IntColumn(&kv);
+    DoubleColumn* dc = new DoubleColumn(&kv);
+    for (size_t i = 0; i < n; ++i) {
+        ic->push_back((int)i);
+        dc->push_back(i / 2.0);
+    }
+    ic->finalize();
+    dc->finalize();
+    Schema scm;
+    DataFrame* df = new DataFrame(scm, &kv);
+    df->add_column(ic);
+    df->add_column(dc);
+    int lo = (int)(n / 2), hi = lo + 999;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    InRangeRower full(lo, hi);
+    df->map(full);
+    double full_ms = ns_since(start) / 1e6;
+    start = chrono::steady_clock::now();
+    InRangeRower ranged(lo, hi);
+    df->map_range(0, lo, hi, ranged);
+    double range_ms = ns_since(start) / 1e6;
+    assert(full.rows_ == 1000 && ranged.rows_ == 1000);
+    printf("  %zu rows, 1000 selected: map %7.2f ms, map_range %6.3f ms "
+           "(%5.0fx)\n", n, full_ms, range_ms, full_ms / range_ms);
+    delete df;
+}
+
+/** Accepts the rows whose int in the first column is below 10. */
+class TenthRower : public Rower {
+public:
+    bool accept(Row& r) {
+        return r.get_int(0) < 10;
+    }
+
+    void join_delete(Rower* other) {
+        delete other;
+    }
+
+    Rower* clone() {
+        return new TenthRower();
+    }
+};
+
+/**
+ * Times filtering a tenth of the rows out of a frame of the given width
+ * and summing one column of the result: through a rower, through a
+ * predicate, and through a predicate with every column then copied, as a
+ * filter that built its whole result would.
+ */
+void bench_filter(size_t n, size_t width) {
+    KVStore kv;
+    Schema scm;
+    DataFrame* df = new DataFrame(scm, &kv);
+    for (size_t c = 0; c < width; ++c) {
+        IntColumn* ic = new IntColumn(&kv);
+        for (size_t i = 0; i < n; ++i) ic->push_back((int)(i % 100 + c));
+        ic->finalize();
+        df->add_column(ic);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    TenthRower tr;
+    DataFrame* by_rower = df->filter(tr);
+    double s1 = by_rower->sum(1);
+    double rower_ms = ns_since(start) / 1e6;
+    start = chrono::steady_clock::now();
+    Predicate p(0, "<", 10);
+    DataFrame* lazy = df->filter(p);
+    double s2 = lazy->sum(1);
+    double lazy_ms = ns_since(start) / 1e6;
+    start = chrono::steady_clock::now();
+    DataFrame* eager = df->filter(p);
+    eager->materialize();
+    double s3 = eager->sum(1);
+    double eager_ms = ns_since(start) / 1e6;
+    assert(by_rower->nrows() * 10 == n && lazy->nrows() * 10 == n);
+    assert(s1 == s2 && s2 == s3);
+    printf("  %zu rows x %zu cols, keep 10%%: rower %7.2f ms, predicate %6.2f ms, "
+           "copying every column %7.2f ms\n", n, width, rower_ms, lazy_ms, eager_ms);
+    delete by_rower;
+    delete lazy;
+    delete eager;
+    delete df;
+}
+
+/**
+ * Times counting and summing n rows grouped by an int key taking the given
+ * number of values, on one thread and on four.
+ */
+void bench_group_by(size_t n, size_t groups) {
+    KVStore kv;
+    IntColumn* keys = new IntColumn(&kv);
+    DoubleColumn* vals = new DoubleColumn(&kv);
+    for (size_t i = 0; i < n; ++i) {
+        keys->push_back((int)((i * 2654435761u) % groups));
+        vals->push_back(i / 4.0);
+    }
+    keys->finalize();
+    vals->finalize();
+    Schema scm;
+    DataFrame* df = new DataFrame(scm, &kv);
+    df->add_column(keys);
+    df->add_column(vals);
+    IntArray by;
+    by.push_back(0);
+    Aggs aggs;
+    aggs.count().sum(1);
+    df->sum(1);
+
+    double ms[2];
+    for (size_t t = 0; t < 2; ++t) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        DataFrame* g = df->group_by(by, aggs, t == 0 ? 1 : 4);
+        ms[t] = ns_since(start) / 1e6;
+        assert(g->nrows() == groups);
+        delete g;
+    }
+    printf("  %zu rows, %7zu groups: 1 thread %7.2f ms (%5.1f M rows/s), "
+           "4 threads %7.2f ms\n", n, groups, ms[0], n / ms[0] / 1e3, ms[1]);
+    delete df;
+}
+
+/**
+ * Times joining n events with the users they name, users numbering a
+ * tenth of the events, as an inner join with either side on the left.
+ */
+void bench_join(size_t n) {
+    KVStore kv;
+    size_t num_users = n / 10;
+    IntColumn* ids = new IntColumn(&kv);
+    for (size_t u = 0; u < num_users; ++u) ids->push_back((int)u);
+    ids->finalize();
+    IntColumn* who = new IntColumn(&kv);
+    DoubleColumn* amounts = new DoubleColumn(&kv);
+    for (size_t i = 0; i < n; ++i) {
+        who->push_back((int)((i * 2654435761u) % num_users));
+        amounts->push_back(i / 8.0);
+    }
+    who->finalize();
+    amounts->finalize();
+    Schema scm;
+    DataFrame* users = new DataFrame(scm, &kv);
+    users->add_column(ids);
+    Schema scm2;
+    DataFrame* events = new DataFrame(scm2, &kv);
+    events->add_column(who);
+    events->add_column(amounts);
+    events->sum(1);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    DataFrame* j = events->join(*users, 0, 0);
+    double probe_ms = ns_since(start) / 1e6;
+    assert(j->nrows() == n);
+    delete j;
+    start = chrono::steady_clock::now();
+    j = users->join(*events, 0, 0);
+    double build_ms = ns_since(start) / 1e6;
+    assert(j->nrows() == n);
+    delete j;
+    printf("  %zu events x %zu users: events left %7.2f ms (%5.1f M rows/s), "
+           "users left %7.2f ms\n", n, num_users, probe_ms, n / probe_ms / 1e3, build_ms);
+    delete users;
+    delete events;
+}
+
+/** Sorts n rows by a shuffled int column, and by a double one descending,
+ *  in memory and with every sorted run spilled to disk. */
+void bench_sort(size_t n) {
+    KVStore kv;
+    IntColumn* keys = new IntColumn(&kv);
+    DoubleColumn* vals = new DoubleColumn(&kv);
+    for (size_t i = 0; i < n; ++i) {
+        keys->push_back((int)(i * 2654435761u));
+        vals->push_back((i * 40503u % n) / 3.0);
+    }
+    keys->finalize();
+    vals->finalize();
+    Schema scm;
+    DataFrame* df = new DataFrame(scm, &kv);
+    df->add_column(keys);
+    df->add_column(vals);
+    df->sum(1);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    DataFrame* sorted = df->sort_by(0, true, 4);
+    double int_ms = ns_since(start) / 1e6;
+    delete sorted;
+    start = chrono::steady_clock::now();
+    sorted = df->sort_by(1, false, 4);
+    double double_ms = ns_since(start) / 1e6;
+    delete sorted;
+    size_t budget = SORT_BUDGET;
+    SORT_BUDGET = 0;
+    start = chrono::steady_clock::now();
+    sorted = df->sort_by(0, true, 4);
+    double spill_ms = ns_since(start) / 1e6;
+    SORT_BUDGET = budget;
+    assert(sorted->nrows() == n);
+    delete sorted;
+    printf("  %zu rows: int %7.2f ms (%5.1f M rows/s), double desc %7.2f ms, "
+           "spilled %7.2f ms\n", n, int_ms, n / int_ms / 1e3, double_ms, spill_ms);
+    delete df;
+}
+
+/** Writes a SoR file of n rows of an int, a String, a double and a bool,
+ *  and times reading it with getline on one thread and through a memory
+ *  map on one and four. */
+void bench_ingest(size_t n) {
+    const char* path = "/tmp/eau2-bench.sor";
+    FILE* f = fopen(path, "w");
+    for (size_t i = 0; i < n; ++i) {
+        fprintf(f, "<%zu> <\"row %zu\"> <%zu.25> <%zu>\n", i + 2, i % 1000, i % 777, i % 2);
+    }
+    long bytes = ftell(f);
+    fclose(f);
+    KVStore kv;
+    double ms[3];
+    for (size_t run = 0; run < 3; ++run) {
+        Sorer sorer(path, &kv);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        DataFrame* df = run == 0 ? sorer.generate_dataframe()
+                                 : sorer.generate_dataframe(run == 1 ? 1 : 4);
+        ms[run] = ns_since(start) / 1e6;
+        assert(df->nrows() == n);
+        delete df;
+    }
+    printf("  %zu rows, %ld MB: getline %7.2f ms, mmap 1 thread %7.2f ms (%5.1f MB/s), "
+           "4 threads %7.2f ms\n", n, bytes >> 20, ms[0], ms[1], bytes / ms[1] / 1e3, ms[2]);
+
+    // the tokenizer alone, over the file in memory
+    char* text = new char[bytes];
+    f = fopen(path, "r");
+    size_t got = fread(text, 1, bytes, f);
+    fclose(f);
+    assert(got == (size_t)bytes);
+    for (size_t simd = 0; simd < 2; ++simd) {
+        USE_SIMD = simd == 1;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        SorTokenizer tok(text, bytes);
+        size_t fields = 0;
+        while (tok.next_line()) fields += tok.fields;
+        ms[simd] = ns_since(start) / 1e6;
+        assert(fields == 4 * n);
+    }
+    USE_SIMD = true;
+    printf("  tokenizer: plain %7.2f ms (%6.1f MB/s), SIMD %7.2f ms (%6.1f MB/s)\n",
+           ms[0], bytes / ms[0] / 1e3, ms[1], bytes / ms[1] / 1e3);
+    delete[] text;
+    remove(path);
+}
+
+/** Describes a node listening on the given loopback port. */
+NodeInfo* loopback_node(size_t id, size_t port) {
+    NodeInfo* n = new NodeInfo();
+    n->id = id;
+    inet_pton(AF_INET, "127.0.0.1", &n->address.sin_addr);
+    n->address.sin_port = htons(port);
+    return n;
+}
+
+/** Brings up the server node, which blocks until the client registers. */
+class ServerStart : public Thread {
+public:
+    KVStore* kv_;
+    size_t port_;
+
+    ServerStart(size_t port) {
+        port_ = port;
+        start();
+    }
+
+    void run() {
+        kv_ = new KVStore(loopback_node(0, port_), 2, 0, "127.0.0.1", port_);
+    }
+};
+
+/**
+ * Starts a two node cluster on loopback and times Get round trips from
+ * node 1 for a small value stored on node 0, both one request at a time
+ * and with several requests in flight on the connection.
+ */
+void bench_roundtrip() {
+    size_t port = 9180;
+    ServerStart server(port);
+    KVStore* client = new KVStore(loopback_node(1, port + 1), 2, 1, "127.0.0.1", port);
+    server.join();
+    KVStore* kv = server.kv_;
+    NetworkThread recv0(kv);
+    NetworkThread recv1(client);
+
+    Key* key = new Key(new String("small"), 0);
+    kv->put(key, "0123456789");
+
+    size_t trips = 10000;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < trips; ++i) {
+        Get g(1, 0, client->msg_id_++, key);
+        delete client->request_(&g);
+    }
+    printf("  sequential: %8.1f us/round trip\n", ns_since(start) / trips / 1000);
+
+    size_t window = 16;
+    size_t* ids = new size_t[window];
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < trips; i += window) {
+        for (size_t j = 0; j < window; ++j) {
+            Get g(1, 0, client->msg_id_++, key);
+            ids[j] = g.id_;
+            client->replies_.expect(g.id_);
+            client->send_m(&g);
+        }
+        for (size_t j = 0; j < window; ++j) delete client->replies_.wait(ids[j]);
+    }
+    printf("  %zu in flight: %7.1f us/round trip\n", window, ns_since(start) / trips / 1000);
+    delete[] ids;
+
+    // fetch a full int chunk, decoding it or reading it in place
+    IntChunk* ic = new IntChunk();
+    for (size_t i = 0; i < ARR_SIZE; ++i) ic->push_back((int)i);
+    Key* ckey = new Key(new String("chunk"), 0);
+    kv->put(ckey, ic);
+    delete ic;
+    size_t fetches = 2000;
+    long sum = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < fetches; ++i) {
+        IntChunk* c = client->get_chunk(ckey)->as_int();
+        sum += c->get(i);
+        delete c;
+    }
+    printf("  chunk get_chunk: %6.1f us/fetch\n", ns_since(start) / fetches / 1000);
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < fetches; ++i) {
+        IntChunkView* c = client->get_view(ckey)->as_int_view();
+        sum -= c->get(i);
+        delete c;
+    }
+    printf("  chunk get_view:  %6.1f us/fetch\n", ns_since(start) / fetches / 1000);
+    assert(sum == 0);
+
+    // fetch 32 small remote chunks with a WaitAndGet each, then all of
+    // them with a single MultiGet
+    size_t batch = 32;
+    KeyArray* many = new KeyArray();
+    ChunkArray* small = new ChunkArray();
+    for (size_t i = 0; i < batch; ++i) {
+        many->push_back(new Key(new String(("many-" + to_string(i)).c_str()), 0));
+        IntChunk* c = new IntChunk();
+        for (size_t j = 0; j < 1024; ++j) c->push_back((int)j);
+        small->push_back(c);
+    }
+    kv->put_chunks(many, small);
+    size_t rounds = 200;
+    start = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < batch; ++i) delete client->get_view(many->get(i));
+    }
+    printf("  %zu chunks, one get each: %7.1f us\n", batch, ns_since(start) / rounds / 1000);
+    start = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) delete client->get_chunks(many);
+    printf("  %zu chunks, get_chunks:   %7.1f us\n", batch, ns_since(start) / rounds / 1000);
+    delete many;
+    delete small;
+
+    // read back and forth across a column whose chunks alternate between
+    // the two nodes, without and then with the chunk cache
+    IntColumn* col = new IntColumn(client);
+    for (size_t i = 0; i < 4 * ARR_SIZE; ++i) col->push_back((int)i);
+    col->finalize();
+    size_t reads = 2000;
+    for (size_t budget = 0; budget <= 1; ++budget) {
+        client->cache_->set_budget(budget * CHUNK_CACHE_BUDGET);
+        size_t misses = client->cache_->misses();
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < reads; ++i) sum += col->get((i % 4) * ARR_SIZE + i);
+        printf("  column, %s cache: %6.1f us/read, %zu fetches\n",
+               budget ? "with" : "no", ns_since(start) / reads / 1000,
+               client->cache_->misses() - misses);
+    }
+    delete col;
+
+    // scan a column half of whose chunks are remote, with and without
+    // read-ahead, after preloading it, and the same column on a single node
+    size_t chunks = 64;
+    KVStore local;
+    IntColumn* cols[2] = {new IntColumn(client), new IntColumn(&local)};
+    for (size_t c = 0; c < 2; ++c) {
+        for (size_t i = 0; i < chunks * ARR_SIZE; ++i) cols[c]->push_back((int)i);
+        cols[c]->finalize();
+    }
+    size_t max_depth = READ_AHEAD_MAX;
+    const char* runs[4] = {"no read-ahead:", "read-ahead:", "preloaded:", "local:"};
+    for (size_t run = 0; run < 4; ++run) {
+        IntColumn* c = cols[run == 3];
+        READ_AHEAD_MAX = run == 0 ? 0 : max_depth;
+        c->kv_->cache_->set_budget(0);
+        c->kv_->cache_->set_budget(CHUNK_CACHE_BUDGET);
+        c->ahead_ = ReadAhead();
+        start = chrono::steady_clock::now();
+        if (run == 2) c->preload();
+        for (size_t i = 0; i < c->size(); ++i) sum += c->get(i);
+        printf("  scan, %-14s %6.2f ns/value\n", runs[run], ns_since(start) / c->size());
+    }
+    delete cols[0];
+    delete cols[1];
+
+    // both network threads are now idle and should sleep in epoll_wait
+    timespec before, after;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &before);
+    Thread::sleep(500);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &after);
+    double idle_ms = (after.tv_sec - before.tv_sec) * 1e3
+        + (after.tv_nsec - before.tv_nsec) / 1e6;
+    printf("  idle: %.2f ms of CPU in 500 ms\n", idle_ms);
+
+    client->teardown();
+    kv->teardown();
+    recv0.join();
+    recv1.join();
+    delete client;
+    delete kv;
+}
+
+int main() {
+    cout << "\033[33mKVSTORE LOOKUP BENCHMARK:\033[0m" << endl << endl;
+    bench_lookup(1000);
+    bench_lookup(100000);
+    bench_lookup(1000000);
+
+    cout << endl << "\033[33mARRAY BENCHMARK:\033[0m" << endl << endl;
+    bench_arrays(64);
+    bench_bools(16 * 1024 * 1024);
+
+    cout << endl << "\033[33mPMAP BENCHMARK:\033[0m" << endl << endl;
+    bench_pmap(8 * 1024 * 1024);
+
+    cout << endl << "\033[33mCOLUMN ACCESS BENCHMARK:\033[0m" << endl << endl;
+    bench_column_access(8 * 1024 * 1024);
+    bench_aggregates(8 * 1024 * 1024);
+    bench_range_scan(8 * 1024 * 1024);
+    bench_filter(1000 * 1000, 16);
+    bench_group_by(8 * 1024 * 1024, 1000);
+    bench_group_by(8 * 1024 * 1024, 1000 * 1000);
+    bench_join(4 * 1024 * 1024);
+    bench_sort(4 * 1024 * 1024);
+    bench_ingest(2 * 1024 * 1024);
+
+    cout << endl << "\033[33mCHUNK SERIALIZATION BENCHMARK:\033[0m" << endl << endl;
+    bench_chunk_format();
+
+    cout << endl << "\033[33mLOOPBACK GET BENCHMARK:\033[0m" << endl << endl;
+    bench_roundtrip();
+    return 0;
+}
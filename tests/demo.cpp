@@ -22,6 +22,8 @@ String* c = new String("ck");
 Key* mainK = new Key(m,(int)0);
 Key* verify = new Key(v,(int)1);
 Key* check = new Key(c,(int)0);
+Key* intsK = new Key(new String("ints"),(int)0);
+Key* halfK = new Key(new String("half"),(int)0);
 
 
 // Variable declarations (to avoid passing many parameters around)
@@ -34,6 +36,9 @@ size_t server_port;
 NodeInfo* node_info;
 const char* server_ip_str;
 KVStore* kv;
+DataFrame* produced[4];  // kept alive until the network shuts down
+int ints_sum = 0;        // sum of the ints dataframe, known to node 0
+DataFrame* loaded;       // the file every node loads, kept alive until shutdown
 
 void producer() {
   cout << "Ran Producer" << endl;
@@ -82,22 +87,52 @@ void producer() {
 
   cout << "Ran Producer E" << endl;
 
-  delete df;
-  delete df2;
+  // deleting the dataframes would kill their chunks, which other nodes
+  // still need to read
+  produced[0] = df;
+  produced[1] = df2;
 
-  delete ser_df;
-  delete ser_df2;
-  cout << "Finished Producer" << endl;
+  delete[] ser_df;
+  delete[] ser_df2;
 
-  kv->teardown();
+  // A dataframe of several chunks, spread over every node, for map_reduce.
+  IntColumn* ic = new IntColumn(kv);
+  for (size_t i = 0; i < 4 * ARR_SIZE + 17; ++i) {
+    ic->push_back((int)(i % 100));
+    ints_sum += i % 100;
+  }
+  ic->finalize();
+  Schema scm3;
+  DataFrame* ints = new DataFrame(scm3, kv);
+  ints->add_column(ic);
+  const char* ser_ints = ints->serialize(ints);
+  kv->put(intsK, ser_ints);
+  delete[] ser_ints;
+  produced[2] = ints;
+
+  // The ints below 50 and their doubles, to join the ints with.
+  IntColumn* keys = new IntColumn(kv);
+  IntColumn* doubled = new IntColumn(kv);
+  for (int i = 0; i < 50; ++i) {
+    keys->push_back(i);
+    doubled->push_back(2 * i);
+  }
+  keys->finalize();
+  doubled->finalize();
+  Schema scm4;
+  DataFrame* half = new DataFrame(scm4, kv);
+  half->add_column(keys);
+  half->add_column(doubled);
+  const char* ser_half = half->serialize(half);
+  kv->put(halfK, ser_half);
+  delete[] ser_half;
+  produced[3] = half;
+cout << "Finished Producer" << endl;
 }
 
 void counter() {
   cout << "Ran Counter" << endl;
 
-  size_t SZ = 10 * 10;
-  double sum = 0;
-
   cout << "\033[0;31mRan Counter A\033[0m" << endl;
 
   // Grab dataframe belonging to mainK and do another summation.
@@ -105,7 +140,7 @@ void counter() {
 
   cout << "\033[0;31mRan Counter ABC!!!\033[0m" << endl;
 
-  for (size_t i = 0; i < SZ; ++i) sum += v->get_double(0, i);
+  double sum = v->sum(0);
   printf("The sum is %f", sum);
   delete v;
 
@@ -129,9 +164,8 @@ void counter() {
   const char* ser_df3 = df3->serialize(df3);
   kv->put(verify, ser_df3);
 
-  delete ser_df3;
+  delete[] ser_df3;
   delete df3;
-  kv->teardown();
   cout << "Finished Counter" << endl;
 }
 
@@ -145,8 +179,157 @@ void summarizer() {
 
   delete result;
   delete expected;
-  kv->teardown();
-  cout << "Finished Summarizer, Press Ctrl-C" << endl;
+  cout << "Finished Summarizer" << endl;
+}
+
+// Every node counts and sums the groups of equal ints it owns, checks
+// them, and tells node 0 how many were right; node 0 expects all 100.
+void grouper(DataFrame* ints) {
+  IntArray keys;
+  keys.push_back(0);
+  Aggs aggs;
+  aggs.count().sum(0);
+  DataFrame* groups = ints->group_by(keys, aggs, "demo-group");
+  size_t rows = 4 * ARR_SIZE + 17;
+  int right = 0;
+  for (size_t g = 0; g < groups->nrows(); ++g) {
+    int k = groups->get_int(0, g);
+    int count = rows / 100 + ((size_t)k < rows % 100 ? 1 : 0);
+    if (groups->get_int(1, g) == count && groups->get_double(2, g) == k * count) ++right;
+  }
+  delete groups;
+  if (this_node != 0) {
+    Key key(new String(("demo-groups-" + to_string(this_node)).c_str()), 0);
+    Serializer s;
+    const char* state = s.serialize(right);
+    kv->put(&key, state);
+    delete[] state;
+    return;
+  }
+  for (size_t node = 1; node < num_nodes; ++node) {
+    Key key(new String(("demo-groups-" + to_string(node)).c_str()), 0);
+    const char* state = kv->getCharsAndWait(&key);
+    right += atoi(state);
+    delete[] state;
+  }
+  printf(right == 100 ? "GROUP_BY SUCCESS\n" : "GROUP_BY FAILURE\n");
+}
+
+// Every node joins its part of the ints with the ints below 50, once by
+// broadcasting those and once by shuffling both, as inner and left joins,
+// and checks its rows. Node 0 adds up the rows and expects every int
+// below 50 once per inner join and every int once per left join.
+void joiner(DataFrame* ints) {
+  DataFrame* half = this_node == 0 ? produced[3] : kv->getAndWait(halfK);
+  size_t rows = 0;
+  bool right = true;
+  for (size_t shuffle = 0; shuffle < 2; ++shuffle) {
+    size_t broadcast_bytes = BROADCAST_JOIN_BYTES;
+    if (shuffle) BROADCAST_JOIN_BYTES = 0;
+    for (size_t left = 0; left < 2; ++left) {
+      string name = "demo-join-" + to_string(shuffle) + to_string(left);
+      DataFrame* j = ints->join(*half, 0, 0, name.c_str(), left == 1);
+      for (size_t r = 0; r < j->nrows(); ++r) {
+        int k = j->get_int(0, r);
+        if (k < 50) right = right && j->get_int(1, r) == k && j->get_int(2, r) == 2 * k;
+        else right = right && left == 1 && j->get_int(2, r) == 0;
+      }
+      rows += j->nrows();
+      delete j;
+    }
+    BROADCAST_JOIN_BYTES = broadcast_bytes;
+  }
+  if (this_node != 0) delete half;
+  if (this_node != 0) {
+    Key key(new String(("demo-joins-" + to_string(this_node)).c_str()), 0);
+    Serializer s;
+    const char* state = s.serialize(right ? (int)rows : -1);
+    kv->put(&key, state);
+    delete[] state;
+    return;
+  }
+  for (size_t node = 1; node < num_nodes; ++node) {
+    Key key(new String(("demo-joins-" + to_string(node)).c_str()), 0);
+    const char* state = kv->getCharsAndWait(&key);
+    int theirs = atoi(state);
+    right = right && theirs >= 0;
+    rows += theirs;
+    delete[] state;
+  }
+  size_t all = 4 * ARR_SIZE + 17;
+  size_t below = all / 100 * 50 + (all % 100 < 50 ? all % 100 : 50);
+  printf(right && rows == 2 * (below + all) ? "JOIN SUCCESS\n" : "JOIN FAILURE\n");
+}
+
+// Every node sorts its range of the ints, largest first; node 0 checks
+// that the ranges cover every row and follow one another.
+void sorter(DataFrame* ints) {
+  DataFrame* part = ints->sort_by(0, false, "demo-sort");
+  bool right = true;
+  size_t n = part->nrows();
+  for (size_t r = 1; r < n; ++r) right = right && part->get_int(0, r - 1) >= part->get_int(0, r);
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%d %zu %d %d", right ? 1 : 0, n,
+           n == 0 ? 100 : part->get_int(0, 0), n == 0 ? 100 : part->get_int(0, n - 1));
+  delete part;
+  if (this_node != 0) {
+    Key key(new String(("demo-sorted-" + to_string(this_node)).c_str()), 0);
+    kv->put(&key, buf);
+    return;
+  }
+  size_t rows = 0;
+  int low = 100;  // smallest value of the parts so far
+  for (size_t node = 0; node < num_nodes; ++node) {
+    const char* state = buf;
+    if (node != 0) {
+      Key key(new String(("demo-sorted-" + to_string(node)).c_str()), 0);
+      state = kv->getCharsAndWait(&key);
+    }
+    int ok, first, last;
+    size_t n;
+    sscanf(state, "%d %zu %d %d", &ok, &n, &first, &last);
+    if (node != 0) delete[] state;
+    right = right && ok == 1 && (n == 0 || first <= low);
+    if (n > 0) low = last;
+    rows += n;
+  }
+  printf(right && rows == 4 * ARR_SIZE + 17 ? "SORT SUCCESS\n" : "SORT FAILURE\n");
+}
+
+// Every node loads its slice of a file node 0 writes, which they all can
+// read; node 0 checks every row of the whole dataframe, in order.
+void loader() {
+  const char* path = "/tmp/eau2-demo.sor";
+  size_t rows = 3 * ARR_SIZE + 1234;
+  if (this_node == 0) {
+    FILE* f = fopen(path, "w");
+    for (size_t i = 0; i < rows; ++i) fprintf(f, "<%zu> <\"s %zu\">\n", i + 10, i % 7);
+    fclose(f);
+  }
+  loaded = Sorer::load_cluster(path, kv, "demo-load");
+  if (this_node != 0) return;
+  remove(path);
+  bool right = loaded->nrows() == rows;
+  for (size_t r = 0; right && r < rows; ++r) {
+    string s = "s " + to_string(r % 7);
+    right = loaded->get_int(0, r) == (int)r + 10 && strcmp(loaded->get_string(1, r)->c_str(), s.c_str()) == 0;
+  }
+  printf(right ? "INGEST SUCCESS\n" : "INGEST FAILURE\n");
+}
+
+// Every node sums the ints stored on it; node 0 joins the sums.
+void reducer() {
+  DataFrame* ints = this_node == 0 ? produced[2] : kv->getAndWait(intsK);
+  SumRower sum;
+  ints->map_reduce(sum, "demo-sum");
+  if (this_node == 0) {
+    printf(sum.getSum() == ints_sum ? "MAP_REDUCE SUCCESS\n" : "MAP_REDUCE FAILURE\n");
+  }
+  grouper(ints);
+  joiner(ints);
+  sorter(ints);
+  loader();
+if (this_node != 0) delete ints;
 }
 
 void run(size_t this_node) {
@@ -155,6 +338,8 @@ void run(size_t this_node) {
     case 1:   counter();      break;
     case 2:   summarizer();
    }
+  reducer();
+  kv->teardown();
 }
 
 int main(int argc, const char** argv) {
@@ -183,13 +368,17 @@ int main(int argc, const char** argv) {
 
     cout << " *****************" << this_node << " OUT OF RUN******************* " << endl;
 
-    // make sure all nodes are dead
-    while (kv->get_num_done() != num_nodes - 1) {
-      continue;
-    }
-
+    // the network thread returns once all nodes are dead
     n1.join();
 
+    if (this_node == 0) {
+      delete produced[0];
+      delete produced[1];
+      delete produced[2];
+      delete produced[3];
+}
+    delete loaded;
+
     delete kv;
 
     cout << "DONE" << endl;
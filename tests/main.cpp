@@ -1,10 +1,13 @@
 #include "trivial.h"
+#include "wordcount.h"
 #include "dataframe.h"
 #include "row.h"
 #include "helper.h"
 #include "sorer.h"
 #include "serial.h"
 #include "message.h"
+#include "network.h"
+#include "thread.h"
 #include <string>
 #include <iostream>
 
@@ -56,12 +59,52 @@ void test_key() {
     k->setHomeNode(100);
     assert(k->getHomeNode() == 100);
 
-    cout << "Checking that hashing works for key values.\n\n";
+    cout << "Checking that hashing works for key values." << endl;
     Key* k2 = new Key(tester2, 0);
     assert(k->hash() != k2->hash());
 
     delete k;
     delete k2;
+
+    cout << "Checking that the kvstore index finds stored keys." << endl;
+    KVStore kv;
+    for (size_t i = 0; i < 1000; ++i) {
+        Key* key = new Key(new String(to_string(i).c_str()), 0);
+        key->setCreatorID(i % 2);
+        kv.put(key, to_string(i * 10).c_str());
+    }
+    assert(kv.size() == 1000);
+    Key lookup(new String("123"), 0);
+    int ind = kv.find(&lookup);
+    assert(ind != -1);
+    assert(!strcmp(kv.getValues()->get(ind)->c_str(), "1230"));
+    Key missing(new String("1000"), 0);
+    assert(kv.find(&missing) == -1);
+
+    cout << "Checking that putting an existing key replaces its value." << endl;
+    Key* dup = new Key(new String("123"), 0);
+    kv.put(dup, "x");
+    assert(kv.size() == 1000);
+    assert(!strcmp(kv.getValues()->get(kv.find(&lookup))->c_str(), "x"));
+    delete dup;
+
+    cout << "Checking that killed keys leave the index." << endl;
+    kv.kill(0);
+    assert(kv.size() == 500);
+    assert(kv.find(&lookup) != -1);
+    Key even(new String("124"), 0);
+    assert(kv.find(&even) == -1);
+
+    cout << "Checking that taken keys leave the store.\n\n";
+    const char* taken = kv.takeCharsAndWait(&lookup);
+    assert(!strcmp(taken, "x") && kv.size() == 499);
+    delete[] taken;
+    assert(kv.find(&lookup) == -1);
+    for (size_t i = 1; i < 1000; i += 2) {
+        Key odd(new String(to_string(i).c_str()), 0);
+        if (i == 123) continue;
+        assert(!strcmp(kv.getValues()->get(kv.find(&odd))->c_str(), to_string(i * 10).c_str()));
+    }
 }
 
 /**
@@ -149,6 +192,86 @@ void test_serial() {
     Text* des_text = dynamic_cast<Text*>(des_msg5);
     assert(des_text != nullptr);
 
+    cout << "Checking serialization of Put Message with a separate payload." << endl;
+
+    Key* put_key = new Key(new String("put-key"), 1);
+    Put* put = new Put(0, 1, 48, put_key, "the value");
+    const char* serial_put = msgs.serialize(put);
+    size_t put_len = 0;
+    const char* put_payload = msgs.payload(put, &put_len);
+    assert(put_len == 9);
+    char* put_body = new char[put_len + 1];
+    strcpy(put_body, put_payload);
+    Put* des_put = dynamic_cast<Put*>(msgs.get_message(serial_put, put_body, put_len));
+    assert(des_put->len_ == 9);
+    assert(des_put != nullptr && des_put->id_ == 48);
+    assert(des_put->get_key()->equals(put_key));
+    assert(strcmp(des_put->get_value(), "the value") == 0);
+
+    cout << "Checking serialization of Multi Messages carrying many keys." << endl;
+
+    KeyArray* multi_keys = new KeyArray();
+    multi_keys->push_back(new Key(new String("m-0"), 1));
+    multi_keys->push_back(new Key(new String("m-1"), 1));
+    KeyArray* asked = new KeyArray();
+    asked->push_back(multi_keys->get(0));
+    asked->push_back(multi_keys->get(1));
+    MultiGet* mget = new MultiGet(1, 0, 60, asked);
+    const char* serial_mget = msgs.serialize(mget);
+    MultiGet* des_mget = dynamic_cast<MultiGet*>(msgs.get_message(serial_mget, nullptr, 0));
+    assert(des_mget != nullptr && des_mget->id_ == 60);
+    assert(des_mget->keys_->size() == 2);
+    assert(des_mget->keys_->get(1)->equals(multi_keys->get(1)));
+
+    // values start on 8 byte boundaries: "abc" at 0, "defghijkl" at 8
+    size_t* mlens = new size_t[2];
+    mlens[0] = 3;
+    mlens[1] = 9;
+    const char* mvalues = "abc\0\0\0\0\0defghijkl";
+    assert(padded_len(3) == 8 && padded_len(8) == 8 && padded_len(9) == 16);
+    MultiReply* mreply = new MultiReply(0, 1, 60, 2, mlens, mvalues, 17);
+    const char* serial_mreply = msgs.serialize(mreply);
+    size_t mreply_len = 0;
+    const char* mreply_payload = msgs.payload(mreply, &mreply_len);
+    assert(mreply_len == 17);
+    char* mreply_body = new char[mreply_len];
+    memcpy(mreply_body, mreply_payload, mreply_len);
+    MultiReply* des_mreply = dynamic_cast<MultiReply*>(
+        msgs.get_message(serial_mreply, mreply_body, mreply_len));
+    assert(des_mreply != nullptr && des_mreply->count_ == 2);
+    assert(des_mreply->lens_[0] == 3 && des_mreply->lens_[1] == 9);
+    assert(memcmp(&des_mreply->value_[8], "defghijkl", 9) == 0);
+
+    size_t* plens = new size_t[2];
+    plens[0] = 3;
+    plens[1] = 9;
+    KeyArray* put_keys = new KeyArray();
+    put_keys->push_back(multi_keys->get(0));
+    put_keys->push_back(multi_keys->get(1));
+    MultiPut* mput = new MultiPut(0, 1, 61, put_keys, plens, mvalues, 17);
+    const char* serial_mput = msgs.serialize(mput);
+    char* mput_body = new char[17];
+    memcpy(mput_body, mvalues, 17);
+    MultiPut* des_mput = dynamic_cast<MultiPut*>(msgs.get_message(serial_mput, mput_body, 17));
+    assert(des_mput != nullptr && des_mput->keys_->size() == 2);
+    assert(des_mput->keys_->get(0)->equals(multi_keys->get(0)));
+    assert(des_mput->lens_[1] == 9 && des_mput->len_ == 17);
+    assert(memcmp(des_mput->value_, "abc", 3) == 0);
+
+    delete mget;
+    delete[] serial_mget;
+    des_mget->keys_->delete_all();
+    delete des_mget;
+    delete mreply;
+    delete[] serial_mreply;
+    delete des_mreply;
+    delete mput;
+    delete[] serial_mput;
+    des_mput->keys_->delete_all();
+    delete des_mput;
+    multi_keys->delete_all();
+    delete multi_keys;
+
     cout << "Checking serialization and deserialization of Int Chunk." << endl;
 
     IntChunk* ichunk = new IntChunk();
@@ -160,6 +283,7 @@ void test_serial() {
     assert(des_chunk1->type_ == 'I');
     IntChunk* des_ichunk = des_chunk1->as_int();
     assert(des_ichunk != nullptr);
+    assert(des_ichunk->size() == 100 * 256 && des_ichunk->get(12345) == 12345);
 
     cout << "Checking serialization and deserialization of Double Chunk." << endl;
 
@@ -172,6 +296,7 @@ void test_serial() {
     assert(des_chunk2->type_ == 'D');
     DoubleChunk* des_dchunk = des_chunk2->as_double();
     assert(des_dchunk != nullptr);
+    assert(des_dchunk->size() == 100 * 256 && des_dchunk->get(777) == 777.0);
 
     cout << "Checking serialization and deserialization of Bool Chunk." << endl;
 
@@ -186,6 +311,8 @@ void test_serial() {
     assert(des_chunk3->type_ == 'B');
     BoolChunk* des_bchunk = des_chunk3->as_bool();
     assert(des_bchunk != nullptr);
+    assert(des_bchunk->size() == 1024 * 256);
+    assert(des_bchunk->get(0) && !des_bchunk->get(1) && !des_bchunk->get(1024 * 256 - 1));
 
     cout << "Checking serialization and deserialization of String Chunk." << endl;
 
@@ -198,6 +325,32 @@ void test_serial() {
     assert(des_chunk4->type_ == 'S');
     StringChunk* des_schunk = des_chunk4->as_string();
     assert(des_schunk != nullptr);
+    assert(des_schunk->size() == 100 * 256);
+    assert(des_schunk->get(4321)->equals(schunk->get(4321)));
+
+    cout << "Checking the binary chunk header and the text chunk format." << endl;
+
+    size_t bin_len;
+    const char* bin = chunks.serialize(dchunk, &bin_len);
+    assert(bin_len == CHUNK_HEADER_SIZE + 100 * 256 * 8);
+    assert(memcmp(bin, CHUNK_MAGIC, 3) == 0 && bin[3] == CHUNK_VERSION && bin[4] == 'D');
+    double first;
+    memcpy(&first, &bin[CHUNK_HEADER_SIZE + 8], 8);
+    assert(first == 1.0);
+    ChunkSerializer text_chunks(ChunkFormat::Text);
+    size_t text_len;
+    const char* text_ichunk = text_chunks.serialize(ichunk, &text_len);
+    assert(strncmp(text_ichunk, "typ: I\n", 7) == 0 && text_len == strlen(text_ichunk));
+    Chunk* des_text_ichunk = chunks.get_chunk(text_ichunk);
+    assert(des_text_ichunk->as_int()->get(100 * 256 - 1) == 100 * 256 - 1);
+
+    StringChunk* odd = new StringChunk();
+    odd->push_back(new String(""));
+    odd->push_back(new String("with a\nnewline"));
+    const char* serial_odd = chunks.serialize(odd);
+    Chunk* des_odd = chunks.get_chunk(serial_odd);
+    assert(des_odd->size() == 2 && des_odd->as_string()->get(0)->size() == 0);
+    assert(des_odd->as_string()->get(1)->equals(odd->get(1)));
 
     cout << "Checking serialization and deserialization of DataFrame with each Column type." << endl << endl;
 
@@ -224,7 +377,7 @@ void test_serial() {
     df->add_column(scol);
     const char* serial_df = df->serialize(df);
     DataFrame* df2 = df->get_dataframe(serial_df);
-    assert(df2 != nullptr);
+    assert(df2 != nullptr && df2->cols_[0]->id_ != icol->id_);
 
     delete blue;
     delete red;
@@ -255,6 +408,11 @@ void test_serial() {
     delete text;
     delete[] serial_text;
     delete des_msg5;
+    delete put;
+    delete put_key;
+    delete[] serial_put;
+    delete des_put->get_key();
+    delete des_put;
     delete ichunk;
     delete[] serial_ichunk;
     delete des_chunk1;
@@ -267,16 +425,68 @@ void test_serial() {
     delete schunk;
     delete[] serial_schunk;
     delete des_chunk4;
+    delete[] bin;
+    delete[] text_ichunk;
+    delete des_text_ichunk;
+    delete odd;
+    delete[] serial_odd;
+    delete des_odd;
     delete df;
     delete[] serial_df;
     delete df2;
     delete kv;
 }
 
+/** Sums int spans, counts set bits of bool spans and Strings of string
+ *  spans, and counts the spans it was handed. */
+class SpanSummer : public SpanVisitor {
+public:
+  long sum_;
+  size_t spans_;
+
+  SpanSummer() {
+    sum_ = 0;
+    spans_ = 0;
+  }
+
+  void visit(const int* vals, size_t n) {
+    for (size_t i = 0; i < n; ++i) sum_ += vals[i];
+    ++spans_;
+  }
+
+  void visit(const uint8_t* bits, size_t n) {
+    for (size_t i = 0; i < n; ++i) sum_ += (bits[i / 8] >> (i % 8)) & 1;
+    ++spans_;
+  }
+
+  void visit(String** vals, size_t n) {
+    for (size_t i = 0; i < n; ++i) sum_ += vals[i]->size() > 0;
+    ++spans_;
+  }
+};
+
 void test_chunk(){
 
   ChunkSerializer chunks;
 
+  cout << "Checking contiguous arrays growing and appending in bulk." << endl;
+  IntArray grown;
+  int block[1000];
+  for (size_t i = 0; i < 1000; ++i) block[i] = (int)i;
+  for (size_t i = 0; i < 3 * ARR_SIZE; ++i) grown.push_back((int)i);
+  grown.append(block, 1000);
+  assert(grown.size() == 3 * ARR_SIZE + 1000);
+  assert(grown.capacity_ >= grown.size() && grown.capacity_ < 2 * grown.size());
+  assert(grown.data()[ARR_SIZE] == (int)ARR_SIZE && grown.get(3 * ARR_SIZE + 999) == 999);
+  grown.remove(0);
+  assert(grown.get(0) == 1 && grown.size() == 3 * ARR_SIZE + 999);
+  ByteArray bytes("abc");
+  for (size_t i = 0; i < 10000; ++i) bytes.push_string("0123456789");
+  assert(bytes.size() == 100003 && bytes.get(100002) == '9');
+  const char* joined = bytes.as_bytes();
+  assert(strlen(joined) == 100003 && memcmp(joined, "abc012", 6) == 0);
+  delete[] joined;
+
   cout << "Checking operations of Int Chunk." << endl;
   cout << "Push Back. Size. Get." << endl;
   IntChunk* ichunk = new IntChunk();
@@ -311,6 +521,56 @@ void test_chunk(){
   assert(bchunk->get(1) == 0);
   cout << "Get Type." << endl;
   assert(bchunk->get_type() == 'B');
+  cout << "Count. Packed bits." << endl;
+  assert(bchunk->count() == 1024 * 128);
+  assert(bchunk->arr_->num_words() == 1024 * 4);
+  assert(bchunk->arr_->data()[0] == 0x5555555555555555ULL);
+
+  cout << "Checking word-wise operations on packed bools." << endl;
+  BoolArray evens;
+  BoolArray thirds;
+  for (size_t i = 0; i < 1000; ++i) {
+    evens.push_back(i % 2 == 0);
+    thirds.push_back(i % 3 == 0);
+  }
+  uint8_t packed[125];
+  evens.copy_bits(packed);
+  BoolArray unpacked;
+  unpacked.push_back(true);
+  unpacked.append_bits(packed, 1000);
+  assert(unpacked.size() == 1001 && unpacked.get(1) && !unpacked.get(2) && unpacked.get(999));
+  evens.and_with(&thirds);
+  assert(evens.count() == 167 && evens.get(6) && !evens.get(3));
+  evens.or_with(&thirds);
+  assert(evens.count() == 334);
+  evens.negate();
+  assert(evens.count() == 666 && !evens.get(999));
+  evens.set(999, true);
+  assert(evens.get(999) && evens.count() == 667);
+
+  KVStore* bkv = new KVStore();
+  BoolColumn* odd_rows = new BoolColumn(bkv);
+  BoolColumn* fifth_rows = new BoolColumn(bkv);
+  for (size_t i = 0; i < 2 * BOOL_ARR_SIZE + 10; ++i) {
+    odd_rows->push_back(i % 2 == 1);
+    fifth_rows->push_back(i % 5 == 0);
+  }
+  odd_rows->finalize();
+  fifth_rows->finalize();
+  assert(odd_rows->count() == BOOL_ARR_SIZE + 5);
+  BoolColumn* both = odd_rows->and_(fifth_rows);
+  BoolColumn* either = odd_rows->or_(fifth_rows);
+  BoolColumn* even_rows = odd_rows->not_();
+  assert(both->size() == odd_rows->size() && both->get(5) && !both->get(10));
+  assert(both->count() == (2 * BOOL_ARR_SIZE + 10) / 10);
+  assert(either->count() == odd_rows->count() + fifth_rows->count() - both->count());
+  assert(even_rows->count() == BOOL_ARR_SIZE + 5 && even_rows->get(2 * BOOL_ARR_SIZE + 8));
+  delete both;
+  delete either;
+  delete even_rows;
+  delete odd_rows;
+  delete fifth_rows;
+  delete bkv;
 
   cout << "Checking operations of String Chunk." << endl;
   cout << "Push Back. Size. Get." << endl;
@@ -320,15 +580,1056 @@ void test_chunk(){
   }
   assert(schunk->size() == 100*256);
   assert(!strcmp(schunk->get(1)->c_str(), "1"));
-  cout << "Get Type." << endl << endl;
+  cout << "Get Type." << endl;
   assert(schunk->get_type() == 'S');
 
+  cout << "Checking chunk views over a shared buffer." << endl;
+  size_t len;
+  char* ser = (char*)chunks.serialize(ichunk, &len);
+  Buffer* buf = new Buffer(true, ser, len);
+  IntChunkView* iview = chunks.get_view(buf->retain())->as_int_view();
+  assert(iview != nullptr && iview->size() == 100 * 256);
+  assert(iview->get(0) == 0 && iview->get(100 * 256 - 1) == 100 * 256 - 1);
+  assert(iview->vals_ == (const int*)(ser + CHUNK_HEADER_SIZE));
+  assert(buf->refs_ == 2);
+  buf->release();
+  assert(iview->get(4096) == 4096);
+  delete iview;
+
+  const char* dser = chunks.serialize(dchunk, &len);
+  DoubleChunkView* dview = chunks.get_view(new Buffer(dser, len))->as_double_view();
+  assert(dview->get(10) == dchunk->get(10));
+  delete dview;
+  delete[] dser;
+
+  const char* bser = chunks.serialize(bchunk, &len);
+  BoolChunkView* bview = chunks.get_view(new Buffer(bser, len))->as_bool_view();
+  for (size_t i = 0; i < 1024 * 256; i += 997) assert(bview->get(i) == bchunk->get(i));
+  delete bview;
+  delete[] bser;
+
+  ChunkSerializer text_chunks(ChunkFormat::Text);
+  const char* tser = text_chunks.serialize(ichunk, &len);
+  Chunk* tview = chunks.get_view(new Buffer(tser, len));
+  assert(tview->as_int_view() != nullptr && tview->as_int_view()->get(77) == 77);
+  delete tview;
+  delete[] tser;
+
+  const char* sser = chunks.serialize(schunk, &len);
+  Chunk* sview = chunks.get_view(new Buffer(sser, len));
+  assert(sview->as_string() != nullptr && sview->as_string()->get(9)->equals(schunk->get(9)));
+  delete sview;
+  delete[] sser;
+
+  cout << "Checking the LRU chunk cache." << endl;
+  ChunkCache cache(250);
+  Key ka(new String("a"), 0), kb(new String("b"), 0), kc(new String("c"), 0);
+  ka.setCreatorID(7);
+  assert(cache.acquire(&ka) == nullptr && cache.misses() == 1);
+  IntChunk* ca = new IntChunk();
+  assert(cache.add(&ka, ca, 100) == ca);
+  cache.release(&ka);
+  cache.add(&kb, new IntChunk(), 100);
+  cache.release(&kb);
+  assert(cache.acquire(&ka) == ca && cache.hits() == 1);
+  cache.release(&ka);
+  // kb is now the least recently used, so kc pushes it out
+  cache.add(&kc, new IntChunk(), 100);
+  assert(cache.evictions() == 1 && cache.size() == 2 && cache.bytes() == 200);
+  assert(cache.acquire(&kb) == nullptr);
+  // kc is still in use, so shrinking the budget can only evict ka
+  cache.set_budget(50);
+  assert(cache.size() == 1 && cache.acquire(&ka) == nullptr);
+  cache.release(&kc);
+  assert(cache.size() == 0 && cache.bytes() == 0);
+  cache.set_budget(1000);
+  cache.add(&ka, new IntChunk(), 10);
+  cache.release(&ka);
+  cache.drop(7);
+  assert(cache.size() == 0);
+
+  cout << "Checking columns reading back and forth between chunks." << endl;
+  KVStore* kv = new KVStore();
+  StringColumn* scol = new StringColumn(kv);
+  IntColumn* icol = new IntColumn(kv);
+  for (size_t i = 0; i < 3 * STRING_ARR_SIZE; ++i) {
+    scol->push_back(new String(to_string(i).c_str()));
+    icol->push_back((int)i);
+  }
+  scol->finalize();
+  icol->finalize();
+  for (size_t i = 0; i < 20; ++i) {
+    size_t idx = (i % 2) * 2 * STRING_ARR_SIZE + i;
+    String expected(to_string(idx).c_str());
+    assert(scol->get(idx)->equals(&expected));
+    assert(icol->get(idx) == (int)idx);
+  }
+  // two chunks of each column, each fetched once
+  assert(kv->cache_->size() == 4 && kv->cache_->misses() == 4);
+
+  cout << "Checking chunks put and gotten many at a time." << endl;
+  KeyArray* batch_keys = new KeyArray();
+  ChunkArray* batch = new ChunkArray();
+  for (size_t c = 0; c < 3; ++c) {
+    Key* k = new Key(new String(("batch-" + to_string(c)).c_str()), (size_t)77);
+    batch_keys->push_back(k);
+    IntChunk* chunk = new IntChunk();
+    for (size_t i = 0; i < 10 + c; ++i) chunk->push_back((int)(c * 100 + i));
+    batch->push_back(chunk);
+  }
+  kv->put_chunks(batch_keys, batch);
+  ChunkArray* got = kv->get_chunks(batch_keys);
+  assert(got->size() == 3);
+  for (size_t c = 0; c < 3; ++c) {
+    IntChunkView* v = got->get(c)->as_int_view();
+    assert(v->size() == 10 + c && v->get(9) == (int)(c * 100 + 9));
+  }
+  kv->load_chunks(batch_keys);
+  assert(kv->cache_->size() == 7 && kv->cache_->contains(batch_keys->get(2)));
+  delete got;
+  delete batch;
+  delete batch_keys;
+  kv->kill(77);
+
+  cout << "Checking columns handed out a span at a time." << endl;
+  size_t rows = 3 * STRING_ARR_SIZE;
+  int* ints = new int[rows];
+  icol->get_range(0, rows, ints);
+  for (size_t i = 0; i < rows; ++i) assert(ints[i] == (int)i);
+  icol->get_range(ARR_SIZE - 3, 5, ints);
+  assert(ints[0] == (int)ARR_SIZE - 3 && ints[4] == (int)ARR_SIZE + 1);
+  delete[] ints;
+  SpanSummer isum;
+  icol->for_each_chunk(isum);
+  assert(isum.spans_ == 2 && isum.sum_ == (long)(rows * (rows - 1) / 2));
+  SpanSummer ssum;
+  scol->for_each_chunk(ssum);
+  assert(ssum.spans_ == 3 && ssum.sum_ == (long)rows);
+  BoolColumn* span_bools = new BoolColumn(kv);
+  for (size_t i = 0; i < BOOL_ARR_SIZE + 5; ++i) span_bools->push_back(i % 4 == 1);
+  span_bools->finalize();
+  bool* bools = new bool[6];
+  span_bools->get_range(BOOL_ARR_SIZE - 1, 6, bools);
+  assert(!bools[0] && bools[2] && !bools[3] && !bools[5]);
+  delete[] bools;
+  SpanSummer bsum;
+  span_bools->for_each_chunk(bsum);
+  assert(bsum.spans_ == 2 && bsum.sum_ == (long)((BOOL_ARR_SIZE + 5 + 2) / 4));
+  delete span_bools;
+
+  cout << "Checking read-ahead depth adapts to stalls." << endl;
+  ReadAhead ahead;
+  ahead.moved_to(0, true, icol->keys_, kv);
+  assert(ahead.depth_ == 1 && ahead.next_ == 1);
+  ahead.moved_to(1, true, icol->keys_, kv);
+  ahead.moved_to(2, true, icol->keys_, kv);
+  // the column only has 2 chunks, so nothing past them is requested
+  assert(ahead.depth_ == 4 && ahead.next_ == 3);
+  for (size_t i = 0; i < 16; ++i) ahead.moved_to(3 + i, false, icol->keys_, kv);
+  assert(ahead.depth_ == 3);
+  ahead.moved_to(0, false, icol->keys_, kv);
+  assert(ahead.next_ == 1 && ahead.depth_ == 3);
+  delete scol;
+  delete icol;
+  assert(kv->cache_->size() == 0);
+  delete kv;
+  cout << endl;
+
   delete schunk;
   delete bchunk;
   delete ichunk;
   delete dchunk;
 }
 
+/**
+ * Checks it is handed rows in order and counts the true bools. Joining
+ * checks the other rower's rows come right after this one's.
+ */
+class OrderRower : public Rower {
+public:
+  long first_;   // first row visited, -1 if none
+  long last_;    // last row visited
+  size_t trues_;
+
+  OrderRower() {
+    first_ = -1;
+    last_ = -1;
+    trues_ = 0;
+  }
+
+  bool accept(Row& r) {
+    assert(last_ == -1 || (long)r.get_idx() == last_ + 1);
+    if (first_ == -1) first_ = r.get_idx();
+    last_ = r.get_idx();
+    trues_ += r.get_bool(1);
+    return false;
+  }
+
+  void join_delete(Rower* other) {
+    OrderRower* o = dynamic_cast<OrderRower*>(other);
+    assert(o->first_ == last_ + 1);
+    last_ = o->last_;
+    trues_ += o->trues_;
+    delete o;
+  }
+
+  Rower* clone() {
+    return new OrderRower();
+  }
+};
+
+/**
+ * tests that pmap visits every row once, splits on chunk boundaries and
+ * joins its rowers in row order, and that a thread pool runs every task.
+ */
+void test_pmap() {
+  KVStore* kv = new KVStore();
+  IntColumn* icol = new IntColumn(kv);
+  BoolColumn* bcol = new BoolColumn(kv);
+  StringColumn* scol = new StringColumn(kv);
+  size_t rows = 3 * BOOL_ARR_SIZE + 1234;
+  String word("word");
+  for (size_t i = 0; i < rows; ++i) {
+    icol->push_back((int)(i % 1000));
+    bcol->push_back(i % 3 == 0);
+    scol->push_back(word.clone());
+  }
+  icol->finalize();
+  bcol->finalize();
+  scol->finalize();
+  Schema scm;
+  DataFrame* df = new DataFrame(scm, kv);
+  df->add_column(icol);
+  df->add_column(bcol);
+  df->add_column(scol);
+
+  cout << "Checking rows pack their fields side by side." << endl;
+  Schema packed("BIDSB");
+  Row flat(packed);
+  assert(flat.offsets_[0] == 0 && flat.offsets_[1] == 4 && flat.offsets_[2] == 8);
+  assert(flat.offsets_[3] == 16 && flat.offsets_[4] == 24);
+  flat.set(0, true);
+  flat.set(1, -7);
+  flat.set(2, 2.5);
+  flat.set(3, &word);
+  flat.set(4, false);
+  assert(flat.get_bool(0) && flat.get_int(1) == -7 && flat.get_double(2) == 2.5);
+  assert(flat.get_string(3) == &word && !flat.get_bool(4));
+  flat.set(1, 9);
+  assert(flat.get_int(1) == 9 && flat.get_bool(0));
+
+  cout << "Checking rows are split on chunk boundaries of every column." << endl;
+  assert(df->split_len_() == BOOL_ARR_SIZE);
+
+  cout << "Checking pmap gives the same sum as map." << endl;
+  SumRower seq;
+  df->map(seq);
+  for (size_t threads = 1; threads <= 8; threads *= 2) {
+    SumRower par;
+    df->pmap(par, threads);
+    assert(par.getSum() == seq.getSum());
+  }
+
+  cout << "Checking pmap visits rows in order and joins in order." << endl << endl;
+  OrderRower order;
+  df->pmap(order, 3);
+  assert(order.first_ == 0 && order.last_ == (long)(rows - 1));
+  assert(order.trues_ == (rows + 2) / 3);
+
+  cout << "Checking local_map skips rows whose first column lives elsewhere." << endl;
+  Key* moved = icol->keys_->get(1);
+  moved->setHomeNode(1);
+  SumRower local;
+  df->local_map(local);
+  int skipped = 0;
+  for (size_t i = ARR_SIZE; i < 2 * ARR_SIZE; ++i) skipped += i % 1000;
+  assert(local.getSum() == seq.getSum() - skipped);
+  moved->setHomeNode(0);
+
+  cout << "Checking a rower's state survives being shipped." << endl;
+  const char* state = seq.serialize();
+  SumRower shipped;
+  shipped.join_delete(shipped.deserialize(state));
+  assert(shipped.getSum() == seq.getSum());
+  delete[] state;
+
+  cout << "Checking map_reduce on a single node covers every row." << endl << endl;
+  SumRower all;
+  df->map_reduce(all, "pmap-test");
+  assert(all.getSum() == seq.getSum());
+
+  delete df;
+  delete kv;
+}
+
+void test_kernels() {
+  size_t n = 1003;
+  int* ints = new int[n];
+  double* doubles = new double[n];
+  uint8_t* bits = new uint8_t[n / 8 + 1];
+  memset(bits, 0xff, n / 8 + 1);
+  int64_t isum = 0;
+  double dsum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    ints[i] = (int)((i * 2654435761u) % 2000001) - 1000000;
+    doubles[i] = ints[i] / 8.0;
+    isum += ints[i];
+    dsum += doubles[i];
+  }
+
+  cout << "Checking SIMD kernels agree with the plain loops." << endl;
+  for (size_t simd = 0; simd < 2; ++simd) {
+    USE_SIMD = simd == 1;
+    for (size_t len = 0; len < 40; ++len) {
+      int64_t expected = 0;
+      for (size_t i = 0; i < len; ++i) expected += ints[i];
+      assert(Kernels::sum(ints, len) == expected);
+    }
+    assert(Kernels::sum(ints, n) == isum);
+    assert(fabs(Kernels::sum(doubles, n) - dsum) < 1e-6);
+    int lo, hi;
+    Kernels::min_max(ints, n, &lo, &hi);
+    double dlo, dhi;
+    Kernels::min_max(doubles, n, &dlo, &dhi);
+    for (size_t i = 0; i < n; ++i) assert(lo <= ints[i] && ints[i] <= hi);
+    assert(dlo == lo / 8.0 && dhi == hi / 8.0);
+    double mean = (double)isum / n;
+    assert(fabs(Kernels::sq_dev(ints, n, mean) - 64 * Kernels::sq_dev(doubles, n, mean / 8)) < 1e-3);
+    for (size_t len = 0; len < n; len += 7) assert(Kernels::popcount(bits, len) == len);
+    string line = "<a> <\"b c\">\n<> <d>  <e f> <\"g\" x>\n <h>\n<i> <j> <k> <l> <m> <n>";
+    string texts = line + line + line + line;
+    const char* text = texts.c_str();
+    size_t text_len = texts.size();
+    uint64_t marks[4];
+    Kernels::match_bytes(text, text_len, "<>\"\n", marks);
+    for (size_t i = 0; i < (text_len + 63) / 64 * 64; ++i) {
+      bool marked = (marks[i / 64] >> (i % 64)) & 1;
+      assert(marked == (i < text_len && strchr("<>\"\n", text[i]) != nullptr));
+    }
+  }
+  USE_SIMD = true;
+#ifdef EAU2_X86
+  cout << "Checking the SSE2 kernels on their own." << endl;
+  int slo = ints[0], shi = ints[0];
+  size_t seen = Kernels::min_max_sse2_(ints, n, &slo, &shi);
+  for (size_t i = 0; i < seen; ++i) assert(slo <= ints[i] && ints[i] <= shi);
+  assert(Kernels::sum_sse2_(ints, n) == isum);
+  assert(fabs(Kernels::sum_sse2_(doubles, n) - dsum) < 1e-6);
+#endif
+
+  cout << "Checking dataframe aggregates read chunk by chunk." << endl << endl;
+  KVStore* kv = new KVStore();
+  IntColumn* icol = new IntColumn(kv);
+  DoubleColumn* dcol = new DoubleColumn(kv);
+  BoolColumn* bcol = new BoolColumn(kv);
+  size_t rows = 2 * ARR_SIZE + 7;
+  double sq = 0;
+  for (size_t i = 0; i < rows; ++i) {
+    icol->push_back(ints[i % n]);
+    dcol->push_back(doubles[i % n]);
+    bcol->push_back(i % 5 == 0);
+  }
+  icol->finalize();
+  dcol->finalize();
+  bcol->finalize();
+  Schema scm;
+  DataFrame* df = new DataFrame(scm, kv);
+  df->add_column(icol);
+  df->add_column(dcol);
+  df->add_column(bcol);
+  double expected = 0;
+  for (size_t i = 0; i < rows; ++i) expected += ints[i % n];
+  double mean = expected / rows;
+  for (size_t i = 0; i < rows; ++i) sq += (ints[i % n] - mean) * (ints[i % n] - mean);
+  assert(df->sum(0) == expected);
+  assert(fabs(df->sum(1) - expected / 8) < 1e-3);
+  int lo, hi;
+  Kernels::min_max(ints, n, &lo, &hi);
+  assert(df->min(0) == lo && df->max(0) == hi && df->max(1) == hi / 8.0);
+  assert(fabs(df->mean(0) - mean) < 1e-6);
+  assert(fabs(df->variance(0) - sq / rows) / (sq / rows) < 1e-9);
+  assert(fabs(df->variance(1) - sq / rows / 64) / (sq / rows / 64) < 1e-9);
+  assert(df->count(0) == rows && df->count(2) == (rows + 4) / 5);
+  assert(bcol->count() == df->count(2));
+  delete df;
+  delete kv;
+  delete[] ints;
+  delete[] doubles;
+  delete[] bits;
+}
+
+/** Counts the rows it visits and sums their ints in the first column. */
+class CountRower : public Rower {
+public:
+  size_t rows_;
+  long sum_;
+
+  CountRower() {
+    rows_ = 0;
+    sum_ = 0;
+  }
+
+  bool accept(Row& r) {
+    ++rows_;
+    if (r.col_type(0) == 'I') sum_ += r.get_int(0);
+    return false;
+  }
+
+  void join_delete(Rower* other) {
+    CountRower* o = dynamic_cast<CountRower*>(other);
+    rows_ += o->rows_;
+    sum_ += o->sum_;
+    delete o;
+  }
+
+  Rower* clone() {
+    return new CountRower();
+  }
+};
+
+/**
+ * Fills in the fields of row i of a dataframe built by test_frame.
+ */
+class TestRows : public Object {
+public:
+  virtual void fill(size_t i, Row& row) = 0;
+};
+
+// a new String of n printed with the given format
+String* test_string(const char* format, size_t n) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), format, n);
+  return new String(buf);
+}
+
+// a finished dataframe on kv with columns of the given types and n rows,
+// each filled in by rows
+DataFrame* test_frame(KVStore* kv, const char* types, size_t n, TestRows& rows) {
+  Schema scm(types);
+  DataFrame* df = new DataFrame(scm, kv);
+  Row row(*df->schema_);
+  for (size_t i = 0; i < n; ++i) {
+    rows.fill(i, row);
+    df->add_row(row);
+  }
+  df->finalize_all();
+  return df;
+}
+
+// row i: i sorted, i % 10 and "k" then i in 7 digits, also sorted
+class ZoneRows : public TestRows {
+public:
+  void fill(size_t i, Row& row) {
+    row.set(0, (int)i);
+    row.set(1, (double)(i % 10));
+    row.set(2, test_string("k%07zu", i));
+  }
+};
+
+void test_zone_maps() {
+  KVStore* kv = new KVStore();
+  size_t rows = 4 * ARR_SIZE;
+  ZoneRows zone_rows;
+  DataFrame* df = test_frame(kv, "IDS", rows, zone_rows);
+  IntColumn* sorted = df->cols_[0]->as_int();
+  DoubleColumn* cycle = df->cols_[1]->as_double();
+  StringColumn* names = df->cols_[2]->as_string();
+
+  cout << "Checking chunks record their range, count and distinct values." << endl;
+  ChunkStats* st = sorted->stats(1);
+  assert(st->count_ == ARR_SIZE && st->min_ == ARR_SIZE && st->max_ == 2 * ARR_SIZE - 1);
+  assert(st->distinct_ > ARR_SIZE * 3 / 4 && st->distinct_ <= ARR_SIZE);
+  assert(cycle->stats(0)->distinct_ == 10 && cycle->stats(3)->max_ == 9);
+  assert(strcmp(names->stats(0)->smin_->c_str(), "k0000000") == 0);
+  String* last = test_string("k%07zu", STRING_ARR_SIZE - 1);
+  assert(names->stats(0)->smax_->equals(last));
+  delete last;
+
+  cout << "Checking statistics survive serializing the dataframe." << endl;
+  const char* ser = df->serialize(df);
+  DataFrame* copy = df->get_dataframe(ser);
+  delete[] ser;
+  for (size_t c = 0; c < 4; ++c) {
+    ChunkStats* a = copy->cols_[0]->stats(c);
+    assert(a->min_ == sorted->stats(c)->min_ && a->max_ == sorted->stats(c)->max_);
+    assert(a->distinct_ == sorted->stats(c)->distinct_);
+    assert(copy->cols_[1]->stats(c)->count_ == ARR_SIZE);
+  }
+  assert(copy->cols_[2]->stats(7)->smax_->equals(names->stats(7)->smax_));
+
+  cout << "Checking range scans only fetch chunks that can match." << endl << endl;
+  CountRower few;
+  df->map_range(0, ARR_SIZE + 10, ARR_SIZE + 19, few);
+  assert(few.rows_ == 10 && few.sum_ == 10 * (long)ARR_SIZE + 145);
+  // one chunk of the filtered column and one of each column read alongside
+  assert(kv->cache_->size() == 3);
+  CountRower none;
+  df->map_range(0, -5, -1, none);
+  assert(none.rows_ == 0 && kv->cache_->size() == 3);
+  CountRower nines;
+  df->map_range(1, 9, 9, nines);
+  assert(nines.rows_ == rows / 10);
+  CountRower named;
+  df->map_range(2, "k0000100", "k0000199", named);
+  assert(named.rows_ == 100 && named.sum_ == 100 * 100 + 4950);
+
+  delete copy;
+  delete df;
+  delete kv;
+}
+
+// row i: i, whether i is a multiple of 3, i / 2 and "k" then i in 7 digits
+class FilterRows : public TestRows {
+public:
+  void fill(size_t i, Row& row) {
+    row.set(0, (int)i);
+    row.set(1, i % 3 == 0);
+    row.set(2, i / 2.0);
+    row.set(3, test_string("k%07zu", i));
+  }
+};
+
+void test_filter() {
+  KVStore* kv = new KVStore();
+  size_t rows = 4 * ARR_SIZE + 5;
+  FilterRows filter_rows;
+  DataFrame* df = test_frame(kv, "IBDS", rows, filter_rows);
+
+  cout << "Checking filtering by a rower keeps the rows it accepts." << endl;
+  BoolRower br;
+  DataFrame* kept = df->filter(br);
+  assert(kept->nrows() == (rows + 2) / 3 && kept->ncols() == 4);
+  assert(kept->get_int(0, 1) == 3 && kept->get_double(2, 2) == 3.0);
+  assert(kept->get_string(3, 1)->equals(df->get_string(3, 3)));
+  assert(kept->sum(0) == 3.0 * (kept->nrows() - 1) * kept->nrows() / 2);
+
+  cout << "Checking filtering by a predicate only reads what it compares." << endl;
+  Predicate* p = new Predicate('|',
+      new Predicate('&', new Predicate(0, ">=", 100), new Predicate(2, "<", 100)),
+      new Predicate(3, "==", "k0090000"));
+  DataFrame* some = df->filter(*p);
+  assert(some->nrows() == 101);
+  for (size_t i = 0; i < 4; ++i) assert(some->cols_[i] == nullptr);
+  assert(some->get_int(0, 0) == 100 && some->get_int(0, 100) == 90000);
+  assert(some->cols_[0] != nullptr && some->cols_[3] == nullptr);
+  assert(some->count(1) == 34 && some->max(2) == 45000);
+
+  Predicate trues(1, "==", 1);
+  DataFrame* same = df->filter(trues);
+  assert(same->nrows() == kept->nrows() && same->max(0) == kept->max(0));
+  Predicate none(0, "<", -1);
+  DataFrame* empty = df->filter(none);
+  assert(empty->nrows() == 0 && empty->count(1) == 0);
+
+  cout << "Checking a filtered dataframe can be filtered and outlive its parent." << endl << endl;
+  Predicate odd_halves(2, "!=", 50);
+  DataFrame* fewer = some->filter(odd_halves);
+  assert(fewer->nrows() == 100 && fewer->get_int(0, 0) == 101);
+  fewer->materialize();
+  delete empty;
+  delete same;
+  delete some;
+  delete kept;
+  delete df;
+  String last("k0090000");
+  assert(fewer->get_string(3, 99)->equals(&last));
+  assert(fewer->sum(2) == (101 + 199) / 2.0 * 99 / 2 + 45000);
+
+  delete fewer;
+  delete p;
+  delete kv;
+}
+
+// row i: i % 7, whether i is odd, "w" then i % 5, and i
+class GroupRows : public TestRows {
+public:
+  void fill(size_t i, Row& row) {
+    row.set(0, (int)(i % 7));
+    row.set(1, i % 2 == 1);
+    row.set(2, test_string("w%zu", i % 5));
+    row.set(3, (double)i);
+  }
+};
+
+void test_group_by() {
+  KVStore* kv = new KVStore();
+  size_t rows = 3 * ARR_SIZE + 11;
+  GroupRows group_rows;
+  DataFrame* df = test_frame(kv, "IBSD", rows, group_rows);
+
+  cout << "Checking each group's count, sum, min, max and mean." << endl;
+  IntArray by_int;
+  by_int.push_back(0);
+  Aggs aggs;
+  aggs.count().sum(3).min(3).max(3).mean(3).sum(1);
+  for (size_t threads = 1; threads <= 4; threads += 3) {
+    DataFrame* g = df->group_by(by_int, aggs, threads);
+    assert(g->nrows() == 7 && g->ncols() == 7);
+    for (size_t r = 0; r < 7; ++r) {
+      size_t k = g->get_int(0, r);
+      size_t count = rows / 7 + (k < rows % 7 ? 1 : 0);
+      size_t last = k + 7 * (count - 1);
+      assert(g->get_int(1, r) == (int)count);
+      assert(g->get_double(2, r) == (double)(k + last) * count / 2);
+      assert(g->get_double(3, r) == k && g->get_double(4, r) == last);
+      assert(g->get_double(5, r) == (k + last) / 2.0);
+      // i and i % 7 are odd together every other lap of seven
+      assert(fabs(g->get_double(6, r) - count / 2.0) <= 1);
+    }
+    delete g;
+  }
+
+  cout << "Checking groups keyed on a bool and a String column." << endl;
+  IntArray by_two;
+  by_two.push_back(1);
+  by_two.push_back(2);
+  Aggs counts;
+  counts.count();
+  DataFrame* g = df->group_by(by_two, counts);
+  assert(g->nrows() == 10 && g->get_schema().col_type(0) == 'B');
+  size_t total = 0;
+  for (size_t r = 0; r < 10; ++r) total += g->get_int(2, r);
+  assert(total == rows);
+  delete g;
+
+  cout << "Checking a table's groups survive serializing." << endl;
+  GroupRower gr(*df->schema_, by_two, aggs);
+  df->map(gr);
+  GroupTable copy(*gr.table_);
+  for (size_t node = 0; node < 3; ++node) {
+    const char* part = gr.table_->serialize(node, 3);
+    copy.merge(part);
+    delete[] part;
+  }
+  assert(copy.size() == 10);
+  for (size_t i = 0; i < 10; ++i) {
+    size_t at = copy.find_(gr.table_->hashes_[i], &gr.table_->ikeys_[i * 2],
+                           &gr.table_->skeys_[i * 2]);
+    assert(copy.counts_[at] == gr.table_->counts_[i]);
+    for (size_t a = 0; a < aggs.size(); ++a) {
+      assert(copy.accs_[at * aggs.size() + a] == gr.table_->accs_[i * aggs.size() + a]);
+    }
+  }
+
+  cout << "Checking the word count." << endl << endl;
+  const char* path = "/tmp/eau2-words.txt";
+  FILE* f = fopen(path, "w");
+  string longest(3000, 'z');
+  for (size_t i = 0; i < 500; ++i) fprintf(f, "the  cat\tsat %zu\n", i % 50);
+  fprintf(f, "%s on the mat", longest.c_str());
+  fclose(f);
+  WordCount* wc = new WordCount(0, kv, path);
+  assert(wc->distinct_ == 56);
+  assert(wc->count("the") == 501 && wc->count("cat") == 500 && wc->count("49") == 10);
+  assert(wc->count(longest.c_str()) == 1 && wc->count("mat") == 1);
+  remove(path);
+
+  delete wc;
+  delete df;
+  delete kv;
+}
+
+// user u: u and "u" then u
+class UserRows : public TestRows {
+public:
+  void fill(size_t u, Row& row) {
+    row.set(0, (int)u);
+    row.set(1, test_string("u%zu", u));
+  }
+};
+
+// event i: by user i * 14 % 3000, for i / 2
+class EventRows : public TestRows {
+public:
+  void fill(size_t i, Row& row) {
+    row.set(0, (int)(i * 14 % 3000));
+    row.set(1, i * 0.5);
+  }
+};
+
+void test_join() {
+  KVStore* kv = new KVStore();
+  UserRows user_rows;
+  DataFrame* users = test_frame(kv, "IS", 1000, user_rows);
+
+  // odd users have no events, and users past 999 do not exist
+  size_t num_events = 2 * ARR_SIZE;
+  EventRows event_rows;
+  DataFrame* events = test_frame(kv, "ID", num_events, event_rows);
+  size_t* per_user = new size_t[3000];
+  memset(per_user, 0, 3000 * sizeof(size_t));
+  double matched_amount = 0;
+  for (size_t i = 0; i < num_events; ++i) {
+    ++per_user[i * 14 % 3000];
+    if (i * 14 % 3000 < 1000) matched_amount += i * 0.5;
+  }
+  size_t matched = 0, users_without = 0;
+  double user_sum = 0;
+  for (size_t u = 0; u < 1000; ++u) {
+    matched += per_user[u];
+    user_sum += (double)u * per_user[u];
+    if (per_user[u] == 0) ++users_without;
+  }
+
+  cout << "Checking an inner join pairs every row with each equal key." << endl;
+  DataFrame* j = events->join(*users, 0, 0);
+  assert(j->ncols() == 4 && j->nrows() == matched);
+  for (size_t r = 0; r < j->nrows(); ++r) {
+    assert(j->get_int(0, r) == j->get_int(2, r));
+    String* name = test_string("u%zu", (size_t)j->get_int(0, r));
+    assert(j->get_string(3, r)->equals(name));
+    delete name;
+  }
+  delete j;
+  DataFrame* by_name = users->join(*users, 1, 1);
+  assert(by_name->nrows() == 1000 && by_name->get_int(0, 5) == by_name->get_int(2, 5));
+  delete by_name;
+
+  cout << "Checking left joins keep unmatched rows from either side." << endl;
+  DataFrame* all_events = events->join(*users, 0, 0, true);
+  assert(all_events->nrows() == num_events);
+  size_t missed = 0;
+  for (size_t r = 0; r < all_events->nrows(); ++r) {
+    if (all_events->get_int(0, r) >= 1000) {
+      assert(all_events->get_string(3, r)->size() == 0 && all_events->get_int(2, r) == 0);
+      ++missed;
+    }
+  }
+  assert(missed == num_events - matched);
+  delete all_events;
+  DataFrame* all_users = users->join(*events, 0, 0, true);
+  assert(users_without == 500 && all_users->nrows() == matched + users_without);
+  assert(all_users->sum(2) == user_sum);
+  delete all_users;
+
+  cout << "Checking the cluster join broadcasts or shuffles on one node." << endl << endl;
+  for (size_t shuffle = 0; shuffle < 2; ++shuffle) {
+    size_t broadcast_bytes = BROADCAST_JOIN_BYTES;
+    if (shuffle) BROADCAST_JOIN_BYTES = 0;
+    DataFrame* inner = events->join(*users, 0, 0, "test-join");
+    DataFrame* outer = events->join(*users, 0, 0, "test-left-join", true);
+    BROADCAST_JOIN_BYTES = broadcast_bytes;
+    assert(inner->nrows() == matched && outer->nrows() == num_events);
+    assert(inner->sum(1) == matched_amount && outer->sum(1) == events->sum(1));
+    delete inner;
+    delete outer;
+  }
+
+  delete[] per_user;
+  delete events;
+  delete users;
+  delete kv;
+}
+
+// row i: a key that repeats, so that stability shows in the last column,
+// a double and a String that repeat, and i
+class SortRows : public TestRows {
+public:
+  void fill(size_t i, Row& row) {
+    row.set(0, (int)(i * 7919 % 5003) - 2500);
+    row.set(1, (i * 31 % 1000) * -0.25);
+    row.set(2, test_string("n%zu", i * 13 % 1001));
+    row.set(3, (int)i);
+  }
+};
+
+void test_sort() {
+  KVStore* kv = new KVStore();
+  size_t rows = 3 * ARR_SIZE + 17;
+  SortRows sort_rows;
+  DataFrame* df = test_frame(kv, "IDSI", rows, sort_rows);
+
+  cout << "Checking sort_by orders ints, doubles and Strings both ways." << endl;
+  DataFrame* by_int = df->sort_by(0, true, 2);
+  assert(by_int->nrows() == rows && by_int->sum(3) == df->sum(3));
+  for (size_t r = 1; r < rows; ++r) {
+    assert(by_int->get_int(0, r - 1) <= by_int->get_int(0, r));
+    size_t i = by_int->get_int(3, r);
+    assert(by_int->get_double(1, r) == df->get_double(1, i));
+    assert(by_int->get_string(2, r)->equals(df->get_string(2, i)));
+  }
+  DataFrame* by_double = df->sort_by(1, false);
+  for (size_t r = 1; r < rows; ++r) {
+    assert(by_double->get_double(1, r - 1) >= by_double->get_double(1, r));
+  }
+  DataFrame* by_name = df->sort_by(2);
+  DataFrame* by_name_desc = df->sort_by(2, false);
+  for (size_t r = 1; r < rows; ++r) {
+    assert(strcmp(by_name->get_string(2, r - 1)->c_str(), by_name->get_string(2, r)->c_str()) <= 0);
+    assert(strcmp(by_name_desc->get_string(2, r - 1)->c_str(),
+                  by_name_desc->get_string(2, r)->c_str()) >= 0);
+  }
+
+  cout << "Checking rows with equal keys keep their order." << endl;
+  for (size_t r = 1; r < rows; ++r) {
+    if (by_int->get_int(0, r - 1) == by_int->get_int(0, r)) {
+      assert(by_int->get_int(3, r - 1) < by_int->get_int(3, r));
+    }
+    if (by_name_desc->get_string(2, r - 1)->equals(by_name_desc->get_string(2, r))) {
+      assert(by_name_desc->get_int(3, r - 1) < by_name_desc->get_int(3, r));
+    }
+  }
+
+  cout << "Checking sorted chunks hold disjoint ranges." << endl;
+  for (size_t c = 1; c < by_int->cols_[0]->keys_->size(); ++c) {
+    assert(by_int->cols_[0]->stats(c - 1)->max_ <= by_int->cols_[0]->stats(c)->min_);
+  }
+
+  cout << "Checking runs spilled to disk merge the same way." << endl;
+  size_t budget = SORT_BUDGET;
+  SORT_BUDGET = 0;
+  DataFrame* spilled = df->sort_by(0, true, 2);
+  DataFrame* spilled_names = df->sort_by(2, false);
+  for (size_t r = 0; r < rows; ++r) {
+    assert(spilled->get_int(3, r) == by_int->get_int(3, r));
+    assert(spilled_names->get_int(3, r) == by_name_desc->get_int(3, r));
+  }
+  delete spilled;
+  delete spilled_names;
+
+  cout << "Checking spilled runs merge a few at a time." << endl;
+  size_t fan_in = SORT_FAN_IN;
+  SORT_FAN_IN = 2;
+  spilled = df->sort_by(0, true, 2);
+  spilled_names = df->sort_by(2, false);
+  SORT_FAN_IN = fan_in;
+  SORT_BUDGET = budget;
+  for (size_t r = 0; r < rows; ++r) {
+    assert(spilled->get_int(3, r) == by_int->get_int(3, r));
+    assert(spilled_names->get_int(3, r) == by_name_desc->get_int(3, r));
+  }
+  delete spilled;
+  delete spilled_names;
+
+  cout << "Checking the cluster sort on one node sorts every row." << endl << endl;
+  DataFrame* cluster = df->sort_by(1, false, "test-sort");
+  assert(cluster->nrows() == rows);
+  for (size_t r = 0; r < rows; ++r) {
+    assert(cluster->get_int(3, r) == by_double->get_int(3, r));
+  }
+  delete cluster;
+
+  delete by_int;
+  delete by_double;
+  delete by_name;
+  delete by_name_desc;
+  delete df;
+  delete kv;
+}
+
+void test_sorer() {
+  KVStore* kv = new KVStore();
+  const char* path = "/tmp/eau2-test.sor";
+  FILE* f = fopen(path, "w");
+  size_t rows = 3 * ARR_SIZE, kept = 0, window_start = 0, window_len = 0, window_rows = 0;
+  for (size_t i = 0; i < rows; ++i) {
+    long at = ftell(f);
+    if (i == 10000) window_start = at;
+    bool bad = i % 97 == 50;
+    if (i % 97 == 50) fprintf(f, "<%zu> <\"n %zu\"> <> <1>\n", i + 10, i);
+    else if (i % 89 == 60) fprintf(f, "<%zu> <\"n %zu\"> <%zu.5>\n", i + 10, i, i);
+    else if (i % 83 == 70) fprintf(f, "<abc> <\"n %zu\"> <%zu.5> <0>\n", i, i);
+    else if (i % 79 == 40) fprintf(f, "<%zu 1> <n> <%zu.5> <0>\n", i + 10, i);
+    else fprintf(f, "< %zu >\t<\"n %zu\">  <-%zu.5> <%zu>\n", i + 10, i, i, i % 2);
+    bad = bad || i % 89 == 60 || i % 83 == 70 || i % 79 == 40;
+    if (!bad) ++kept;
+    if (!bad && i >= 10000 && i < 12000) ++window_rows;
+    if (i == 11999) window_len = ftell(f) - window_start;
+  }
+  fclose(f);
+
+  cout << "Checking fields parse to the narrowest type that holds them." << endl;
+  int n;
+  double d;
+  assert(SorField::parse("1", 1, &n, &d) == 'B' && n == 1);
+  assert(SorField::parse("+1", 2, &n, &d) == 'I' && n == 1);
+  assert(SorField::parse("-2147483648", 11, &n, &d) == 'I' && n == -2147483647 - 1);
+  assert(SorField::parse("2147483648", 10, &n, &d) == 'D' && d == 2147483648.0);
+  assert(SorField::parse("-0.51", 5, &n, &d) == 'D' && d == -0.51);
+  assert(SorField::parse("1.5e3", 5, &n, &d) == 'D' && d == 1500);
+  assert(SorField::parse(".5", 2, &n, &d) == 'D' && d == 0.5);
+  assert(SorField::parse("123456789012345678901234.5", 26, &n, &d) == 'D');
+  assert(d == 123456789012345678901234.5);
+  assert(SorField::parse("12", 1, &n, &d) == 'B' && n == 1);
+  const char* strings[] = {"", "-", "+.", "1.5.", "1e", "1e+", "12ab", "1 2", "nan", "0x10"};
+  for (size_t i = 0; i < 10; ++i) {
+    assert(SorField::parse(strings[i], strlen(strings[i]), &n, &d) == 'S');
+  }
+
+  cout << "Checking the tokenizer finds fields and flags bad ones." << endl;
+  const char* text = "<12> < \"a <b>\" >\t<> < x >\n<1 2> <\"c\" d> <e\n<\"f\n<g>";
+  SorTokenizer tok(text, strlen(text));
+  assert(tok.next_line() && tok.fields == 4 && !tok.malformed);
+  assert(tok.starts[0] == 1 && tok.len(0) == 2 && tok.flags[0] == 0);
+  assert(strncmp(text + tok.starts[1], "a <b>", tok.len(1)) == 0);
+  assert(tok.flags[1] == SorTokenizer::QUOTED && tok.len(2) == 0 && tok.len(3) == 1);
+  assert(tok.next_line() && tok.fields == 3 && tok.malformed);
+  assert(tok.flags[0] == SorTokenizer::MALFORMED);
+  assert(tok.flags[1] == (SorTokenizer::QUOTED | SorTokenizer::MALFORMED));
+  assert(tok.flags[2] == SorTokenizer::MALFORMED);
+  assert(tok.next_line() && tok.fields == 1 && tok.malformed);
+  assert(tok.next_line() && tok.fields == 1 && !tok.malformed && !tok.next_line());
+
+  cout << "Checking the parallel ingest reads what the serial one does." << endl;
+  Sorer serial_sorer(path, kv);
+  DataFrame* serial = serial_sorer.generate_dataframe();
+  assert(serial->nrows() == kept);
+  assert(strcmp(serial_sorer.schema->types_->c_str(), "ISDB") == 0);
+  size_t range_bytes = SOR_RANGE_BYTES;
+  SOR_RANGE_BYTES = 4096;
+  size_t ship_queue = SHIP_QUEUE;
+  for (size_t threads = 1; threads <= 3; threads += 2) {
+    // a queue of one batch makes the ingest wait on the shipper
+    SHIP_QUEUE = threads == 1 ? 1 : ship_queue;
+    Sorer sorer(path, kv);
+    DataFrame* df = sorer.generate_dataframe(threads);
+    assert(df->cols_[0]->shipper_ == nullptr && df->cols_[0]->keys_->size() == 3);
+    assert(df->nrows() == kept);
+    for (size_t r = 0; r < kept; ++r) {
+      assert(df->get_int(0, r) == serial->get_int(0, r));
+      assert(df->get_string(1, r)->equals(serial->get_string(1, r)));
+      assert(df->get_double(2, r) == serial->get_double(2, r));
+      assert(df->get_bool(3, r) == serial->get_bool(3, r));
+    }
+    delete df;
+  }
+  SHIP_QUEUE = ship_queue;
+
+  cout << "Checking it reads only the lines that start in its window." << endl;
+  Sorer windowed(path, window_start + 1, (int)window_len - 1, kv);
+  DataFrame* part = windowed.generate_dataframe(2);
+  assert(part->nrows() == window_rows - 1 && part->get_int(0, 0) == 10011);
+  delete part;
+  Sorer aligned(path, window_start, (int)window_len, kv);
+  part = aligned.generate_dataframe(2);
+  assert(part->nrows() == window_rows && part->get_int(0, 0) == 10010);
+  delete part;
+  assert(aligned.count_rows(2) == window_rows);
+
+  cout << "Checking a cluster ingest splits its rows on group boundaries." << endl;
+  // node 1 finishes node 0's group 8-11, node 3 node 1's 12-15, and node 4
+  // node 3's 20-23
+  size_t counts[] = {10, 3, 0, 9, 6};
+  assert(Sorer::head_rows_(counts, 0, 4) == 0 && Sorer::head_rows_(counts, 2, 4) == 0);
+  assert(Sorer::head_rows_(counts, 1, 4) == 2 && Sorer::owner_(counts, 5, 8) == 0);
+  assert(Sorer::head_rows_(counts, 3, 4) == 3 && Sorer::owner_(counts, 5, 12) == 1);
+  assert(Sorer::head_rows_(counts, 4, 4) == 2 && Sorer::owner_(counts, 5, 20) == 3);
+
+  cout << "Checking it stitches its parts into the whole file." << endl << endl;
+  IntColumn* first = new IntColumn(kv);
+  IntColumn* rest = new IntColumn(kv);
+  for (size_t i = 0; i < ARR_SIZE + 5; ++i) (i < ARR_SIZE ? first : rest)->push_back((int)i);
+  first->finalize();
+  rest->finalize();
+  first->extend_(rest);
+  assert(first->size() == ARR_SIZE + 5 && first->keys_->size() == 2);
+  assert(first->get(ARR_SIZE - 1) == (int)ARR_SIZE - 1 && first->get(ARR_SIZE + 4) == (int)ARR_SIZE + 4);
+  assert(first->stats(1)->min_ == (int)ARR_SIZE);
+  delete first;
+  delete rest;
+  DataFrame* loaded = Sorer::load_cluster(path, kv, "test-load", 2);
+  assert(loaded->nrows() == kept && loaded->cols_[0]->keys_->size() == 3);
+  for (size_t r = 0; r < kept; ++r) {
+    assert(loaded->get_int(0, r) == serial->get_int(0, r));
+    assert(loaded->get_string(1, r)->equals(serial->get_string(1, r)));
+  }
+  delete loaded;
+  SOR_RANGE_BYTES = range_bytes;
+
+  remove(path);
+  delete serial;
+  delete kv;
+}
+
+/** Counts the messages a reactor hands it, finishing after a target. */
+class CountingHandler : public MessageHandler {
+public:
+  size_t count_;
+  size_t expected_;
+
+  CountingHandler(size_t expected) {
+    count_ = 0;
+    expected_ = expected;
+  }
+
+  void handle(Message* msg, Connection* from) {
+    assert(msg->get_kind() == MsgKind::Ack);
+    ++count_;
+    delete msg;
+  }
+
+  bool finished() {
+    return count_ == expected_;
+  }
+};
+
+/** Runs a reactor on its own thread. */
+class ReactorThread : public Thread {
+public:
+  Reactor* r_;
+  MessageHandler* h_;
+
+  ReactorThread(Reactor* r, MessageHandler* h) {
+    r_ = r;
+    h_ = h;
+    start();
+  }
+
+  void run() {
+    r_->run(h_);
+  }
+};
+
+/**
+ * tests that one reactor serves many connections and reassembles frames
+ * that arrive in pieces.
+ */
+void test_network() {
+  size_t peers = 200;
+  MessageSerializer ms;
+  Ack ack(0, 1, 7);
+  const char* meta = ms.serialize(&ack);
+  FrameHeader hdr;
+  hdr.magic = FRAME_MAGIC;
+  hdr.kind = (uint32_t)MsgKind::Ack;
+  hdr.id = 7;
+  hdr.meta_len = strlen(meta);
+  hdr.body_len = 0;
+  size_t len = sizeof(hdr) + hdr.meta_len;
+  char* frame = new char[len];
+  memcpy(frame, &hdr, sizeof(hdr));
+  memcpy(frame + sizeof(hdr), meta, hdr.meta_len);
+
+  cout << "Checking that a reactor serves " << peers << " connections." << endl;
+  Reactor r(-1);
+  int* ends = new int[peers];
+  for (size_t i = 0; i < peers; ++i) {
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    r.add(new Connection(sv[0]));
+    ends[i] = sv[1];
+  }
+
+  cout << "Checking that frames split across reads are reassembled." << endl << endl;
+  size_t half = sizeof(hdr) / 2 + 1;
+  for (size_t i = 0; i < peers; ++i) assert(write(ends[i], frame, half) == (ssize_t)half);
+  CountingHandler h(peers * 2);
+  ReactorThread t(&r, &h);
+  Thread::sleep(20);
+  assert(h.count_ == 0);
+  for (size_t i = 0; i < peers; ++i) {
+    assert(write(ends[i], frame + half, len - half) == (ssize_t)(len - half));
+    assert(write(ends[i], frame, len) == (ssize_t)len);
+  }
+  t.join();
+  assert(h.count_ == peers * 2);
+
+  for (size_t i = 0; i < peers; ++i) close(ends[i]);
+  delete[] ends;
+  delete[] frame;
+  delete[] meta;
+}
+
 int main(int argc, const char** argv) {
     if (argc != 2) {
         cout << "please enter ./eau2 <filename>" << endl;
@@ -354,5 +1655,41 @@ int main(int argc, const char** argv) {
     cout << "\033[33mRUNNING CHUNK TESTS:\033[0m" << endl << endl;
     test_chunk();
     cout << "\033[32mChunk tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING KERNEL TESTS:\033[0m" << endl << endl;
+    test_kernels();
+    cout << "\033[32mKernel tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING ZONE MAP TESTS:\033[0m" << endl << endl;
+    test_zone_maps();
+    cout << "\033[32mZone map tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING FILTER TESTS:\033[0m" << endl << endl;
+    test_filter();
+    cout << "\033[32mFilter tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING GROUP BY TESTS:\033[0m" << endl << endl;
+    test_group_by();
+    cout << "\033[32mGroup by tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING JOIN TESTS:\033[0m" << endl << endl;
+    test_join();
+    cout << "\033[32mJoin tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING SORT TESTS:\033[0m" << endl << endl;
+    test_sort();
+    cout << "\033[32mSort tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING SORER TESTS:\033[0m" << endl << endl;
+    test_sorer();
+    cout << "\033[32mSorer tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING PMAP TESTS:\033[0m" << endl << endl;
+    test_pmap();
+    cout << "\033[32mPmap tests successful.\033[0m" << endl << endl;
+
+    cout << "\033[33mRUNNING NETWORK TESTS:\033[0m" << endl << endl;
+    test_network();
+    cout << "\033[32mNetwork tests successful.\033[0m" << endl << endl;
     return 0;
 }